@@ -4,4 +4,8 @@
 #include <neurology/allocators.hpp>
 #include <neurology/configuration.hpp>
 #include <neurology/exception.hpp>
+#include <neurology/platform.hpp>
+
+#ifdef _WIN32
 #include <neurology/win32.hpp>
+#endif
@@ -1,7 +1,8 @@
 #pragma once
 
-#include <windows.h>
+#include <neurology/platform.hpp>
 
+#include <atomic>
 #include <cstdint>
 #include <limits>
 #include <map>
@@ -213,21 +214,83 @@ namespace Neurology
       /* one label can have multiple identities */
       typedef std::map<const Label, IdentitySet> LabelMap;
 
-      /* one identity can have multiple addresses */
-      typedef std::map<const Identity, AddressSet> BindingMap;
+      /* identities are carved out of slabs owned by the pool. an identity
+         points at the label at the front of its slot, and the slot also
+         heads the intrusive list of addresses bound to that identity. the
+         label is atomic because resolve() reads it without a lock while the
+         shard's owner moves it. */
+      struct IdentitySlot
+      {
+         std::atomic<Label> label;
+         Address *bindings;
+         std::atomic<SIZE_T> shard;
+      };
+
+      typedef std::vector<IdentitySlot *> SlabList;
+
+      /* the identity tables are split into shards, each behind its own lock.
+         a label belongs to the shard picked by hashing its stored label, and an
+         identity lives in the shard of the label it's stored under. */
+      class Shard
+      {
+      public:
+         CRITICAL_SECTION lock;
+         IdentitySet identities;
+         LabelMap labels;
+         SlabList identitySlabs;
+         Identity freeIdentities;
+
+         Shard(void);
+         ~Shard(void);
+      };
+
+      /* holds shard locks for as long as it's in scope. shards are always
+         entered in index order, and anything touching the whole pool (the
+         range, the base, draining) holds every shard, so a single shard lock
+         is enough to keep those stable. */
+      class ShardLock
+      {
+      protected:
+         const AddressPool *pool;
+         SIZE_T low, high;
+         bool whole;
+
+      public:
+         ShardLock(const AddressPool *pool);
+         ShardLock(const AddressPool *pool, Label label);
+         ShardLock(const AddressPool *pool, const Identity identity);
+         ShardLock(const AddressPool *pool, const Identity identity, Label newLabel);
+         ~ShardLock(void);
+
+      protected:
+         void enter(SIZE_T first, SIZE_T second);
+         void leave(void);
+      };
       
    public:
       static AddressPool Instance;
+      static const SIZE_T IdentitySlabSize = 1024;
+      static const SIZE_T FirstIdentitySlabSize = 4;
+      static const SIZE_T InstanceShards = 64;
+      static const DWORD ShardSpinCount = 4000;
+      static const SIZE_T NoShard = static_cast<SIZE_T>(-1);
 
    protected:
       Label minLabel, maxLabel;
-      IdentitySet identities;
-      LabelMap labels;
-      BindingMap bindings;
+      Shard *shards;
+      SIZE_T shardCount;
+
+      /* in relative mode, identities store their labels as offsets from
+         labelBase, so shifting the pool only has to move the base. it's only
+         stored while every shard is held, but shard locks read it before
+         they know which shard to take. */
+      bool relative;
+      std::atomic<Label> labelBase;
 
    public:
       AddressPool(void);
       AddressPool(Label minLabel, Label maxLabel);
+      AddressPool(Label minLabel, Label maxLabel, SIZE_T shardCount);
       AddressPool(AddressPool &pool);
       ~AddressPool(void);
 
@@ -240,6 +303,10 @@ namespace Neurology
       bool inRange(Label label) const noexcept;
       bool hasIdentity(const Identity identity) const noexcept;
       bool sharesIdentity(const Address &left, const Address &right) const noexcept;
+      bool isRelative(void) const noexcept;
+      SIZE_T shardTotal(void) const noexcept;
+
+      void setRelative(bool relative);
 
       void throwIfNoLabel(const LPVOID pointer) const;
       void throwIfNoLabel(Label label) const;
@@ -257,6 +324,7 @@ namespace Neurology
       
       Address address(const LPVOID pointer);
       Address address(Label label);
+      bool tryAddress(Label label, Address *address);
       Address newAddress(const LPVOID pointer);
       Address newAddress(Label label);
 
@@ -268,19 +336,36 @@ namespace Neurology
 
    protected:
       void throwIfNoIdentity(const Identity identity) const;
+
+      SIZE_T shardOf(Label storedLabel) const noexcept;
+      bool extents(Label *lowest, Label *highest) const noexcept;
+      void rekey(Label delta);
+      void relocate(Identity identity, SIZE_T shard);
+
+      bool isLabeled(const Identity identity) const noexcept;
+      Label resolve(const Identity identity) const noexcept;
+      static Address *&boundAddresses(const Identity identity) noexcept;
+      static std::atomic<Label> &storedLabel(const Identity identity) noexcept;
       
       Identity getIdentity(const LPVOID pointer) const;
       Identity getIdentity(Label label) const;
+      Identity tryGetIdentity(Label label) const noexcept;
       Identity newIdentity(const LPVOID pointer);
       Identity newIdentity(Label label);
       void releaseIdentity(Identity identity);
+      Identity allocateIdentity(SIZE_T shard);
+      void freeIdentity(Identity identity);
 
       Address newAddress(Identity identity);
+      Identity acquire(Address *address, Label label);
 
       void bind(Address *address, Identity identity);
       void rebind(Address *address, Identity newIdentity);
       void unbind(Address *address);
       void unbindOutOfBounds(void);
+      void evict(Shard &shard, LabelMap::iterator first, LabelMap::iterator last);
+      void attach(Address *address, Identity identity);
+      void detach(Address *address);
       
       void identify(Identity identity, Label label);
       void reidentify(Identity identity, Label newLabel);
@@ -332,6 +417,9 @@ namespace Neurology
       AddressPool *pool;
       Identity identity;
 
+      /* hooks into the list of addresses bound to the same identity */
+      Address *prevBinding, *nextBinding;
+
       /* constructors for AddressPool objects to use */
       Address(AddressPool *pool);
 
@@ -449,4 +537,88 @@ namespace Neurology
 
       Offset copy(void) const;
    };
+
+   /* an untracked address. it's nothing more than a label, so it can be copied
+      and shifted around freely without ever touching an address pool. promote
+      it to an Address when relocations need to be tracked. */
+   class RawAddress
+   {
+   public:
+      class Exception : public Neurology::Exception
+      {
+      public:
+         const Label label;
+
+         Exception(const Label label, const LPWSTR message);
+      };
+
+      class AddressUnderflowException : public Exception
+      {
+      public:
+         const std::intptr_t shift;
+
+         AddressUnderflowException(const Label label, const std::intptr_t shift);
+      };
+
+      class AddressOverflowException : public Exception
+      {
+      public:
+         const std::intptr_t shift;
+
+         AddressOverflowException(const Label label, const std::intptr_t shift);
+      };
+
+   protected:
+      Label value;
+
+   public:
+      RawAddress(void);
+      RawAddress(const LPVOID pointer);
+      RawAddress(Label label);
+      RawAddress(unsigned int lowLabel);
+      RawAddress(const Address &address);
+      RawAddress(const Offset &offset);
+
+      static RawAddress Null(void);
+
+      operator Label(void) const;
+
+      bool operator<(const RawAddress &address) const;
+      bool operator<(Label label) const;
+      bool operator>(const RawAddress &address) const;
+      bool operator>(Label label) const;
+      bool operator==(const RawAddress &address) const;
+      bool operator==(Label label) const;
+      bool operator!=(const RawAddress &address) const;
+      bool operator!=(Label label) const;
+      bool operator<=(const RawAddress &address) const;
+      bool operator<=(Label label) const;
+      bool operator>=(const RawAddress &address) const;
+      bool operator>=(Label label) const;
+
+      RawAddress operator+(std::intptr_t shift) const;
+      RawAddress operator+(std::uintptr_t shift) const;
+      RawAddress operator+(int shift) const;
+      RawAddress operator-(std::intptr_t shift) const;
+      RawAddress operator-(std::uintptr_t shift) const;
+      RawAddress operator-(int shift) const;
+      std::intptr_t operator-(const RawAddress &address) const;
+      RawAddress &operator+=(std::intptr_t shift);
+      RawAddress &operator+=(std::uintptr_t shift);
+      RawAddress &operator+=(int shift);
+      RawAddress &operator-=(std::intptr_t shift);
+      RawAddress &operator-=(std::uintptr_t shift);
+      RawAddress &operator-=(int shift);
+
+      LPVOID pointer(void) const;
+
+      bool isNull(void) const noexcept;
+
+      Label label(void) const noexcept;
+      void move(const LPVOID pointer);
+      void move(Label newLabel);
+
+      Address promote(void) const;
+      Address promote(AddressPool *pool) const;
+   };
 }
@@ -1,5 +1,11 @@
 #pragma once
 
+#include <neurology/allocators/arena.hpp>
+#include <neurology/allocators/copy.hpp>
+#include <neurology/allocators/heap.hpp>
 #include <neurology/allocators/local.hpp>
+#include <neurology/allocators/mirror.hpp>
+#include <neurology/allocators/paging.hpp>
+#include <neurology/allocators/slab.hpp>
 #include <neurology/allocators/virtual.hpp>
 #include <neurology/allocators/void.hpp>
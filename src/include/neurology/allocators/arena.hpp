@@ -0,0 +1,110 @@
+#pragma once
+
+#include <neurology/platform.hpp>
+
+#include <vector>
+
+#include <neurology/allocators/local.hpp>
+#include <neurology/exception.hpp>
+
+namespace Neurology
+{
+   /**
+      An allocator which carves its allocations out of large chunks of local
+      memory with a bump pointer. Individual allocations are never handed back
+      to the heap; instead, reset() invalidates every allocation at once and
+      rewinds the arena so its chunks get reused. This makes it a good fit for
+      lots of short-lived allocations which all die together.
+
+      Only the memory is handled in bulk. The arena's own bookkeeping is
+      flat, but every bound Allocation is still tracked by the maps and the
+      index of the base Allocator, one entry apiece, since that's what lets
+      allocations work against the arena unchanged.
+   */
+   class ArenaAllocator : public Allocator
+   {
+   public:
+      /**
+         A single chunk of memory allocations are carved from.
+      */
+      struct Chunk
+      {
+         LPBYTE base;
+         SIZE_T size;
+      };
+
+      typedef std::vector<Chunk> ChunkList;
+
+      /**
+         The size of the chunks created when none is given.
+      */
+      static const SIZE_T DefaultChunkSize = 0x10000;
+
+      /**
+         The alignment of every allocation carved from a chunk.
+      */
+      static const SIZE_T Alignment = 16;
+
+      class Exception : public Allocator::Exception
+      {
+      public:
+         Exception(ArenaAllocator &allocator, const LPWSTR message);
+      };
+
+   protected:
+      /**
+         The size of newly created chunks. Allocations larger than this get a
+         chunk of their own.
+      */
+      SIZE_T chunkSize;
+
+      /**
+         Every chunk created by this arena, in the order they get carved.
+      */
+      ChunkList chunks;
+
+      /**
+         The chunk currently being carved and the offset of its first free byte.
+      */
+      SIZE_T currentChunk;
+      SIZE_T cursor;
+
+   public:
+      ArenaAllocator(void);
+      ArenaAllocator(SIZE_T chunkSize);
+      ~ArenaAllocator(void);
+
+      SIZE_T chunkCount(void) const noexcept;
+
+      /**
+         Return the total size of every chunk held by the arena.
+      */
+      SIZE_T capacity(void) const noexcept;
+
+      /**
+         Invalidate every allocation made by this arena and rewind it to the
+         start of its first chunk. Chunks are kept around for reuse. Allocations
+         which were bound to the arena are left unbound, but can be allocated
+         again. If the zeroing policy zeroes on free, every byte carved so
+         far gets wiped.
+
+         Nothing is unbound or unpooled one allocation at a time, but this
+         isn't constant time either: it takes a pass over the allocation
+         table, and clearing the base Allocator's maps and index frees an
+         entry for every allocation made since the last reset.
+      */
+      void reset(void);
+
+   protected:
+      virtual Address poolAddress(SIZE_T size);
+      virtual Address repoolAddress(Address &address, SIZE_T newSize);
+      virtual void unpoolAddress(Address &address);
+
+      virtual void readAddressInto(const RawAddress &address, LPVOID destination, SIZE_T size) const;
+      virtual void writeAddressFrom(const RawAddress &destination, LPCVOID source, SIZE_T size);
+      virtual void zeroAddressRange(const RawAddress &address, SIZE_T size, bool secure);
+
+      LPBYTE carve(SIZE_T size);
+      bool isTop(LPBYTE block, SIZE_T size) const noexcept;
+   };
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <neurology/platform.hpp>
+
+namespace Neurology
+{
+   /**
+      A fault in a copy is traced back to the start of its page at this
+      granularity. It's no bigger than any real page, so everything before
+      that point is known to be reachable.
+   */
+   const SIZE_T CopyPageSize = 0x1000;
+
+   /**
+      Copy data from one process-local buffer to another. Returns 0 if it all
+      got copied, or the status of the fault which stopped it. The buffers are
+      allowed to overlap.
+   */
+   LONG CopyData(LPVOID destination, const LPVOID source, SIZE_T size);
+
+   /**
+      Copy data like above, and report in copied exactly how many bytes made
+      it over before a fault stopped the copy. Those are always the leading
+      bytes of the range, up to the first page either buffer can't reach,
+      except when the buffers overlap: an overlapping copy that faults
+      reports nothing copied.
+
+      Copies are a single memmove. If one faults, the bytes before the page
+      it faulted on are copied again, which is what makes the count exact
+      without costing copies that don't fault anything. Faults are caught
+      with structured exception handling on Windows, and with a SIGSEGV and
+      SIGBUS handler elsewhere, which passes faults outside of a copy on to
+      whatever handler was there before. That handler goes in on the first
+      copy and isn't checked again, so a program which installs its own
+      SIGSEGV or SIGBUS handler afterwards gets the faults of later copies
+      too, and those copies stop being guarded. Programs with handlers of
+      their own should install them before the first copy.
+   */
+   LONG CopyData(LPVOID destination, LPCVOID source, SIZE_T size, SIZE_T *copied);
+}
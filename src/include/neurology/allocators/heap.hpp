@@ -1 +1,198 @@
+#pragma once
 
+#include <neurology/platform.hpp>
+
+#include <atomic>
+#include <map>
+
+#include <neurology/allocators/local.hpp>
+#include <neurology/allocators/paging.hpp>
+#include <neurology/allocators/slab.hpp>
+#include <neurology/exception.hpp>
+
+namespace Neurology
+{
+   /**
+      A heap of its own, for memory which should all go away at once. On
+      Windows it's a private heap from HeapCreate. Elsewhere small blocks are
+      carved out of slabs in regions mapped for the heap through VirtualMemory,
+      with a free list per thread for every size class, and bigger blocks get
+      a region of their own. Destroying the heap unmaps every region at once.
+   */
+   class PrivateHeap
+   {
+   protected:
+#ifdef _WIN32
+      HANDLE heap;
+#else
+      /**
+         Every small block is preceded by one of these, so free() knows the
+         block's size and can tell it belongs to this heap. The heap comes
+         first, where a freed block keeps its free list link, so a block freed
+         twice doesn't look like it belongs to anyone.
+      */
+      struct BlockHeader
+      {
+         PrivateHeap *heap;
+         SIZE_T size;
+      };
+
+      /**
+         The bytes in front of every small block, which keeps blocks 16 byte
+         aligned.
+      */
+      static const SIZE_T HeaderSize = 16;
+
+      static std::atomic<SIZE_T> NextID;
+
+      SIZE_T id;
+
+      /**
+         Where the small blocks come from. Its spans are big blocks of this
+         heap.
+      */
+      SlabPool *slabs;
+
+      /**
+         The size of every big block, by address. Big blocks are mapped a
+         page at a time, so they can grow in place up to the end of their
+         last page.
+      */
+      std::map<LPVOID, SIZE_T> blocks;
+      mutable CRITICAL_SECTION lock;
+#endif
+
+   public:
+      /**
+         Throws a Win32Exception if the heap can't be created.
+      */
+      PrivateHeap(void);
+      ~PrivateHeap(void);
+
+      /**
+         Identify the heap. Outside of Windows there's no heap handle, so
+         this is an id which never gets reused instead.
+      */
+      HANDLE handle(void) const noexcept;
+
+      /**
+         Allocate a block, zeroed if asked to, or return NULL if there's no
+         memory for it.
+      */
+      LPVOID allocate(SIZE_T size, bool zero);
+
+      /**
+         Resize a block without moving it, returning whether or not it could
+         be. If asked to, whatever it grows by comes zeroed.
+      */
+      bool resize(LPVOID block, SIZE_T size, bool zero);
+
+      /**
+         Throws a Win32Exception if the block can't be freed.
+      */
+      void free(LPVOID block);
+
+#ifndef _WIN32
+   protected:
+      /**
+         Return the slab size a small block of the given size takes up with its
+         header, or 0 if the block is too big for the slabs.
+      */
+      static SIZE_T SlabSize(SIZE_T size) noexcept;
+
+      /**
+         Return the header of a small block of this heap, or NULL if the block
+         isn't one.
+      */
+      BlockHeader *findHeader(LPVOID block) const noexcept;
+#endif
+   };
+
+   /**
+      An allocator backed by a PrivateHeap of its own. Small allocations come
+      out of a slab pool whose spans live in the heap, with a free list per
+      thread for every size class; anything bigger goes to the heap directly.
+      Because everything lives in the one heap, destroy() can throw away every
+      allocation at once, which makes it a good fit for memory that lives and
+      dies with something like an analysis session.
+   */
+   class HeapAllocator : public Allocator
+   {
+   public:
+      class Exception : public Allocator::Exception
+      {
+      public:
+         Exception(HeapAllocator &allocator, const LPWSTR message);
+      };
+
+      /**
+         A snapshot of how the heap is being used.
+      */
+      struct Statistics
+      {
+         /**
+            The bytes currently handed out to allocations.
+         */
+         SIZE_T live;
+
+         /**
+            The most bytes ever handed out at once. This survives destroy(), so
+            a session's peak can still be read after its memory is gone.
+         */
+         SIZE_T peak;
+
+         /**
+            The bytes taken from the heap, slab spans included.
+         */
+         SIZE_T reserved;
+
+         /**
+            The share of reserved bytes which aren't live, from 0 to 1.
+         */
+         double fragmentation;
+      };
+
+   protected:
+      PrivateHeap *heap;
+      SlabPool *slabs;
+
+      SIZE_T liveBytes;
+      SIZE_T peakBytes;
+
+      /**
+         The bytes of the blocks too big for the slabs.
+      */
+      SIZE_T largeBytes;
+
+   public:
+      HeapAllocator(void);
+      ~HeapAllocator(void);
+
+      HANDLE handle(void) const noexcept;
+      Statistics statistics(void) const noexcept;
+
+      /**
+         Invalidate every allocation made by this allocator and destroy the
+         heap underneath them in one go. A fresh heap takes its place, so the
+         allocator can be used again afterwards. If the zeroing policy zeroes
+         on free, every live allocation gets wiped first.
+      */
+      void destroy(void);
+
+   protected:
+      virtual Address poolAddress(SIZE_T size);
+      virtual Address repoolAddress(Address &address, SIZE_T newSize);
+      virtual void unpoolAddress(Address &address);
+      virtual SIZE_T forgetAddress(Address &address);
+      virtual void releaseAddress(const RawAddress &address, SIZE_T size);
+
+      virtual void readAddressInto(const RawAddress &address, LPVOID destination, SIZE_T size) const;
+      virtual void writeAddressFrom(const RawAddress &destination, LPCVOID source, SIZE_T size);
+      virtual void zeroAddressRange(const RawAddress &address, SIZE_T size, bool secure);
+
+      LPVOID allocateBlock(SIZE_T size, bool zero);
+      void create(void);
+      void release(void);
+      void track(SIZE_T oldSize, SIZE_T newSize) noexcept;
+   };
+}
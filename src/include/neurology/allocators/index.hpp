@@ -0,0 +1,141 @@
+#pragma once
+
+#include <neurology/platform.hpp>
+
+#include <unordered_map>
+#include <vector>
+
+#include <neurology/address.hpp>
+
+namespace Neurology
+{
+   class Allocation;
+
+   /**
+      An interval index over the ranges of allocations. Entries are kept in
+      flat sorted blocks ordered by start label (ties broken by the larger
+      end first), and the furthest end label of each block is tracked in a
+      max-tree. A lookup binary searches for the last entry starting at or
+      before the requested label, then walks backwards, using the tree to
+      skip every block which can't possibly cover the requested range.
+      Within a block, the running furthest end of each entry does the same
+      for the entries before it.
+   */
+   class AllocationIndex
+   {
+   public:
+      /**
+         A single indexed range. The range is [start, end). reach is the
+         furthest end of this entry and every entry before it in its block,
+         which tells a backwards walk when it can stop.
+      */
+      struct Entry
+      {
+         Label start;
+         Label end;
+         Label reach;
+         Allocation *allocation;
+      };
+
+      typedef std::vector<Entry> Block;
+      typedef std::vector<Block> BlockList;
+      typedef std::unordered_map<const Allocation *, Entry> EntryMap;
+
+      /**
+         The number of entries a block may hold before it gets split in two.
+      */
+      static const SIZE_T BlockCapacity = 512;
+
+      /**
+         Returned by block searches when no block qualifies.
+      */
+      static const SIZE_T NoBlock = static_cast<SIZE_T>(-1);
+
+      /**
+         How many neighbouring entries isExclusive() looks at before giving
+         up on a range.
+      */
+      static const SIZE_T ExclusiveScanLimit = 256;
+
+   protected:
+      /**
+         The sorted blocks of entries.
+      */
+      BlockList blocks;
+
+      /**
+         The furthest end label within each block.
+      */
+      std::vector<Label> furthestEnds;
+
+      /**
+         A max-tree over furthestEnds. Leaves start at treeWidth.
+      */
+      std::vector<Label> blockEnds;
+      SIZE_T treeWidth;
+
+      /**
+         The entry currently indexed for each allocation, so that entries
+         can be found again after the allocation's range has moved.
+      */
+      EntryMap entries;
+
+      /**
+         Bumped on every insert, erase and clear.
+      */
+      SIZE_T currentGeneration;
+
+   public:
+      AllocationIndex(void);
+
+      bool isIndexed(const Allocation *allocation) const noexcept;
+      SIZE_T size(void) const noexcept;
+
+      /**
+         Return a counter which changes whenever the index does, so anything
+         remembered about the index can be checked for staleness.
+      */
+      SIZE_T generation(void) const noexcept;
+
+      /**
+         Index the given allocation with the range [start, end). If the
+         allocation is already indexed, its old range is replaced.
+      */
+      void insert(Allocation *allocation, Label start, Label end);
+
+      /**
+         Remove the given allocation from the index, if it's indexed.
+      */
+      void erase(const Allocation *allocation);
+
+      void clear(void);
+
+      /**
+         Return the smallest indexed allocation covering the range
+         [label, label+size), or NULL if no allocation covers it. A size of 0
+         only requires the label itself to be covered. No heap allocation
+         takes place during a lookup.
+      */
+      Allocation *find(Label label, SIZE_T size) const noexcept;
+
+      /**
+         Return whether or not find() gives back the given allocation for
+         every range inside the allocation's own range. That's the case when
+         no other entry starts inside it and nothing starting before it ends
+         inside it. Ranges with too many neighbours to check are reported as
+         not exclusive.
+      */
+      bool isExclusive(const Allocation *allocation) const noexcept;
+
+   protected:
+      static bool precedes(const Entry &left, const Entry &right) noexcept;
+      static Label furthestEnd(const Block &block) noexcept;
+      static void spreadReach(Block &block, SIZE_T from) noexcept;
+
+      SIZE_T locate(const Entry &entry) const noexcept;
+      SIZE_T lastCandidate(SIZE_T block, Label end) const noexcept;
+      void extendBlock(SIZE_T block, Label end);
+      void refreshBlock(SIZE_T block);
+      void rebuildTree(void);
+   };
+}
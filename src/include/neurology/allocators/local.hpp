@@ -1,33 +1,37 @@
 #pragma once
 
-#include <windows.h>
+#include <neurology/platform.hpp>
 
 #include <algorithm>
 
+#include <neurology/allocators/copy.hpp>
+#include <neurology/allocators/slab.hpp>
 #include <neurology/allocators/void.hpp>
 #include <neurology/exception.hpp>
 
 namespace Neurology
 {
-   /**
-      Copy data from one process-local buffer to another.
-   */
-   LONG CopyData(LPVOID destination, const LPVOID source, SIZE_T size);
-
    class KernelFaultException : public Exception
    {
    public:
       LONG status;
-      Address &source, &destination;
+      Address source, destination;
       SIZE_T size;
 
-      KernelFaultException(LONG status, Address &source, Address &destination, SIZE_T size);
+      KernelFaultException(LONG status, const Address &source, const Address &destination, SIZE_T size);
    };
    
    class LocalAllocator : public Allocator
    {
    public:
       static LocalAllocator Instance;
+
+      /**
+         Blocks of at least this size are taken straight from the OS as pages
+         through VirtualMemory, which come already zeroed: VirtualAlloc on
+         Windows, and mmap everywhere else.
+      */
+      static const SIZE_T PagedBlockSize = 0x100000;
       
       class Exception : public Allocator::Exception
       {
@@ -35,14 +39,49 @@ namespace Neurology
          Exception(LocalAllocator &allocator, const LPWSTR message);
       };
 
+   protected:
+      /**
+         The size-class pool small allocations come out of, or NULL if every
+         allocation goes to the general-purpose heap.
+      */
+      SlabPool *slabs;
+
+   public:
       LocalAllocator(void);
 
+      /**
+         Create a local allocator which, if useSlabs is set, serves allocations
+         of up to SlabPool::MaximumSize bytes out of a size-class pool instead
+         of the general-purpose heap. Such allocations can also grow and shrink
+         in place as long as they stay within their size class.
+      */
+      LocalAllocator(bool useSlabs);
+      ~LocalAllocator(void);
+
+      bool usesSlabs(void) const noexcept;
+
       virtual Address poolAddress(SIZE_T size);
       virtual Address repoolAddress(Address &address, SIZE_T newSize);
       virtual void unpoolAddress(Address &address);
-
-      virtual Data readAddress(const Address &address, SIZE_T size) const;
-      virtual void writeAddress(const Address &destination, const Data data);
+      virtual SIZE_T forgetAddress(Address &address);
+      virtual void releaseAddress(const RawAddress &address, SIZE_T size);
+
+      /**
+         Read as much of the range as can be read. A fault partway through
+         returns the bytes before it rather than throwing, and only a read
+         which faults on its very first byte throws a KernelFaultException.
+      */
+      virtual Data readAddress(const RawAddress &address, SIZE_T size) const;
+      virtual void readAddressInto(const RawAddress &address, LPVOID destination, SIZE_T size) const;
+      virtual void writeAddressFrom(const RawAddress &destination, LPCVOID source, SIZE_T size);
+      virtual void zeroAddressRange(const RawAddress &address, SIZE_T size, bool secure);
+
+   protected:
+      LPBYTE allocateBlock(SIZE_T size, bool *zeroed);
+      void freeBlock(LPVOID block, SIZE_T size);
+      bool isSlabbed(SIZE_T size) const noexcept;
+      bool isPaged(SIZE_T size) const noexcept;
+      bool fitsInPlace(SIZE_T oldSize, SIZE_T newSize) const noexcept;
    };
 
    Allocation nrlMalloc(SIZE_T size);
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <neurology/platform.hpp>
+
+#include <chrono>
+#include <list>
+#include <map>
+#include <vector>
+
+#include <neurology/allocators/paging.hpp>
+#include <neurology/allocators/void.hpp>
+#include <neurology/exception.hpp>
+
+namespace Neurology
+{
+   /**
+      Local copies of the pages of memory which is expensive to get at, like
+      another process's. Reads are served from the copies, fetching every
+      page they're missing in one batch. Writes only change the copies and
+      remember which bytes they changed, and sync() writes all of those back
+      in one batch, with changed bytes which touch merged into one range.
+      Every byte written counts as changed, even one which matches the copy,
+      since the memory behind the copy may have changed since it was fetched.
+
+      The mirror holds up to its capacity of pages, evicting the ones used
+      least recently once an operation is done, and writing back whatever
+      they changed first. Pages can be dropped explicitly with invalidate(),
+      or fetched again once they're older than a time to live. Changes to
+      pages which get dropped or refetched are written back beforehand.
+   */
+   class PageMirror
+   {
+   public:
+      typedef std::chrono::steady_clock Clock;
+
+      class WriteBackException : public Exception
+      {
+      public:
+         const SIZE_T lost;
+
+         WriteBackException(SIZE_T lost);
+      };
+
+      /**
+         How a mirror gets at the memory it mirrors.
+      */
+      class Backing
+      {
+      public:
+         virtual ~Backing(void) {}
+
+         /**
+            Transfer every range in the vector, filling in how much of each
+            made it across.
+         */
+         virtual void transfer(VirtualMemory::TransferVector *transfers, bool writing) = 0;
+      };
+
+   protected:
+      /**
+         Maps the offset of every changed range of a page to where it ends.
+         Ranges in it never touch.
+      */
+      typedef std::map<SIZE_T, SIZE_T> DirtyMap;
+      typedef std::list<Label> RecencyList;
+
+      struct MirroredPage
+      {
+         Data bytes;
+         DirtyMap dirty;
+         Clock::time_point fetched;
+         RecencyList::iterator recency;
+      };
+
+      typedef std::map<Label, MirroredPage> PageMap;
+      typedef std::vector<PageMap::iterator> PageList;
+
+      Backing *backing;
+      SIZE_T pageSize;
+      SIZE_T capacity;
+      Clock::duration timeToLive;
+      PageMap pages;
+
+      /**
+         The bases of the mirrored pages, most recently used first.
+      */
+      RecencyList recency;
+
+   public:
+      /**
+         Mirror pages of the given size through the backing, which has to
+         outlive the mirror. A time to live of zero keeps pages until
+         they're evicted or invalidated.
+      */
+      PageMirror(Backing *backing, SIZE_T pageSize, SIZE_T capacity, Clock::duration timeToLive);
+
+      SIZE_T getPageSize(void) const noexcept;
+      SIZE_T getCapacity(void) const noexcept;
+      Clock::duration getTimeToLive(void) const noexcept;
+
+      /**
+         Return how many pages are mirrored, and how many of them have
+         changes which weren't written back yet.
+      */
+      SIZE_T size(void) const noexcept;
+      SIZE_T dirtySize(void) const noexcept;
+
+      /**
+         Read or write every range in the vector, filling in how many leading
+         bytes of each could be, which stops short at the first page which
+         couldn't be fetched.
+      */
+      void read(VirtualMemory::TransferVector *transfers);
+      void write(VirtualMemory::TransferVector *transfers);
+
+      SIZE_T read(Label address, LPVOID buffer, SIZE_T size);
+      SIZE_T write(Label address, LPCVOID buffer, SIZE_T size);
+
+      /**
+         Write every change back. Changes which can't be written back are
+         dropped anyway, and reported with a WriteBackException once the rest
+         are done.
+      */
+      void sync(void);
+
+      /**
+         Write back and drop every page, or every page overlapping the given
+         range, so they're fetched again the next time they're needed.
+      */
+      void invalidate(void);
+      void invalidate(Label address, SIZE_T size);
+
+   protected:
+      Label pageOf(Label address) const noexcept;
+
+      /**
+         Find a page which is mirrored and not past its time to live.
+      */
+      PageMap::iterator current(Label base, Clock::time_point now);
+
+      /**
+         Make sure every page the transfers touch is mirrored and current,
+         fetching the ones which aren't in one batch.
+      */
+      void fetch(const VirtualMemory::TransferVector &transfers);
+
+      /**
+         Write back the changes of the given pages, which have to be sorted
+         by address. Returns how many changed bytes couldn't be.
+      */
+      SIZE_T writeBack(const PageList &dirtyPages);
+
+      /**
+         Write back and drop the given pages.
+      */
+      void drop(PageList &droppedPages);
+
+      /**
+         Evict the least recently used pages until the mirror is back within
+         its capacity.
+      */
+      void trim(void);
+
+      void touch(PageMap::iterator pageIter);
+   };
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <neurology/platform.hpp>
+
+#include <vector>
+
+#include <neurology/exception.hpp>
+
+namespace Neurology
+{
+   /**
+      The operating system's virtual memory calls behind one interface, so
+      VirtualAllocator and Page work the same everywhere. Protections and
+      allocation types are always the PAGE_* and MEM_* masks Page uses, and
+      region information always comes back as a MEMORY_BASIC_INFORMATION.
+
+      On Windows these are thin wrappers around VirtualAlloc and friends. A
+      process of NULL means the current process, anything else is a handle
+      to the process to operate on.
+
+      Elsewhere they're built on mmap, mprotect, madvise and mlock, and only
+      the current process is supported. The kernel doesn't know reserved
+      memory from committed memory, so every reservation made through
+      Allocate is tracked here to make queries come out the way they would
+      on Windows. Regions this didn't allocate are described from
+      /proc/self/maps, read again for every query so memory mapped or
+      unmapped behind VirtualMemory's back shows up right away. PAGE_GUARD,
+      PAGE_NOCACHE and PAGE_WRITECOMBINE are remembered but have no effect.
+
+      Failures throw a Win32Exception. Outside of Windows, its error is the
+      errno of the call which failed.
+   */
+   class VirtualMemory
+   {
+   public:
+      typedef std::vector<MEMORY_BASIC_INFORMATION> RegionVector;
+
+      /**
+         One range to transfer between processes: size bytes at address in
+         the other process, to or from buffer in this one. transferred is
+         how many leading bytes of the range made it across.
+      */
+      struct Transfer
+      {
+         LPVOID address;
+         LPVOID buffer;
+         SIZE_T size;
+         SIZE_T transferred;
+      };
+
+      typedef std::vector<Transfer> TransferVector;
+
+      /**
+         Return the size of a page, which everything here gets rounded to.
+      */
+      static SIZE_T PageSize(void);
+
+      /**
+         Reserve and/or commit memory like VirtualAlloc, returning where it
+         ended up. MEM_RESET marks the range as no longer needed, letting the
+         system reclaim it whenever it likes, without decommitting it.
+      */
+      static LPVOID Allocate(HANDLE process, LPVOID address, SIZE_T size, DWORD allocationType, DWORD protection);
+
+      /**
+         Decommit or release memory like VirtualFree. Decommitted memory
+         comes back zeroed when it gets committed again.
+      */
+      static void Free(HANDLE process, LPVOID address, SIZE_T size, DWORD freeType);
+
+      /**
+         Change the protection of committed memory, returning the old
+         protection of its first page.
+      */
+      static DWORD Protect(HANDLE process, LPVOID address, SIZE_T size, DWORD protection);
+
+      static void Lock(LPVOID address, SIZE_T size);
+      static void Unlock(LPVOID address, SIZE_T size);
+
+      /**
+         Describe the region containing the given address like VirtualQuery.
+         Returns the number of bytes written to the buffer, or 0 if there's
+         no region at or after the address.
+      */
+      static SIZE_T Query(HANDLE process, LPCVOID address, PMEMORY_BASIC_INFORMATION buffer, SIZE_T length);
+
+      /**
+         Describe every region of the process in address order, the same
+         regions a walk with Query would find. Outside of Windows they all
+         come from a single read of /proc/self/maps rather than a query
+         apiece.
+      */
+      static void Enumerate(HANDLE process, RegionVector *regions);
+
+#ifndef _WIN32
+      /**
+         Translate between PAGE_* protections and PROT_* flags. A protection
+         without exactly one of the PAGE_* access values translates to -1.
+      */
+      static int NativeProtection(DWORD protection);
+      static DWORD PageProtection(int protection);
+
+      /**
+         Translate MEM_* allocation types into the MAP_* flags of the mmap
+         which reserves them.
+      */
+      static int NativeAllocation(DWORD allocationType);
+#endif
+   };
+
+#ifndef _WIN32
+   /**
+      The memory of another process, by pid, for the places Windows would
+      use a process handle. Only reading, writing and querying are possible
+      this way.
+
+      Transfers go through process_vm_readv and process_vm_writev, with up to
+      IOV_MAX ranges per call. If the kernel refuses those, they fall back to
+      pread and pwrite on /proc/<pid>/mem. A range running into unmapped
+      memory stops there and the transfer carries on with the next range, so
+      a hole only costs the ranges it's in. Either way the target has to be
+      one this process may ptrace.
+   */
+   class ProcessMemory
+   {
+   public:
+      typedef VirtualMemory::Transfer Transfer;
+      typedef VirtualMemory::TransferVector TransferVector;
+
+   protected:
+      DWORD processID;
+      int memoryFile;
+      bool vectored;
+
+   public:
+      /**
+         Throws a Win32Exception with ESRCH if there's no such process.
+      */
+      ProcessMemory(DWORD processID);
+      ~ProcessMemory(void);
+
+      DWORD getProcessID(void) const noexcept;
+
+      /**
+         Like VirtualMemory::Query and VirtualMemory::Enumerate, with the
+         regions coming from /proc/<pid>/maps.
+      */
+      SIZE_T query(LPCVOID address, PMEMORY_BASIC_INFORMATION buffer, SIZE_T length) const;
+      void enumerate(VirtualMemory::RegionVector *regions) const;
+
+      /**
+         Transfer every range in the vector, filling in what made it across.
+      */
+      void read(TransferVector *transfers);
+      void write(TransferVector *transfers);
+
+      /**
+         Transfer a single range, returning how many leading bytes of it made
+         it across.
+      */
+      SIZE_T read(LPCVOID address, LPVOID buffer, SIZE_T size);
+      SIZE_T write(LPVOID address, LPCVOID buffer, SIZE_T size);
+
+   protected:
+      void transfer(TransferVector *transfers, bool writing);
+      void transferFile(TransferVector *transfers, SIZE_T index, bool writing);
+   };
+#endif
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <neurology/platform.hpp>
+
+#include <atomic>
+#include <vector>
+
+#include <neurology/exception.hpp>
+
+namespace Neurology
+{
+   class PrivateHeap;
+
+   /**
+      A pool of small blocks sorted into size classes, from 8 bytes up to 4
+      kilobytes. Blocks of a class are carved out of spans which only hold that
+      class, and each thread keeps a cache of free blocks for every class, so
+      most allocations and frees never touch the shared lists or their lock.
+
+      A thread finds its caches in a thread-local list, one per pool it has
+      used, without any locking, so going back and forth between pools costs
+      no more than sticking to one. When a thread exits, whatever its caches
+      still hold goes back to the shared lists of their pools.
+   */
+   class SlabPool
+   {
+   public:
+      class SizeClassException : public Exception
+      {
+      public:
+         const SIZE_T size;
+
+         SizeClassException(const SIZE_T size);
+      };
+
+      static const SIZE_T MinimumSize = 8;
+      static const SIZE_T MaximumSize = 4096;
+      static const SIZE_T ClassCount = 18;
+
+      /**
+         The size of each span blocks are carved from.
+      */
+      static const SIZE_T SpanSize = 0x10000;
+
+      /**
+         The number of blocks moved between a thread's cache and the shared
+         lists at once. A cache holding twice this many blocks of a class
+         hands a batch back.
+      */
+      static const SIZE_T CacheBatch = 32;
+
+      static const SIZE_T NoClass = static_cast<SIZE_T>(-1);
+      static const DWORD SpinCount = 4000;
+
+      /**
+         The block size of every size class, smallest first.
+      */
+      static const SIZE_T ClassSizes[ClassCount];
+
+   protected:
+      /* free blocks hold the address of the next free block in their first bytes */
+      struct FreeList
+      {
+         LPVOID head;
+         SIZE_T count;
+      };
+
+      class ThreadCache
+      {
+      public:
+         /**
+            The id of the pool the cache belongs to, and the pool itself until
+            it's destroyed. The pool is guarded by CacheLock.
+         */
+         SIZE_T poolID;
+         SlabPool *pool;
+
+         FreeList lists[ClassCount];
+
+         ThreadCache(SlabPool *pool);
+      };
+
+      typedef std::vector<ThreadCache *> ThreadCacheList;
+
+      /**
+         The caches of a single thread, the one used last first. Destroying
+         it hands the blocks of every cache back to its pool.
+      */
+      class ThreadCacheSet
+      {
+      public:
+         ThreadCacheList caches;
+
+         ~ThreadCacheSet(void);
+      };
+
+      typedef std::vector<LPBYTE> SpanList;
+
+      static std::atomic<SIZE_T> NextID;
+      static thread_local ThreadCacheSet ThreadCaches;
+
+      /**
+         Identifies this pool to the per-thread lookup of caches. Ids are never
+         reused, so a thread can't mistake a new pool for a dead one.
+      */
+      SIZE_T id;
+
+      /**
+         The heap spans are allocated from, or NULL to use new[].
+      */
+      PrivateHeap *heap;
+
+      /**
+         Guards the shared lists and the spans.
+      */
+      mutable CRITICAL_SECTION lock;
+
+      FreeList shared[ClassCount];
+      SpanList spans;
+
+      /**
+         The caches of every thread which has used the pool. Guarded by
+         CacheLock rather than the pool's lock, since exiting threads reach it
+         through their caches.
+      */
+      ThreadCacheList caches;
+
+   public:
+      SlabPool(void);
+
+      /**
+         Create a slab pool which takes its spans from the given heap rather
+         than from new[].
+      */
+      SlabPool(PrivateHeap *heap);
+      ~SlabPool(void);
+
+      /**
+         Return the size class a block of the given size falls into, or NoClass
+         if it's too big (or too small) for the pool.
+      */
+      static SIZE_T sizeClass(SIZE_T size) noexcept;
+
+      /**
+         Return whether or not a block of the given size comes out of a slab.
+      */
+      static bool isSlabSize(SIZE_T size) noexcept;
+
+      /**
+         Return the total size of every span held by the pool.
+      */
+      SIZE_T capacity(void) const noexcept;
+
+      LPVOID allocate(SIZE_T size);
+
+      /**
+         Return a block to the pool. The size has to fall into the same class
+         as the size it was allocated with.
+      */
+      void free(LPVOID block, SIZE_T size);
+
+   protected:
+      void initialize(void);
+      ThreadCache *threadCache(void);
+      ThreadCache *findCache(void);
+      void refill(FreeList *list, SIZE_T sizeClass);
+      void flush(FreeList *list, SIZE_T sizeClass);
+
+      /**
+         Hand everything in the cache back to the shared lists.
+      */
+      void drain(ThreadCache *cache);
+   };
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <neurology/platform.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+#include <neurology/exception.hpp>
+
+/*
+  define NEUROLOGY_INSTRUMENT to have allocators count and time what they do.
+  without it, the measurements below compile down to the statement alone and
+  nothing gets recorded. allocators carry their statistics either way, so code
+  built with and without it can still be linked together. the CMake build
+  turns it on with the NEUROLOGY_INSTRUMENT option.
+*/
+#ifdef NEUROLOGY_INSTRUMENT
+#define NEUROLOGY_MEASURE(statistics, operation, bytes, statement) \
+   do { Neurology::AllocatorStatistics::Measurement measurement(&(statistics), (operation), (bytes)); statement; } while (0)
+#define NEUROLOGY_INSTRUMENTED(statement) do { statement; } while (0)
+#else
+#define NEUROLOGY_MEASURE(statistics, operation, bytes, statement) do { statement; } while (0)
+#define NEUROLOGY_INSTRUMENTED(statement) do { } while (0)
+#endif
+
+namespace Neurology
+{
+   /**
+      Counters, byte totals and latency histograms for the operations of an
+      allocator. Everything is atomic, so operations on any thread can be
+      recorded while a snapshot is taken on another.
+   */
+   class AllocatorStatistics
+   {
+   public:
+      enum Operation
+      {
+         Allocate = 0,
+         Reallocate,
+         Deallocate,
+         Find,
+         Read,
+         Write,
+         OperationCount
+      };
+
+      enum Format
+      {
+         FormatText = 0,
+         FormatJSON
+      };
+
+      /**
+         Latencies are kept in buckets of powers of two nanoseconds. Bucket n
+         holds [2^n, 2^(n+1)) nanoseconds, with 0 going to the first bucket
+         and anything too long going to the last.
+      */
+      static const SIZE_T LatencyBuckets = 32;
+
+      /**
+         A copy of the statistics at one point in time.
+      */
+      struct Snapshot
+      {
+         SIZE_T calls[OperationCount];
+         SIZE_T bytes[OperationCount];
+         SIZE_T nanoseconds[OperationCount];
+         SIZE_T latencies[OperationCount][LatencyBuckets];
+
+         /**
+            The bytes and blocks of memory pooled by the allocator, and the
+            most bytes ever pooled at once.
+         */
+         SIZE_T liveBytes;
+         SIZE_T liveAllocations;
+         SIZE_T peakBytes;
+
+         /**
+            Return the upper bound of the latency bucket which the given
+            fraction of calls fall under, or 0 if there were no calls.
+         */
+         SIZE_T percentile(Operation operation, double fraction) const noexcept;
+
+         std::string text(void) const;
+         std::string json(void) const;
+
+         /**
+            Write the snapshot to the given file in the given format,
+            replacing whatever the file held. Throws a Win32Exception if the
+            file can't be written.
+         */
+         void save(LPCWSTR filename, Format format) const;
+      };
+
+      /**
+         Times a scope and records it as one call of an operation.
+      */
+      class Measurement
+      {
+      protected:
+         AllocatorStatistics *statistics;
+         Operation operation;
+         SIZE_T bytes;
+         std::chrono::steady_clock::time_point start;
+
+      public:
+         Measurement(AllocatorStatistics *statistics, Operation operation, SIZE_T bytes);
+         ~Measurement(void);
+      };
+
+      static const char *OperationName(Operation operation) noexcept;
+
+   protected:
+      std::atomic<SIZE_T> calls[OperationCount];
+      std::atomic<SIZE_T> bytes[OperationCount];
+      std::atomic<SIZE_T> nanoseconds[OperationCount];
+      std::atomic<SIZE_T> latencies[OperationCount][LatencyBuckets];
+
+      std::atomic<SIZE_T> liveBytes;
+      std::atomic<SIZE_T> liveAllocations;
+      std::atomic<SIZE_T> peakBytes;
+
+   public:
+      AllocatorStatistics(void);
+
+      void record(Operation operation, SIZE_T bytes, SIZE_T nanoseconds) noexcept;
+
+      /**
+         Account for pooled memory coming and going. Shrinking by more than
+         what's live leaves nothing live rather than wrapping around.
+      */
+      void grow(SIZE_T bytes, SIZE_T allocations) noexcept;
+      void shrink(SIZE_T bytes, SIZE_T allocations) noexcept;
+
+      Snapshot snapshot(void) const noexcept;
+
+      /**
+         Zero every counter. Live memory stays as it is, and becomes the new
+         peak.
+      */
+      void reset(void) noexcept;
+   };
+}
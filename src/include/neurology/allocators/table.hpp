@@ -0,0 +1,180 @@
+#pragma once
+
+#include <neurology/platform.hpp>
+
+#include <vector>
+
+#include <neurology/address.hpp>
+#include <neurology/exception.hpp>
+
+namespace Neurology
+{
+   class Allocation;
+
+   /**
+      A dense table of the allocations bound to an allocator. Every bound
+      allocation holds a slot, and what the allocator knows about it-- the
+      address it's bound to, its parent and children, and the other
+      allocations bound to the same address-- is kept in the slot, linked to
+      other slots by index. The only pointer to an allocation is the one in
+      its own slot, so an allocation can change objects by updating that one
+      pointer. A slot's generation is bumped every time it's given up, which
+      lets a handle that outlived its allocation be caught without any
+      lookups.
+   */
+   class AllocationTable
+   {
+   public:
+      /**
+         Thrown when every slot index is in use.
+      */
+      class FullTableException : public Exception
+      {
+      public:
+         FullTableException(void);
+      };
+
+      /**
+         A reference to an allocation by its slot and the generation of the
+         slot when the handle was made.
+      */
+      struct Handle
+      {
+         DWORD slot;
+         DWORD generation;
+      };
+
+      /**
+         The head of a list of slots linked through the slots themselves.
+      */
+      struct SlotList
+      {
+         DWORD first;
+         SIZE_T count;
+      };
+
+      struct Slot
+      {
+         /**
+            The allocation holding this slot, or NULL if the slot is free.
+         */
+         Allocation *allocation;
+
+         /**
+            The address the allocation is bound to.
+         */
+         Label address;
+
+         DWORD generation;
+
+         /**
+            The slots of the parent, the first child and the siblings on
+            either side. Free slots are chained through nextSibling.
+         */
+         DWORD parent, firstChild, previousSibling, nextSibling;
+
+         /**
+            The neighbouring slots bound to the same address.
+         */
+         DWORD previousBound, nextBound;
+      };
+
+      typedef std::vector<Slot> SlotVector;
+
+      static const DWORD NoSlot = static_cast<DWORD>(-1);
+
+      /**
+         A handle which never resolves to anything.
+      */
+      static const Handle NullHandle;
+
+   protected:
+      SlotVector slots;
+
+      /**
+         The most recently freed slot, which is the first to be reused.
+      */
+      DWORD freeSlot;
+
+      SIZE_T liveCount;
+
+   public:
+      AllocationTable(void);
+
+      /**
+         Return the number of slots held by allocations.
+      */
+      SIZE_T size(void) const noexcept;
+
+      /**
+         Return the number of slots in the table, free ones included.
+      */
+      SIZE_T capacity(void) const noexcept;
+
+      /**
+         Return whether or not the given allocation holds the given slot.
+      */
+      bool holds(DWORD slot, const Allocation *allocation) const noexcept;
+
+      /**
+         Return whether or not the slot of the given handle is still held by
+         the allocation it was made for.
+      */
+      bool isLive(const Handle &handle) const noexcept;
+
+      /**
+         Return the allocation the given handle refers to, or NULL if the
+         handle is stale.
+      */
+      Allocation *resolve(const Handle &handle) const noexcept;
+
+      /**
+         Return a handle to whatever currently holds the given slot.
+      */
+      Handle handle(DWORD slot) const noexcept;
+
+      /**
+         Return the given slot. Slots aren't bounds checked; use holds() first
+         when the slot might not belong to the table.
+      */
+      Slot &at(DWORD slot) noexcept;
+      const Slot &at(DWORD slot) const noexcept;
+
+      /**
+         Give the allocation a slot, bound to the given address, and return
+         it. Freed slots are reused before the table grows.
+      */
+      DWORD claim(Allocation *allocation, Label address);
+
+      /**
+         Give up the given slot, bumping its generation. The slot is taken out
+         of its family, but it has to be taken out of any bound list first.
+      */
+      void release(DWORD slot);
+
+      /**
+         Give up every slot at once. The slots are kept rather than thrown
+         away, and the generation of every held one is bumped, so handles
+         from before can't resolve to whatever claims the slot next.
+      */
+      void clear(void);
+
+      /**
+         Make the first slot the parent of the second, taking the second away
+         from any parent it already had.
+      */
+      void adopt(DWORD parent, DWORD child);
+
+      /**
+         Take the given slot away from its parent, if it has one.
+      */
+      void orphan(DWORD child);
+
+      /**
+         Add a slot to, or remove it from, a list of slots bound to the same
+         address.
+      */
+      void link(SlotList *list, DWORD slot);
+      void unlink(SlotList *list, DWORD slot);
+   };
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <neurology/platform.hpp>
+
+#include <chrono>
+#include <map>
+#include <vector>
+
+#include <neurology/allocators/statistics.hpp>
+#include <neurology/allocators/void.hpp>
+#include <neurology/exception.hpp>
+
+namespace Neurology
+{
+   /**
+      Records what an allocator gets asked to do into a compact binary trace,
+      so the same workload can be replayed against other allocators later.
+      Memory is identified by the order its blocks were pooled in, and
+      accesses by an offset into their block, so a trace doesn't depend on
+      where anything happened to be allocated.
+
+      A trace starts with the magic bytes "NTRC" and a version byte. Every
+      event after that is an operation byte followed by LEB128 varints of
+      the thread id, the nanoseconds since the previous event, the block
+      number plus one (0 when the address wasn't in any block), the offset
+      and the size. Offsets of addresses outside any block are the address
+      itself.
+
+      Recording never throws, since it happens inside allocator calls which
+      can't. Anything that goes wrong marks the recorder as failed instead.
+   */
+   class TraceRecorder
+   {
+   public:
+      static const BYTE Magic[4];
+      static const BYTE Version = 1;
+
+      /**
+         How much a recorder writing to a file buffers before writing it out.
+      */
+      static const SIZE_T FlushThreshold = 0x10000;
+
+      /**
+         Returned in place of a block number for addresses outside every
+         block.
+      */
+      static const DWORD NoBlock = static_cast<DWORD>(-1);
+
+   protected:
+      /**
+         A live block of pooled memory, keyed by its address.
+      */
+      struct Block
+      {
+         DWORD number;
+         SIZE_T size;
+      };
+
+      typedef std::map<Label, Block> BlockMap;
+
+      BlockMap blocks;
+      DWORD nextBlock;
+
+      /**
+         The encoded events not yet written out.
+      */
+      Data buffer;
+
+      HANDLE file;
+      SIZE_T events;
+      bool broken;
+
+      std::chrono::steady_clock::time_point lastEvent;
+      mutable CRITICAL_SECTION lock;
+
+   public:
+      /**
+         Record into memory, where contents() can get at the trace.
+      */
+      TraceRecorder(void);
+
+      /**
+         Record into the given file, which gets replaced. Throws a
+         Win32Exception if the file can't be created.
+      */
+      TraceRecorder(LPCWSTR filename);
+
+      ~TraceRecorder(void);
+
+      /**
+         Called by allocators as their memory comes and goes.
+      */
+      void allocated(Label address, SIZE_T size) noexcept;
+      void reallocated(Label oldAddress, Label newAddress, SIZE_T size) noexcept;
+      void deallocated(Label address) noexcept;
+
+      /**
+         Called by allocators for every find, read and write.
+      */
+      void accessed(AllocatorStatistics::Operation operation, Label address, SIZE_T size) noexcept;
+
+      /**
+         Return the trace recorded so far. A recorder writing to a file only
+         has what hasn't been flushed yet.
+      */
+      Data contents(void) const;
+
+      /**
+         Write whatever's buffered out to the file, if there is one.
+      */
+      void flush(void) noexcept;
+
+      SIZE_T eventCount(void) const noexcept;
+
+      /**
+         Return whether or not anything went wrong while recording, in which
+         case the trace is incomplete.
+      */
+      bool failed(void) const noexcept;
+
+   protected:
+      void record(AllocatorStatistics::Operation operation, DWORD block, SIZE_T offset, SIZE_T size);
+      void writeBuffer(void);
+
+      static void Encode(Data *buffer, ULONGLONG value);
+   };
+
+   /**
+      Drives an allocator with the events of a recorded trace and measures
+      how it copes. Events are replayed in the order they were recorded, on
+      the calling thread.
+   */
+   class TraceReplay
+   {
+   public:
+      class CorruptTraceException : public Exception
+      {
+      public:
+         /**
+            The offset in the trace where decoding fell apart.
+         */
+         SIZE_T offset;
+
+         CorruptTraceException(SIZE_T offset);
+      };
+
+      struct Event
+      {
+         AllocatorStatistics::Operation operation;
+         DWORD thread;
+
+         /**
+            Nanoseconds since the trace started.
+         */
+         ULONGLONG timestamp;
+
+         DWORD block;
+         SIZE_T offset;
+         SIZE_T size;
+      };
+
+      typedef std::vector<Event> EventList;
+
+      struct Result
+      {
+         SIZE_T events;
+
+         /**
+            Events which couldn't be replayed, such as accesses outside any
+            block or to blocks which are gone.
+         */
+         SIZE_T skipped;
+
+         /**
+            Events the allocator threw an exception on.
+         */
+         SIZE_T failed;
+
+         long long nanoseconds;
+         double eventsPerSecond;
+
+         /**
+            The most bytes of memory live at once during the replay.
+         */
+         SIZE_T peakBytes;
+      };
+
+   protected:
+      EventList eventList;
+
+      /**
+         The number of blocks the events refer to.
+      */
+      SIZE_T blockCount;
+
+   public:
+      TraceReplay(const Data &trace);
+
+      /**
+         Load the trace in the given file. Throws a Win32Exception if it can't
+         be read.
+      */
+      TraceReplay(LPCWSTR filename);
+
+      const EventList &events(void) const noexcept;
+
+      /**
+         Replay every event against the given allocator. Memory still live at
+         the end gets deallocated, and isn't part of the timing.
+      */
+      Result run(Allocator &allocator) const;
+
+   protected:
+      void decode(const Data &trace);
+      static ULONGLONG Decode(const Data &trace, SIZE_T *offset);
+   };
+}
@@ -1,11 +1,16 @@
 #pragma once
 
-#include <windows.h>
+#include <neurology/platform.hpp>
 
 #include <neurology/address.hpp>
 #include <neurology/allocators/local.hpp>
+#include <neurology/allocators/mirror.hpp>
+#include <neurology/allocators/paging.hpp>
 #include <neurology/object.hpp>
+
+#ifdef _WIN32
 #include <neurology/win32/handle.hpp>
+#endif
 
 namespace Neurology
 {
@@ -87,6 +92,12 @@ namespace Neurology
       VirtualAllocator *allocator;
       Object<MEMORY_BASIC_INFORMATION> memoryInfo;
 
+      /**
+         Move and resize the page to match the region its memory info
+         describes.
+      */
+      void settle(void);
+
    public:
       Page(void);
       Page(VirtualAllocator *allocator);
@@ -104,6 +115,11 @@ namespace Neurology
       Protection protection(void);
       State type(void);
 
+      /**
+         Give the memory of the page back to the system while keeping it
+         reserved. Committing it again brings it back zeroed.
+      */
+      void decommit(void);
       void release(void);
    };
 
@@ -128,24 +144,73 @@ namespace Neurology
          NoSuchPageException(VirtualAllocator &allocator, Page &page);
       };
 
+      class LocalMirrorException : public Exception
+      {
+      public:
+         LocalMirrorException(VirtualAllocator &allocator);
+      };
+
+      class MirrorFaultException : public Exception
+      {
+      public:
+         MirrorFaultException(VirtualAllocator &allocator);
+      };
+
       typedef std::map<const Address, Page *> PageObjectMap;
 
    protected:
+      /**
+         Hands the fetches and write-backs of the mirror to the process.
+      */
+      class MirrorBacking : public PageMirror::Backing
+      {
+      protected:
+         VirtualAllocator *allocator;
+
+      public:
+         MirrorBacking(VirtualAllocator *allocator);
+
+         virtual void transfer(VirtualMemory::TransferVector *transfers, bool writing);
+      };
+
       PageObjectMap pages;
-      Handle processHandle;
       Page::State defaultAllocation;
       Page::State defaultProtection;
+      MirrorBacking mirrorBacking;
+      PageMirror *mirror;
+
+#ifdef _WIN32
+      Handle processHandle;
+#else
+      /**
+         The process this allocator works on when it isn't local, since
+         there are no process handles to use outside of Windows.
+      */
+      ProcessMemory *processMemory;
+#endif
       
    public:
       VirtualAllocator(void);
+#ifdef _WIN32
       VirtualAllocator(Handle &processHandle);
+#else
+      VirtualAllocator(DWORD processID);
+#endif
       ~VirtualAllocator(void);
 
       bool hasPage(Page &page) const noexcept;
 
       void throwIfNoPage(Page &page) const;
       
+#ifdef _WIN32
       void setProcessHandle(Handle &handle);
+#else
+      /**
+         Make this the allocator of another process. Its memory can be read,
+         written, queried and enumerated, but not allocated or protected.
+      */
+      void setProcessID(DWORD processID);
+#endif
       void setDefaultAllocation(Page::State state);
       void setDefaultProtection(Page::State state);
 
@@ -157,11 +222,44 @@ namespace Neurology
       void unlock(Page &page);
       
       void protect(Page &page, Page::Protection protection);
+      void decommit(Page &page);
       
       SIZE_T query(Page &page);
       SIZE_T query(Address address, PMEMORY_BASIC_INFORMATION buffer, SIZE_T length);
 
-      void enumerate(void);
+      /**
+         Bring the pages up to date with the regions of the process. Pages
+         are created for new regions, updated for regions which changed,
+         and dropped for regions which are gone, unless they were allocated
+         here. Pages of regions which didn't change aren't touched. Returns
+         how many pages were created, updated or dropped, so nothing having
+         moved comes back as 0.
+      */
+      SIZE_T enumerate(void);
+
+      /**
+         Mirror the pages of the process locally, so reads and writes go to
+         local copies instead of the process, and only sync() and eviction
+         send changes over. See PageMirror for how pages are kept. Only
+         another process's memory can be mirrored, and switching the process
+         writes back and drops everything mirrored so far.
+      */
+      void enableMirror(SIZE_T capacity, PageMirror::Clock::duration timeToLive);
+      void disableMirror(void);
+      bool isMirrored(void) const noexcept;
+
+      /**
+         Write every change made through the mirror back to the process.
+      */
+      void sync(void);
+
+      /**
+         Write back and drop every mirrored page, or the mirrored pages
+         overlapping the given range, so their next use sees the process's
+         memory as it is now.
+      */
+      void invalidate(void);
+      void invalidate(const RawAddress &address, SIZE_T size);
 
       template <class Type>
       Pointer<Type> pointer(Address address)
@@ -207,12 +305,50 @@ namespace Neurology
       virtual Address repoolAddress(Address &address, SIZE_T size);
       virtual void unpoolAddress(Address &address);
 
+      /**
+         Return the process handle VirtualMemory calls take, which is NULL
+         for the current process. Outside of Windows there's no handle for
+         another process, so this throws instead.
+      */
+      HANDLE targetProcess(void) const;
+
+      /**
+         Unpool every page, releasing the ones allocated here.
+      */
+      void unpoolPages(void);
+
       void createPage(Address &address, bool owned);
       void freePage(Address &address);
 
+      /**
+         Forget about a page without touching the memory behind it.
+      */
+      void discardPage(Address &address);
+
+      /**
+         Transfer ranges straight to or from the process, filling in how
+         much of each made it across, without going through the mirror.
+      */
+      void transferRemote(VirtualMemory::TransferVector *transfers, bool writing);
+
       virtual void allocate(Allocation *allocation, SIZE_T size);
 
-      virtual Data readAddress(const Address &address, SIZE_T size) const;
-      virtual void writeAddress(const Address &address, const Data data);
+      /**
+         Read as much of the range as can be read, like LocalAllocator does.
+         Remote reads through the mirror or outside of Windows come back
+         short at the first unmapped page, and only throw if nothing could be
+         read at all.
+      */
+      virtual Data readAddress(const RawAddress &address, SIZE_T size) const;
+      virtual void readAddressInto(const RawAddress &address, LPVOID destination, SIZE_T size) const;
+      virtual void writeAddressFrom(const RawAddress &address, LPCVOID source, SIZE_T size);
+
+      /**
+         Remote batches go through the mirror when there is one, or outside
+         of Windows to the process in as few calls as possible. Every entry gets transferred as far as it can
+         before an entry which fell short throws.
+      */
+      virtual void readAddresses(const Batch &batch) const;
+      virtual void writeAddresses(const Batch &batch);
    };
 }
@@ -1,13 +1,16 @@
 #pragma once
 
-#include <windows.h>
+#include <neurology/platform.hpp>
 
-#include <list>
+#include <atomic>
 #include <map>
 #include <set>
 #include <vector>
 
 #include <neurology/address.hpp>
+#include <neurology/allocators/index.hpp>
+#include <neurology/allocators/statistics.hpp>
+#include <neurology/allocators/table.hpp>
 #include <neurology/exception.hpp>
 
 #define BlockData(ptr, size) Neurology::Data((LPBYTE)(ptr),((LPBYTE)(ptr))+(size))
@@ -28,6 +31,7 @@ namespace Neurology
    typedef std::vector<BYTE> Data;
 
    class Allocation;
+   class TraceRecorder;
 
    class Allocator
    {
@@ -172,20 +176,25 @@ namespace Neurology
       class AddressNotFoundException : public Exception
       {
       public:
-         Address &address;
+         /**
+            The address which wasn't found. It's kept by value, since the
+            address thrown for is often a temporary the throw unwinds past.
+         */
+         const RawAddress address;
 
-         AddressNotFoundException(Allocator &allocator, Address &address);
+         AddressNotFoundException(Allocator &allocator, const RawAddress &address);
       };
 
       /**
-         The set of all allocations made by this allocator.
+         A set of allocations, as returned by children().
       */
       typedef std::set<Allocation *> AllocationSet;
 
       /**
-         The mapping of addresses associated with allocations.
+         A reference to an allocation which can tell when the allocation is
+         gone. See AllocationTable.
       */
-      typedef std::map<const Allocation *, Address> AssociationMap;
+      typedef AllocationTable::Handle AllocationHandle;
 
       /**
          The mapping of addressed allocations and their given
@@ -194,9 +203,137 @@ namespace Neurology
       typedef std::map<const Address, SIZE_T> MemoryPool;
 
       /**
-         The mapping of an address to a given set of allocations.
+         The mapping of an address to the slots of the allocations bound to it.
+      */
+      typedef std::map<Label, AllocationTable::SlotList> BindingMap;
+
+      /**
+         A single entry of a batched read or write: size bytes at address,
+         read into or written from buffer.
+      */
+      struct BatchEntry
+      {
+         RawAddress address;
+         LPVOID buffer;
+         SIZE_T size;
+      };
+
+      /**
+         A list of entries to read or write in one go.
+      */
+      typedef std::vector<BatchEntry> Batch;
+
+      /**
+         A block of memory its allocator has forgotten about but not yet freed.
+      */
+      struct RetiredBlock
+      {
+         Label address;
+         SIZE_T size;
+      };
+
+      /**
+         Retired blocks handed off by handOff() to be freed with release(),
+         sorted by address.
+      */
+      typedef std::vector<RetiredBlock> ReleaseQueue;
+
+      /**
+         Keeps memory retired while it's alive from being reclaimed, for as
+         long as the guard is around.
+      */
+      class EpochGuard
+      {
+      protected:
+         Allocator &allocator;
+         SIZE_T epoch;
+
+      public:
+         EpochGuard(Allocator &allocator);
+         ~EpochGuard(void);
+      };
+
+      /**
+         When the memory behind allocations gets zeroed. ZeroSecurely zeroes
+         memory both when it's handed out and when it's given back, and makes
+         sure the latter can't be optimized away.
+      */
+      enum ZeroPolicy
+      {
+         ZeroNever = 0,
+         ZeroOnAlloc,
+         ZeroOnFree,
+         ZeroSecurely
+      };
+
+      /**
+         The policy allocators start out with. Debug builds leave memory alone
+         so uninitialized reads stand out.
+      */
+#ifdef _DEBUG
+      static const ZeroPolicy DefaultZeroPolicy = ZeroNever;
+#else
+      static const ZeroPolicy DefaultZeroPolicy = ZeroOnAlloc;
+#endif
+
+      /**
+         The number of recently found allocations each thread remembers.
+      */
+      static const SIZE_T LookasideSize = 4;
+
+      /**
+         Reclaiming walks the whole memory pool in address order unless the
+         pool holds more than this many times as many blocks as there are to
+         reclaim, in which case they're looked up one at a time instead.
+      */
+      static const SIZE_T RetiredWalkRatio = 16;
+
+      /**
+         The number of allocators each thread keeps recently found allocations
+         for, so a few allocators used in turn don't evict each other.
       */
-      typedef std::map<const Address, AllocationSet> BindingMap;
+      static const SIZE_T LookasideAllocators = 4;
+
+      /**
+         How often lookups were answered by the per-thread lookaside cache
+         instead of the index.
+      */
+      struct LookasideStatistics
+      {
+         SIZE_T hits;
+         SIZE_T misses;
+      };
+
+   protected:
+      /**
+         A run of batch entries whose ranges touch or overlap, covering
+         [start, end). first and last bound the run's entries within the
+         sorted order of the batch.
+      */
+      struct BatchRun
+      {
+         Label start, end;
+         SIZE_T first, last;
+      };
+
+      typedef std::vector<BatchRun> BatchRunList;
+
+      /**
+         A pooled address whose last binding went away while frees were being
+         deferred, along with the epoch it happened in.
+      */
+      struct Retirement
+      {
+         Label address;
+         SIZE_T epoch;
+      };
+
+      typedef std::vector<Retirement> RetirementList;
+
+      /**
+         The number of readers inside each epoch.
+      */
+      typedef std::map<SIZE_T, SIZE_T> ReaderMap;
 
    protected:
       /**
@@ -205,19 +342,20 @@ namespace Neurology
       bool local;
 
       /**
-         Addresses pooled by this allocator.
+         When this allocator zeroes its memory.
       */
-      AddressPool pooledAddresses;
+      ZeroPolicy zeroing;
 
       /**
-         The set of allocations created by this allocator.
+         Addresses pooled by this allocator.
       */
-      AllocationSet allocations;
+      AddressPool pooledAddresses;
 
       /**
-         The mapping of allocations to addresses created by this allocator.
+         The slots of the allocations bound to this allocator, which hold the
+         address each one is bound to and how they're related.
       */
-      AssociationMap associations;
+      AllocationTable table;
 
       /**
          The size of allocations created by this allocator, mapped by
@@ -231,6 +369,54 @@ namespace Neurology
       */
       BindingMap bindings;
 
+      /**
+         The interval index of every bound allocation's range, used to
+         resolve addresses to allocations.
+      */
+      AllocationIndex index;
+
+      /**
+         Whether or not freeing pooled memory is put off until reclaim().
+      */
+      bool deferring;
+
+      /**
+         The current epoch, the readers inside each epoch and the memory
+         waiting to be reclaimed, all guarded by the lock, so readers can come
+         and go from any thread. The rest of the allocator isn't guarded, so
+         deallocating and reclaiming still have to happen one thread at a
+         time, like every other change to it.
+      */
+      SIZE_T epoch;
+      ReaderMap readers;
+      RetirementList retired;
+      mutable CRITICAL_SECTION epochLock;
+
+      /**
+         Identifies this allocator to the per-thread lookaside cache. Ids are
+         never reused, so a thread can't mistake a new allocator for a dead
+         one.
+      */
+      SIZE_T id;
+
+      mutable std::atomic<SIZE_T> lookasideHits;
+      mutable std::atomic<SIZE_T> lookasideMisses;
+
+      /**
+         What this allocator has been doing, and how long it took. It's there
+         whether or not the library is built with NEUROLOGY_INSTRUMENT, so the
+         layout of an Allocator never depends on it; only the updates are
+         compiled out.
+      */
+      mutable AllocatorStatistics instruments;
+
+      /**
+         Where every allocation and access gets recorded, if anywhere.
+      */
+      TraceRecorder *recorder;
+
+      static std::atomic<SIZE_T> NextID;
+
    public:
       Allocator(void);
       ~Allocator(void);
@@ -240,6 +426,48 @@ namespace Neurology
       */
       bool isLocal(void) const noexcept;
 
+      ZeroPolicy zeroPolicy(void) const noexcept;
+      void setZeroPolicy(ZeroPolicy policy) noexcept;
+
+      /**
+         Return whether or not freeing memory is deferred. While it is,
+         deallocating an allocation still unbinds it right away, but the memory
+         behind it is only retired, and stays pooled until a call to reclaim()
+         or handOff() frees it in one sorted pass. Turning deferral off leaves
+         whatever is already retired for the next reclaim().
+      */
+      bool defersFrees(void) const noexcept;
+      void setDeferredFrees(bool defer) noexcept;
+
+      /**
+         Return the number of pooled addresses waiting to be reclaimed.
+      */
+      SIZE_T retiredCount(void) const noexcept;
+
+      /**
+         Enter or leave the current epoch as a reader. Memory retired while a
+         reader is inside an epoch isn't reclaimed until the reader leaves.
+         These can be called from any thread; EpochGuard calls them for you.
+      */
+      SIZE_T enterEpoch(void);
+      void leaveEpoch(SIZE_T epoch);
+
+      /**
+         Free every retired address no reader can still be looking at, lowest
+         address first, and return how many were freed.
+      */
+      SIZE_T reclaim(void);
+
+      /**
+         Like reclaim(), but only forget the retired memory here and hand it
+         back as a queue, so the freeing itself can happen on another thread
+         with release(). The queue has to be released before the allocator
+         goes away. Only allocators whose memory can be freed from anywhere
+         support this; the rest throw.
+      */
+      ReleaseQueue handOff(void);
+      void release(const ReleaseQueue &queue);
+
       /**
          Return whether or not a given address has been pooled.
       */
@@ -250,6 +478,20 @@ namespace Neurology
       */
       bool isBound(const Allocation &allocation) const noexcept;
 
+      /**
+         Return a handle to the given allocation, or a null handle if it isn't
+         bound. The handle stays valid for as long as the allocation stays
+         bound, even if the allocation is moved to another object.
+      */
+      AllocationHandle handle(const Allocation &allocation) const noexcept;
+
+      /**
+         Return the allocation behind the given handle, or NULL if it has
+         been unbound since the handle was made.
+      */
+      Allocation *resolve(const AllocationHandle &handle) const noexcept;
+      bool isLive(const AllocationHandle &handle) const noexcept;
+
       /**
          Return whether or not the given address exists somewhere in
          this allocator.
@@ -358,28 +600,57 @@ namespace Neurology
       /**
          Remove the given address from the address pool.
       */
-      void unpool(Address &address);
+      void unpool(const Address &address);
       
       Allocation &find(const Address &address) const;
       virtual Allocation &find(const Address &address, SIZE_T size) const;
 
+      /**
+         Return the smallest allocation covering the given range, or NULL if
+         no allocation covers it. Each thread keeps the last few allocations
+         it found here, and checks those before going to the index. They're
+         only kept while the index is unchanged and when nothing smaller
+         could be found inside them. A thread keeps them for the last
+         LookasideAllocators allocators it found something in; going back
+         and forth between more than that starts evicting them.
+      */
+      Allocation *tryFind(const Address &address, SIZE_T size) const noexcept;
+      Allocation *tryFind(const RawAddress &address, SIZE_T size) const noexcept;
+
+      /**
+         Return or reset the hit and miss counts of the lookaside cache,
+         summed over every thread. They're shared by every thread, so they're
+         only counted when the library is built with NEUROLOGY_INSTRUMENT, and
+         are always zero otherwise.
+      */
+      LookasideStatistics lookasideStatistics(void) const noexcept;
+      void resetLookasideStatistics(void) noexcept;
+
+      /**
+         Return or reset what this allocator has counted and timed. Unless
+         the library is built with NEUROLOGY_INSTRUMENT, nothing is recorded
+         and the snapshot is all zeroes.
+      */
+      AllocatorStatistics::Snapshot instrumentation(void) const noexcept;
+      void resetInstrumentation(void) noexcept;
+
+      /**
+         Record every allocation, reallocation, deallocation, find, read and
+         write into the given recorder from now on, or stop recording when
+         given NULL. The recorder has to outlive the allocator, or be swapped
+         out before it goes away.
+      */
+      void setRecorder(TraceRecorder *recorder) noexcept;
+      TraceRecorder *getRecorder(void) const noexcept;
+
       Allocation null(void);
       Allocation null(void) const;
       
       Allocation allocate(SIZE_T size);
       
-      template <class Type> Allocation allocate(void)
-      {
-         return this->allocate(sizeof(Type));
-      }
-
-      template <class Type> Allocation allocate(SIZE_T size)
-      {
-         if (sizeof(Type) > size)
-            throw InsufficientSizeException(*this, size);
-
-         return this->allocate(size);
-      }
+      /* these return an Allocation by value, so they're defined once it's complete */
+      template <class Type> Allocation allocate(void);
+      template <class Type> Allocation allocate(SIZE_T size);
          
       void reallocate(Allocation &allocation, SIZE_T size);
 
@@ -401,6 +672,47 @@ namespace Neurology
       Data read(const Address &address, SIZE_T size) const;
       void write(const Address &address, const Data data);
 
+      /**
+         Read from or write to an untracked address. The allocation covering
+         the range is found without creating any tracked addresses, which
+         makes these the ones to use in tight scanning loops.
+      */
+      Data read(const RawAddress &address, SIZE_T size) const;
+      void write(const RawAddress &address, const Data data);
+
+      /**
+         Read from or write to an address without throwing when no allocation
+         covers the range. A miss returns false instead, so probing addresses
+         which mostly miss doesn't pay for unwinding. Faults raised by the
+         backend itself still throw.
+      */
+      bool tryRead(const Address &address, SIZE_T size, Data *data) const;
+      bool tryRead(const RawAddress &address, SIZE_T size, Data *data) const;
+      bool tryWrite(const Address &address, const Data data);
+      bool tryWrite(const RawAddress &address, const Data data);
+
+      /**
+         Read into or write from a caller-supplied buffer instead of a Data
+         object, so the same buffer can be reused from one call to the next.
+         The range has to be covered by an allocation, just like read and
+         write.
+      */
+      void readInto(const Address &address, LPVOID destination, SIZE_T size) const;
+      void readInto(const RawAddress &address, LPVOID destination, SIZE_T size) const;
+      void writeFrom(const Address &address, LPCVOID source, SIZE_T size);
+      void writeFrom(const RawAddress &address, LPCVOID source, SIZE_T size);
+
+      /**
+         Read or write a whole batch of scattered ranges. Every entry is
+         validated against the allocations in a single sorted pass before
+         anything gets copied, so a miss throws without touching memory.
+         Entries which touch or overlap are coalesced into one range before
+         the backend sees them. When written entries overlap, the later
+         entry in the batch wins.
+      */
+      void readv(const Batch &batch) const;
+      void writev(const Batch &batch);
+
       Allocation &root(Allocation &allocation) const;
       const Allocation &root(const Allocation &allocation) const;
       Allocation &parent(Allocation &allocation);
@@ -410,25 +722,89 @@ namespace Neurology
       void zeroAddress(const Address &address, SIZE_T size);
       
    protected:
+      /* find on behalf of the allocator itself, which doesn't get recorded as a
+         find of its own. */
+      Allocation *lookup(const Address &address, SIZE_T size) const noexcept;
+      Allocation *lookup(const RawAddress &address, SIZE_T size) const noexcept;
+
+      /* find through the per-thread lookaside cache, falling back on the index. */
+      Allocation *findCached(const RawAddress &address, SIZE_T size) const noexcept;
+
+      /* hand an access over to the recorder, if there is one. */
+      void traceAccess(AllocatorStatistics::Operation operation, Label address, SIZE_T size) const noexcept;
+
+      /* apply the zeroing policy to memory being pooled or unpooled. memory
+         which comes fresh from the OS already zeroed doesn't need zeroOnPool. */
+      bool zeroesOnPool(void) const noexcept;
+      bool zeroesOnUnpool(void) const noexcept;
+      void zeroOnPool(const RawAddress &address, SIZE_T size);
+      void zeroOnUnpool(const RawAddress &address, SIZE_T size);
+
+      /* zero a range of memory directly. by default this writes from a block of
+         zeroes a piece at a time, local allocators just clear the memory. */
+      virtual void zeroAddressRange(const RawAddress &address, SIZE_T size, bool secure);
+
       virtual Address poolAddress(SIZE_T size);
       virtual Address repoolAddress(Address &address, SIZE_T newSize);
       virtual void unpoolAddress(Address &address);
+
+      /* the two halves of unpooling: forgetting the address, which has to
+         happen on the allocator's thread, and freeing the memory behind it,
+         which for some allocators can happen anywhere. */
+      virtual SIZE_T forgetAddress(Address &address);
+      virtual void releaseAddress(const RawAddress &address, SIZE_T size);
+
+      /* put off unpooling the given address until a reclaim. */
+      void retire(const Address &address);
+
+      /* move the retirements no reader can still be looking at into the given
+         list, sorted by address, and start a new epoch. */
+      void takeRetired(RetirementList *taken);
+
+      /* unpool everything retired, readers or not. for destructors. */
+      void reclaimAll(void);
+
+      /* unpool the given retirements, sorted by address, and return how many
+         were still pooled. */
+      SIZE_T unpoolRetired(const RetirementList &taken);
       
       virtual void allocate(Allocation *allocation, SIZE_T size);
       virtual void reallocate(Allocation *allocation, SIZE_T size);
       virtual void deallocate(Allocation *allocation);
 
       void bind(Allocation *allocation, const Address &address);
+      void bind(Allocation *allocation, const Address &address, Allocation *parent);
       void rebind(Allocation *allocation, const Address &newAddress);
       void unbind(Allocation *allocation);
+      void reindex(Allocation *allocation);
+
+      /* hand the binding of one allocation over to another, unbound one. */
+      void transfer(Allocation *from, Allocation *to);
+
+      /* drop every binding at once. allocations are detached from each other and
+         the bookkeeping is cleared wholesale-- nothing gets unpooled, retired
+         memory included, so this is only for allocators which reclaim their
+         memory in bulk. it's still linear in the number of allocations, since
+         every one of them has to be cut loose and has map entries to free. */
+      void unbindAll(void);
 
       /* functions for writing to/reading from directly to/from an allocation */
       Data read(const Allocation *allocation, const Address &address, SIZE_T size) const;
       void write(const Allocation *allocation, const Address &destination, const Data data);
 
-      /* overloadable functions for writing to/from addresses themselves */
-      virtual Data readAddress(const Address &address, SIZE_T size) const;
-      virtual void writeAddress(const Address &destination, const Data data);
+      /* overloadable functions for writing to/from addresses themselves. by
+         default, the Data versions go through the buffer versions. */
+      virtual Data readAddress(const RawAddress &address, SIZE_T size) const;
+      virtual void writeAddress(const RawAddress &destination, const Data data);
+      virtual void readAddressInto(const RawAddress &address, LPVOID destination, SIZE_T size) const;
+      virtual void writeAddressFrom(const RawAddress &destination, LPCVOID source, SIZE_T size);
+
+      /* batched versions of the above, so a remote backend can issue a whole
+         batch at once. by default each entry is copied on its own. */
+      virtual void readAddresses(const Batch &batch) const;
+      virtual void writeAddresses(const Batch &batch);
+
+      void planBatch(const Batch &batch, std::vector<SIZE_T> *order, BatchRunList *runs) const;
 
       Allocation spawn(Allocation *allocation, const Address &address, SIZE_T size);
    };
@@ -503,17 +879,46 @@ namespace Neurology
 
    protected:
       Allocator *allocator;
-      Allocation *parent;
-      Allocator::AllocationSet children;
-      AddressPool pool;
+
+      /**
+         The pool tracking addresses handed out from this allocation, so they
+         follow it when it moves. Most allocations, slices especially, never
+         hand out a tracked address, so the pool only gets created once one is
+         asked for.
+      */
+      mutable AddressPool *pool;
+
+      /**
+         The range of the allocation, [minimum, maximum).
+      */
+      Label minimum, maximum;
+
+      /**
+         Bumped every time the range changes.
+      */
+      SIZE_T generation;
+
+      /**
+         The slot this allocation holds in its allocator's table while it's
+         bound. Its parent and children are found through the slot.
+      */
+      DWORD slot;
       
    public:
       Allocation(void);
       Allocation(Allocator *allocator);
       Allocation(Allocation &allocation);
+
+      /**
+         Take over the binding of the given allocation, which is left unbound.
+         Nothing but the allocator's table points at an allocation, so this
+         costs about as much as an index update.
+      */
+      Allocation(Allocation &&allocation);
       ~Allocation(void);
 
       void operator=(Allocation &allocation);
+      void operator=(Allocation &&allocation);
       void operator=(const Allocation *allocation);
 
       bool isNull(void) const noexcept;
@@ -524,17 +929,30 @@ namespace Neurology
       bool inRange(SIZE_T offset, SIZE_T size) const noexcept;
       bool inRange(const Address &address) const noexcept;
       bool inRange(const Address &address, SIZE_T size) const noexcept;
+      bool inRange(const RawAddress &address) const noexcept;
+      bool inRange(const RawAddress &address, SIZE_T size) const noexcept;
       bool hasParent(void) const noexcept;
       bool hasChildren(void) const noexcept;
       bool isChild(const Allocation &parent) const noexcept;
       bool isParent(const Allocation &child) const noexcept;
 
+      /**
+         Return a number which changes whenever the allocation moves, resizes
+         or goes away, so raw addresses resolved from it can be checked for
+         staleness without asking the allocator.
+      */
+      SIZE_T currentGeneration(void) const noexcept;
+
+      Allocator::AllocationHandle handle(void) const noexcept;
+
       void throwIfNoAllocator(void) const;
       void throwIfNotBound(void) const;
       void throwIfNotInRange(SIZE_T offset) const;
       void throwIfNotInRange(SIZE_T offset, SIZE_T size) const;
       void throwIfNotInRange(const Address &address) const;
       void throwIfNotInRange(const Address &address, SIZE_T size) const;
+      void throwIfNotInRange(const RawAddress &address) const;
+      void throwIfNotInRange(const RawAddress &address, SIZE_T size) const;
       void throwIfNoParent(void) const;
 
       Address address(void);
@@ -595,6 +1013,10 @@ namespace Neurology
       void write(const Data data);
       void write(SIZE_T offset, const Data data);
       void write(Address &address, const Data data);
+      bool tryRead(SIZE_T offset, SIZE_T size, Data *data) const;
+      bool tryWrite(SIZE_T offset, const Data data);
+      void readInto(SIZE_T offset, LPVOID destination, SIZE_T size) const;
+      void writeFrom(SIZE_T offset, LPCVOID source, SIZE_T size);
 
       void copy(Allocation &allocation);
       void clone(const Allocation &allocation);
@@ -608,8 +1030,31 @@ namespace Neurology
       Allocator::AllocationSet getChildren(void) const;
 
    protected:
-      void setParent(Allocation &allocation);
-      void disownChild(Allocation &allocation);
-      void leaveParent(void);
+      bool resolveOffset(SIZE_T offset, SIZE_T size, RawAddress *address) const noexcept;
+      bool holdsSlot(void) const noexcept;
+
+      AddressPool &trackingPool(void) const;
+      void setRange(Label minimum, Label maximum);
+      void setMax(Label maximum);
+      void rebase(Label base);
    };
+
+   template <class Type>
+   Allocation
+   Allocator::allocate
+   (void)
+   {
+      return this->allocate(sizeof(Type));
+   }
+
+   template <class Type>
+   Allocation
+   Allocator::allocate
+   (SIZE_T size)
+   {
+      if (sizeof(Type) > size)
+         throw InsufficientSizeException(*this, size);
+
+      return this->allocate(size);
+   }
 }
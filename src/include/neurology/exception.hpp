@@ -1,6 +1,6 @@
 #pragma once
 
-#include <windows.h>
+#include <neurology/platform.hpp>
 
 #ifdef _DEBUG
 #define EXCSTR(str) (str)
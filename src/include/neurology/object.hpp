@@ -1,6 +1,6 @@
 #pragma once
 
-#include <windows.h>
+#include <neurology/platform.hpp>
 
 #include <new>
 #include <type_traits>
@@ -169,6 +169,12 @@ namespace Neurology
          *this = object;
       }
 
+      /* objects handed back by value are temporaries, which the copy above can't take */
+      Object(Object &&object)
+         : Object(object)
+      {
+      }
+
       Object(Allocator *allocator, Allocation allocation, Data cache, bool built, bool cached, bool autoflush)
          : allocator(allocator)
          , allocation(allocation)
@@ -0,0 +1,285 @@
+#pragma once
+
+/**
+   The Windows types and constants the library is written against. On
+   Windows this is just windows.h. Elsewhere the same names are mapped onto
+   the standard library and POSIX, so the portable parts of the library
+   build unchanged: the integer and pointer types, the PAGE_* and MEM_*
+   masks VirtualMemory translates, MEMORY_BASIC_INFORMATION, the memory
+   macros, critical sections as recursive pthread mutexes, and files opened
+   with CreateFileW as descriptors. Calls which only exist on Windows, like
+   the process APIs and every other kind of handle, aren't mapped.
+*/
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <wchar.h>
+
+#include <type_traits>
+#include <vector>
+
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef int32_t LONG;
+typedef uint32_t ULONG;
+typedef int BOOL;
+typedef uint64_t ULONGLONG;
+typedef int64_t LONGLONG;
+typedef uintptr_t ULONG_PTR;
+typedef intptr_t LONG_PTR;
+typedef size_t SIZE_T;
+
+typedef BYTE *PBYTE, *LPBYTE;
+typedef WORD *PWORD, *LPWORD;
+typedef DWORD *PDWORD, *LPDWORD;
+typedef SIZE_T *PSIZE_T;
+typedef void *PVOID, *LPVOID;
+typedef const void *LPCVOID;
+typedef wchar_t WCHAR;
+typedef wchar_t *LPWSTR;
+typedef const wchar_t *LPCWSTR;
+typedef char *LPSTR;
+typedef const char *LPCSTR;
+typedef void *HANDLE;
+
+#define FALSE 0
+#define TRUE 1
+
+#define INVALID_HANDLE_VALUE (reinterpret_cast<HANDLE>(static_cast<LONG_PTR>(-1)))
+
+#define GENERIC_READ 0x80000000
+#define GENERIC_WRITE 0x40000000
+#define FILE_SHARE_READ 0x1
+#define FILE_SHARE_WRITE 0x2
+#define CREATE_ALWAYS 2
+#define OPEN_EXISTING 3
+#define FILE_ATTRIBUTE_NORMAL 0x80
+
+#define PAGE_NOACCESS 0x01
+#define PAGE_READONLY 0x02
+#define PAGE_READWRITE 0x04
+#define PAGE_WRITECOPY 0x08
+#define PAGE_EXECUTE 0x10
+#define PAGE_EXECUTE_READ 0x20
+#define PAGE_EXECUTE_READWRITE 0x40
+#define PAGE_EXECUTE_WRITECOPY 0x80
+#define PAGE_GUARD 0x100
+#define PAGE_NOCACHE 0x200
+#define PAGE_WRITECOMBINE 0x400
+
+#define MEM_COMMIT 0x1000
+#define MEM_RESERVE 0x2000
+#define MEM_DECOMMIT 0x4000
+#define MEM_RELEASE 0x8000
+#define MEM_FREE 0x10000
+#define MEM_PRIVATE 0x20000
+#define MEM_MAPPED 0x40000
+#define MEM_RESET 0x80000
+#define MEM_TOP_DOWN 0x100000
+#define MEM_WRITE_WATCH 0x200000
+#define MEM_PHYSICAL 0x400000
+#define MEM_IMAGE 0x1000000
+#define MEM_RESET_UNDO 0x1000000
+#define MEM_LARGE_PAGES 0x20000000
+
+typedef struct _MEMORY_BASIC_INFORMATION
+{
+   PVOID BaseAddress;
+   PVOID AllocationBase;
+   DWORD AllocationProtect;
+   SIZE_T RegionSize;
+   DWORD State;
+   DWORD Protect;
+   DWORD Type;
+} MEMORY_BASIC_INFORMATION, *PMEMORY_BASIC_INFORMATION;
+
+#define CopyMemory(destination, source, length) memcpy((destination), (source), (length))
+#define MoveMemory(destination, source, length) memmove((destination), (source), (length))
+#define FillMemory(destination, length, fill) memset((destination), (fill), (length))
+#define ZeroMemory(destination, length) memset((destination), 0, (length))
+
+/* windows.h has these as macros, which the standard library headers here can't survive */
+template <class Left, class Right>
+inline typename std::common_type<Left, Right>::type
+min(Left left, Right right)
+{
+   return (left < right) ? left : right;
+}
+
+template <class Left, class Right>
+inline typename std::common_type<Left, Right>::type
+max(Left left, Right right)
+{
+   return (left > right) ? left : right;
+}
+
+inline PVOID
+SecureZeroMemory(PVOID destination, SIZE_T length)
+{
+   volatile BYTE *byte = static_cast<volatile BYTE *>(destination);
+
+   while (length-- > 0)
+      *byte++ = 0;
+
+   return destination;
+}
+
+/* the last error is errno, so Win32Exception carries errno values here */
+inline DWORD
+GetLastError(void)
+{
+   return static_cast<DWORD>(errno);
+}
+
+inline DWORD
+GetCurrentThreadId(void)
+{
+   return static_cast<DWORD>(syscall(SYS_gettid));
+}
+
+/* critical sections can be entered again by the thread holding them, so these are recursive */
+typedef struct _CRITICAL_SECTION
+{
+   pthread_mutex_t mutex;
+} CRITICAL_SECTION, *LPCRITICAL_SECTION;
+
+inline BOOL
+InitializeCriticalSectionAndSpinCount(LPCRITICAL_SECTION section, DWORD spinCount)
+{
+   pthread_mutexattr_t attributes;
+
+   (void)spinCount;
+
+   pthread_mutexattr_init(&attributes);
+   pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+   pthread_mutex_init(&section->mutex, &attributes);
+   pthread_mutexattr_destroy(&attributes);
+
+   return TRUE;
+}
+
+inline void
+InitializeCriticalSection(LPCRITICAL_SECTION section)
+{
+   InitializeCriticalSectionAndSpinCount(section, 0);
+}
+
+inline void
+EnterCriticalSection(LPCRITICAL_SECTION section)
+{
+   pthread_mutex_lock(&section->mutex);
+}
+
+inline BOOL
+TryEnterCriticalSection(LPCRITICAL_SECTION section)
+{
+   return pthread_mutex_trylock(&section->mutex) == 0;
+}
+
+inline void
+LeaveCriticalSection(LPCRITICAL_SECTION section)
+{
+   pthread_mutex_unlock(&section->mutex);
+}
+
+inline void
+DeleteCriticalSection(LPCRITICAL_SECTION section)
+{
+   pthread_mutex_destroy(&section->mutex);
+}
+
+/* a file handle is its descriptor, so a failed open comes out as INVALID_HANDLE_VALUE */
+inline HANDLE
+CreateFileW(LPCWSTR filename, DWORD access, DWORD shareMode, LPVOID security, DWORD disposition, DWORD attributes, HANDLE templateFile)
+{
+   std::vector<char> path(wcslen(filename) * MB_CUR_MAX + 1);
+   int flags = O_CLOEXEC;
+
+   (void)shareMode;
+   (void)security;
+   (void)attributes;
+   (void)templateFile;
+
+   if (wcstombs(path.data(), filename, path.size()) == static_cast<size_t>(-1))
+   {
+      errno = EILSEQ;
+      return INVALID_HANDLE_VALUE;
+   }
+
+   if ((access & GENERIC_READ) != 0 && (access & GENERIC_WRITE) != 0)
+      flags |= O_RDWR;
+   else if ((access & GENERIC_WRITE) != 0)
+      flags |= O_WRONLY;
+   else
+      flags |= O_RDONLY;
+
+   if (disposition == CREATE_ALWAYS)
+      flags |= O_CREAT | O_TRUNC;
+
+   return reinterpret_cast<HANDLE>(static_cast<LONG_PTR>(open(path.data(), flags, 0666)));
+}
+
+inline BOOL
+ReadFile(HANDLE file, LPVOID buffer, DWORD size, LPDWORD bytesRead, LPVOID overlapped)
+{
+   ssize_t result;
+
+   (void)overlapped;
+
+   do
+   {
+      result = read(static_cast<int>(reinterpret_cast<LONG_PTR>(file)), buffer, size);
+   } while (result == -1 && errno == EINTR);
+
+   if (result == -1)
+      return FALSE;
+
+   *bytesRead = static_cast<DWORD>(result);
+
+   return TRUE;
+}
+
+/* like on Windows, a write to a file only returns once all of it is written */
+inline BOOL
+WriteFile(HANDLE file, LPCVOID buffer, DWORD size, LPDWORD written, LPVOID overlapped)
+{
+   const BYTE *cursor = static_cast<const BYTE *>(buffer);
+   ssize_t result;
+
+   (void)overlapped;
+
+   *written = 0;
+
+   while (*written < size)
+   {
+      result = write(static_cast<int>(reinterpret_cast<LONG_PTR>(file)), cursor + *written, size - *written);
+
+      if (result == -1 && errno == EINTR)
+         continue;
+
+      if (result <= 0)
+         return FALSE;
+
+      *written += static_cast<DWORD>(result);
+   }
+
+   return TRUE;
+}
+
+inline BOOL
+CloseHandle(HANDLE file)
+{
+   return close(static_cast<int>(reinterpret_cast<LONG_PTR>(file))) == 0;
+}
+#endif
@@ -1,6 +1,6 @@
 #pragma once
 
-#include <windows.h>
+#include <neurology/platform.hpp>
 
 #include <type_traits>
 #include <vector>
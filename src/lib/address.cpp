@@ -2,7 +2,13 @@
 
 using namespace Neurology;
 
-AddressPool AddressPool::Instance;
+/* Windows is fucking rude basically */
+#pragma push_macro("max")
+#undef max
+
+AddressPool AddressPool::Instance(0, std::numeric_limits<Label>::max(), AddressPool::InstanceShards);
+
+#pragma pop_macro("max")
 
 AddressPool::Exception::Exception
 (AddressPool &pool, LPWSTR message)
@@ -81,6 +87,154 @@ AddressPool::LabelNotInRangeException::LabelNotInRangeException
 {
 }
 
+AddressPool::Shard::Shard
+(void)
+   : freeIdentities(NULL)
+{
+   InitializeCriticalSectionAndSpinCount(&this->lock, AddressPool::ShardSpinCount);
+}
+
+AddressPool::Shard::~Shard
+(void)
+{
+   DeleteCriticalSection(&this->lock);
+}
+
+AddressPool::ShardLock::ShardLock
+(const AddressPool *pool)
+   : pool(pool)
+   , low(0)
+   , high(pool->shardCount-1)
+   , whole(true)
+{
+   for (SIZE_T i=this->low; i<=this->high; ++i)
+      EnterCriticalSection(&this->pool->shards[i].lock);
+}
+
+AddressPool::ShardLock::ShardLock
+(const AddressPool *pool, Label label)
+   : pool(pool)
+   , low(AddressPool::NoShard)
+   , high(AddressPool::NoShard)
+   , whole(false)
+{
+   /* the base can only move while every shard is held, so once the shard is
+      entered, the stored label has to come out the same as before. */
+   for (;;)
+   {
+      Label storedLabel = label - this->pool->labelBase.load(std::memory_order_acquire);
+      SIZE_T shard = this->pool->shardOf(storedLabel);
+
+      this->enter(shard, shard);
+
+      if (label - this->pool->labelBase.load(std::memory_order_acquire) == storedLabel)
+         break;
+
+      this->leave();
+   }
+}
+
+AddressPool::ShardLock::ShardLock
+(const AddressPool *pool, const Identity identity)
+   : pool(pool)
+   , low(AddressPool::NoShard)
+   , high(AddressPool::NoShard)
+   , whole(false)
+{
+   IdentitySlot *slot = reinterpret_cast<IdentitySlot *>(identity);
+
+   if (identity == NULL)
+      return;
+
+   /* an identity can be relocated to another shard while we wait on its
+      current one, so check it's still there once we're in. */
+   for (;;)
+   {
+      SIZE_T shard = slot->shard;
+
+      if (shard >= this->pool->shardCount)
+         return;
+
+      this->enter(shard, shard);
+
+      if (slot->shard == shard)
+         break;
+
+      this->leave();
+   }
+}
+
+AddressPool::ShardLock::ShardLock
+(const AddressPool *pool, const Identity identity, Label newLabel)
+   : pool(pool)
+   , low(AddressPool::NoShard)
+   , high(AddressPool::NoShard)
+   , whole(false)
+{
+   IdentitySlot *slot = reinterpret_cast<IdentitySlot *>(identity);
+
+   for (;;)
+   {
+      Label storedLabel = newLabel - this->pool->labelBase.load(std::memory_order_acquire);
+      SIZE_T newShard = this->pool->shardOf(storedLabel);
+      SIZE_T shard = (identity == NULL) ? newShard : static_cast<SIZE_T>(slot->shard);
+
+      if (shard >= this->pool->shardCount)
+         shard = newShard;
+
+      this->enter(shard, newShard);
+
+      if (newLabel - this->pool->labelBase.load(std::memory_order_acquire) == storedLabel
+          && (identity == NULL || slot->shard == shard || slot->shard >= this->pool->shardCount))
+         break;
+
+      this->leave();
+   }
+}
+
+AddressPool::ShardLock::~ShardLock
+(void)
+{
+   this->leave();
+}
+
+void
+AddressPool::ShardLock::enter
+(SIZE_T first, SIZE_T second)
+{
+   this->low = min(first, second);
+   this->high = max(first, second);
+
+   EnterCriticalSection(&this->pool->shards[this->low].lock);
+
+   if (this->high != this->low)
+      EnterCriticalSection(&this->pool->shards[this->high].lock);
+}
+
+void
+AddressPool::ShardLock::leave
+(void)
+{
+   if (this->low == AddressPool::NoShard)
+      return;
+
+   if (this->whole)
+   {
+      for (SIZE_T i=this->high+1; i>this->low; --i)
+         LeaveCriticalSection(&this->pool->shards[i-1].lock);
+   }
+   else
+   {
+      if (this->high != this->low)
+         LeaveCriticalSection(&this->pool->shards[this->high].lock);
+
+      LeaveCriticalSection(&this->pool->shards[this->low].lock);
+   }
+
+   this->low = AddressPool::NoShard;
+   this->high = AddressPool::NoShard;
+}
+
 /* Windows is fucking rude basically */
 #pragma push_macro("max")
 #undef max
@@ -89,6 +243,10 @@ AddressPool::AddressPool
 (void)
    : minLabel(0)
    , maxLabel(std::numeric_limits<Label>::max())
+   , shards(new Shard[1])
+   , shardCount(1)
+   , relative(false)
+   , labelBase(0)
 {
 }
 
@@ -98,6 +256,23 @@ AddressPool::AddressPool
 (Label minLabel, Label maxLabel)
    : minLabel(minLabel)
    , maxLabel(maxLabel)
+   , shards(new Shard[1])
+   , shardCount(1)
+   , relative(false)
+   , labelBase(0)
+{
+   if (this->minLabel > this->maxLabel)
+      throw BadRangeException(*this, minLabel, maxLabel);
+}
+
+AddressPool::AddressPool
+(Label minLabel, Label maxLabel, SIZE_T shardCount)
+   : minLabel(minLabel)
+   , maxLabel(maxLabel)
+   , shards(new Shard[(shardCount == 0) ? 1 : shardCount])
+   , shardCount((shardCount == 0) ? 1 : shardCount)
+   , relative(false)
+   , labelBase(0)
 {
    if (this->minLabel > this->maxLabel)
       throw BadRangeException(*this, minLabel, maxLabel);
@@ -105,6 +280,12 @@ AddressPool::AddressPool
 
 AddressPool::AddressPool
 (AddressPool &pool)
+   : minLabel(pool.minLabel)
+   , maxLabel(pool.maxLabel)
+   , shards(new Shard[pool.shardCount])
+   , shardCount(pool.shardCount)
+   , relative(false)
+   , labelBase(0)
 {
    pool.drain(*this);
 }
@@ -112,75 +293,158 @@ AddressPool::AddressPool
 AddressPool::~AddressPool
 (void)
 {
-   BindingMap::iterator bindingIter;
-   LabelMap::iterator labelIter;
-   AddressSet::iterator addressIter;
-   IdentitySet::iterator identifierIter;
+   {
+      ShardLock lock(this);
+
+      for (SIZE_T i=0; i<this->shardCount; ++i)
+      {
+         Shard &shard = this->shards[i];
+         IdentitySet::iterator identIter;
+         LabelMap::iterator labelIter;
    
-   /* unbind all addresses from their corresponding identifiers */
+         /* unbind all addresses from their corresponding identifiers */
 
-   /* the caveat with unbinding is that they will modify the corresponding
-      map objects when we do so, so take a different approach to iterating
-      over the objects. */
-   while ((bindingIter = this->bindings.begin()) != this->bindings.end())
-   {
-      AddressSet::iterator addrIter = bindingIter->second.begin();
-      this->unbind(*addrIter);
-   }
+         /* the caveat with unbinding is that unbinding the last address of an
+            identity releases the identity, so step past it before unbinding. */
+         identIter = shard.identities.begin();
+
+         while (identIter != shard.identities.end())
+         {
+            Identity identity = *identIter++;
+            Address *address;
+
+            while ((address = AddressPool::boundAddresses(identity)) != NULL)
+               this->unbind(address);
+         }
    
-   /* release all remaining identifiers from their corresponding labels */
-   while ((labelIter = this->labels.begin()) != this->labels.end())
-   {
-      IdentitySet::iterator identifierIter = labelIter->second.begin();
-      this->releaseIdentity(*identifierIter);
+         /* release all remaining identifiers from their corresponding labels */
+         while ((labelIter = shard.labels.begin()) != shard.labels.end())
+         {
+            IdentitySet::iterator identifierIter = labelIter->second.begin();
+            this->releaseIdentity(*identifierIter);
+         }
+
+         /* any identities still hanging around live in the slabs, so they all go
+            away in one fell swoop here. */
+         shard.identities.clear();
+         shard.freeIdentities = NULL;
+
+         for (SlabList::iterator slabIter=shard.identitySlabs.begin(); slabIter!=shard.identitySlabs.end(); ++slabIter)
+            delete[] *slabIter;
+
+         shard.identitySlabs.clear();
+      }
    }
 
-   /* why are there still identities? delete them, this is probably some kind of
-      memory leak. */
-   while ((identifierIter = this->identities.begin()) != this->identities.end())
-      delete *identifierIter;
+   delete[] this->shards;
 }
 
 void
 AddressPool::drain
 (AddressPool &targetPool)
 {
-   targetPool.identities = this->identities;
-   targetPool.labels = this->labels;
-   targetPool.bindings = this->bindings;
+   AddressPool *firstPool, *secondPool;
+
+   if (&targetPool == this)
+      return;
 
-   for (BindingMap::iterator iter=this->bindings.begin();
-        iter!=this->bindings.end();
-        ++iter)
+   /* draining is atomic with respect to both pools. take every shard of both,
+      always starting with the same pool so two drains can't deadlock. */
+   if (std::less<AddressPool *>()(this, &targetPool))
    {
-      for (AddressSet::iterator setIter=iter->second.begin();
-           setIter!=iter->second.end();
-           ++setIter)
+      firstPool = this;
+      secondPool = &targetPool;
+   }
+   else
+   {
+      firstPool = &targetPool;
+      secondPool = this;
+   }
+
+   ShardLock firstLock(firstPool);
+   ShardLock secondLock(secondPool);
+
+   /* whatever the target already holds has to be stored against our base */
+   targetPool.rekey(targetPool.labelBase - this->labelBase);
+   targetPool.relative = this->relative;
+   targetPool.labelBase.store(this->labelBase, std::memory_order_release);
+
+   for (SIZE_T i=0; i<this->shardCount; ++i)
+   {
+      Shard &shard = this->shards[i];
+      Shard &targetHeir = targetPool.shards[i % targetPool.shardCount];
+
+      for (LabelMap::iterator labelIter=shard.labels.begin(); labelIter!=shard.labels.end(); ++labelIter)
+      {
+         IdentitySet &targetSet = targetPool.shards[targetPool.shardOf(labelIter->first)].labels[labelIter->first];
+         targetSet.insert(labelIter->second.begin(), labelIter->second.end());
+      }
+
+      for (IdentitySet::iterator identIter=shard.identities.begin();
+           identIter!=shard.identities.end();
+           ++identIter)
+      {
+         SIZE_T targetShard = targetPool.shardOf(AddressPool::storedLabel(*identIter).load(std::memory_order_relaxed));
+
+         reinterpret_cast<IdentitySlot *>(*identIter)->shard = targetShard;
+         targetPool.shards[targetShard].identities.insert(*identIter);
+         
+         for (Address *address=AddressPool::boundAddresses(*identIter);
+              address!=NULL;
+              address=address->nextBinding)
+         {
+            address->pool = &targetPool;
+         }
+      }
+
+      /* the identities we're handing over live in our slabs, so the slabs have
+         to go with them. each shard hands its slabs and free list to a shard of
+         the target in turn, so the target's allocations don't all pile onto
+         one shard's lock afterwards. */
+      targetHeir.identitySlabs.insert(targetHeir.identitySlabs.end()
+                                       ,shard.identitySlabs.begin()
+                                       ,shard.identitySlabs.end());
+
+      if (shard.freeIdentities != NULL)
       {
-         (*setIter)->pool = &targetPool;
+         Identity tail = shard.freeIdentities;
+
+         while (*tail != 0)
+            tail = reinterpret_cast<Identity>(*tail);
+
+         *tail = reinterpret_cast<Label>(targetHeir.freeIdentities);
+         targetHeir.freeIdentities = shard.freeIdentities;
       }
+
+      /* the copy constructors literally copy, and that's not what we want to
+         do. so clear the pool we drained. */
+      shard.identities.clear();
+      shard.labels.clear();
+      shard.identitySlabs.clear();
+      shard.freeIdentities = NULL;
    }
 
-   /* the copy constructors literally copy, and that's not what we want to do.
-      so clear the pool we drained. */
-   this->identities.clear();
-   this->labels.clear();
-   this->bindings.clear();
+   this->labelBase.store(0, std::memory_order_release);
 }
 
 AddressPool::AddressSet
 AddressPool::pool
 (void) const
 {
-   BindingMap::const_iterator bindingIter;
+   ShardLock lock(this);
    AddressSet result;
 
-   for (bindingIter=this->bindings.begin(); bindingIter!=this->bindings.end(); ++bindingIter)
+   for (SIZE_T i=0; i<this->shardCount; ++i)
    {
-      AddressSet::iterator addressIter;
+      const Shard &shard = this->shards[i];
+      
+      for (IdentitySet::const_iterator identIter=shard.identities.begin(); identIter!=shard.identities.end(); ++identIter)
+      {
+         Address *address;
 
-      for (addressIter=bindingIter->second.begin(); addressIter!=bindingIter->second.end(); ++addressIter)
-         result.insert(*addressIter);
+         for (address=AddressPool::boundAddresses(*identIter); address!=NULL; address=address->nextBinding)
+            result.insert(address);
+      }
    }
 
    return result;
@@ -197,17 +461,23 @@ bool
 AddressPool::hasLabel
 (Label label) const noexcept
 {
-   return this->labels.count(label) > 0;
+   ShardLock lock(this, label);
+   Label storedLabel = label - this->labelBase;
+
+   return this->shards[this->shardOf(storedLabel)].labels.count(storedLabel) > 0;
 }
 
 bool
 AddressPool::isBound
 (const Address &address) const noexcept
 {
-   if (this->bindings.count(address.identity) == 0)
+   if (address.pool != this || address.identity == NULL)
       return false;
 
-   return this->bindings.at(address.identity).find(const_cast<Address *>(&address)) != this->bindings.at(address.identity).end();
+   ShardLock lock(this, address.identity);
+
+   /* an address is bound if it's linked into its identity's binding list */
+   return address.prevBinding != NULL || AddressPool::boundAddresses(address.identity) == &address;
 }
 
 bool
@@ -221,7 +491,18 @@ bool
 AddressPool::hasIdentity
 (const Identity identity) const noexcept
 {
-   return this->identities.find(const_cast<Identity>(identity)) != this->identities.end();
+   ShardLock lock(this, identity);
+   SIZE_T shard;
+
+   if (identity == NULL)
+      return false;
+
+   shard = reinterpret_cast<IdentitySlot *>(identity)->shard;
+
+   if (shard >= this->shardCount)
+      return false;
+
+   return this->shards[shard].identities.count(const_cast<Identity>(identity)) > 0;
 }
 
 bool
@@ -234,6 +515,39 @@ AddressPool::sharesIdentity
    return first.identity == second.identity;
 }
 
+bool
+AddressPool::isRelative
+(void) const noexcept
+{
+   return this->relative;
+}
+
+SIZE_T
+AddressPool::shardTotal
+(void) const noexcept
+{
+   return this->shardCount;
+}
+
+void
+AddressPool::setRelative
+(bool relative)
+{
+   ShardLock lock(this);
+
+   if (this->relative == relative)
+      return;
+
+   /* leaving relative mode means baking the base into every stored label */
+   if (!relative)
+   {
+      this->rekey(this->labelBase);
+      this->labelBase.store(0, std::memory_order_release);
+   }
+
+   this->relative = relative;
+}
+
 void
 AddressPool::throwIfNoLabel
 (const LPVOID pointer) const
@@ -290,22 +604,32 @@ void
 AddressPool::setMin
 (Label label)
 {
+   ShardLock lock(this);
+   Label oldMin = this->minLabel;
+
    if (label > this->maxLabel)
       throw BadRangeException(*this, label, this->maxLabel);
       
    this->minLabel = label;
-   this->unbindOutOfBounds();
+
+   if (label > oldMin)
+      this->unbindOutOfBounds();
 }
 
 void
 AddressPool::setMax
 (Label label)
 {
+   ShardLock lock(this);
+   Label oldMax = this->maxLabel;
+
    if (label < this->minLabel)
       throw BadRangeException(*this, this->minLabel, label);
 
    this->maxLabel = label;
-   this->unbindOutOfBounds();
+
+   if (label < oldMax)
+      this->unbindOutOfBounds();
 }
 
 void
@@ -319,12 +643,18 @@ void
 AddressPool::setRange
 (std::pair<Label, Label> range)
 {
+   ShardLock lock(this);
+   std::pair<Label, Label> oldRange = this->range();
+
    if (range.first > range.second || range.second < range.first)
       throw BadRangeException(*this, range.first, range.second);
 
    this->minLabel = range.first;
    this->maxLabel = range.second;
-   this->unbindOutOfBounds();
+
+   /* growing the range can't leave anything behind */
+   if (range.first > oldRange.first || range.second < oldRange.second)
+      this->unbindOutOfBounds();
 }
 
 std::uintptr_t
@@ -345,12 +675,33 @@ Address
 AddressPool::address
 (Label label)
 {
-   std::set<Identity>::iterator identifierIter;
+   Address newAddress;
 
-   if (this->hasLabel(label))
-      return this->newAddress(this->getIdentity(label));
-   
-   return this->newAddress(label);
+   if (!this->tryAddress(label, &newAddress))
+      throw LabelNotInRangeException(*this, label);
+
+   return newAddress;
+}
+
+bool
+AddressPool::tryAddress
+(Label label, Address *address)
+{
+   /* let go of whatever the address was bound to first. that may take a lock
+      in another shard, so it can't happen while this one is held. */
+   *address = Address();
+
+   {
+      ShardLock lock(this, label);
+
+      if (!this->inRange(label))
+         return false;
+
+      address->pool = this;
+      this->acquire(address, label);
+   }
+
+   return true;
 }
 
 Address
@@ -364,6 +715,10 @@ Address
 AddressPool::newAddress
 (Label label)
 {
+   /* hold the label's shard so nobody can release the identity before the
+      new address gets bound to it */
+   ShardLock lock(this, label);
+   
    return this->newAddress(this->newIdentity(label));
 }
 
@@ -379,27 +734,31 @@ AddressPool::move
 (Address &address, Label newLabel)
 {
    this->throwIfNotBound(address);
+   this->throwIfNotInRange(newLabel);
 
-   if (this->hasLabel(newLabel))
-      this->rebind(&address, this->getIdentity(newLabel));
-   else
-      this->rebind(&address, this->newIdentity(newLabel));
+   /* the old identity goes away if this was its last address */
+   this->unbind(&address);
+   address.pool = this;
+   this->acquire(&address, newLabel);
 }
 
 void
 AddressPool::move
 (Label priorLabel, Label newLabel)
 {
+   ShardLock lock(this);
    std::set<Identity>::iterator identIter;
+   Label priorKey = priorLabel - this->labelBase;
+   LabelMap &priorLabels = this->shards[this->shardOf(priorKey)].labels;
    
    this->throwIfNoLabel(priorLabel);
 
    /* reidentifying will slowly wipe out this list of labels */
-   while ((identIter = this->labels[priorLabel].begin()) != this->labels[priorLabel].end())
+   while ((identIter = priorLabels[priorKey].begin()) != priorLabels[priorKey].end())
    {
       this->reidentify(*identIter, newLabel);
       
-      if (this->labels.count(priorLabel) == 0)
+      if (priorLabels.count(priorKey) == 0)
          break;
    }
 }
@@ -408,19 +767,38 @@ void
 AddressPool::shift
 (std::intptr_t shift)
 {
-   IdentitySet::iterator identIter;
+   ShardLock lock(this);
+   Label lowest, highest;
 
    if (shift == 0)
       return;
 
-   for (identIter=this->identities.begin(); identIter!=this->identities.end(); ++identIter)
-      this->reidentify(*identIter, **identIter+shift);
+   /* every label moves by the same amount, so only the lowest and highest
+      labels need to be checked against the range. a shift which wraps around
+      the label space could still land in range, so catch that too. */
+   if (this->extents(&lowest, &highest))
+   {
+      if (shift > 0 && highest + shift < highest)
+         throw LabelNotInRangeException(*this, highest + shift);
+
+      if (shift < 0 && lowest + shift > lowest)
+         throw LabelNotInRangeException(*this, lowest + shift);
+      
+      this->throwIfNotInRange(lowest + shift);
+      this->throwIfNotInRange(highest + shift);
+   }
+
+   if (this->relative)
+      this->labelBase.store(this->labelBase + shift, std::memory_order_release);
+   else
+      this->rekey(shift);
 }
 
 void
 AddressPool::rebase
 (Label newBase)
 {
+   ShardLock lock(this);
    std::uintptr_t currentSize = this->size();
    Label newMax = newBase + currentSize;
    std::intptr_t delta = newBase - this->minLabel;
@@ -450,6 +828,147 @@ AddressPool::throwIfNoIdentity
       throw NoSuchIdentityException(*const_cast<AddressPool *>(this), identity);
 }
 
+SIZE_T
+AddressPool::shardOf
+(Label storedLabel) const noexcept
+{
+   std::uint64_t mixed;
+   
+   if (this->shardCount == 1)
+      return 0;
+
+   /* neighboring labels are usually only a few bytes apart, so scramble the
+      bits before picking a shard */
+   mixed = static_cast<std::uint64_t>(storedLabel) * 0x9E3779B97F4A7C15ULL;
+   
+   return static_cast<SIZE_T>((mixed >> 32) % this->shardCount);
+}
+
+bool
+AddressPool::extents
+(Label *lowest, Label *highest) const noexcept
+{
+   bool found = false;
+
+   for (SIZE_T i=0; i<this->shardCount; ++i)
+   {
+      const LabelMap &labels = this->shards[i].labels;
+      LabelMap::const_iterator lowIter, highIter;
+      
+      if (labels.size() == 0)
+         continue;
+
+      /* stored labels can wrap around relative to the base, so the lowest
+         label is the first one stored at or after the minimum of the range. */
+      lowIter = labels.lower_bound(this->minLabel - this->labelBase);
+
+      if (lowIter == labels.end())
+         lowIter = labels.begin();
+
+      highIter = (lowIter == labels.begin()) ? labels.end() : lowIter;
+      --highIter;
+
+      if (!found || lowIter->first + this->labelBase < *lowest)
+         *lowest = lowIter->first + this->labelBase;
+
+      if (!found || highIter->first + this->labelBase > *highest)
+         *highest = highIter->first + this->labelBase;
+
+      found = true;
+   }
+
+   return found;
+}
+
+void
+AddressPool::rekey
+(Label delta)
+{
+   std::vector<Identity> identities;
+
+   /* only call this with every shard held. every stored label moves by the
+      delta, which can land identities in a different shard, so rebuild the
+      tables from scratch. */
+   if (delta == 0)
+      return;
+
+   for (SIZE_T i=0; i<this->shardCount; ++i)
+   {
+      identities.insert(identities.end(), this->shards[i].identities.begin(), this->shards[i].identities.end());
+      this->shards[i].identities.clear();
+      this->shards[i].labels.clear();
+   }
+
+   for (std::vector<Identity>::iterator identIter=identities.begin(); identIter!=identities.end(); ++identIter)
+   {
+      Identity identity = *identIter;
+      Label storedLabel;
+      SIZE_T shard;
+
+      storedLabel = AddressPool::storedLabel(identity).load(std::memory_order_relaxed) + delta;
+      AddressPool::storedLabel(identity).store(storedLabel, std::memory_order_relaxed);
+      shard = this->shardOf(storedLabel);
+      
+      reinterpret_cast<IdentitySlot *>(identity)->shard = shard;
+      this->shards[shard].identities.insert(identity);
+      this->shards[shard].labels[storedLabel].insert(identity);
+   }
+}
+
+void
+AddressPool::relocate
+(Identity identity, SIZE_T shard)
+{
+   IdentitySlot *slot = reinterpret_cast<IdentitySlot *>(identity);
+
+   /* only call this with both shards held */
+   if (slot->shard == shard)
+      return;
+
+   this->shards[slot->shard].identities.erase(identity);
+   this->shards[shard].identities.insert(identity);
+   slot->shard = shard;
+}
+
+bool
+AddressPool::isLabeled
+(const Identity identity) const noexcept
+{
+   ShardLock lock(this, identity);
+   const LabelMap &labels = this->shards[reinterpret_cast<IdentitySlot *>(identity)->shard].labels;
+   LabelMap::const_iterator labelIter = labels.find(AddressPool::storedLabel(identity).load(std::memory_order_relaxed));
+
+   /* a stored label of 0 is perfectly valid in relative mode, so check the
+      label map rather than the value. */
+   if (labelIter == labels.end())
+      return false;
+
+   return labelIter->second.find(identity) != labelIter->second.end();
+}
+
+Label
+AddressPool::resolve
+(const Identity identity) const noexcept
+{
+   /* no lock here. the stored label is atomic, and the base only moves while
+      every shard is held. */
+   return AddressPool::storedLabel(identity).load(std::memory_order_relaxed) + this->labelBase.load(std::memory_order_acquire);
+}
+
+Address *&
+AddressPool::boundAddresses
+(const Identity identity) noexcept
+{
+   return reinterpret_cast<IdentitySlot *>(identity)->bindings;
+}
+
+std::atomic<Label> &
+AddressPool::storedLabel
+(const Identity identity) noexcept
+{
+   return reinterpret_cast<IdentitySlot *>(identity)->label;
+}
+
 Identity
 AddressPool::getIdentity
 (const LPVOID pointer) const
@@ -461,16 +980,35 @@ Identity
 AddressPool::getIdentity
 (Label label) const
 {
+   Identity identity = this->tryGetIdentity(label);
+
+   if (identity != NULL)
+      return identity;
+   
    this->throwIfNotInRange(label);
    this->throwIfNoLabel(label);
 
-   /* douchebag C++:
-      >wants you to enforce const correctness
-      >won't properly enforce const correctness on the stl
+   return NULL;
+}
+
+Identity
+AddressPool::tryGetIdentity
+(Label label) const noexcept
+{
+   ShardLock lock(this, label);
+   Label storedLabel = label - this->labelBase;
+   const LabelMap &labels = this->shards[this->shardOf(storedLabel)].labels;
+   LabelMap::const_iterator labelIter;
 
-      buddy why can't you just return a const reference for std::map::operator[]() const
-    */
-   return *this->labels.at(label).begin();
+   if (!this->inRange(label))
+      return NULL;
+
+   labelIter = labels.find(storedLabel);
+
+   if (labelIter == labels.end())
+      return NULL;
+
+   return *labelIter->second.begin();
 }
 
 Identity
@@ -484,12 +1022,15 @@ Identity
 AddressPool::newIdentity
 (Label label)
 {
+   ShardLock lock(this, label);
    Identity newIdentity;
+   SIZE_T shard;
 
    this->throwIfNotInRange(label);
 
-   newIdentity = new Label(0);
-   this->identities.insert(newIdentity);
+   shard = this->shardOf(label - this->labelBase);
+   newIdentity = this->allocateIdentity(shard);
+   this->shards[shard].identities.insert(newIdentity);
    this->identify(newIdentity, label);
 
    return newIdentity;
@@ -499,25 +1040,82 @@ void
 AddressPool::releaseIdentity
 (Identity identity)
 {
-   BindingMap::iterator bindingIter;
-   LabelMap::iterator labelIter;
+   ShardLock lock(this, identity);
+   Address *address;
    
    this->throwIfNoIdentity(identity);
 
-   while ((bindingIter = this->bindings.find(identity)) != this->bindings.end())
-   {
-      AddressSet::iterator addrIter = bindingIter->second.begin();
-      this->unbind(*addrIter);
-   }
+   while ((address = AddressPool::boundAddresses(identity)) != NULL)
+      this->unbind(address);
 
    /* if the unbinding of all its addresses killed the identity, we're done here. */
    if (!this->hasIdentity(identity))
       return;
 
-   if (this->labels.count(*identity) > 0)
+   if (this->isLabeled(identity))
       this->unidentify(identity);
 
-   delete identity;
+   this->shards[reinterpret_cast<IdentitySlot *>(identity)->shard].identities.erase(identity);
+   this->freeIdentity(identity);
+}
+
+Identity
+AddressPool::allocateIdentity
+(SIZE_T shard)
+{
+   Shard &owner = this->shards[shard];
+   Identity identity;
+   SIZE_T slabSize;
+
+   if (owner.freeIdentities == NULL)
+   {
+      IdentitySlot *slab;
+
+      /* most pools (every allocation has one) only ever hold a handful of
+         identities, so start the slabs off small and double them from there. */
+      slabSize = AddressPool::FirstIdentitySlabSize;
+
+      for (SIZE_T i=0; i<owner.identitySlabs.size() && slabSize < AddressPool::IdentitySlabSize; ++i)
+         slabSize <<= 1;
+
+      slab = new IdentitySlot[slabSize];
+
+      /* free identities hold the address of the next free identity in place
+         of a label. */
+      for (SIZE_T i=0; i<slabSize; ++i)
+      {
+         if (i+1 < slabSize)
+            slab[i].label.store(reinterpret_cast<Label>(&slab[i+1].label), std::memory_order_relaxed);
+         else
+            slab[i].label.store(0, std::memory_order_relaxed);
+
+         slab[i].bindings = NULL;
+         slab[i].shard = shard;
+      }
+
+      owner.identitySlabs.push_back(slab);
+      owner.freeIdentities = reinterpret_cast<Identity>(&slab[0].label);
+   }
+
+   identity = owner.freeIdentities;
+   owner.freeIdentities = reinterpret_cast<Identity>(AddressPool::storedLabel(identity).load(std::memory_order_relaxed));
+   AddressPool::storedLabel(identity).store(0, std::memory_order_relaxed);
+   AddressPool::boundAddresses(identity) = NULL;
+   reinterpret_cast<IdentitySlot *>(identity)->shard = shard;
+
+   return identity;
+}
+
+void
+AddressPool::freeIdentity
+(Identity identity)
+{
+   /* slabs are only ever freed with the pool, so the slot can go back on
+      whichever shard it lives in now. */
+   Shard &owner = this->shards[reinterpret_cast<IdentitySlot *>(identity)->shard];
+   
+   AddressPool::storedLabel(identity).store(reinterpret_cast<Label>(owner.freeIdentities), std::memory_order_relaxed);
+   owner.freeIdentities = identity;
 }
 
 Address
@@ -531,122 +1129,207 @@ AddressPool::newAddress
    return newAddress;
 }
 
+Identity
+AddressPool::acquire
+(Address *address, Label label)
+{
+   /* finding the identity and binding to it have to happen under the same
+      lock, otherwise the identity could be released in between. */
+   ShardLock lock(this, label);
+   Identity identity;
+
+   this->throwIfNotInRange(label);
+
+   identity = this->tryGetIdentity(label);
+
+   if (identity == NULL)
+      identity = this->newIdentity(label);
+
+   this->bind(address, identity);
+   
+   return identity;
+}
+
 void
 AddressPool::bind
 (Address *address, Identity identity)
 {
+   ShardLock lock(this, identity);
+   
    this->throwIfNoIdentity(identity);
 
-   if (this->bindings.count(identity) > 0 && this->bindings[identity].find(address) != this->bindings[identity].end())
+   if (this->isBound(*address))
       throw AddressAlreadyBoundException(*this, *address);
 
-   this->bindings[identity].insert(address);
-   address->identity = identity;
+   this->attach(address, identity);
+}
+
+void
+AddressPool::rebind
+(Address *address, Identity identity)
+{
+   this->throwIfNoIdentity(identity);
+
+   /* the old and new identities can live in different shards, so leave one
+      before binding in the other. */
+   if (this->isBound(*address))
+   {
+      this->unbind(address);
+      address->pool = this;
+   }
+
+   this->bind(address, identity);
+}
+
+void
+AddressPool::unbind
+(Address *address)
+{
+   ShardLock lock(this, address->identity);
+   Identity identity;
+
+   this->throwIfNotBound(*address);
+
+   identity = address->identity;
+   this->detach(address);
+
+   address->pool = NULL;
+   address->identity = NULL;
+
+   if (AddressPool::boundAddresses(identity) == NULL)
+      this->releaseIdentity(identity);
+}
+
+void
+AddressPool::unbindOutOfBounds
+(void)
+{
+   ShardLock lock(this);
+   Label lowKey = this->minLabel - this->labelBase;
+   Label highKey = this->maxLabel - this->labelBase;
+
+   /* labels are ordered within each shard, so whatever is out of range can
+      be found with a pair of range queries rather than a pass over every
+      identity. */
+   for (SIZE_T i=0; i<this->shardCount; ++i)
+   {
+      Shard &shard = this->shards[i];
+      LabelMap::iterator lowIter = shard.labels.lower_bound(lowKey);
+      LabelMap::iterator highIter = shard.labels.upper_bound(highKey);
+
+      if (lowKey <= highKey)
+      {
+         this->evict(shard, shard.labels.begin(), lowIter);
+         this->evict(shard, highIter, shard.labels.end());
+      }
+      else
+      {
+         /* the range wraps around the base in stored labels, so everything
+            out of range sits between the two bounds. */
+         this->evict(shard, highIter, lowIter);
+      }
+   }
 }
 
 void
-AddressPool::rebind
-(Address *address, Identity identity)
+AddressPool::evict
+(Shard &shard, LabelMap::iterator first, LabelMap::iterator last)
 {
-   Identity assoc;
-
-   this->throwIfNoIdentity(identity);
-
-   assoc = address->identity;
-
-   if (this->bindings.count(assoc) > 0 && this->bindings[assoc].find(address) != this->bindings[assoc].end())
+   /* only call this with every shard held. the addresses are cut loose and
+      the identities freed in bulk, so nothing gets looked up twice. */
+   for (LabelMap::iterator labelIter=first; labelIter!=last; ++labelIter)
    {
-      this->bindings[assoc].erase(address);
-
-      if (this->bindings[assoc].size() == 0)
-         this->bindings.erase(assoc);
+      for (IdentitySet::iterator identIter=labelIter->second.begin();
+           identIter!=labelIter->second.end();
+           ++identIter)
+      {
+         Identity identity = *identIter;
+         Address *address = AddressPool::boundAddresses(identity);
+
+         while (address != NULL)
+         {
+            Address *nextAddress = address->nextBinding;
+
+            address->pool = NULL;
+            address->identity = NULL;
+            address->prevBinding = NULL;
+            address->nextBinding = NULL;
+            address = nextAddress;
+         }
+
+         AddressPool::boundAddresses(identity) = NULL;
+         shard.identities.erase(identity);
+         this->freeIdentity(identity);
+      }
    }
 
-   this->bindings[identity].insert(address);
-   address->identity = identity;
+   shard.labels.erase(first, last);
 }
 
 void
-AddressPool::unbind
-(Address *address)
+AddressPool::attach
+(Address *address, Identity identity)
 {
-   BindingMap::iterator bindIter;
-   AddressSet::iterator addrIter;
-
-   this->throwIfNotBound(*address);
+   Address *&head = AddressPool::boundAddresses(identity);
 
-   this->bindings[address->identity].erase(address);
+   address->prevBinding = NULL;
+   address->nextBinding = head;
 
-   if (this->bindings[address->identity].size() == 0)
-   {
-      this->bindings.erase(address->identity);
-      this->releaseIdentity(address->identity);
-   }
+   if (head != NULL)
+      head->prevBinding = address;
 
-   address->pool = NULL;
-   address->identity = NULL;
+   head = address;
+   address->identity = identity;
 }
 
 void
-AddressPool::unbindOutOfBounds
-(void)
+AddressPool::detach
+(Address *address)
 {
-   BindingMap::iterator bindIter;
-   AddressSet killSet;
-
-   for (bindIter=this->bindings.begin();
-        bindIter!=this->bindings.end();
-        ++bindIter)
-   {
-      if (this->inRange(*bindIter->first))
-         continue;
-
-      for (AddressSet::iterator addrIter=bindIter->second.begin();
-           addrIter!=bindIter->second.end();
-           ++addrIter)
-         killSet.insert(*addrIter);
-   }
+   if (address->prevBinding != NULL)
+      address->prevBinding->nextBinding = address->nextBinding;
+   else
+      AddressPool::boundAddresses(address->identity) = address->nextBinding;
 
-   if (killSet.size() == 0)
-      return;
+   if (address->nextBinding != NULL)
+      address->nextBinding->prevBinding = address->prevBinding;
 
-   for (AddressSet::iterator killIter=killSet.begin();
-        killIter!=killSet.end();
-        ++killIter)
-      this->unbind(*killIter);
+   address->prevBinding = NULL;
+   address->nextBinding = NULL;
 }
 
 void
 AddressPool::identify
 (Identity identity, Label label)
 {
+   ShardLock lock(this, identity, label);
+   Label storedLabel;
+   SIZE_T shard;
+   
    if (identity == NULL)
       throw NullIdentityException(*this);
 
    this->throwIfNoIdentity(identity);
    this->throwIfNotInRange(label);
    
-   if (this->labels.count(label) == 0)
-      this->labels[label] = std::set<Identity>();
-
-   if (*identity != 0)
-   {
-      if (this->labels.count(*identity) > 0 && this->labels[*identity].find(identity) != this->labels[*identity].end())
-         throw IdentityAlreadyLabeledException(*this, identity);
+   if (this->isLabeled(identity))
+      throw IdentityAlreadyLabeledException(*this, identity);
 
-      if (this->labels[label].find(identity) != this->labels[label].end())
-         throw IdentityAlreadyLabeledException(*this, identity);
-   }
+   storedLabel = label - this->labelBase;
+   shard = this->shardOf(storedLabel);
 
-   this->labels[label].insert(identity);
-   *identity = label;
+   this->relocate(identity, shard);
+   this->shards[shard].labels[storedLabel].insert(identity);
+   AddressPool::storedLabel(identity).store(storedLabel, std::memory_order_relaxed);
 }
 
 void
 AddressPool::reidentify
 (Identity identity, Label newLabel)
 {
-   LabelMap::iterator labelIter;
+   ShardLock lock(this, identity, newLabel);
+   Label storedLabel;
+   SIZE_T shard;
    
    if (identity == NULL)
       throw NullIdentityException(*this);
@@ -655,58 +1338,57 @@ AddressPool::reidentify
    this->throwIfNotInRange(newLabel);
 
    /* this identity hasn't been labeled. label it and leave. */
-   if (*identity == 0)
+   if (!this->isLabeled(identity))
       return this->identify(identity, newLabel);
 
-   /* find the identity set associated with this identity's label. if it's found,
-      find if the identity is in the identity set. if it is, erase it. */
-   if (this->labels.count(*identity) > 0)
+   /* isLabeled guarantees the identity sits under its label, so pull it out. */
    {
-      std::set<Identity>::iterator identityIter;
-      identityIter = this->labels[*identity].find(identity);
-      
-      if (identityIter != this->labels[*identity].end())
-      {
-         this->labels[*identity].erase(identity);
+      LabelMap &labels = this->shards[reinterpret_cast<IdentitySlot *>(identity)->shard].labels;
+      LabelMap::iterator labelIter = labels.find(AddressPool::storedLabel(identity).load(std::memory_order_relaxed));
 
-         if (this->labels[*identity].size() == 0)
-            this->labels.erase(*identity);
-      }
+      labelIter->second.erase(identity);
+
+      if (labelIter->second.size() == 0)
+         labels.erase(labelIter);
    }
 
-   if (this->labels.count(newLabel) == 0)
-      this->labels[newLabel] = std::set<Identity>();
+   storedLabel = newLabel - this->labelBase;
+   shard = this->shardOf(storedLabel);
 
-   this->labels[newLabel].insert(identity);
-   *identity = newLabel;
+   this->relocate(identity, shard);
+   this->shards[shard].labels[storedLabel].insert(identity);
+   AddressPool::storedLabel(identity).store(storedLabel, std::memory_order_relaxed);
 }
 
 void
 AddressPool::unidentify
 (Identity identity)
 {
+   ShardLock lock(this, identity);
    LabelMap::iterator labelIter;
+   Shard *shard;
    
    if (identity == NULL)
       throw NullIdentityException(*this);
 
    this->throwIfNoIdentity(identity);
 
-   labelIter = this->labels.find(*identity);
+   shard = &this->shards[reinterpret_cast<IdentitySlot *>(identity)->shard];
+   labelIter = shard->labels.find(AddressPool::storedLabel(identity).load(std::memory_order_relaxed));
 
-   if (labelIter == this->labels.end())
+   if (labelIter == shard->labels.end())
       throw IdentityNotLabeledException(*this, identity);
 
    if (labelIter->second.find(identity) == labelIter->second.end())
       throw IdentityNotLabeledException(*this, identity);
 
-   this->labels[*identity].erase(identity);
+   labelIter->second.erase(identity);
 
-   if (this->labels[*identity].size() == 0)
-      this->labels.erase(*identity);
+   if (labelIter->second.size() == 0)
+      shard->labels.erase(labelIter);
 
-   this->identities.erase(identity);
-   *identity = 0;
+   shard->identities.erase(identity);
+   AddressPool::storedLabel(identity).store(0, std::memory_order_relaxed);
 }
 
 Address::Exception::Exception
@@ -746,6 +1428,8 @@ Address::Address
 (AddressPool *pool)
    : pool(pool)
    , identity(NULL)
+   , prevBinding(NULL)
+   , nextBinding(NULL)
 {
    this->throwIfNoPool();
 }
@@ -754,48 +1438,47 @@ Address::Address
 (void)
    : pool(NULL)
    , identity(NULL)
+   , prevBinding(NULL)
+   , nextBinding(NULL)
 {
 }
 
 Address::Address
 (const LPVOID pointer)
    : pool(&AddressPool::Instance)
+   , identity(NULL)
+   , prevBinding(NULL)
+   , nextBinding(NULL)
 {
-   if (this->pool->hasLabel(pointer))
-      this->identity = this->pool->getIdentity(pointer);
-   else
-      this->identity = this->pool->newIdentity(pointer);
-
-   this->pool->bind(this, this->identity);
+   this->pool->acquire(this, reinterpret_cast<Label>(pointer));
 }
 
 Address::Address
 (Label label)
    : pool(&AddressPool::Instance)
+   , identity(NULL)
+   , prevBinding(NULL)
+   , nextBinding(NULL)
 {
-   if (this->pool->hasLabel(label))
-      this->identity = this->pool->getIdentity(label);
-   else
-      this->identity = this->pool->newIdentity(label);
-
-   this->pool->bind(this, this->identity);
+   this->pool->acquire(this, label);
 }
 
 Address::Address
 (unsigned int lowLabel)
    : pool(&AddressPool::Instance)
+   , identity(NULL)
+   , prevBinding(NULL)
+   , nextBinding(NULL)
 {
-   if (this->pool->hasLabel(lowLabel))
-      this->identity = this->pool->getIdentity(lowLabel);
-   else
-      this->identity = this->pool->newIdentity(lowLabel);
-
-   this->pool->bind(this, this->identity);
+   this->pool->acquire(this, lowLabel);
 }
 
 Address::Address
 (const Address &address)
    : pool(NULL)
+   , identity(NULL)
+   , prevBinding(NULL)
+   , nextBinding(NULL)
 {
    *this = address;
 }
@@ -1193,12 +1876,7 @@ Address::setPool
       return;
 
    if (label != 0)
-   {
-      if (pool->hasLabel(label))
-         pool->bind(this, pool->getIdentity(label));
-      else
-         pool->bind(this, pool->newIdentity(label));
-   }
+      pool->acquire(this, label);
 }         
 
 Label
@@ -1207,7 +1885,7 @@ Address::label
 {
    this->throwIfNull();
    
-   return *this->identity;
+   return this->pool->resolve(this->identity);
 }
 
 void
@@ -1583,3 +2261,328 @@ Offset::copy
 {
    return Offset(*const_cast<Address *>(reinterpret_cast<const Address *>(this)), this->offset);
 }
+
+RawAddress::Exception::Exception
+(const Label label, const LPWSTR message)
+   : Neurology::Exception(message)
+   , label(label)
+{
+}
+
+RawAddress::AddressUnderflowException::AddressUnderflowException
+(const Label label, const std::intptr_t shift)
+   : RawAddress::Exception(label, EXCSTR(L"Shift value underflowed the address."))
+   , shift(shift)
+{
+}
+
+RawAddress::AddressOverflowException::AddressOverflowException
+(const Label label, const std::intptr_t shift)
+   : RawAddress::Exception(label, EXCSTR(L"Shift value overflowed the address."))
+   , shift(shift)
+{
+}
+
+RawAddress::RawAddress
+(void)
+   : value(0)
+{
+}
+
+RawAddress::RawAddress
+(const LPVOID pointer)
+   : value(reinterpret_cast<Label>(pointer))
+{
+}
+
+RawAddress::RawAddress
+(Label label)
+   : value(label)
+{
+}
+
+RawAddress::RawAddress
+(unsigned int lowLabel)
+   : value(lowLabel)
+{
+}
+
+RawAddress::RawAddress
+(const Address &address)
+   : value((address.isNull()) ? 0 : address.label())
+{
+}
+
+RawAddress::RawAddress
+(const Offset &offset)
+   : value((offset.isNull()) ? 0 : offset.label())
+{
+}
+
+RawAddress
+RawAddress::Null
+(void)
+{
+   return RawAddress();
+}
+
+RawAddress::operator Label
+(void) const
+{
+   return this->value;
+}
+
+bool
+RawAddress::operator<
+(const RawAddress &address) const
+{
+   return this->value < address.value;
+}
+
+bool
+RawAddress::operator<
+(Label label) const
+{
+   return this->value < label;
+}
+
+bool
+RawAddress::operator>
+(const RawAddress &address) const
+{
+   return this->value > address.value;
+}
+
+bool
+RawAddress::operator>
+(Label label) const
+{
+   return this->value > label;
+}
+
+bool
+RawAddress::operator==
+(const RawAddress &address) const
+{
+   return this->value == address.value;
+}
+
+bool
+RawAddress::operator==
+(Label label) const
+{
+   return this->value == label;
+}
+
+bool
+RawAddress::operator!=
+(const RawAddress &address) const
+{
+   return this->value != address.value;
+}
+
+bool
+RawAddress::operator!=
+(Label label) const
+{
+   return this->value != label;
+}
+
+bool
+RawAddress::operator<=
+(const RawAddress &address) const
+{
+   return this->value <= address.value;
+}
+
+bool
+RawAddress::operator<=
+(Label label) const
+{
+   return this->value <= label;
+}
+
+bool
+RawAddress::operator>=
+(const RawAddress &address) const
+{
+   return this->value >= address.value;
+}
+
+bool
+RawAddress::operator>=
+(Label label) const
+{
+   return this->value >= label;
+}
+
+RawAddress
+RawAddress::operator+
+(std::intptr_t shift) const
+{
+   std::uintptr_t newValue = this->value + shift;
+
+   if (shift > 0 && newValue < this->value)
+      throw AddressOverflowException(this->value, shift);
+   else if (shift < 0 && newValue > this->value)
+      throw AddressUnderflowException(this->value, shift);
+
+   return RawAddress(newValue);
+}
+
+RawAddress
+RawAddress::operator+
+(std::uintptr_t shift) const
+{
+   std::uintptr_t newValue = this->value + shift;
+
+   if (newValue < this->value)
+      throw AddressOverflowException(this->value, shift);
+
+   return RawAddress(newValue);
+}
+
+RawAddress
+RawAddress::operator+
+(int shift) const
+{
+   return this->operator+(static_cast<std::intptr_t>(shift));
+}
+
+RawAddress
+RawAddress::operator-
+(std::intptr_t shift) const
+{
+   std::uintptr_t newValue = this->value - shift;
+
+   if (shift > 0 && newValue > this->value)
+      throw AddressUnderflowException(this->value, shift);
+   else if (shift < 0 && newValue < this->value)
+      throw AddressOverflowException(this->value, shift);
+
+   return RawAddress(newValue);
+}
+
+RawAddress
+RawAddress::operator-
+(std::uintptr_t shift) const
+{
+   std::uintptr_t newValue = this->value - shift;
+
+   if (newValue > this->value)
+      throw AddressUnderflowException(this->value, shift);
+
+   return RawAddress(newValue);
+}
+
+RawAddress
+RawAddress::operator-
+(int shift) const
+{
+   return this->operator-(static_cast<std::intptr_t>(shift));
+}
+
+std::intptr_t
+RawAddress::operator-
+(const RawAddress &address) const
+{
+   return this->value - address.value;
+}
+
+RawAddress &
+RawAddress::operator+=
+(std::intptr_t shift)
+{
+   *this = *this + shift;
+   return *this;
+}
+
+RawAddress &
+RawAddress::operator+=
+(std::uintptr_t shift)
+{
+   *this = *this + shift;
+   return *this;
+}
+
+RawAddress &
+RawAddress::operator+=
+(int shift)
+{
+   return this->operator+=(static_cast<std::intptr_t>(shift));
+}
+
+RawAddress &
+RawAddress::operator-=
+(std::intptr_t shift)
+{
+   *this = *this - shift;
+   return *this;
+}
+
+RawAddress &
+RawAddress::operator-=
+(std::uintptr_t shift)
+{
+   *this = *this - shift;
+   return *this;
+}
+
+RawAddress &
+RawAddress::operator-=
+(int shift)
+{
+   return this->operator-=(static_cast<std::intptr_t>(shift));
+}
+
+LPVOID
+RawAddress::pointer
+(void) const
+{
+   return reinterpret_cast<LPVOID>(this->value);
+}
+
+bool
+RawAddress::isNull
+(void) const noexcept
+{
+   return this->value == 0;
+}
+
+Label
+RawAddress::label
+(void) const noexcept
+{
+   return this->value;
+}
+
+void
+RawAddress::move
+(const LPVOID pointer)
+{
+   this->move(reinterpret_cast<Label>(pointer));
+}
+
+void
+RawAddress::move
+(Label newLabel)
+{
+   this->value = newLabel;
+}
+
+Address
+RawAddress::promote
+(void) const
+{
+   return this->promote(&AddressPool::Instance);
+}
+
+Address
+RawAddress::promote
+(AddressPool *pool) const
+{
+   if (pool == NULL)
+      return Address();
+
+   return pool->address(this->value);
+}
@@ -0,0 +1,256 @@
+#include <neurology/allocators/arena.hpp>
+
+using namespace Neurology;
+
+ArenaAllocator::Exception::Exception
+(ArenaAllocator &allocator, const LPWSTR message)
+   : Allocator::Exception(allocator, message)
+{
+}
+
+ArenaAllocator::ArenaAllocator
+(void)
+   : Allocator()
+   , chunkSize(ArenaAllocator::DefaultChunkSize)
+   , currentChunk(0)
+   , cursor(0)
+{
+   this->local = true;
+}
+
+ArenaAllocator::ArenaAllocator
+(SIZE_T chunkSize)
+   : Allocator()
+   , chunkSize(chunkSize)
+   , currentChunk(0)
+   , cursor(0)
+{
+   if (chunkSize == 0)
+      throw ZeroSizeException(*this);
+
+   this->local = true;
+}
+
+ArenaAllocator::~ArenaAllocator
+(void)
+{
+   ChunkList::iterator chunkIter;
+
+   /* the base destructor would unpool everything one at a time, which is
+      exactly what the arena is here to avoid. */
+   this->reset();
+
+   for (chunkIter=this->chunks.begin(); chunkIter!=this->chunks.end(); ++chunkIter)
+      delete[] chunkIter->base;
+
+   this->chunks.clear();
+}
+
+SIZE_T
+ArenaAllocator::chunkCount
+(void) const noexcept
+{
+   return this->chunks.size();
+}
+
+SIZE_T
+ArenaAllocator::capacity
+(void) const noexcept
+{
+   ChunkList::const_iterator chunkIter;
+   SIZE_T total = 0;
+
+   for (chunkIter=this->chunks.begin(); chunkIter!=this->chunks.end(); ++chunkIter)
+      total += chunkIter->size;
+
+   return total;
+}
+
+void
+ArenaAllocator::reset
+(void)
+{
+   SIZE_T chunk;
+
+   /* unbinding doesn't unpool anything, so whatever the policy wants wiped
+      on free has to be wiped here: every chunk carved so far, up to the
+      cursor of the current one. */
+   if (this->zeroesOnUnpool())
+   {
+      for (chunk=0; chunk<this->currentChunk && chunk<this->chunks.size(); ++chunk)
+         this->zeroOnUnpool(RawAddress(this->chunks[chunk].base), this->chunks[chunk].size);
+
+      if (this->currentChunk < this->chunks.size())
+         this->zeroOnUnpool(RawAddress(this->chunks[this->currentChunk].base), this->cursor);
+   }
+
+   this->unbindAll();
+
+   this->currentChunk = 0;
+   this->cursor = 0;
+}
+
+Address
+ArenaAllocator::poolAddress
+(SIZE_T size)
+{
+   LPBYTE block = this->carve(size);
+
+   this->zeroOnPool(RawAddress(block), size);
+
+   return this->pooledAddresses.address(block);
+}
+
+Address
+ArenaAllocator::repoolAddress
+(Address &address, SIZE_T newSize)
+{
+   Address newAddress;
+   LPBYTE block;
+   SIZE_T oldSize, offset;
+
+   this->throwIfNotPooled(address);
+
+   block = static_cast<LPBYTE>(address.pointer());
+   oldSize = this->pooledMemory[address];
+
+   /* the most recent allocation can grow or shrink in place if its chunk has room */
+   if (this->isTop(block, oldSize))
+   {
+      offset = block - this->chunks[this->currentChunk].base;
+
+      if (newSize <= this->chunks[this->currentChunk].size - offset)
+      {
+         if (newSize > oldSize)
+            this->zeroOnPool(RawAddress(block+oldSize), newSize-oldSize);
+         else
+            this->zeroOnUnpool(RawAddress(block+newSize), oldSize-newSize);
+
+         this->cursor = offset + newSize;
+         return address;
+      }
+   }
+
+   /* only the part of the new block which doesn't get copied over needs zeroing */
+   newAddress = this->pooledAddresses.address(this->carve(newSize));
+   this->writeAddressFrom(newAddress, block, min(oldSize, newSize));
+
+   if (newSize > oldSize)
+      this->zeroOnPool(RawAddress(newAddress.label()+oldSize), newSize-oldSize);
+
+   this->unpoolAddress(address);
+
+   return newAddress;
+}
+
+void
+ArenaAllocator::unpoolAddress
+(Address &address)
+{
+   LPBYTE block;
+   SIZE_T size;
+
+   this->throwIfNotPooled(address);
+
+   block = static_cast<LPBYTE>(address.pointer());
+   size = this->pooledMemory[address];
+
+   this->zeroOnUnpool(address, size);
+
+   /* only the most recent allocation can be given back, everything else
+      waits for the next reset. */
+   if (this->isTop(block, size))
+      this->cursor = block - this->chunks[this->currentChunk].base;
+
+   this->pooledMemory.erase(address);
+}
+
+void
+ArenaAllocator::readAddressInto
+(const RawAddress &address, LPVOID destination, SIZE_T size) const
+{
+   LONG status;
+
+   status = CopyData(destination, address.pointer(), size);
+
+   if (status != 0)
+      throw KernelFaultException(status
+                                 ,address.promote()
+                                 ,Address(destination)
+                                 ,size);
+}
+
+void
+ArenaAllocator::writeAddressFrom
+(const RawAddress &destination, LPCVOID source, SIZE_T size)
+{
+   LONG status;
+
+   status = CopyData(destination.pointer(), const_cast<LPVOID>(source), size);
+
+   if (status != 0)
+      throw KernelFaultException(status
+                                 ,Address(const_cast<LPVOID>(source))
+                                 ,destination.promote()
+                                 ,size);
+}
+
+void
+ArenaAllocator::zeroAddressRange
+(const RawAddress &address, SIZE_T size, bool secure)
+{
+   if (secure)
+      SecureZeroMemory(address.pointer(), size);
+   else
+      ZeroMemory(address.pointer(), size);
+}
+
+LPBYTE
+ArenaAllocator::carve
+(SIZE_T size)
+{
+   Chunk chunk;
+   SIZE_T offset;
+
+   /* look for room in the current chunk, then in whatever chunks are left
+      over from before the last reset. */
+   while (this->currentChunk < this->chunks.size())
+   {
+      Chunk &current = this->chunks[this->currentChunk];
+
+      offset = (this->cursor + ArenaAllocator::Alignment - 1) & ~(ArenaAllocator::Alignment - 1);
+
+      if (offset <= current.size && size <= current.size - offset)
+      {
+         this->cursor = offset + size;
+         return current.base + offset;
+      }
+
+      ++this->currentChunk;
+      this->cursor = 0;
+   }
+
+   chunk.size = max(this->chunkSize, size);
+   chunk.base = new BYTE[chunk.size];
+   this->chunks.push_back(chunk);
+
+   this->currentChunk = this->chunks.size() - 1;
+   this->cursor = size;
+
+   return chunk.base;
+}
+
+bool
+ArenaAllocator::isTop
+(LPBYTE block, SIZE_T size) const noexcept
+{
+   const Chunk *current;
+
+   if (this->currentChunk >= this->chunks.size())
+      return false;
+
+   current = &this->chunks[this->currentChunk];
+
+   /* chunks can sit right next to each other, so make sure it's actually ours */
+   return block >= current->base && block + size == current->base + this->cursor;
+}
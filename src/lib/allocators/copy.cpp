@@ -0,0 +1,205 @@
+#include <neurology/allocators/copy.hpp>
+#include <neurology/exception.hpp>
+
+#ifndef _WIN32
+#include <atomic>
+
+#include <setjmp.h>
+#include <signal.h>
+#endif
+
+using namespace Neurology;
+
+namespace
+{
+   /*
+     the leading bytes of a copy that certainly come before the page which
+     faulted, or 0 if the fault wasn't in either buffer. it's always less
+     than the size, since the faulting address itself is inside the copy.
+   */
+   SIZE_T FaultOffset(const BYTE *destination, const BYTE *source, SIZE_T size, ULONG_PTR faultAddress)
+   {
+      ULONG_PTR page = faultAddress - faultAddress % CopyPageSize;
+      ULONG_PTR base;
+
+      if (faultAddress >= reinterpret_cast<ULONG_PTR>(destination) && faultAddress < reinterpret_cast<ULONG_PTR>(destination+size))
+         base = reinterpret_cast<ULONG_PTR>(destination);
+      else if (faultAddress >= reinterpret_cast<ULONG_PTR>(source) && faultAddress < reinterpret_cast<ULONG_PTR>(source+size))
+         base = reinterpret_cast<ULONG_PTR>(source);
+      else
+         return 0;
+
+      return (page > base) ? page - base : 0;
+   }
+
+#ifndef _WIN32
+   /* what a fault looks like on Windows, so callers see the same statuses everywhere */
+   const LONG AccessViolation = static_cast<LONG>(0xC0000005);
+   const LONG InPageError = static_cast<LONG>(0xC0000006);
+
+   struct FaultGuard
+   {
+      sigjmp_buf context;
+      volatile int signal;
+      volatile ULONG_PTR address;
+   };
+
+   /* only the signal handler reads the guard while it's set, which the
+      compiler can't see, so it has to be volatile or setting it gets dropped */
+   thread_local FaultGuard *volatile ActiveGuard = NULL;
+   struct sigaction PreviousSegmentationAction, PreviousBusAction;
+
+   void FaultHandler(int signal, siginfo_t *info, void *context)
+   {
+      FaultGuard *guard = ActiveGuard;
+      struct sigaction *previous;
+
+      if (guard != NULL)
+      {
+         ActiveGuard = NULL;
+         guard->signal = signal;
+         guard->address = reinterpret_cast<ULONG_PTR>(info->si_addr);
+         siglongjmp(guard->context, 1);
+      }
+
+      /* not our fault, so it goes to whoever was handling it before */
+      previous = (signal == SIGBUS) ? &PreviousBusAction : &PreviousSegmentationAction;
+
+      if ((previous->sa_flags & SA_SIGINFO) != 0)
+         previous->sa_sigaction(signal, info, context);
+      else if (previous->sa_handler != SIG_DFL && previous->sa_handler != SIG_IGN)
+         previous->sa_handler(signal);
+      else
+         /* returning with the default back in place lets the fault happen again, fatally */
+         sigaction(signal, previous, NULL);
+   }
+
+   bool InstallFaultHandlers(void)
+   {
+      struct sigaction action;
+
+      ZeroMemory(&action, sizeof(action));
+      action.sa_sigaction = FaultHandler;
+      /* leaving the signal unblocked in the handler spares every copy saving the signal mask */
+      action.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_NODEFER;
+      sigemptyset(&action.sa_mask);
+
+      sigaction(SIGSEGV, &action, &PreviousSegmentationAction);
+      sigaction(SIGBUS, &action, &PreviousBusAction);
+
+      return true;
+   }
+
+   /* one guarded move, returning 0 or the status of the fault and where it hit */
+   LONG GuardedMove(LPVOID destination, LPCVOID source, SIZE_T size, ULONG_PTR *faultAddress)
+   {
+      /*
+        installed on the first copy rather than at load, so they go on top of
+        whatever the program set up. checking they're still in place on every
+        copy would cost two sigaction calls each time, so a handler installed
+        after that takes the faults instead, as the header says.
+      */
+      static const bool FaultHandlersInstalled = InstallFaultHandlers();
+      FaultGuard guard;
+      FaultGuard *outerGuard;
+      LONG status = 0;
+
+      UNUSED(FaultHandlersInstalled);
+
+      /* a copy made from inside another one's signal handler puts the outer guard back after */
+      outerGuard = ActiveGuard;
+
+      if (sigsetjmp(guard.context, 0) == 0)
+      {
+         ActiveGuard = &guard;
+         std::atomic_signal_fence(std::memory_order_seq_cst);
+         MoveMemory(destination, source, size);
+         std::atomic_signal_fence(std::memory_order_seq_cst);
+      }
+      else
+      {
+         status = (guard.signal == SIGBUS) ? InPageError : AccessViolation;
+         *faultAddress = guard.address;
+      }
+
+      ActiveGuard = outerGuard;
+
+      return status;
+   }
+#else
+   /* access violations and in-page errors both say which address they hit */
+   int FaultFilter(EXCEPTION_POINTERS *pointers, ULONG_PTR *faultAddress)
+   {
+      EXCEPTION_RECORD *record = pointers->ExceptionRecord;
+
+      if (record->NumberParameters >= 2)
+         *faultAddress = record->ExceptionInformation[1];
+
+      return EXCEPTION_EXECUTE_HANDLER;
+   }
+
+   LONG GuardedMove(LPVOID destination, LPCVOID source, SIZE_T size, ULONG_PTR *faultAddress)
+   {
+      LONG status = 0; // STATUS_SUCCESS
+
+      __try
+      {
+         MoveMemory(destination, source, size);
+      }
+      __except (FaultFilter(GetExceptionInformation(), faultAddress))
+      {
+         status = GetExceptionCode();
+      }
+
+      return status;
+   }
+#endif
+}
+
+LONG
+Neurology::CopyData
+(LPVOID destination, const LPVOID source, SIZE_T size)
+{
+   SIZE_T copied;
+
+   return CopyData(destination, static_cast<LPCVOID>(source), size, &copied);
+}
+
+LONG
+Neurology::CopyData
+(LPVOID destination, LPCVOID source, SIZE_T size, SIZE_T *copied)
+{
+   LPBYTE destinationBytes = static_cast<LPBYTE>(destination);
+   const BYTE *sourceBytes = static_cast<const BYTE *>(source);
+   bool overlapping = destinationBytes < sourceBytes+size && sourceBytes < destinationBytes+size;
+   ULONG_PTR faultAddress = 0;
+   SIZE_T attempt = size;
+   LONG status;
+
+   status = GuardedMove(destination, source, size, &faultAddress);
+   *copied = (status == 0) ? size : 0;
+
+   /* an overlapping move may have overwritten the source before faulting, so
+      there's nothing left to copy again */
+   if (status == 0 || overlapping)
+      return status;
+
+   /*
+     memmove makes no promise about the order it copies in, so nothing it
+     did before the fault can be counted on. everything short of the page
+     which faulted can be reached, though, so copy that much again, and
+     again for every earlier fault, until a copy goes through. this only
+     ever happens after a fault, so copies which don't fault pay for a
+     single guarded move and nothing else.
+   */
+   while ((attempt = FaultOffset(destinationBytes, sourceBytes, attempt, faultAddress)) > 0)
+   {
+      if (GuardedMove(destination, source, attempt, &faultAddress) == 0)
+      {
+         *copied = attempt;
+         break;
+      }
+   }
+
+   return status;
+}
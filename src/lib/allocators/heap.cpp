@@ -1 +1,528 @@
+#include <neurology/allocators/heap.hpp>
 
+using namespace Neurology;
+
+#ifndef _WIN32
+std::atomic<SIZE_T> PrivateHeap::NextID(1);
+#endif
+
+PrivateHeap::PrivateHeap
+(void)
+#ifdef _WIN32
+   : heap(HeapCreate(0, 0, 0))
+{
+   if (this->heap == NULL)
+      throw Win32Exception(EXCSTR(L"HeapCreate failed."));
+}
+#else
+   : id(PrivateHeap::NextID++)
+   , slabs(NULL)
+{
+   InitializeCriticalSection(&this->lock);
+   this->slabs = new SlabPool(this);
+}
+#endif
+
+PrivateHeap::~PrivateHeap
+(void)
+{
+#ifdef _WIN32
+   HeapDestroy(this->heap);
+#else
+   std::map<LPVOID, SIZE_T>::iterator blockIter;
+
+   /* the slab pool hands its spans back through free(), so it goes first */
+   delete this->slabs;
+
+   /* whatever can't be unmapped is leaked, since a destructor can't throw */
+   for (blockIter=this->blocks.begin(); blockIter!=this->blocks.end(); ++blockIter)
+   {
+      try
+      {
+         VirtualMemory::Free(NULL, blockIter->first, 0, MEM_RELEASE);
+      }
+      catch (...)
+      {
+      }
+   }
+
+   DeleteCriticalSection(&this->lock);
+#endif
+}
+
+HANDLE
+PrivateHeap::handle
+(void) const noexcept
+{
+#ifdef _WIN32
+   return this->heap;
+#else
+   return reinterpret_cast<HANDLE>(this->id);
+#endif
+}
+
+LPVOID
+PrivateHeap::allocate
+(SIZE_T size, bool zero)
+{
+#ifdef _WIN32
+   return HeapAlloc(this->heap, zero ? HEAP_ZERO_MEMORY : 0, size);
+#else
+   LPVOID block;
+   BlockHeader *header;
+   SIZE_T slabSize = PrivateHeap::SlabSize(size);
+
+   if (slabSize != 0)
+   {
+      try
+      {
+         header = static_cast<BlockHeader *>(this->slabs->allocate(slabSize));
+      }
+      catch (Win32Exception &exception)
+      {
+         UNUSED(exception);
+         return NULL;
+      }
+
+      header->heap = this;
+      header->size = size;
+      block = reinterpret_cast<LPBYTE>(header) + PrivateHeap::HeaderSize;
+
+      /* slab blocks get reused, so unlike fresh mappings they need zeroing */
+      if (zero)
+         ZeroMemory(block, size);
+
+      return block;
+   }
+
+   /* fresh mappings always come zeroed, so there's nothing to do for zero */
+   try
+   {
+      block = VirtualMemory::Allocate(NULL, NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+   }
+   catch (Win32Exception &exception)
+   {
+      UNUSED(exception);
+      return NULL;
+   }
+
+   EnterCriticalSection(&this->lock);
+   this->blocks[block] = size;
+   LeaveCriticalSection(&this->lock);
+
+   return block;
+#endif
+}
+
+bool
+PrivateHeap::resize
+(LPVOID block, SIZE_T size, bool zero)
+{
+#ifdef _WIN32
+   return HeapReAlloc(this->heap, HEAP_REALLOC_IN_PLACE_ONLY | (zero ? HEAP_ZERO_MEMORY : 0), block, size) != NULL;
+#else
+   std::map<LPVOID, SIZE_T>::iterator blockIter;
+   BlockHeader *header = this->findHeader(block);
+   SIZE_T pageSize = VirtualMemory::PageSize();
+   SIZE_T mapped, slabSize;
+
+   /* slab blocks can only change size within their class */
+   if (header != NULL)
+   {
+      slabSize = PrivateHeap::SlabSize(size);
+
+      if (slabSize == 0 || SlabPool::sizeClass(slabSize) != SlabPool::sizeClass(PrivateHeap::SlabSize(header->size)))
+         return false;
+
+      if (zero && size > header->size)
+         ZeroMemory(static_cast<LPBYTE>(block) + header->size, size - header->size);
+
+      header->size = size;
+
+      return true;
+   }
+
+   EnterCriticalSection(&this->lock);
+
+   blockIter = this->blocks.find(block);
+
+   if (blockIter == this->blocks.end())
+   {
+      LeaveCriticalSection(&this->lock);
+      return false;
+   }
+
+   mapped = (blockIter->second + pageSize - 1) / pageSize * pageSize;
+
+   if (size > mapped)
+   {
+      LeaveCriticalSection(&this->lock);
+      return false;
+   }
+
+   /* the bytes past the old end were either never touched or left behind by a shrink */
+   if (zero && size > blockIter->second)
+      ZeroMemory(static_cast<LPBYTE>(block) + blockIter->second, size - blockIter->second);
+
+   blockIter->second = size;
+
+   LeaveCriticalSection(&this->lock);
+
+   return true;
+#endif
+}
+
+void
+PrivateHeap::free
+(LPVOID block)
+{
+#ifdef _WIN32
+   if (!HeapFree(this->heap, 0, block))
+      throw Win32Exception(EXCSTR(L"HeapFree failed."));
+#else
+   BlockHeader *header = this->findHeader(block);
+   SIZE_T erased;
+
+   if (header != NULL)
+   {
+      this->slabs->free(header, PrivateHeap::SlabSize(header->size));
+      return;
+   }
+
+   EnterCriticalSection(&this->lock);
+   erased = this->blocks.erase(block);
+   LeaveCriticalSection(&this->lock);
+
+   if (erased == 0)
+      throw Win32Exception(EINVAL, EXCSTR(L"The block doesn't belong to the heap."));
+
+   VirtualMemory::Free(NULL, block, 0, MEM_RELEASE);
+#endif
+}
+
+#ifndef _WIN32
+SIZE_T
+PrivateHeap::SlabSize
+(SIZE_T size) noexcept
+{
+   if (size > SlabPool::MaximumSize - PrivateHeap::HeaderSize)
+      return 0;
+
+   /* rounded to 16 bytes, a block only ever lands in the classes which are
+      multiples of 16, so every block stays aligned behind its header */
+   return (size + PrivateHeap::HeaderSize + 15) & ~static_cast<SIZE_T>(15);
+}
+
+PrivateHeap::BlockHeader *
+PrivateHeap::findHeader
+(LPVOID block) const noexcept
+{
+   std::map<LPVOID, SIZE_T>::const_iterator blockIter;
+   ULONG_PTR blockValue = reinterpret_cast<ULONG_PTR>(block);
+   LPBYTE headerBytes = static_cast<LPBYTE>(block) - PrivateHeap::HeaderSize;
+   BlockHeader *header = reinterpret_cast<BlockHeader *>(headerBytes);
+   bool mapped = false;
+
+   if (block == NULL || blockValue % PrivateHeap::HeaderSize != 0)
+      return NULL;
+
+   /* a block starting a page might be a big block, and its header would be on
+      the page before, which might not be mapped at all. make sure it's inside
+      one of the heap's regions before reading it. */
+   if (blockValue % VirtualMemory::PageSize() == 0)
+   {
+      EnterCriticalSection(&this->lock);
+
+      if (this->blocks.find(block) == this->blocks.end())
+      {
+         blockIter = this->blocks.upper_bound(headerBytes);
+
+         if (blockIter != this->blocks.begin())
+         {
+            --blockIter;
+            mapped = headerBytes < static_cast<LPBYTE>(blockIter->first) + blockIter->second;
+         }
+      }
+
+      LeaveCriticalSection(&this->lock);
+
+      if (!mapped)
+         return NULL;
+   }
+
+   if (header->heap != this)
+      return NULL;
+
+   return header;
+}
+#endif
+
+HeapAllocator::Exception::Exception
+(HeapAllocator &allocator, const LPWSTR message)
+   : Allocator::Exception(allocator, message)
+{
+}
+
+HeapAllocator::HeapAllocator
+(void)
+   : Allocator()
+   , heap(NULL)
+   , slabs(NULL)
+   , liveBytes(0)
+   , peakBytes(0)
+   , largeBytes(0)
+{
+   this->local = true;
+   this->create();
+}
+
+HeapAllocator::~HeapAllocator
+(void)
+{
+   /* like the arena, the base destructor would unpool everything one at a
+      time. the heap is going away anyway, so don't bother. */
+   this->unbindAll();
+   this->release();
+}
+
+HANDLE
+HeapAllocator::handle
+(void) const noexcept
+{
+   return this->heap->handle();
+}
+
+HeapAllocator::Statistics
+HeapAllocator::statistics
+(void) const noexcept
+{
+   Statistics result;
+
+   result.live = this->liveBytes;
+   result.peak = this->peakBytes;
+   result.reserved = this->largeBytes;
+
+   if (this->slabs != NULL)
+      result.reserved += this->slabs->capacity();
+
+   if (result.reserved == 0)
+      result.fragmentation = 0.0;
+   else
+      result.fragmentation = 1.0 - static_cast<double>(result.live) / static_cast<double>(result.reserved);
+
+   return result;
+}
+
+void
+HeapAllocator::destroy
+(void)
+{
+   std::map<Address, SIZE_T>::iterator pooledIter;
+
+   /* unbinding doesn't unpool anything, so wipe what the policy wants wiped
+      before the heap goes away. */
+   if (this->zeroesOnUnpool())
+      for (pooledIter=this->pooledMemory.begin(); pooledIter!=this->pooledMemory.end(); ++pooledIter)
+         this->zeroOnUnpool(pooledIter->first, pooledIter->second);
+
+   this->unbindAll();
+   this->release();
+   this->create();
+}
+
+Address
+HeapAllocator::poolAddress
+(SIZE_T size)
+{
+   return this->pooledAddresses.address(this->allocateBlock(size, this->zeroesOnPool()));
+}
+
+Address
+HeapAllocator::repoolAddress
+(Address &address, SIZE_T newSize)
+{
+   Address newAddress;
+   SIZE_T oldSize;
+   LPBYTE block;
+
+   this->throwIfNotPooled(address);
+
+   oldSize = this->pooledMemory[address];
+   block = static_cast<LPBYTE>(address.pointer());
+
+   /* slab blocks stay put within their size class, and the heap gets a shot
+      at resizing big blocks where they are. */
+   if (SlabPool::isSlabSize(oldSize) && SlabPool::sizeClass(oldSize) == SlabPool::sizeClass(newSize))
+   {
+      if (newSize > oldSize)
+         this->zeroOnPool(RawAddress(block+oldSize), newSize-oldSize);
+      else
+         this->zeroOnUnpool(RawAddress(block+newSize), oldSize-newSize);
+
+      this->track(oldSize, newSize);
+      return address;
+   }
+   else if (!SlabPool::isSlabSize(oldSize)
+            && !SlabPool::isSlabSize(newSize)
+            && this->heap->resize(block, newSize, this->zeroesOnPool()))
+   {
+      this->largeBytes = this->largeBytes - oldSize + newSize;
+      this->track(oldSize, newSize);
+      return address;
+   }
+
+   /* only the part of the new block which doesn't get copied over needs zeroing */
+   newAddress = this->pooledAddresses.address(this->allocateBlock(newSize, false));
+   this->writeAddressFrom(newAddress, block, min(oldSize, newSize));
+
+   if (newSize > oldSize)
+      this->zeroOnPool(RawAddress(newAddress.label()+oldSize), newSize-oldSize);
+
+   this->unpoolAddress(address);
+
+   return newAddress;
+}
+
+void
+HeapAllocator::unpoolAddress
+(Address &address)
+{
+   SIZE_T size = this->forgetAddress(address);
+
+   this->releaseAddress(address, size);
+}
+
+SIZE_T
+HeapAllocator::forgetAddress
+(Address &address)
+{
+   SIZE_T size;
+
+   this->throwIfNotPooled(address);
+
+   size = this->pooledMemory[address];
+
+   if (!SlabPool::isSlabSize(size))
+      this->largeBytes -= size;
+
+   this->track(size, 0);
+   this->pooledMemory.erase(address);
+
+   return size;
+}
+
+void
+HeapAllocator::releaseAddress
+(const RawAddress &address, SIZE_T size)
+{
+   this->zeroOnUnpool(address, size);
+
+   if (SlabPool::isSlabSize(size))
+      this->slabs->free(address.pointer(), size);
+   else
+      this->heap->free(address.pointer());
+}
+
+void
+HeapAllocator::readAddressInto
+(const RawAddress &address, LPVOID destination, SIZE_T size) const
+{
+   LONG status;
+
+   status = CopyData(destination, address.pointer(), size);
+
+   if (status != 0)
+      throw KernelFaultException(status
+                                 ,address.promote()
+                                 ,Address(destination)
+                                 ,size);
+}
+
+void
+HeapAllocator::writeAddressFrom
+(const RawAddress &destination, LPCVOID source, SIZE_T size)
+{
+   LONG status;
+
+   status = CopyData(destination.pointer(), const_cast<LPVOID>(source), size);
+
+   if (status != 0)
+      throw KernelFaultException(status
+                                 ,Address(const_cast<LPVOID>(source))
+                                 ,destination.promote()
+                                 ,size);
+}
+
+void
+HeapAllocator::zeroAddressRange
+(const RawAddress &address, SIZE_T size, bool secure)
+{
+   if (secure)
+      SecureZeroMemory(address.pointer(), size);
+   else
+      ZeroMemory(address.pointer(), size);
+}
+
+LPVOID
+HeapAllocator::allocateBlock
+(SIZE_T size, bool zero)
+{
+   LPVOID block;
+
+   if (SlabPool::isSlabSize(size))
+   {
+      block = this->slabs->allocate(size);
+
+      if (zero)
+         this->zeroAddressRange(RawAddress(block), size, false);
+   }
+   else
+   {
+      /* let the heap hand back zeroed memory rather than clearing it again */
+      block = this->heap->allocate(size, zero);
+
+      if (block == NULL)
+         throw PoolAllocationException(*this);
+
+      this->largeBytes += size;
+   }
+
+   this->track(0, size);
+
+   return block;
+}
+
+void
+HeapAllocator::create
+(void)
+{
+   this->heap = new PrivateHeap();
+   this->slabs = new SlabPool(this->heap);
+}
+
+void
+HeapAllocator::release
+(void)
+{
+   /* the slab pool has to go before the heap its spans live in */
+   if (this->slabs != NULL)
+      delete this->slabs;
+
+   if (this->heap != NULL)
+      delete this->heap;
+
+   this->slabs = NULL;
+   this->heap = NULL;
+   this->liveBytes = 0;
+   this->largeBytes = 0;
+}
+
+void
+HeapAllocator::track
+(SIZE_T oldSize, SIZE_T newSize) noexcept
+{
+   this->liveBytes = this->liveBytes - oldSize + newSize;
+
+   if (this->liveBytes > this->peakBytes)
+      this->peakBytes = this->liveBytes;
+}
@@ -0,0 +1,396 @@
+#include <neurology/allocators/index.hpp>
+
+#include <algorithm>
+#include <functional>
+
+using namespace Neurology;
+
+AllocationIndex::AllocationIndex
+(void)
+   : treeWidth(0)
+   , currentGeneration(0)
+{
+}
+
+bool
+AllocationIndex::isIndexed
+(const Allocation *allocation) const noexcept
+{
+   return this->entries.find(allocation) != this->entries.end();
+}
+
+SIZE_T
+AllocationIndex::size
+(void) const noexcept
+{
+   return this->entries.size();
+}
+
+SIZE_T
+AllocationIndex::generation
+(void) const noexcept
+{
+   return this->currentGeneration;
+}
+
+void
+AllocationIndex::insert
+(Allocation *allocation, Label start, Label end)
+{
+   Entry entry;
+   SIZE_T blockIndex;
+   Block::iterator position;
+
+   if (this->isIndexed(allocation))
+      this->erase(allocation);
+
+   entry.start = start;
+   entry.end = end;
+   entry.allocation = allocation;
+   this->entries[allocation] = entry;
+   ++this->currentGeneration;
+
+   if (this->blocks.size() == 0)
+   {
+      entry.reach = end;
+      this->blocks.push_back(Block(1, entry));
+      this->furthestEnds.push_back(end);
+      this->rebuildTree();
+      return;
+   }
+
+   blockIndex = this->locate(entry);
+   Block &block = this->blocks[blockIndex];
+   position = std::upper_bound(block.begin(), block.end(), entry, AllocationIndex::precedes);
+   position = block.insert(position, entry);
+   AllocationIndex::spreadReach(block, position - block.begin());
+
+   if (block.size() <= AllocationIndex::BlockCapacity)
+      return this->extendBlock(blockIndex, end);
+
+   /* split the block in half. the tree has to be rebuilt since every block
+      after this one shifts over. */
+   Block upperHalf(block.begin() + block.size()/2, block.end());
+   block.erase(block.begin() + block.size()/2, block.end());
+   AllocationIndex::spreadReach(upperHalf, 0);
+   this->blocks.insert(this->blocks.begin() + blockIndex + 1, upperHalf);
+   this->furthestEnds.insert(this->furthestEnds.begin() + blockIndex + 1, 0);
+   this->furthestEnds[blockIndex] = AllocationIndex::furthestEnd(this->blocks[blockIndex]);
+   this->furthestEnds[blockIndex+1] = AllocationIndex::furthestEnd(this->blocks[blockIndex+1]);
+   this->rebuildTree();
+}
+
+void
+AllocationIndex::erase
+(const Allocation *allocation)
+{
+   EntryMap::iterator entryIter;
+   SIZE_T blockIndex;
+   Block::iterator position;
+   Label end;
+
+   entryIter = this->entries.find(allocation);
+
+   if (entryIter == this->entries.end())
+      return;
+
+   ++this->currentGeneration;
+   blockIndex = this->locate(entryIter->second);
+   Block &block = this->blocks[blockIndex];
+
+   /* entries are unique on (start, end, allocation), so the lower bound is
+      the entry itself. */
+   position = std::lower_bound(block.begin(), block.end(), entryIter->second, AllocationIndex::precedes);
+
+   if (position != block.end() && position->allocation == allocation)
+   {
+      position = block.erase(position);
+      AllocationIndex::spreadReach(block, position - block.begin());
+   }
+
+   end = entryIter->second.end;
+   this->entries.erase(entryIter);
+
+   /* the block's furthest end only needs recalculating if this entry was it */
+   if (block.size() > 0 && end < this->furthestEnds[blockIndex])
+      return;
+   else if (block.size() > 0)
+      return this->refreshBlock(blockIndex);
+
+   this->blocks.erase(this->blocks.begin() + blockIndex);
+   this->furthestEnds.erase(this->furthestEnds.begin() + blockIndex);
+   this->rebuildTree();
+}
+
+void
+AllocationIndex::clear
+(void)
+{
+   this->blocks.clear();
+   this->furthestEnds.clear();
+   this->blockEnds.clear();
+   this->entries.clear();
+   this->treeWidth = 0;
+   ++this->currentGeneration;
+}
+
+Allocation *
+AllocationIndex::find
+(Label label, SIZE_T size) const noexcept
+{
+   const Entry *best = NULL;
+   Label end = label + ((size == 0) ? 1 : size);
+   SIZE_T blockIndex, startIndex;
+   BlockList::const_iterator blockIter;
+
+   if (end <= label || this->blocks.size() == 0)
+      return NULL;
+
+   /* find the last block, then the last entry, starting at or before the label */
+   blockIter = std::upper_bound(this->blocks.begin(), this->blocks.end(), label
+                                ,[] (Label value, const Block &block) { return value < block.front().start; });
+
+   if (blockIter == this->blocks.begin())
+      return NULL;
+
+   startIndex = static_cast<SIZE_T>(blockIter - this->blocks.begin()) - 1;
+   blockIndex = this->lastCandidate(startIndex, end);
+
+   while (blockIndex != AllocationIndex::NoBlock)
+   {
+      const Block &block = this->blocks[blockIndex];
+      SIZE_T entryIndex;
+
+      if (blockIndex == startIndex)
+         entryIndex = std::upper_bound(block.begin(), block.end(), label
+                                       ,[] (Label value, const Entry &entry) { return value < entry.start; }) - block.begin();
+      else
+         entryIndex = block.size();
+
+      while (entryIndex-- > 0)
+      {
+         const Entry &entry = block[entryIndex];
+
+         /* every entry from here on starts earlier, so none of them can be
+            smaller than the best match while still reaching the end. */
+         if (best != NULL && end - entry.start >= best->end - best->start)
+            return best->allocation;
+
+         /* nothing else in this block reaches the end either */
+         if (entry.reach < end)
+            break;
+
+         if (entry.end < end)
+            continue;
+
+         if (best == NULL || entry.end - entry.start < best->end - best->start)
+            best = &entry;
+      }
+
+      if (blockIndex == 0)
+         break;
+
+      blockIndex = this->lastCandidate(blockIndex-1, end);
+   }
+
+   if (best == NULL)
+      return NULL;
+
+   return best->allocation;
+}
+
+bool
+AllocationIndex::isExclusive
+(const Allocation *allocation) const noexcept
+{
+   EntryMap::const_iterator entryIter = this->entries.find(allocation);
+   SIZE_T blockIndex, entryIndex, scanned = 0;
+   Label start, end;
+
+   if (entryIter == this->entries.end())
+      return false;
+
+   start = entryIter->second.start;
+   end = entryIter->second.end;
+
+   if (end <= start)
+      return false;
+
+   blockIndex = this->locate(entryIter->second);
+   entryIndex = std::lower_bound(this->blocks[blockIndex].begin(), this->blocks[blockIndex].end(), entryIter->second, AllocationIndex::precedes)
+      - this->blocks[blockIndex].begin();
+
+   /* whatever comes next in order starts either inside the range or after
+      it. an identical range coming next would win ties in find(). */
+   if (entryIndex+1 < this->blocks[blockIndex].size())
+   {
+      if (this->blocks[blockIndex][entryIndex+1].start < end)
+         return false;
+   }
+   else if (blockIndex+1 < this->blocks.size() && this->blocks[blockIndex+1].front().start < end)
+      return false;
+
+   /* everything earlier in order which reaches into the range has to reach
+      all the way through it. */
+   while (blockIndex != AllocationIndex::NoBlock)
+   {
+      const Block &block = this->blocks[blockIndex];
+
+      while (entryIndex-- > 0 && block[entryIndex].reach > start)
+      {
+         const Entry &entry = block[entryIndex];
+
+         if (++scanned > AllocationIndex::ExclusiveScanLimit)
+            return false;
+
+         if (entry.end > start && entry.end < end)
+            return false;
+      }
+
+      if (blockIndex == 0)
+         break;
+
+      blockIndex = this->lastCandidate(blockIndex-1, start+1);
+
+      if (blockIndex != AllocationIndex::NoBlock)
+         entryIndex = this->blocks[blockIndex].size();
+   }
+
+   return true;
+}
+
+bool
+AllocationIndex::precedes
+(const Entry &left, const Entry &right) noexcept
+{
+   if (left.start != right.start)
+      return left.start < right.start;
+
+   if (left.end != right.end)
+      return left.end > right.end;
+
+   return std::less<const Allocation *>()(left.allocation, right.allocation);
+}
+
+SIZE_T
+AllocationIndex::locate
+(const Entry &entry) const noexcept
+{
+   BlockList::const_iterator blockIter;
+
+   blockIter = std::upper_bound(this->blocks.begin(), this->blocks.end(), entry
+                                ,[] (const Entry &value, const Block &block) { return AllocationIndex::precedes(value, block.front()); });
+
+   if (blockIter == this->blocks.begin())
+      return 0;
+
+   return static_cast<SIZE_T>(blockIter - this->blocks.begin()) - 1;
+}
+
+SIZE_T
+AllocationIndex::lastCandidate
+(SIZE_T block, Label end) const noexcept
+{
+   SIZE_T node = this->treeWidth + block;
+
+   if (this->blockEnds[node] >= end)
+      return block;
+
+   /* climb until there's a left sibling which reaches the end, then descend
+      into its rightmost qualifying leaf. */
+   while (node > 1)
+   {
+      if ((node & 1) == 1 && this->blockEnds[node-1] >= end)
+      {
+         node = node-1;
+
+         while (node < this->treeWidth)
+         {
+            if (this->blockEnds[node*2+1] >= end)
+               node = node*2+1;
+            else
+               node = node*2;
+         }
+
+         return node - this->treeWidth;
+      }
+
+      node >>= 1;
+   }
+
+   return AllocationIndex::NoBlock;
+}
+
+Label
+AllocationIndex::furthestEnd
+(const Block &block) noexcept
+{
+   if (block.size() == 0)
+      return 0;
+
+   return block.back().reach;
+}
+
+void
+AllocationIndex::spreadReach
+(Block &block, SIZE_T from) noexcept
+{
+   Label reach = (from == 0) ? 0 : block[from-1].reach;
+
+   /* once an entry's reach comes out the same as before, so does the reach
+      of every entry after it */
+   for (SIZE_T index=from; index<block.size(); ++index)
+   {
+      reach = max(reach, block[index].end);
+
+      if (index > from && block[index].reach == reach)
+         return;
+
+      block[index].reach = reach;
+   }
+}
+
+void
+AllocationIndex::refreshBlock
+(SIZE_T block)
+{
+   SIZE_T node = this->treeWidth + block;
+
+   this->furthestEnds[block] = AllocationIndex::furthestEnd(this->blocks[block]);
+   this->blockEnds[node] = this->furthestEnds[block];
+
+   for (node >>= 1; node > 0; node >>= 1)
+      this->blockEnds[node] = max(this->blockEnds[node*2], this->blockEnds[node*2+1]);
+}
+
+void
+AllocationIndex::extendBlock
+(SIZE_T block, Label end)
+{
+   /* inserting can only ever push a block's end further out */
+   if (this->furthestEnds[block] >= end)
+      return;
+
+   this->furthestEnds[block] = end;
+
+   for (SIZE_T node=this->treeWidth + block; node > 0 && this->blockEnds[node] < end; node >>= 1)
+      this->blockEnds[node] = end;
+}
+
+void
+AllocationIndex::rebuildTree
+(void)
+{
+   SIZE_T node;
+
+   this->treeWidth = 1;
+
+   while (this->treeWidth < this->blocks.size())
+      this->treeWidth <<= 1;
+
+   this->blockEnds.assign(this->treeWidth*2, 0);
+   std::copy(this->furthestEnds.begin(), this->furthestEnds.end(), this->blockEnds.begin() + this->treeWidth);
+
+   for (node=this->treeWidth-1; node > 0; --node)
+      this->blockEnds[node] = max(this->blockEnds[node*2], this->blockEnds[node*2+1]);
+}
@@ -1,26 +1,13 @@
 #include <neurology/allocators/local.hpp>
 
+#include <neurology/allocators/paging.hpp>
+
 using namespace Neurology;
 
 LocalAllocator LocalAllocator::Instance;
 
-LONG
-Neurology::CopyData
-(LPVOID destination, const LPVOID source, SIZE_T size)
-{
-   __try
-   {
-      MoveMemory(destination, source, size);
-      return 0; // STATUS_SUCCESS
-   }
-   __except (EXCEPTION_EXECUTE_HANDLER)
-   {
-      return GetExceptionCode();
-   }
-}
-
 KernelFaultException::KernelFaultException
-(LONG status, Address &source, Address &destination, SIZE_T size)
+(LONG status, const Address &source, const Address &destination, SIZE_T size)
    : Neurology::Exception(EXCSTR(L"Kernel fault occured during operation on addresses."))
    , status(status)
    , source(source)
@@ -38,20 +25,55 @@ LocalAllocator::Exception::Exception
 LocalAllocator::LocalAllocator
 (void)
    : Allocator()
+   , slabs(NULL)
 {
    this->local = true; // it's literally in the name my dude 
 }
 
+LocalAllocator::LocalAllocator
+(bool useSlabs)
+   : Allocator()
+   , slabs(NULL)
+{
+   this->local = true;
+
+   if (useSlabs)
+      this->slabs = new SlabPool();
+}
+
+LocalAllocator::~LocalAllocator
+(void)
+{
+   /* retired memory has to go back to the slabs before they do */
+   this->reclaimAll();
+
+   if (this->slabs != NULL)
+      delete this->slabs;
+
+   this->slabs = NULL;
+}
+
+bool
+LocalAllocator::usesSlabs
+(void) const noexcept
+{
+   return this->slabs != NULL;
+}
+
 Address
 LocalAllocator::poolAddress
 (SIZE_T size)
 {
-   Address newAddress = this->pooledAddresses.address(new BYTE[size]);
+   Address newAddress;
+   LPBYTE block;
+   bool zeroed;
+
+   block = this->allocateBlock(size, &zeroed);
+   newAddress = this->pooledAddresses.address(block);
    this->pooledMemory[newAddress] = size;
 
-#ifndef _DEBUG
-   this->zeroAddress(newAddress, size);
-#endif
+   if (!zeroed)
+      this->zeroOnPool(newAddress, size);
 
    return newAddress;
 }
@@ -61,14 +83,35 @@ LocalAllocator::repoolAddress
 (Address &address, SIZE_T newSize)
 {
    Address newAddress;
+   SIZE_T oldSize;
+   LPBYTE block;
+   bool zeroed;
    
    this->throwIfNotPooled(address);
 
-   newAddress = this->poolAddress(newSize);
-   this->writeAddress(newAddress
-                      ,this->readAddress(address
-                                         ,min(this->pooledMemory[address]
-                                              ,newSize)));
+   oldSize = this->pooledMemory[address];
+
+   if (this->fitsInPlace(oldSize, newSize))
+   {
+      if (newSize > oldSize)
+         this->zeroOnPool(RawAddress(address.label()+oldSize), newSize-oldSize);
+      else
+         this->zeroOnUnpool(RawAddress(address.label()+newSize), oldSize-newSize);
+
+      return address;
+   }
+
+   /* only the part of the new block which doesn't get copied over needs zeroing */
+   block = this->allocateBlock(newSize, &zeroed);
+   newAddress = this->pooledAddresses.address(block);
+   this->pooledMemory[newAddress] = newSize;
+
+   this->writeAddressFrom(newAddress
+                          ,address.pointer()
+                          ,min(oldSize, newSize));
+
+   if (!zeroed && newSize > oldSize)
+      this->zeroOnPool(RawAddress(newAddress.label()+oldSize), newSize-oldSize);
    
    /* delete the old address, but don't unpool its bindings-- that'll nuke all the allocations */
    if (newAddress != address)
@@ -81,55 +124,165 @@ void
 LocalAllocator::unpoolAddress
 (Address &address)
 {
-   this->throwIfNotPooled(address);
+   SIZE_T size = this->forgetAddress(address);
 
-#ifndef _DEBUG
-   this->zeroAddress(address, this->pooledMemory[address]);
-#endif
+   this->releaseAddress(address, size);
+}
+
+SIZE_T
+LocalAllocator::forgetAddress
+(Address &address)
+{
+   SIZE_T size;
+
+   this->throwIfNotPooled(address);
 
+   size = this->pooledMemory[address];
    this->pooledMemory.erase(address);
 
-   delete[] address.pointer();
+   return size;
+}
+
+void
+LocalAllocator::releaseAddress
+(const RawAddress &address, SIZE_T size)
+{
+   /* the slabs, the heap and the OS are all fine with being freed to from any thread */
+   this->zeroOnUnpool(address, size);
+   this->freeBlock(address.pointer(), size);
 }
 
 Data
 LocalAllocator::readAddress
-(const Address &address, SIZE_T size) const
+(const RawAddress &address, SIZE_T size) const
 {
-   Data result;
+   Data result(size);
+   SIZE_T copied;
    LONG status;
 
-   result.resize(size);
-   status = CopyData(result.data(), address.pointer(), size);
+   status = CopyData(result.data(), address.pointer(), size, &copied);
 
-   if (status != 0)
+   if (status != 0 && copied == 0)
       throw KernelFaultException(status
-                                 ,const_cast<Address &>(address)
+                                 ,address.promote()
                                  ,Address(result.data())
                                  ,size);
 
+   result.resize(copied);
    return result;
 }
 
 void
-LocalAllocator::writeAddress
-(const Address &destination, const Data data)
+LocalAllocator::readAddressInto
+(const RawAddress &address, LPVOID destination, SIZE_T size) const
+{
+   LONG status;
+
+   status = CopyData(destination, address.pointer(), size);
+
+   if (status != 0)
+      throw KernelFaultException(status
+                                 ,address.promote()
+                                 ,Address(destination)
+                                 ,size);
+}
+
+void
+LocalAllocator::writeAddressFrom
+(const RawAddress &destination, LPCVOID source, SIZE_T size)
 {
    LONG status;
 
-   /* if you come across this code, can you explain to me why reinterpret_cast<const LPVOID> doesn't work here? */
-   status = CopyData(destination.pointer()
-                     ,static_cast<LPVOID>(
-                        const_cast<LPBYTE>(data.data()))
-                     ,data.size());
+   status = CopyData(destination.pointer(), const_cast<LPVOID>(source), size);
 
    if (status != 0)
       throw KernelFaultException(status
-                                 ,Address(
-                                    static_cast<LPVOID>(
-                                       const_cast<LPBYTE>(data.data())))
-                                 ,const_cast<Address &>(destination)
-                                 ,data.size());
+                                 ,Address(const_cast<LPVOID>(source))
+                                 ,destination.promote()
+                                 ,size);
+}
+
+void
+LocalAllocator::zeroAddressRange
+(const RawAddress &address, SIZE_T size, bool secure)
+{
+   if (secure)
+      SecureZeroMemory(address.pointer(), size);
+   else
+      ZeroMemory(address.pointer(), size);
+}
+
+LPBYTE
+LocalAllocator::allocateBlock
+(SIZE_T size, bool *zeroed)
+{
+   LPBYTE block;
+
+   *zeroed = false;
+
+   if (this->isSlabbed(size))
+      return static_cast<LPBYTE>(this->slabs->allocate(size));
+   else if (!this->isPaged(size))
+      return new BYTE[size];
+
+   try
+   {
+      block = static_cast<LPBYTE>(VirtualMemory::Allocate(NULL, NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+   }
+   catch (Win32Exception &exception)
+   {
+      UNUSED(exception);
+      throw PoolAllocationException(*this);
+   }
+
+   /* fresh pages from the OS always come zeroed */
+   *zeroed = true;
+
+   return block;
+}
+
+void
+LocalAllocator::freeBlock
+(LPVOID block, SIZE_T size)
+{
+   if (this->isSlabbed(size))
+      this->slabs->free(block, size);
+   else if (!this->isPaged(size))
+      delete[] static_cast<LPBYTE>(block);
+   else
+      VirtualMemory::Free(NULL, block, 0, MEM_RELEASE);
+}
+
+bool
+LocalAllocator::isSlabbed
+(SIZE_T size) const noexcept
+{
+   return this->slabs != NULL && SlabPool::isSlabSize(size);
+}
+
+bool
+LocalAllocator::isPaged
+(SIZE_T size) const noexcept
+{
+   return size >= LocalAllocator::PagedBlockSize;
+}
+
+bool
+LocalAllocator::fitsInPlace
+(SIZE_T oldSize, SIZE_T newSize) const noexcept
+{
+   /* where a block gets freed to is decided by its size, so it can't cross
+      over between the slabs, the heap and the pages. */
+   if (this->isSlabbed(oldSize) != this->isSlabbed(newSize)
+       || this->isPaged(oldSize) != this->isPaged(newSize))
+      return false;
+
+   /* slab blocks are as big as their class, everything else as big as it
+      was allocated. either way, they can always shrink. */
+   if (this->isSlabbed(oldSize))
+      return SlabPool::sizeClass(oldSize) == SlabPool::sizeClass(newSize);
+
+   return newSize <= oldSize;
 }
 
 Allocation
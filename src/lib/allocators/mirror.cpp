@@ -0,0 +1,478 @@
+#include <neurology/allocators/mirror.hpp>
+
+#include <algorithm>
+
+using namespace Neurology;
+
+namespace
+{
+   /* add [start, end) to the changed ranges of a page, merging it with every range it touches */
+   void MarkDirty(std::map<SIZE_T, SIZE_T> &dirty, SIZE_T start, SIZE_T end)
+   {
+      std::map<SIZE_T, SIZE_T>::iterator rangeIter = dirty.upper_bound(start);
+
+      if (rangeIter != dirty.begin())
+      {
+         --rangeIter;
+
+         if (rangeIter->second >= start)
+         {
+            start = rangeIter->first;
+            end = max(end, rangeIter->second);
+            rangeIter = dirty.erase(rangeIter);
+         }
+         else
+            ++rangeIter;
+      }
+
+      while (rangeIter != dirty.end() && rangeIter->first <= end)
+      {
+         end = max(end, rangeIter->second);
+         rangeIter = dirty.erase(rangeIter);
+      }
+
+      dirty[start] = end;
+   }
+}
+
+PageMirror::WriteBackException::WriteBackException
+(SIZE_T lost)
+   : Exception(EXCSTR(L"Some changes to mirrored pages couldn't be written back."))
+   , lost(lost)
+{
+}
+
+PageMirror::PageMirror
+(Backing *backing, SIZE_T pageSize, SIZE_T capacity, Clock::duration timeToLive)
+   : backing(backing)
+   , pageSize(pageSize)
+   , capacity(capacity)
+   , timeToLive(timeToLive)
+{
+}
+
+SIZE_T
+PageMirror::getPageSize
+(void) const noexcept
+{
+   return this->pageSize;
+}
+
+SIZE_T
+PageMirror::getCapacity
+(void) const noexcept
+{
+   return this->capacity;
+}
+
+PageMirror::Clock::duration
+PageMirror::getTimeToLive
+(void) const noexcept
+{
+   return this->timeToLive;
+}
+
+SIZE_T
+PageMirror::size
+(void) const noexcept
+{
+   return this->pages.size();
+}
+
+SIZE_T
+PageMirror::dirtySize
+(void) const noexcept
+{
+   PageMap::const_iterator pageIter;
+   SIZE_T result = 0;
+
+   for (pageIter=this->pages.begin(); pageIter!=this->pages.end(); ++pageIter)
+      if (!pageIter->second.dirty.empty())
+         ++result;
+
+   return result;
+}
+
+void
+PageMirror::read
+(VirtualMemory::TransferVector *transfers)
+{
+   VirtualMemory::TransferVector::iterator transferIter;
+   PageMap::iterator pageIter;
+   Label address, base;
+   SIZE_T offset, piece;
+
+   this->fetch(*transfers);
+
+   for (transferIter=transfers->begin(); transferIter!=transfers->end(); ++transferIter)
+   {
+      for (transferIter->transferred=0; transferIter->transferred<transferIter->size; transferIter->transferred+=piece)
+      {
+         address = reinterpret_cast<Label>(transferIter->address) + transferIter->transferred;
+         base = this->pageOf(address);
+         pageIter = this->pages.find(base);
+
+         /* everything the transfers touch got fetched, so a missing page is one which couldn't be */
+         if (pageIter == this->pages.end())
+            break;
+
+         offset = address - base;
+         piece = min(transferIter->size - transferIter->transferred, this->pageSize - offset);
+
+         CopyMemory(static_cast<LPBYTE>(transferIter->buffer) + transferIter->transferred
+                    ,pageIter->second.bytes.data() + offset
+                    ,piece);
+
+         this->touch(pageIter);
+      }
+   }
+
+   this->trim();
+}
+
+void
+PageMirror::write
+(VirtualMemory::TransferVector *transfers)
+{
+   VirtualMemory::TransferVector::iterator transferIter;
+   PageMap::iterator pageIter;
+   Label address, base;
+   SIZE_T offset, piece;
+
+   this->fetch(*transfers);
+
+   for (transferIter=transfers->begin(); transferIter!=transfers->end(); ++transferIter)
+   {
+      for (transferIter->transferred=0; transferIter->transferred<transferIter->size; transferIter->transferred+=piece)
+      {
+         address = reinterpret_cast<Label>(transferIter->address) + transferIter->transferred;
+         base = this->pageOf(address);
+         pageIter = this->pages.find(base);
+
+         if (pageIter == this->pages.end())
+            break;
+
+         offset = address - base;
+         piece = min(transferIter->size - transferIter->transferred, this->pageSize - offset);
+
+         /* the copy may be behind the memory it mirrors, so a write counts even if it changes nothing here */
+         CopyMemory(pageIter->second.bytes.data() + offset
+                    ,static_cast<const BYTE *>(transferIter->buffer) + transferIter->transferred
+                    ,piece);
+
+         MarkDirty(pageIter->second.dirty, offset, offset+piece);
+
+         this->touch(pageIter);
+      }
+   }
+
+   this->trim();
+}
+
+SIZE_T
+PageMirror::read
+(Label address, LPVOID buffer, SIZE_T size)
+{
+   VirtualMemory::TransferVector transfers(1);
+
+   transfers[0].address = reinterpret_cast<LPVOID>(address);
+   transfers[0].buffer = buffer;
+   transfers[0].size = size;
+
+   this->read(&transfers);
+
+   return transfers[0].transferred;
+}
+
+SIZE_T
+PageMirror::write
+(Label address, LPCVOID buffer, SIZE_T size)
+{
+   VirtualMemory::TransferVector transfers(1);
+
+   transfers[0].address = reinterpret_cast<LPVOID>(address);
+   transfers[0].buffer = const_cast<LPVOID>(buffer);
+   transfers[0].size = size;
+
+   this->write(&transfers);
+
+   return transfers[0].transferred;
+}
+
+void
+PageMirror::sync
+(void)
+{
+   PageList dirtyPages;
+   PageMap::iterator pageIter;
+   SIZE_T lost;
+
+   for (pageIter=this->pages.begin(); pageIter!=this->pages.end(); ++pageIter)
+      if (!pageIter->second.dirty.empty())
+         dirtyPages.push_back(pageIter);
+
+   lost = this->writeBack(dirtyPages);
+
+   if (lost != 0)
+      throw WriteBackException(lost);
+}
+
+void
+PageMirror::invalidate
+(void)
+{
+   PageList droppedPages;
+   PageMap::iterator pageIter;
+
+   for (pageIter=this->pages.begin(); pageIter!=this->pages.end(); ++pageIter)
+      droppedPages.push_back(pageIter);
+
+   this->drop(droppedPages);
+}
+
+void
+PageMirror::invalidate
+(Label address, SIZE_T size)
+{
+   PageList droppedPages;
+   PageMap::iterator pageIter;
+
+   for (pageIter=this->pages.lower_bound(this->pageOf(address));
+        pageIter!=this->pages.end() && pageIter->first<address+size;
+        ++pageIter)
+      droppedPages.push_back(pageIter);
+
+   this->drop(droppedPages);
+}
+
+Label
+PageMirror::pageOf
+(Label address) const noexcept
+{
+   return address - address % this->pageSize;
+}
+
+PageMirror::PageMap::iterator
+PageMirror::current
+(Label base, Clock::time_point now)
+{
+   PageMap::iterator pageIter = this->pages.find(base);
+
+   if (pageIter == this->pages.end())
+      return pageIter;
+
+   if (this->timeToLive != Clock::duration::zero() && now - pageIter->second.fetched > this->timeToLive)
+      return this->pages.end();
+
+   return pageIter;
+}
+
+void
+PageMirror::fetch
+(const VirtualMemory::TransferVector &transfers)
+{
+   Clock::time_point now = Clock::now();
+   VirtualMemory::TransferVector::const_iterator transferIter;
+   VirtualMemory::TransferVector fetches;
+   VirtualMemory::Transfer fetch;
+   std::vector<Label> missing;
+   std::vector<Label>::iterator baseIter;
+   PageList stalePages;
+   PageMap::iterator pageIter;
+   Label base, end;
+   SIZE_T lost;
+
+   for (transferIter=transfers.begin(); transferIter!=transfers.end(); ++transferIter)
+   {
+      if (transferIter->size == 0)
+         continue;
+
+      end = reinterpret_cast<Label>(transferIter->address) + transferIter->size;
+
+      for (base=this->pageOf(reinterpret_cast<Label>(transferIter->address)); base<end; base+=this->pageSize)
+         if (this->current(base, now) == this->pages.end())
+            missing.push_back(base);
+   }
+
+   if (missing.empty())
+      return;
+
+   std::sort(missing.begin(), missing.end());
+   missing.erase(std::unique(missing.begin(), missing.end()), missing.end());
+
+   /* pages past their time to live get their changes written back before they're overwritten */
+   for (baseIter=missing.begin(); baseIter!=missing.end(); ++baseIter)
+   {
+      pageIter = this->pages.find(*baseIter);
+
+      if (pageIter != this->pages.end() && !pageIter->second.dirty.empty())
+         stalePages.push_back(pageIter);
+   }
+
+   lost = this->writeBack(stalePages);
+
+   /* every page gets fetched as its own range, so a hole only costs the pages in it */
+   for (baseIter=missing.begin(); baseIter!=missing.end(); ++baseIter)
+   {
+      pageIter = this->pages.find(*baseIter);
+
+      if (pageIter == this->pages.end())
+      {
+         pageIter = this->pages.insert(std::make_pair(*baseIter, MirroredPage())).first;
+         this->recency.push_front(*baseIter);
+         pageIter->second.recency = this->recency.begin();
+      }
+
+      pageIter->second.bytes.resize(this->pageSize);
+
+      fetch.address = reinterpret_cast<LPVOID>(*baseIter);
+      fetch.buffer = pageIter->second.bytes.data();
+      fetch.size = this->pageSize;
+      fetch.transferred = 0;
+      fetches.push_back(fetch);
+   }
+
+   try
+   {
+      this->backing->transfer(&fetches, false);
+   }
+   catch (...)
+   {
+      /* nothing which was supposed to be fetched can be trusted now */
+      for (baseIter=missing.begin(); baseIter!=missing.end(); ++baseIter)
+      {
+         pageIter = this->pages.find(*baseIter);
+         this->recency.erase(pageIter->second.recency);
+         this->pages.erase(pageIter);
+      }
+
+      throw;
+   }
+
+   for (transferIter=fetches.begin(); transferIter!=fetches.end(); ++transferIter)
+   {
+      pageIter = this->pages.find(reinterpret_cast<Label>(transferIter->address));
+
+      if (transferIter->transferred == transferIter->size)
+      {
+         pageIter->second.fetched = now;
+         continue;
+      }
+
+      this->recency.erase(pageIter->second.recency);
+      this->pages.erase(pageIter);
+   }
+
+   if (lost != 0)
+      throw WriteBackException(lost);
+}
+
+SIZE_T
+PageMirror::writeBack
+(const PageList &dirtyPages)
+{
+   PageList::const_iterator pageIter;
+   DirtyMap::iterator rangeIter;
+   VirtualMemory::TransferVector transfers;
+   VirtualMemory::TransferVector::iterator transferIter;
+   VirtualMemory::Transfer transfer;
+   Data scratch;
+   SIZE_T used = 0, lost = 0, length;
+   Label address, runEnd = 0;
+
+   for (pageIter=dirtyPages.begin(); pageIter!=dirtyPages.end(); ++pageIter)
+      for (rangeIter=(*pageIter)->second.dirty.begin(); rangeIter!=(*pageIter)->second.dirty.end(); ++rangeIter)
+         used += rangeIter->second - rangeIter->first;
+
+   if (used == 0)
+      return 0;
+
+   /* the changes get gathered in address order, so ranges which touch, even across pages, go out as one */
+   scratch.resize(used);
+   used = 0;
+
+   for (pageIter=dirtyPages.begin(); pageIter!=dirtyPages.end(); ++pageIter)
+   {
+      MirroredPage &page = (*pageIter)->second;
+
+      for (rangeIter=page.dirty.begin(); rangeIter!=page.dirty.end(); ++rangeIter)
+      {
+         address = (*pageIter)->first + rangeIter->first;
+         length = rangeIter->second - rangeIter->first;
+
+         CopyMemory(scratch.data() + used, page.bytes.data() + rangeIter->first, length);
+
+         if (!transfers.empty() && runEnd == address)
+            transfers.back().size += length;
+         else
+         {
+            transfer.address = reinterpret_cast<LPVOID>(address);
+            transfer.buffer = scratch.data() + used;
+            transfer.size = length;
+            transfer.transferred = 0;
+            transfers.push_back(transfer);
+         }
+
+         used += length;
+         runEnd = address + length;
+      }
+
+      page.dirty.clear();
+   }
+
+   this->backing->transfer(&transfers, true);
+
+   for (transferIter=transfers.begin(); transferIter!=transfers.end(); ++transferIter)
+      lost += transferIter->size - transferIter->transferred;
+
+   return lost;
+}
+
+void
+PageMirror::drop
+(PageList &droppedPages)
+{
+   PageList::iterator pageIter;
+   SIZE_T lost;
+
+   std::sort(droppedPages.begin()
+             ,droppedPages.end()
+             ,[] (const PageMap::iterator &left, const PageMap::iterator &right) { return left->first < right->first; });
+
+   lost = this->writeBack(droppedPages);
+
+   for (pageIter=droppedPages.begin(); pageIter!=droppedPages.end(); ++pageIter)
+   {
+      this->recency.erase((*pageIter)->second.recency);
+      this->pages.erase(*pageIter);
+   }
+
+   if (lost != 0)
+      throw WriteBackException(lost);
+}
+
+void
+PageMirror::trim
+(void)
+{
+   PageList evictedPages;
+   RecencyList::reverse_iterator recencyIter;
+   SIZE_T excess;
+
+   if (this->pages.size() <= this->capacity)
+      return;
+
+   excess = this->pages.size() - this->capacity;
+
+   for (recencyIter=this->recency.rbegin(); evictedPages.size()<excess; ++recencyIter)
+      evictedPages.push_back(this->pages.find(*recencyIter));
+
+   this->drop(evictedPages);
+}
+
+void
+PageMirror::touch
+(PageMap::iterator pageIter)
+{
+   this->recency.splice(this->recency.begin(), this->recency, pageIter->second.recency);
+}
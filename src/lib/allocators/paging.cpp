@@ -0,0 +1,1173 @@
+#include <neurology/allocators/paging.hpp>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <map>
+#include <mutex>
+#endif
+
+using namespace Neurology;
+
+#ifdef _WIN32
+SIZE_T
+VirtualMemory::PageSize
+(void)
+{
+   SYSTEM_INFO info;
+
+   GetSystemInfo(&info);
+
+   return info.dwPageSize;
+}
+
+LPVOID
+VirtualMemory::Allocate
+(HANDLE process, LPVOID address, SIZE_T size, DWORD allocationType, DWORD protection)
+{
+   LPVOID result;
+
+   if (process == NULL)
+      result = VirtualAlloc(address, size, allocationType, protection);
+   else
+      result = VirtualAllocEx(process, address, size, allocationType, protection);
+
+   if (result == NULL)
+      throw Win32Exception(EXCSTR(L"VirtualAlloc failed."));
+
+   return result;
+}
+
+void
+VirtualMemory::Free
+(HANDLE process, LPVOID address, SIZE_T size, DWORD freeType)
+{
+   BOOL result;
+
+   if (process == NULL)
+      result = VirtualFree(address, size, freeType);
+   else
+      result = VirtualFreeEx(process, address, size, freeType);
+
+   if (result == FALSE)
+      throw Win32Exception(EXCSTR(L"VirtualFree failed."));
+}
+
+DWORD
+VirtualMemory::Protect
+(HANDLE process, LPVOID address, SIZE_T size, DWORD protection)
+{
+   DWORD oldProtect;
+   BOOL result;
+
+   if (process == NULL)
+      result = VirtualProtect(address, size, protection, &oldProtect);
+   else
+      result = VirtualProtectEx(process, address, size, protection, &oldProtect);
+
+   if (result == FALSE)
+      throw Win32Exception(EXCSTR(L"VirtualProtect failed."));
+
+   return oldProtect;
+}
+
+void
+VirtualMemory::Lock
+(LPVOID address, SIZE_T size)
+{
+   if (!VirtualLock(address, size))
+      throw Win32Exception(EXCSTR(L"VirtualLock failed."));
+}
+
+void
+VirtualMemory::Unlock
+(LPVOID address, SIZE_T size)
+{
+   if (!VirtualUnlock(address, size))
+      throw Win32Exception(EXCSTR(L"VirtualUnlock failed."));
+}
+
+SIZE_T
+VirtualMemory::Query
+(HANDLE process, LPCVOID address, PMEMORY_BASIC_INFORMATION buffer, SIZE_T length)
+{
+   if (process == NULL)
+      return VirtualQuery(address, buffer, length);
+   else
+      return VirtualQueryEx(process, address, buffer, length);
+}
+
+void
+VirtualMemory::Enumerate
+(HANDLE process, RegionVector *regions)
+{
+   MEMORY_BASIC_INFORMATION region;
+   ULONG_PTR address = 0;
+
+   regions->clear();
+
+   while (Query(process, reinterpret_cast<LPCVOID>(address), &region, sizeof(region)) == sizeof(region))
+   {
+      regions->push_back(region);
+      address = reinterpret_cast<ULONG_PTR>(region.BaseAddress) + region.RegionSize;
+   }
+
+   if (regions->size() == 0)
+      throw Win32Exception(EXCSTR(L"VirtualQuery failed."));
+}
+#else
+namespace
+{
+#ifdef MADV_FREE
+   const int LazyFree = MADV_FREE;
+#else
+   const int LazyFree = MADV_DONTNEED;
+#endif
+
+#ifdef IOV_MAX
+   const SIZE_T TransferBatchLimit = IOV_MAX;
+#else
+   const SIZE_T TransferBatchLimit = 1024;
+#endif
+
+#ifdef MAP_FIXED_NOREPLACE
+   const int FixedAddress = MAP_FIXED_NOREPLACE;
+#else
+   /* without it the address is only a hint, and landing anywhere else counts as failing */
+   const int FixedAddress = 0;
+#endif
+
+   /* a stretch of a reservation whose pages all have the same state and protection */
+   struct Run
+   {
+      SIZE_T size;
+      ULONG_PTR allocationBase;
+      DWORD allocationProtect;
+      DWORD state;
+      DWORD protect;
+   };
+
+   typedef std::map<ULONG_PTR, Run> RunMap;
+
+   /* every reservation made through VirtualMemory, split into runs keyed by where they start */
+   struct Reservations
+   {
+      std::mutex lock;
+      RunMap runs;
+   };
+
+   /* a line of /proc/self/maps */
+   struct Mapping
+   {
+      ULONG_PTR start, end;
+      DWORD protect;
+      DWORD type;
+   };
+
+   Reservations &Reserved(void)
+   {
+      static Reservations reservations;
+
+      return reservations;
+   }
+
+   inline ULONG_PTR RoundDown(ULONG_PTR address)
+   {
+      return address - address % VirtualMemory::PageSize();
+   }
+
+   inline ULONG_PTR RoundUp(ULONG_PTR address)
+   {
+      return RoundDown(address + VirtualMemory::PageSize() - 1);
+   }
+
+   /* the run containing the given address, or the end of the runs */
+   RunMap::iterator RunAt(RunMap &runs, ULONG_PTR address)
+   {
+      RunMap::iterator runIter = runs.upper_bound(address);
+
+      if (runIter == runs.begin())
+         return runs.end();
+
+      --runIter;
+
+      if (runIter->first + runIter->second.size <= address)
+         return runs.end();
+
+      return runIter;
+   }
+
+   /* whether any run lies within [start, end) */
+   bool Overlaps(RunMap &runs, ULONG_PTR start, ULONG_PTR end)
+   {
+      RunMap::iterator runIter = runs.lower_bound(start);
+
+      return RunAt(runs, start) != runs.end() || (runIter != runs.end() && runIter->first < end);
+   }
+
+   /* whether [start, end) lies entirely within one reservation */
+   bool IsReserved(RunMap &runs, ULONG_PTR start, ULONG_PTR end)
+   {
+      RunMap::iterator runIter = RunAt(runs, start);
+      ULONG_PTR allocationBase;
+
+      if (runIter == runs.end())
+         return false;
+
+      allocationBase = runIter->second.allocationBase;
+
+      /* every run after the first has to pick up right where the one before left off */
+      for (start=runIter->first; start<end; ++runIter)
+      {
+         if (runIter == runs.end() || runIter->first != start || runIter->second.allocationBase != allocationBase)
+            return false;
+
+         start += runIter->second.size;
+      }
+
+      return true;
+   }
+
+   /* make a run start at the given address, splitting the one it falls in */
+   void SplitAt(RunMap &runs, ULONG_PTR address)
+   {
+      RunMap::iterator runIter = RunAt(runs, address);
+      Run tail;
+
+      if (runIter == runs.end() || runIter->first == address)
+         return;
+
+      tail = runIter->second;
+      tail.size = runIter->first + runIter->second.size - address;
+      runIter->second.size = address - runIter->first;
+      runs[address] = tail;
+   }
+
+   /* give [start, end) a new state and protection, merging whatever ends up alike */
+   void Mark(RunMap &runs, ULONG_PTR start, ULONG_PTR end, DWORD state, DWORD protect)
+   {
+      RunMap::iterator runIter, nextIter;
+
+      SplitAt(runs, start);
+      SplitAt(runs, end);
+
+      for (runIter=runs.find(start); runIter!=runs.end() && runIter->first<end; ++runIter)
+      {
+         runIter->second.state = state;
+         runIter->second.protect = protect;
+      }
+
+      /* start merging from the run before the range, in case it now matches */
+      runIter = runs.find(start);
+
+      if (runIter != runs.begin())
+         --runIter;
+
+      while (runIter != runs.end() && runIter->first <= end)
+      {
+         nextIter = runIter;
+         ++nextIter;
+
+         if (nextIter != runs.end()
+             && runIter->first + runIter->second.size == nextIter->first
+             && runIter->second.allocationBase == nextIter->second.allocationBase
+             && runIter->second.state == nextIter->second.state
+             && runIter->second.protect == nextIter->second.protect)
+         {
+            runIter->second.size += nextIter->second.size;
+            runs.erase(nextIter);
+         }
+         else
+            runIter = nextIter;
+      }
+   }
+
+   typedef std::vector<Mapping> MappingVector;
+
+   /* skip past the spaces, then past the field after them */
+   inline const char *SkipField(const char *cursor, const char *end)
+   {
+      while (cursor < end && *cursor == ' ')
+         ++cursor;
+
+      while (cursor < end && *cursor != ' ' && *cursor != '\n')
+         ++cursor;
+
+      return cursor;
+   }
+
+   /* parse a hexadecimal number, leaving the cursor on whatever follows it */
+   inline ULONG_PTR ParseHex(const char *&cursor, const char *end)
+   {
+      ULONG_PTR value = 0;
+      char digit;
+
+      for (; cursor < end; ++cursor)
+      {
+         digit = *cursor;
+
+         if (digit >= '0' && digit <= '9')
+            value = (value << 4) | static_cast<ULONG_PTR>(digit - '0');
+         else if (digit >= 'a' && digit <= 'f')
+            value = (value << 4) | static_cast<ULONG_PTR>(digit - 'a' + 10);
+         else
+            break;
+      }
+
+      return value;
+   }
+
+   /* open /proc/<pid>/maps, or /proc/self/maps for a pid of 0 */
+   int OpenMappings(pid_t processID)
+   {
+      char path[32];
+
+      if (processID == 0)
+         std::snprintf(path, sizeof(path), "/proc/self/maps");
+      else
+         std::snprintf(path, sizeof(path), "/proc/%d/maps", static_cast<int>(processID));
+
+      return open(path, O_RDONLY | O_CLOEXEC);
+   }
+
+   /*
+     parse the line of the maps file at the cursor, leaving the cursor at the
+     start of the next one. returns whether the line held a mapping.
+   */
+   bool ParseMapping(const char *&cursor, const char *end, Mapping *mapping)
+   {
+      int protection;
+
+      /* each line is "start-end perms offset dev inode [path]" */
+      mapping->start = ParseHex(cursor, end);
+
+      if (cursor < end && *cursor == '-')
+         ++cursor;
+
+      mapping->end = ParseHex(cursor, end);
+
+      if (cursor < end && *cursor == ' ')
+         ++cursor;
+
+      protection = PROT_NONE;
+
+      if (end - cursor >= 3)
+      {
+         if (cursor[0] == 'r')
+            protection |= PROT_READ;
+
+         if (cursor[1] == 'w')
+            protection |= PROT_WRITE;
+
+         if (cursor[2] == 'x')
+            protection |= PROT_EXEC;
+      }
+
+      mapping->protect = VirtualMemory::PageProtection(protection);
+
+      /* the permissions, offset, device and inode come before the path */
+      cursor = SkipField(cursor, end);
+      cursor = SkipField(cursor, end);
+      cursor = SkipField(cursor, end);
+      cursor = SkipField(cursor, end);
+
+      while (cursor < end && *cursor == ' ')
+         ++cursor;
+
+      /* named mappings are files, the rest ([heap], [stack] and anonymous memory) are private */
+      if (cursor < end && *cursor != '\n' && *cursor != '[')
+         mapping->type = MEM_MAPPED;
+      else
+         mapping->type = MEM_PRIVATE;
+
+      while (cursor < end && *cursor != '\n')
+         ++cursor;
+
+      ++cursor;
+
+      return mapping->end > mapping->start;
+   }
+
+   /*
+     read all of the maps file of a process. the file gets pulled in with as
+     few reads as it takes and parsed in place, since a process can have tens
+     of thousands of mappings.
+   */
+   bool ReadMappings(pid_t processID, MappingVector *mappings)
+   {
+      std::vector<char> buffer;
+      SIZE_T used = 0;
+      ssize_t bytesRead;
+      const char *cursor, *end;
+      Mapping mapping;
+      int descriptor;
+
+      descriptor = OpenMappings(processID);
+
+      if (descriptor == -1)
+         return false;
+
+      buffer.resize(0x10000);
+
+      for (;;)
+      {
+         if (used == buffer.size())
+            buffer.resize(buffer.size() * 2);
+
+         bytesRead = read(descriptor, &buffer[used], buffer.size() - used);
+
+         if (bytesRead == -1 && errno == EINTR)
+            continue;
+
+         if (bytesRead <= 0)
+            break;
+
+         used += static_cast<SIZE_T>(bytesRead);
+      }
+
+      close(descriptor);
+
+      if (bytesRead == -1)
+         return false;
+
+      mappings->clear();
+      cursor = buffer.data();
+      end = cursor + used;
+
+      while (cursor < end)
+         if (ParseMapping(cursor, end, &mapping))
+            mappings->push_back(mapping);
+
+      return true;
+   }
+
+   /*
+     find the first mapping of the process which ends after the given
+     address. the maps file is read fresh every time, since anything in the
+     process can map or unmap memory without this knowing. it's read a piece
+     at a time and only up to the mapping, which the kernel generates lazily,
+     so a query doesn't pay for the mappings above the address.
+   */
+   bool NextMapping(pid_t processID, ULONG_PTR address, Mapping *mapping)
+   {
+      std::vector<char> buffer(0x8000);
+      SIZE_T used = 0;
+      ssize_t bytesRead;
+      const char *cursor, *lineEnd, *end;
+      int descriptor;
+      bool found = false;
+
+      descriptor = OpenMappings(processID);
+
+      if (descriptor == -1)
+         return false;
+
+      while (!found)
+      {
+         if (used == buffer.size())
+            buffer.resize(buffer.size() * 2);
+
+         bytesRead = read(descriptor, &buffer[used], buffer.size() - used);
+
+         if (bytesRead == -1 && errno == EINTR)
+            continue;
+
+         if (bytesRead <= 0)
+            break;
+
+         used += static_cast<SIZE_T>(bytesRead);
+         cursor = buffer.data();
+         end = cursor + used;
+
+         /* only whole lines get parsed, whatever's left over waits for the next read */
+         while (!found && (lineEnd = static_cast<const char *>(memchr(cursor, '\n', end - cursor))) != NULL)
+            found = ParseMapping(cursor, lineEnd + 1, mapping) && mapping->end > address;
+
+         used = end - cursor;
+         MoveMemory(buffer.data(), cursor, used);
+      }
+
+      close(descriptor);
+
+      /* the file ends in a newline, but a last line without one still counts */
+      if (!found && bytesRead == 0 && used > 0)
+      {
+         cursor = buffer.data();
+         found = ParseMapping(cursor, cursor + used, mapping) && mapping->end > address;
+      }
+
+      return found;
+   }
+
+   /* describe [start, end) of a mapping this didn't allocate, or a gap between mappings */
+   void DescribeForeign(ULONG_PTR start, ULONG_PTR end, const Mapping *mapping, PMEMORY_BASIC_INFORMATION buffer)
+   {
+      buffer->BaseAddress = reinterpret_cast<LPVOID>(start);
+      buffer->RegionSize = end - start;
+
+      if (mapping == NULL)
+      {
+         buffer->AllocationBase = NULL;
+         buffer->AllocationProtect = 0;
+         buffer->State = MEM_FREE;
+         buffer->Protect = PAGE_NOACCESS;
+         buffer->Type = 0;
+      }
+      else
+      {
+         buffer->AllocationBase = reinterpret_cast<LPVOID>(mapping->start);
+         buffer->AllocationProtect = mapping->protect;
+         buffer->State = MEM_COMMIT;
+         buffer->Protect = mapping->protect;
+         buffer->Type = mapping->type;
+      }
+   }
+
+   /* describe [start, end) of a run */
+   void DescribeRun(ULONG_PTR start, ULONG_PTR end, const Run &run, PMEMORY_BASIC_INFORMATION buffer)
+   {
+      buffer->BaseAddress = reinterpret_cast<LPVOID>(start);
+      buffer->AllocationBase = reinterpret_cast<LPVOID>(run.allocationBase);
+      buffer->AllocationProtect = run.allocationProtect;
+      buffer->RegionSize = end - start;
+      buffer->State = run.state;
+      buffer->Protect = run.protect;
+      buffer->Type = MEM_PRIVATE;
+   }
+
+   /*
+     add the foreign part of [start, end) to the regions, with the runs inside
+     it in their place. runIter is the first run not added yet, and moves past
+     every run which gets added.
+   */
+   void AddRegions(ULONG_PTR start, ULONG_PTR end, const Mapping *mapping, RunMap &runs, RunMap::iterator &runIter, VirtualMemory::RegionVector *regions)
+   {
+      MEMORY_BASIC_INFORMATION region;
+      ULONG_PTR runEnd;
+
+      while (start < end)
+      {
+         if (runIter == runs.end() || runIter->first >= end)
+         {
+            DescribeForeign(start, end, mapping, &region);
+            regions->push_back(region);
+            break;
+         }
+
+         if (runIter->first > start)
+         {
+            DescribeForeign(start, runIter->first, mapping, &region);
+            regions->push_back(region);
+         }
+
+         runEnd = runIter->first + runIter->second.size;
+
+         if (runEnd > start)
+         {
+            DescribeRun(max(start, runIter->first), runEnd, runIter->second, &region);
+            regions->push_back(region);
+            start = runEnd;
+         }
+
+         ++runIter;
+      }
+   }
+
+   /* add the regions of the mappings, and of the gaps before each of them, with the runs carved out */
+   void AddMappings(MappingVector &mappings, RunMap &runs, VirtualMemory::RegionVector *regions)
+   {
+      MappingVector::iterator mappingIter;
+      RunMap::iterator runIter = runs.begin();
+      ULONG_PTR covered = 0;
+
+      regions->clear();
+      regions->reserve(mappings.size() * 2);
+
+      for (mappingIter=mappings.begin(); mappingIter!=mappings.end(); ++mappingIter)
+      {
+         if (mappingIter->start > covered)
+            AddRegions(covered, mappingIter->start, NULL, runs, runIter, regions);
+
+         AddRegions(max(covered, mappingIter->start), mappingIter->end, &*mappingIter, runs, runIter, regions);
+
+         if (regions->size() > 0)
+            covered = max(mappingIter->end, reinterpret_cast<ULONG_PTR>(regions->back().BaseAddress) + regions->back().RegionSize);
+      }
+   }
+}
+
+SIZE_T
+VirtualMemory::PageSize
+(void)
+{
+   static const SIZE_T pageSize = static_cast<SIZE_T>(sysconf(_SC_PAGESIZE));
+
+   return pageSize;
+}
+
+int
+VirtualMemory::NativeProtection
+(DWORD protection)
+{
+   /* the modifiers above the access values have nothing to map to */
+   switch (protection & 0xFF)
+   {
+   case PAGE_NOACCESS:
+      return PROT_NONE;
+
+   case PAGE_READONLY:
+      return PROT_READ;
+
+   case PAGE_READWRITE:
+   case PAGE_WRITECOPY:
+      return PROT_READ | PROT_WRITE;
+
+   case PAGE_EXECUTE:
+      return PROT_EXEC;
+
+   case PAGE_EXECUTE_READ:
+      return PROT_READ | PROT_EXEC;
+
+   case PAGE_EXECUTE_READWRITE:
+   case PAGE_EXECUTE_WRITECOPY:
+      return PROT_READ | PROT_WRITE | PROT_EXEC;
+
+   default:
+      return -1;
+   }
+}
+
+DWORD
+VirtualMemory::PageProtection
+(int protection)
+{
+   /* writable memory is always readable, whatever the flags say */
+   if ((protection & PROT_WRITE) != 0)
+      return ((protection & PROT_EXEC) != 0) ? PAGE_EXECUTE_READWRITE : PAGE_READWRITE;
+
+   if ((protection & PROT_READ) != 0)
+      return ((protection & PROT_EXEC) != 0) ? PAGE_EXECUTE_READ : PAGE_READONLY;
+
+   return ((protection & PROT_EXEC) != 0) ? PAGE_EXECUTE : PAGE_NOACCESS;
+}
+
+int
+VirtualMemory::NativeAllocation
+(DWORD allocationType)
+{
+   int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+   /* memory which is only reserved shouldn't count against the commit limit */
+   if ((allocationType & MEM_COMMIT) == 0)
+      flags |= MAP_NORESERVE;
+
+#ifdef MAP_HUGETLB
+   if ((allocationType & MEM_LARGE_PAGES) != 0)
+      flags |= MAP_HUGETLB;
+#endif
+
+   return flags;
+}
+
+LPVOID
+VirtualMemory::Allocate
+(HANDLE process, LPVOID address, SIZE_T size, DWORD allocationType, DWORD protection)
+{
+   Reservations &reserved = Reserved();
+   ULONG_PTR start = RoundDown(reinterpret_cast<ULONG_PTR>(address));
+   ULONG_PTR end = RoundUp(reinterpret_cast<ULONG_PTR>(address) + size);
+   int native = NativeProtection(protection);
+   bool commit = (allocationType & MEM_COMMIT) != 0;
+   LPVOID result;
+   Run run;
+
+   if (process != NULL)
+      throw Win32Exception(ENOSYS, EXCSTR(L"Only the current process is supported."));
+
+   if (size == 0)
+      throw Win32Exception(EINVAL, EXCSTR(L"Can't allocate zero bytes."));
+
+   if ((allocationType & MEM_RESET) != 0)
+   {
+      if (madvise(reinterpret_cast<LPVOID>(start), end - start, LazyFree) != 0)
+         throw Win32Exception(errno, EXCSTR(L"madvise failed."));
+
+      return address;
+   }
+
+   if (native == -1 || (allocationType & (MEM_COMMIT | MEM_RESERVE)) == 0)
+      throw Win32Exception(EINVAL, EXCSTR(L"Invalid allocation type or protection."));
+
+   std::lock_guard<std::mutex> guard(reserved.lock);
+
+   /* committing without reserving has to land in memory that's already reserved, unless it can go anywhere */
+   if (address != NULL && (allocationType & MEM_RESERVE) == 0)
+   {
+      if (!IsReserved(reserved.runs, start, end))
+         throw Win32Exception(EINVAL, EXCSTR(L"Memory to commit isn't reserved."));
+
+      if (mprotect(reinterpret_cast<LPVOID>(start), end - start, native) != 0)
+         throw Win32Exception(errno, EXCSTR(L"mprotect failed."));
+
+      Mark(reserved.runs, start, end, MEM_COMMIT, protection);
+
+      return reinterpret_cast<LPVOID>(start);
+   }
+
+   result = mmap(reinterpret_cast<LPVOID>(start)
+                 ,end - start
+                 ,(commit) ? native : PROT_NONE
+                 ,NativeAllocation(allocationType) | ((address != NULL) ? FixedAddress : 0)
+                 ,-1
+                 ,0);
+
+   if (result == MAP_FAILED)
+      throw Win32Exception(errno, EXCSTR(L"mmap failed."));
+
+   if (address != NULL && reinterpret_cast<ULONG_PTR>(result) != start)
+   {
+      munmap(result, end - start);
+      throw Win32Exception(EEXIST, EXCSTR(L"Address is already in use."));
+   }
+
+   run.size = end - start;
+   run.allocationBase = reinterpret_cast<ULONG_PTR>(result);
+   run.allocationProtect = protection;
+   run.state = (commit) ? MEM_COMMIT : MEM_RESERVE;
+   run.protect = (commit) ? protection : 0;
+   reserved.runs[run.allocationBase] = run;
+
+   return result;
+}
+
+void
+VirtualMemory::Free
+(HANDLE process, LPVOID address, SIZE_T size, DWORD freeType)
+{
+   Reservations &reserved = Reserved();
+   ULONG_PTR start = reinterpret_cast<ULONG_PTR>(address), end;
+   bool release = (freeType & MEM_RELEASE) != 0;
+   RunMap::iterator runIter;
+
+   if (process != NULL)
+      throw Win32Exception(ENOSYS, EXCSTR(L"Only the current process is supported."));
+
+   if (release == ((freeType & MEM_DECOMMIT) != 0))
+      throw Win32Exception(EINVAL, EXCSTR(L"Either release or decommit."));
+
+   if (release && size != 0)
+      throw Win32Exception(EINVAL, EXCSTR(L"Releasing takes a size of zero."));
+
+   std::lock_guard<std::mutex> guard(reserved.lock);
+
+   /* releasing, or decommitting without a size, covers the whole reservation from its base */
+   if (size == 0)
+   {
+      runIter = reserved.runs.find(start);
+
+      if (runIter == reserved.runs.end() || runIter->second.allocationBase != start)
+         throw Win32Exception(EINVAL, EXCSTR(L"Address isn't the base of a reservation."));
+
+      for (end=start; runIter!=reserved.runs.end() && runIter->second.allocationBase==start; ++runIter)
+         end = runIter->first + runIter->second.size;
+   }
+   else
+   {
+      start = RoundDown(start);
+      end = RoundUp(reinterpret_cast<ULONG_PTR>(address) + size);
+
+      if (!IsReserved(reserved.runs, start, end))
+         throw Win32Exception(EINVAL, EXCSTR(L"Memory to decommit isn't reserved."));
+   }
+
+   if (release)
+   {
+      if (munmap(reinterpret_cast<LPVOID>(start), end - start) != 0)
+         throw Win32Exception(errno, EXCSTR(L"munmap failed."));
+
+      reserved.runs.erase(reserved.runs.find(start), runIter);
+
+      return;
+   }
+
+   /* dropping the pages makes them come back zeroed, like recommitted pages on Windows */
+   if (madvise(reinterpret_cast<LPVOID>(start), end - start, MADV_DONTNEED) != 0)
+      throw Win32Exception(errno, EXCSTR(L"madvise failed."));
+
+   if (mprotect(reinterpret_cast<LPVOID>(start), end - start, PROT_NONE) != 0)
+      throw Win32Exception(errno, EXCSTR(L"mprotect failed."));
+
+   Mark(reserved.runs, start, end, MEM_RESERVE, 0);
+}
+
+DWORD
+VirtualMemory::Protect
+(HANDLE process, LPVOID address, SIZE_T size, DWORD protection)
+{
+   Reservations &reserved = Reserved();
+   ULONG_PTR start = RoundDown(reinterpret_cast<ULONG_PTR>(address));
+   ULONG_PTR end = RoundUp(reinterpret_cast<ULONG_PTR>(address) + size);
+   int native = NativeProtection(protection);
+   RunMap::iterator runIter;
+   DWORD oldProtect = 0;
+   Mapping mapping;
+   bool owned;
+
+   if (process != NULL)
+      throw Win32Exception(ENOSYS, EXCSTR(L"Only the current process is supported."));
+
+   if (native == -1)
+      throw Win32Exception(EINVAL, EXCSTR(L"Invalid protection."));
+
+   std::lock_guard<std::mutex> guard(reserved.lock);
+
+   /* like on Windows, protection can't be changed across reservations or on memory that isn't committed */
+   owned = Overlaps(reserved.runs, start, end);
+
+   if (owned)
+   {
+      if (!IsReserved(reserved.runs, start, end))
+         throw Win32Exception(EINVAL, EXCSTR(L"Memory spans more than one reservation."));
+
+      for (runIter=RunAt(reserved.runs, start); runIter!=reserved.runs.end() && runIter->first<end; ++runIter)
+         if (runIter->second.state != MEM_COMMIT)
+            throw Win32Exception(EINVAL, EXCSTR(L"Memory isn't committed."));
+
+      oldProtect = RunAt(reserved.runs, start)->second.protect;
+   }
+   else if (NextMapping(0, start, &mapping) && mapping.start <= start)
+      oldProtect = mapping.protect;
+
+   if (mprotect(reinterpret_cast<LPVOID>(start), end - start, native) != 0)
+      throw Win32Exception(errno, EXCSTR(L"mprotect failed."));
+
+   if (owned)
+      Mark(reserved.runs, start, end, MEM_COMMIT, protection);
+
+   return oldProtect;
+}
+
+void
+VirtualMemory::Lock
+(LPVOID address, SIZE_T size)
+{
+   ULONG_PTR start = RoundDown(reinterpret_cast<ULONG_PTR>(address));
+   ULONG_PTR end = RoundUp(reinterpret_cast<ULONG_PTR>(address) + size);
+
+   if (mlock(reinterpret_cast<LPVOID>(start), end - start) != 0)
+      throw Win32Exception(errno, EXCSTR(L"mlock failed."));
+}
+
+void
+VirtualMemory::Unlock
+(LPVOID address, SIZE_T size)
+{
+   ULONG_PTR start = RoundDown(reinterpret_cast<ULONG_PTR>(address));
+   ULONG_PTR end = RoundUp(reinterpret_cast<ULONG_PTR>(address) + size);
+
+   if (munlock(reinterpret_cast<LPVOID>(start), end - start) != 0)
+      throw Win32Exception(errno, EXCSTR(L"munlock failed."));
+}
+
+SIZE_T
+VirtualMemory::Query
+(HANDLE process, LPCVOID address, PMEMORY_BASIC_INFORMATION buffer, SIZE_T length)
+{
+   Reservations &reserved = Reserved();
+   ULONG_PTR start = RoundDown(reinterpret_cast<ULONG_PTR>(address));
+   ULONG_PTR nextRun = ~static_cast<ULONG_PTR>(0);
+   RunMap::iterator runIter;
+   Mapping mapping;
+
+   if (process != NULL || length < sizeof(MEMORY_BASIC_INFORMATION))
+      return 0;
+
+   {
+      std::lock_guard<std::mutex> guard(reserved.lock);
+
+      runIter = RunAt(reserved.runs, start);
+
+      /* like VirtualQuery, the region starts at the page asked about */
+      if (runIter != reserved.runs.end())
+      {
+         DescribeRun(start, runIter->first + runIter->second.size, runIter->second, buffer);
+
+         return sizeof(MEMORY_BASIC_INFORMATION);
+      }
+
+      runIter = reserved.runs.upper_bound(start);
+
+      if (runIter != reserved.runs.end())
+         nextRun = runIter->first;
+   }
+
+   /* past the last mapping there's nothing left to describe */
+   if (!NextMapping(0, start, &mapping))
+      return 0;
+
+   /* the kernel may have merged a reservation into the mapping next to it, so stop where the next one starts */
+   if (mapping.start > start)
+      DescribeForeign(start, min(mapping.start, nextRun), NULL, buffer);
+   else
+      DescribeForeign(start, min(mapping.end, nextRun), &mapping, buffer);
+
+   return sizeof(MEMORY_BASIC_INFORMATION);
+}
+
+void
+VirtualMemory::Enumerate
+(HANDLE process, RegionVector *regions)
+{
+   Reservations &reserved = Reserved();
+   MappingVector mappings;
+
+   if (process != NULL)
+      throw Win32Exception(ENOSYS, EXCSTR(L"Only the current process is supported."));
+
+   if (!ReadMappings(0, &mappings))
+      throw Win32Exception(errno, EXCSTR(L"Couldn't read the process's mappings."));
+
+   std::lock_guard<std::mutex> guard(reserved.lock);
+
+   AddMappings(mappings, reserved.runs, regions);
+}
+
+ProcessMemory::ProcessMemory
+(DWORD processID)
+   : processID(processID)
+   , memoryFile(-1)
+   , vectored(true)
+{
+   /* a process which exists but can't be signalled still exists */
+   if (processID == 0 || (kill(static_cast<pid_t>(processID), 0) != 0 && errno == ESRCH))
+      throw Win32Exception(ESRCH, EXCSTR(L"No such process."));
+}
+
+ProcessMemory::~ProcessMemory
+(void)
+{
+   if (this->memoryFile != -1)
+      close(this->memoryFile);
+}
+
+DWORD
+ProcessMemory::getProcessID
+(void) const noexcept
+{
+   return this->processID;
+}
+
+SIZE_T
+ProcessMemory::query
+(LPCVOID address, PMEMORY_BASIC_INFORMATION buffer, SIZE_T length) const
+{
+   ULONG_PTR start = RoundDown(reinterpret_cast<ULONG_PTR>(address));
+   Mapping mapping;
+
+   if (length < sizeof(MEMORY_BASIC_INFORMATION))
+      return 0;
+
+   if (!NextMapping(static_cast<pid_t>(this->processID), start, &mapping))
+      return 0;
+
+   if (mapping.start > start)
+      DescribeForeign(start, mapping.start, NULL, buffer);
+   else
+      DescribeForeign(start, mapping.end, &mapping, buffer);
+
+   return sizeof(MEMORY_BASIC_INFORMATION);
+}
+
+void
+ProcessMemory::enumerate
+(VirtualMemory::RegionVector *regions) const
+{
+   MappingVector mappings;
+   RunMap noRuns;
+
+   if (!ReadMappings(static_cast<pid_t>(this->processID), &mappings))
+      throw Win32Exception(errno, EXCSTR(L"Couldn't read the process's mappings."));
+
+   AddMappings(mappings, noRuns, regions);
+}
+
+void
+ProcessMemory::read
+(TransferVector *transfers)
+{
+   this->transfer(transfers, false);
+}
+
+void
+ProcessMemory::write
+(TransferVector *transfers)
+{
+   this->transfer(transfers, true);
+}
+
+SIZE_T
+ProcessMemory::read
+(LPCVOID address, LPVOID buffer, SIZE_T size)
+{
+   TransferVector transfers(1);
+
+   transfers[0].address = const_cast<LPVOID>(address);
+   transfers[0].buffer = buffer;
+   transfers[0].size = size;
+
+   this->transfer(&transfers, false);
+
+   return transfers[0].transferred;
+}
+
+SIZE_T
+ProcessMemory::write
+(LPVOID address, LPCVOID buffer, SIZE_T size)
+{
+   TransferVector transfers(1);
+
+   transfers[0].address = address;
+   transfers[0].buffer = const_cast<LPVOID>(buffer);
+   transfers[0].size = size;
+
+   this->transfer(&transfers, true);
+
+   return transfers[0].transferred;
+}
+
+void
+ProcessMemory::transfer
+(TransferVector *transfers, bool writing)
+{
+   struct iovec local[TransferBatchLimit], remote[TransferBatchLimit];
+   TransferVector::iterator transferIter, batchEnd;
+   SIZE_T count, piece;
+   ssize_t result;
+
+   for (transferIter=transfers->begin(); transferIter!=transfers->end(); ++transferIter)
+      transferIter->transferred = 0;
+
+   transferIter = transfers->begin();
+
+   /* transferIter is always the first range which isn't done. only it can be partway through */
+   while (transferIter != transfers->end())
+   {
+      if (transferIter->transferred == transferIter->size)
+      {
+         ++transferIter;
+         continue;
+      }
+
+      if (!this->vectored)
+      {
+         this->transferFile(transfers, transferIter - transfers->begin(), writing);
+         return;
+      }
+
+      for (count=0, batchEnd=transferIter; batchEnd!=transfers->end() && count<TransferBatchLimit; ++batchEnd)
+      {
+         if (batchEnd->transferred == batchEnd->size)
+            continue;
+
+         local[count].iov_base = static_cast<LPBYTE>(batchEnd->buffer) + batchEnd->transferred;
+         local[count].iov_len = batchEnd->size - batchEnd->transferred;
+         remote[count].iov_base = static_cast<LPBYTE>(batchEnd->address) + batchEnd->transferred;
+         remote[count].iov_len = local[count].iov_len;
+         ++count;
+      }
+
+      if (writing)
+         result = process_vm_writev(static_cast<pid_t>(this->processID), local, count, remote, count, 0);
+      else
+         result = process_vm_readv(static_cast<pid_t>(this->processID), local, count, remote, count, 0);
+
+      if (result == -1)
+      {
+         if (errno == ENOSYS || errno == EPERM)
+         {
+            this->vectored = false;
+            continue;
+         }
+
+         if (errno != EFAULT)
+            throw Win32Exception(errno, EXCSTR(L"Couldn't transfer memory of the process."));
+
+         result = 0;
+      }
+
+      /* nothing at all means the first range starts in a hole, so it's as done as it gets */
+      if (result == 0)
+      {
+         ++transferIter;
+         continue;
+      }
+
+      /* the kernel stops at the first hole, so the ranges before it are complete and the one it's in gets retried from there */
+      for (; transferIter!=batchEnd; ++transferIter)
+      {
+         piece = min(static_cast<SIZE_T>(result), transferIter->size - transferIter->transferred);
+         transferIter->transferred += piece;
+         result -= piece;
+
+         if (transferIter->transferred != transferIter->size)
+            break;
+      }
+   }
+}
+
+void
+ProcessMemory::transferFile
+(TransferVector *transfers, SIZE_T index, bool writing)
+{
+   char path[32];
+   LPBYTE buffer;
+   ssize_t result;
+
+   if (this->memoryFile == -1)
+   {
+      std::snprintf(path, sizeof(path), "/proc/%d/mem", static_cast<int>(this->processID));
+      this->memoryFile = open(path, O_RDWR | O_CLOEXEC);
+
+      if (this->memoryFile == -1)
+         throw Win32Exception(errno, EXCSTR(L"Couldn't open the process's memory."));
+   }
+
+   for (; index<transfers->size(); ++index)
+   {
+      Transfer &transfer = (*transfers)[index];
+
+      /* the file is read and written at the addresses themselves, and a hole comes back as an error */
+      while (transfer.transferred < transfer.size)
+      {
+         buffer = static_cast<LPBYTE>(transfer.buffer) + transfer.transferred;
+
+         if (writing)
+            result = pwrite(this->memoryFile
+                            ,buffer
+                            ,transfer.size - transfer.transferred
+                            ,static_cast<off_t>(reinterpret_cast<ULONG_PTR>(transfer.address) + transfer.transferred));
+         else
+            result = pread(this->memoryFile
+                           ,buffer
+                           ,transfer.size - transfer.transferred
+                           ,static_cast<off_t>(reinterpret_cast<ULONG_PTR>(transfer.address) + transfer.transferred));
+
+         if (result == -1 && errno == EINTR)
+            continue;
+
+         if (result <= 0)
+            break;
+
+         transfer.transferred += static_cast<SIZE_T>(result);
+      }
+   }
+}
+#endif
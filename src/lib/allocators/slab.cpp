@@ -0,0 +1,365 @@
+#include <neurology/allocators/slab.hpp>
+
+#include <algorithm>
+#include <mutex>
+
+#include <neurology/allocators/heap.hpp>
+
+using namespace Neurology;
+
+namespace
+{
+   /* guards which pool every thread cache belongs to, so a pool going away and
+      a thread exiting can't trip over each other. it's only taken the first
+      time a thread uses a pool and when either of them goes away. */
+   std::mutex CacheLock;
+}
+
+const SIZE_T SlabPool::ClassSizes[SlabPool::ClassCount] = {
+   8, 16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096
+};
+
+std::atomic<SIZE_T> SlabPool::NextID(1);
+thread_local SlabPool::ThreadCacheSet SlabPool::ThreadCaches;
+
+SlabPool::SizeClassException::SizeClassException
+(const SIZE_T size)
+   : Exception(EXCSTR(L"Size doesn't fall into any size class of the slab pool."))
+   , size(size)
+{
+}
+
+SlabPool::ThreadCache::ThreadCache
+(SlabPool *pool)
+   : poolID(pool->id)
+   , pool(pool)
+{
+   for (SIZE_T i=0; i<SlabPool::ClassCount; ++i)
+   {
+      this->lists[i].head = NULL;
+      this->lists[i].count = 0;
+   }
+}
+
+SlabPool::ThreadCacheSet::~ThreadCacheSet
+(void)
+{
+   ThreadCacheList::iterator cacheIter;
+   std::lock_guard<std::mutex> guard(CacheLock);
+
+   /* whatever the thread still has cached goes back to pools which are still
+      around. the caches of pools which aren't have nothing worth keeping. */
+   for (cacheIter=this->caches.begin(); cacheIter!=this->caches.end(); ++cacheIter)
+   {
+      SlabPool *pool = (*cacheIter)->pool;
+
+      if (pool != NULL)
+      {
+         pool->drain(*cacheIter);
+         pool->caches.erase(std::find(pool->caches.begin(), pool->caches.end(), *cacheIter));
+      }
+
+      delete *cacheIter;
+   }
+
+   this->caches.clear();
+}
+
+SlabPool::SlabPool
+(void)
+   : id(SlabPool::NextID++)
+   , heap(NULL)
+{
+   this->initialize();
+}
+
+SlabPool::SlabPool
+(PrivateHeap *heap)
+   : id(SlabPool::NextID++)
+   , heap(heap)
+{
+   this->initialize();
+}
+
+SlabPool::~SlabPool
+(void)
+{
+   /* the caches belong to their threads, so they're only cut loose here.
+      whatever they hold goes away with the spans. */
+   {
+      std::lock_guard<std::mutex> guard(CacheLock);
+
+      for (ThreadCacheList::iterator cacheIter=this->caches.begin(); cacheIter!=this->caches.end(); ++cacheIter)
+         (*cacheIter)->pool = NULL;
+
+      this->caches.clear();
+   }
+
+   /* a span the heap won't take back is leaked, since a destructor can't throw */
+   for (SpanList::iterator spanIter=this->spans.begin(); spanIter!=this->spans.end(); ++spanIter)
+   {
+      if (this->heap == NULL)
+      {
+         delete[] *spanIter;
+         continue;
+      }
+
+      try
+      {
+         this->heap->free(*spanIter);
+      }
+      catch (...)
+      {
+      }
+   }
+
+   this->spans.clear();
+
+   DeleteCriticalSection(&this->lock);
+}
+
+SIZE_T
+SlabPool::sizeClass
+(SIZE_T size) noexcept
+{
+   const SIZE_T *classIter;
+
+   if (size == 0 || size > SlabPool::MaximumSize)
+      return SlabPool::NoClass;
+
+   classIter = std::lower_bound(SlabPool::ClassSizes, SlabPool::ClassSizes+SlabPool::ClassCount, size);
+
+   return static_cast<SIZE_T>(classIter - SlabPool::ClassSizes);
+}
+
+bool
+SlabPool::isSlabSize
+(SIZE_T size) noexcept
+{
+   return size > 0 && size <= SlabPool::MaximumSize;
+}
+
+SIZE_T
+SlabPool::capacity
+(void) const noexcept
+{
+   SIZE_T spanCount;
+
+   EnterCriticalSection(&this->lock);
+   spanCount = this->spans.size();
+   LeaveCriticalSection(&this->lock);
+
+   return spanCount * SlabPool::SpanSize;
+}
+
+LPVOID
+SlabPool::allocate
+(SIZE_T size)
+{
+   SIZE_T sizeClass = SlabPool::sizeClass(size);
+   FreeList *list;
+   LPVOID block;
+
+   if (sizeClass == SlabPool::NoClass)
+      throw SizeClassException(size);
+
+   list = &this->threadCache()->lists[sizeClass];
+
+   if (list->head == NULL)
+      this->refill(list, sizeClass);
+
+   block = list->head;
+   list->head = *static_cast<LPVOID *>(block);
+   --list->count;
+
+   return block;
+}
+
+void
+SlabPool::free
+(LPVOID block, SIZE_T size)
+{
+   SIZE_T sizeClass = SlabPool::sizeClass(size);
+   FreeList *list;
+
+   if (sizeClass == SlabPool::NoClass)
+      throw SizeClassException(size);
+
+   list = &this->threadCache()->lists[sizeClass];
+
+   *static_cast<LPVOID *>(block) = list->head;
+   list->head = block;
+   ++list->count;
+
+   if (list->count >= SlabPool::CacheBatch*2)
+      this->flush(list, sizeClass);
+}
+
+void
+SlabPool::initialize
+(void)
+{
+   InitializeCriticalSectionAndSpinCount(&this->lock, SlabPool::SpinCount);
+
+   for (SIZE_T i=0; i<SlabPool::ClassCount; ++i)
+   {
+      this->shared[i].head = NULL;
+      this->shared[i].count = 0;
+   }
+}
+
+SlabPool::ThreadCache *
+SlabPool::threadCache
+(void)
+{
+   ThreadCacheList &caches = SlabPool::ThreadCaches.caches;
+
+   if (caches.size() > 0 && caches.front()->poolID == this->id)
+      return caches.front();
+
+   return this->findCache();
+}
+
+SlabPool::ThreadCache *
+SlabPool::findCache
+(void)
+{
+   ThreadCacheList &caches = SlabPool::ThreadCaches.caches;
+   ThreadCacheList::iterator cacheIter;
+   ThreadCache *cache;
+
+   /* a pool this thread has used before just moves to the front */
+   for (cacheIter=caches.begin(); cacheIter!=caches.end(); ++cacheIter)
+   {
+      if ((*cacheIter)->poolID == this->id)
+      {
+         std::iter_swap(caches.begin(), cacheIter);
+         return caches.front();
+      }
+   }
+
+   std::lock_guard<std::mutex> guard(CacheLock);
+
+   /* while we're here, drop the caches of pools which are gone */
+   for (cacheIter=caches.begin(); cacheIter!=caches.end();)
+   {
+      if ((*cacheIter)->pool != NULL)
+      {
+         ++cacheIter;
+         continue;
+      }
+
+      delete *cacheIter;
+      cacheIter = caches.erase(cacheIter);
+   }
+
+   /* the pool learns about the cache first. if the thread's list can't take
+      it, the cache is only leaked, rather than left for a dead pool to drain. */
+   cache = new ThreadCache(this);
+   this->caches.push_back(cache);
+   caches.insert(caches.begin(), cache);
+
+   return cache;
+}
+
+void
+SlabPool::refill
+(FreeList *list, SIZE_T sizeClass)
+{
+   FreeList &shared = this->shared[sizeClass];
+   SIZE_T blockSize = SlabPool::ClassSizes[sizeClass];
+
+   EnterCriticalSection(&this->lock);
+
+   /* carve a fresh span into blocks if nothing is left to hand out */
+   if (shared.head == NULL)
+   {
+      LPBYTE span;
+      SIZE_T blockCount = SlabPool::SpanSize / blockSize;
+
+      if (this->heap == NULL)
+         span = new BYTE[SlabPool::SpanSize];
+      else if ((span = static_cast<LPBYTE>(this->heap->allocate(SlabPool::SpanSize, false))) == NULL)
+      {
+         LeaveCriticalSection(&this->lock);
+         throw Win32Exception(EXCSTR(L"Couldn't allocate a span from the heap."));
+      }
+
+      this->spans.push_back(span);
+
+      for (SIZE_T i=0; i<blockCount; ++i)
+      {
+         LPVOID block = span + i*blockSize;
+
+         *static_cast<LPVOID *>(block) = shared.head;
+         shared.head = block;
+      }
+
+      shared.count += blockCount;
+   }
+
+   while (shared.head != NULL && list->count < SlabPool::CacheBatch)
+   {
+      LPVOID block = shared.head;
+
+      shared.head = *static_cast<LPVOID *>(block);
+      --shared.count;
+
+      *static_cast<LPVOID *>(block) = list->head;
+      list->head = block;
+      ++list->count;
+   }
+
+   LeaveCriticalSection(&this->lock);
+}
+
+void
+SlabPool::flush
+(FreeList *list, SIZE_T sizeClass)
+{
+   FreeList &shared = this->shared[sizeClass];
+
+   EnterCriticalSection(&this->lock);
+
+   while (list->head != NULL && list->count > SlabPool::CacheBatch)
+   {
+      LPVOID block = list->head;
+
+      list->head = *static_cast<LPVOID *>(block);
+      --list->count;
+
+      *static_cast<LPVOID *>(block) = shared.head;
+      shared.head = block;
+      ++shared.count;
+   }
+
+   LeaveCriticalSection(&this->lock);
+}
+
+void
+SlabPool::drain
+(ThreadCache *cache)
+{
+   EnterCriticalSection(&this->lock);
+
+   for (SIZE_T i=0; i<SlabPool::ClassCount; ++i)
+   {
+      FreeList &list = cache->lists[i];
+      FreeList &shared = this->shared[i];
+
+      while (list.head != NULL)
+      {
+         LPVOID block = list.head;
+
+         list.head = *static_cast<LPVOID *>(block);
+
+         *static_cast<LPVOID *>(block) = shared.head;
+         shared.head = block;
+      }
+
+      shared.count += list.count;
+      list.count = 0;
+   }
+
+   LeaveCriticalSection(&this->lock);
+}
@@ -0,0 +1,261 @@
+#include <neurology/allocators/statistics.hpp>
+
+using namespace Neurology;
+
+namespace
+{
+   SIZE_T LatencyBucket(SIZE_T nanoseconds)
+   {
+      SIZE_T bucket = 0;
+
+      for (; nanoseconds > 1 && bucket < AllocatorStatistics::LatencyBuckets-1; nanoseconds >>= 1)
+         ++bucket;
+
+      return bucket;
+   }
+
+   /* shrink a gauge without letting it wrap around below zero */
+   void Drain(std::atomic<SIZE_T> *gauge, SIZE_T amount)
+   {
+      SIZE_T current = gauge->load(std::memory_order_relaxed);
+
+      while (!gauge->compare_exchange_weak(current, (amount > current) ? 0 : current - amount, std::memory_order_relaxed));
+   }
+}
+
+AllocatorStatistics::Measurement::Measurement
+(AllocatorStatistics *statistics, Operation operation, SIZE_T bytes)
+   : statistics(statistics)
+   , operation(operation)
+   , bytes(bytes)
+   , start(std::chrono::steady_clock::now())
+{
+}
+
+AllocatorStatistics::Measurement::~Measurement
+(void)
+{
+   std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - this->start;
+
+   this->statistics->record(this->operation
+                            ,this->bytes
+                            ,static_cast<SIZE_T>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+}
+
+SIZE_T
+AllocatorStatistics::Snapshot::percentile
+(Operation operation, double fraction) const noexcept
+{
+   SIZE_T wanted, seen = 0;
+
+   if (this->calls[operation] == 0)
+      return 0;
+
+   wanted = static_cast<SIZE_T>(fraction * this->calls[operation]);
+
+   if (wanted == 0)
+      wanted = 1;
+
+   for (SIZE_T bucket=0; bucket<AllocatorStatistics::LatencyBuckets; ++bucket)
+   {
+      seen += this->latencies[operation][bucket];
+
+      if (seen >= wanted)
+         return static_cast<SIZE_T>(1) << (bucket+1);
+   }
+
+   return static_cast<SIZE_T>(1) << AllocatorStatistics::LatencyBuckets;
+}
+
+std::string
+AllocatorStatistics::Snapshot::text
+(void) const
+{
+   std::string result;
+
+   result += "live bytes: " + std::to_string(this->liveBytes) + "\n";
+   result += "live allocations: " + std::to_string(this->liveAllocations) + "\n";
+   result += "peak bytes: " + std::to_string(this->peakBytes) + "\n";
+
+   for (SIZE_T operation=0; operation<AllocatorStatistics::OperationCount; ++operation)
+   {
+      Operation current = static_cast<Operation>(operation);
+
+      result += std::string(AllocatorStatistics::OperationName(current)) + ":";
+      result += " calls " + std::to_string(this->calls[operation]);
+      result += ", bytes " + std::to_string(this->bytes[operation]);
+      result += ", total ns " + std::to_string(this->nanoseconds[operation]);
+      result += ", p50 ns < " + std::to_string(this->percentile(current, 0.5));
+      result += ", p99 ns < " + std::to_string(this->percentile(current, 0.99));
+      result += "\n";
+   }
+
+   return result;
+}
+
+std::string
+AllocatorStatistics::Snapshot::json
+(void) const
+{
+   std::string result;
+
+   result += "{\"live_bytes\":" + std::to_string(this->liveBytes);
+   result += ",\"live_allocations\":" + std::to_string(this->liveAllocations);
+   result += ",\"peak_bytes\":" + std::to_string(this->peakBytes);
+   result += ",\"operations\":{";
+
+   for (SIZE_T operation=0; operation<AllocatorStatistics::OperationCount; ++operation)
+   {
+      if (operation > 0)
+         result += ",";
+
+      result += "\"" + std::string(AllocatorStatistics::OperationName(static_cast<Operation>(operation))) + "\":{";
+      result += "\"calls\":" + std::to_string(this->calls[operation]);
+      result += ",\"bytes\":" + std::to_string(this->bytes[operation]);
+      result += ",\"nanoseconds\":" + std::to_string(this->nanoseconds[operation]);
+      result += ",\"latency_buckets\":[";
+
+      for (SIZE_T bucket=0; bucket<AllocatorStatistics::LatencyBuckets; ++bucket)
+      {
+         if (bucket > 0)
+            result += ",";
+
+         result += std::to_string(this->latencies[operation][bucket]);
+      }
+
+      result += "]}";
+   }
+
+   result += "}}\n";
+
+   return result;
+}
+
+void
+AllocatorStatistics::Snapshot::save
+(LPCWSTR filename, Format format) const
+{
+   std::string contents = (format == FormatJSON) ? this->json() : this->text();
+   HANDLE file;
+   DWORD written;
+   BOOL result;
+
+   file = CreateFileW(filename, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+
+   if (file == INVALID_HANDLE_VALUE)
+      throw Win32Exception(EXCSTR(L"CreateFile failed."));
+
+   result = WriteFile(file, contents.data(), static_cast<DWORD>(contents.size()), &written, NULL);
+   CloseHandle(file);
+
+   if (result == FALSE || written != contents.size())
+      throw Win32Exception(EXCSTR(L"WriteFile failed."));
+}
+
+const char *
+AllocatorStatistics::OperationName
+(Operation operation) noexcept
+{
+   switch (operation)
+   {
+   case Allocate:
+      return "allocate";
+
+   case Reallocate:
+      return "reallocate";
+
+   case Deallocate:
+      return "deallocate";
+
+   case Find:
+      return "find";
+
+   case Read:
+      return "read";
+
+   case Write:
+      return "write";
+
+   default:
+      return "unknown";
+   }
+}
+
+AllocatorStatistics::AllocatorStatistics
+(void)
+   : liveBytes(0)
+   , liveAllocations(0)
+   , peakBytes(0)
+{
+   this->reset();
+}
+
+void
+AllocatorStatistics::record
+(Operation operation, SIZE_T bytes, SIZE_T nanoseconds) noexcept
+{
+   this->calls[operation].fetch_add(1, std::memory_order_relaxed);
+   this->bytes[operation].fetch_add(bytes, std::memory_order_relaxed);
+   this->nanoseconds[operation].fetch_add(nanoseconds, std::memory_order_relaxed);
+   this->latencies[operation][LatencyBucket(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void
+AllocatorStatistics::grow
+(SIZE_T bytes, SIZE_T allocations) noexcept
+{
+   SIZE_T live = this->liveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+   SIZE_T peak = this->peakBytes.load(std::memory_order_relaxed);
+
+   this->liveAllocations.fetch_add(allocations, std::memory_order_relaxed);
+
+   while (live > peak && !this->peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed));
+}
+
+void
+AllocatorStatistics::shrink
+(SIZE_T bytes, SIZE_T allocations) noexcept
+{
+   Drain(&this->liveBytes, bytes);
+   Drain(&this->liveAllocations, allocations);
+}
+
+AllocatorStatistics::Snapshot
+AllocatorStatistics::snapshot
+(void) const noexcept
+{
+   Snapshot result;
+
+   for (SIZE_T operation=0; operation<AllocatorStatistics::OperationCount; ++operation)
+   {
+      result.calls[operation] = this->calls[operation].load(std::memory_order_relaxed);
+      result.bytes[operation] = this->bytes[operation].load(std::memory_order_relaxed);
+      result.nanoseconds[operation] = this->nanoseconds[operation].load(std::memory_order_relaxed);
+
+      for (SIZE_T bucket=0; bucket<AllocatorStatistics::LatencyBuckets; ++bucket)
+         result.latencies[operation][bucket] = this->latencies[operation][bucket].load(std::memory_order_relaxed);
+   }
+
+   result.liveBytes = this->liveBytes.load(std::memory_order_relaxed);
+   result.liveAllocations = this->liveAllocations.load(std::memory_order_relaxed);
+   result.peakBytes = this->peakBytes.load(std::memory_order_relaxed);
+
+   return result;
+}
+
+void
+AllocatorStatistics::reset
+(void) noexcept
+{
+   for (SIZE_T operation=0; operation<AllocatorStatistics::OperationCount; ++operation)
+   {
+      this->calls[operation].store(0, std::memory_order_relaxed);
+      this->bytes[operation].store(0, std::memory_order_relaxed);
+      this->nanoseconds[operation].store(0, std::memory_order_relaxed);
+
+      for (SIZE_T bucket=0; bucket<AllocatorStatistics::LatencyBuckets; ++bucket)
+         this->latencies[operation][bucket].store(0, std::memory_order_relaxed);
+   }
+
+   this->peakBytes.store(this->liveBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
@@ -0,0 +1,275 @@
+#include <neurology/allocators/table.hpp>
+
+using namespace Neurology;
+
+const AllocationTable::Handle AllocationTable::NullHandle = { AllocationTable::NoSlot, 0 };
+
+AllocationTable::FullTableException::FullTableException
+(void)
+   : Exception(EXCSTR(L"Every slot of the allocation table is in use."))
+{
+}
+
+AllocationTable::AllocationTable
+(void)
+   : freeSlot(AllocationTable::NoSlot)
+   , liveCount(0)
+{
+}
+
+SIZE_T
+AllocationTable::size
+(void) const noexcept
+{
+   return this->liveCount;
+}
+
+SIZE_T
+AllocationTable::capacity
+(void) const noexcept
+{
+   return this->slots.size();
+}
+
+bool
+AllocationTable::holds
+(DWORD slot, const Allocation *allocation) const noexcept
+{
+   return allocation != NULL && slot < this->slots.size() && this->slots[slot].allocation == allocation;
+}
+
+bool
+AllocationTable::isLive
+(const Handle &handle) const noexcept
+{
+   return this->resolve(handle) != NULL;
+}
+
+Allocation *
+AllocationTable::resolve
+(const Handle &handle) const noexcept
+{
+   if (handle.slot >= this->slots.size())
+      return NULL;
+
+   const Slot &slot = this->slots[handle.slot];
+
+   if (slot.generation != handle.generation)
+      return NULL;
+
+   return slot.allocation;
+}
+
+AllocationTable::Handle
+AllocationTable::handle
+(DWORD slot) const noexcept
+{
+   Handle result;
+
+   if (slot >= this->slots.size() || this->slots[slot].allocation == NULL)
+      return AllocationTable::NullHandle;
+
+   result.slot = slot;
+   result.generation = this->slots[slot].generation;
+
+   return result;
+}
+
+AllocationTable::Slot &
+AllocationTable::at
+(DWORD slot) noexcept
+{
+   return this->slots[slot];
+}
+
+const AllocationTable::Slot &
+AllocationTable::at
+(DWORD slot) const noexcept
+{
+   return this->slots[slot];
+}
+
+DWORD
+AllocationTable::claim
+(Allocation *allocation, Label address)
+{
+   DWORD index;
+
+   if (this->freeSlot != AllocationTable::NoSlot)
+   {
+      index = this->freeSlot;
+      this->freeSlot = this->slots[index].nextSibling;
+   }
+   else
+   {
+      Slot fresh;
+
+      /* the last index is NoSlot itself */
+      if (this->slots.size() >= AllocationTable::NoSlot)
+         throw FullTableException();
+
+      fresh.generation = 0;
+      index = static_cast<DWORD>(this->slots.size());
+      this->slots.push_back(fresh);
+   }
+
+   Slot &slot = this->slots[index];
+
+   slot.allocation = allocation;
+   slot.address = address;
+   slot.parent = AllocationTable::NoSlot;
+   slot.firstChild = AllocationTable::NoSlot;
+   slot.previousSibling = AllocationTable::NoSlot;
+   slot.nextSibling = AllocationTable::NoSlot;
+   slot.previousBound = AllocationTable::NoSlot;
+   slot.nextBound = AllocationTable::NoSlot;
+
+   ++this->liveCount;
+
+   return index;
+}
+
+void
+AllocationTable::release
+(DWORD slot)
+{
+   DWORD child;
+
+   this->orphan(slot);
+
+   /* whatever children are left lose their parent along with the slot */
+   child = this->slots[slot].firstChild;
+
+   while (child != AllocationTable::NoSlot)
+   {
+      DWORD next = this->slots[child].nextSibling;
+
+      this->slots[child].parent = AllocationTable::NoSlot;
+      this->slots[child].previousSibling = AllocationTable::NoSlot;
+      this->slots[child].nextSibling = AllocationTable::NoSlot;
+      child = next;
+   }
+
+   Slot &freed = this->slots[slot];
+
+   freed.allocation = NULL;
+   freed.address = 0;
+   freed.firstChild = AllocationTable::NoSlot;
+   ++freed.generation;
+
+   freed.nextSibling = this->freeSlot;
+   this->freeSlot = slot;
+
+   --this->liveCount;
+}
+
+void
+AllocationTable::clear
+(void)
+{
+   DWORD index;
+
+   this->freeSlot = AllocationTable::NoSlot;
+
+   /* every family and bound list goes at once, so there's nothing to untangle.
+      going backwards leaves the free list in order, lowest slot first. */
+   for (index=static_cast<DWORD>(this->slots.size()); index-- > 0;)
+   {
+      Slot &freed = this->slots[index];
+
+      if (freed.allocation != NULL)
+         ++freed.generation;
+
+      freed.allocation = NULL;
+      freed.address = 0;
+      freed.parent = AllocationTable::NoSlot;
+      freed.firstChild = AllocationTable::NoSlot;
+      freed.previousSibling = AllocationTable::NoSlot;
+      freed.previousBound = AllocationTable::NoSlot;
+      freed.nextBound = AllocationTable::NoSlot;
+
+      freed.nextSibling = this->freeSlot;
+      this->freeSlot = index;
+   }
+
+   this->liveCount = 0;
+}
+
+void
+AllocationTable::adopt
+(DWORD parent, DWORD child)
+{
+   Slot &childSlot = this->slots[child];
+   Slot &parentSlot = this->slots[parent];
+
+   if (childSlot.parent == parent)
+      return;
+
+   this->orphan(child);
+
+   childSlot.parent = parent;
+   childSlot.previousSibling = AllocationTable::NoSlot;
+   childSlot.nextSibling = parentSlot.firstChild;
+
+   if (parentSlot.firstChild != AllocationTable::NoSlot)
+      this->slots[parentSlot.firstChild].previousSibling = child;
+
+   parentSlot.firstChild = child;
+}
+
+void
+AllocationTable::orphan
+(DWORD child)
+{
+   Slot &childSlot = this->slots[child];
+
+   if (childSlot.parent == AllocationTable::NoSlot)
+      return;
+
+   if (childSlot.previousSibling != AllocationTable::NoSlot)
+      this->slots[childSlot.previousSibling].nextSibling = childSlot.nextSibling;
+   else
+      this->slots[childSlot.parent].firstChild = childSlot.nextSibling;
+
+   if (childSlot.nextSibling != AllocationTable::NoSlot)
+      this->slots[childSlot.nextSibling].previousSibling = childSlot.previousSibling;
+
+   childSlot.parent = AllocationTable::NoSlot;
+   childSlot.previousSibling = AllocationTable::NoSlot;
+   childSlot.nextSibling = AllocationTable::NoSlot;
+}
+
+void
+AllocationTable::link
+(SlotList *list, DWORD slot)
+{
+   Slot &linked = this->slots[slot];
+
+   linked.previousBound = AllocationTable::NoSlot;
+   linked.nextBound = list->first;
+
+   if (list->first != AllocationTable::NoSlot)
+      this->slots[list->first].previousBound = slot;
+
+   list->first = slot;
+   ++list->count;
+}
+
+void
+AllocationTable::unlink
+(SlotList *list, DWORD slot)
+{
+   Slot &linked = this->slots[slot];
+
+   if (linked.previousBound != AllocationTable::NoSlot)
+      this->slots[linked.previousBound].nextBound = linked.nextBound;
+   else
+      list->first = linked.nextBound;
+
+   if (linked.nextBound != AllocationTable::NoSlot)
+      this->slots[linked.nextBound].previousBound = linked.previousBound;
+
+   linked.previousBound = AllocationTable::NoSlot;
+   linked.nextBound = AllocationTable::NoSlot;
+   --list->count;
+}
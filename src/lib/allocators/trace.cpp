@@ -0,0 +1,478 @@
+#include <neurology/allocators/trace.hpp>
+
+using namespace Neurology;
+
+const BYTE TraceRecorder::Magic[4] = { 'N', 'T', 'R', 'C' };
+
+TraceRecorder::TraceRecorder
+(void)
+   : nextBlock(0)
+   , file(INVALID_HANDLE_VALUE)
+   , events(0)
+   , broken(false)
+   , lastEvent(std::chrono::steady_clock::now())
+{
+   InitializeCriticalSection(&this->lock);
+
+   this->buffer.assign(TraceRecorder::Magic, TraceRecorder::Magic+sizeof(TraceRecorder::Magic));
+   this->buffer.push_back(static_cast<BYTE>(TraceRecorder::Version));
+}
+
+TraceRecorder::TraceRecorder
+(LPCWSTR filename)
+   : nextBlock(0)
+   , file(INVALID_HANDLE_VALUE)
+   , events(0)
+   , broken(false)
+   , lastEvent(std::chrono::steady_clock::now())
+{
+   this->file = CreateFileW(filename, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+
+   if (this->file == INVALID_HANDLE_VALUE)
+      throw Win32Exception(EXCSTR(L"CreateFile failed."));
+
+   InitializeCriticalSection(&this->lock);
+
+   this->buffer.assign(TraceRecorder::Magic, TraceRecorder::Magic+sizeof(TraceRecorder::Magic));
+   this->buffer.push_back(static_cast<BYTE>(TraceRecorder::Version));
+}
+
+TraceRecorder::~TraceRecorder
+(void)
+{
+   this->flush();
+
+   if (this->file != INVALID_HANDLE_VALUE)
+      CloseHandle(this->file);
+
+   DeleteCriticalSection(&this->lock);
+}
+
+void
+TraceRecorder::allocated
+(Label address, SIZE_T size) noexcept
+{
+   EnterCriticalSection(&this->lock);
+
+   try
+   {
+      Block block;
+
+      block.number = this->nextBlock++;
+      block.size = size;
+      this->blocks[address] = block;
+
+      this->record(AllocatorStatistics::Allocate, block.number, 0, size);
+   }
+   catch (...)
+   {
+      this->broken = true;
+   }
+
+   LeaveCriticalSection(&this->lock);
+}
+
+void
+TraceRecorder::reallocated
+(Label oldAddress, Label newAddress, SIZE_T size) noexcept
+{
+   BlockMap::iterator blockIter;
+
+   EnterCriticalSection(&this->lock);
+
+   try
+   {
+      Block block;
+
+      blockIter = this->blocks.find(oldAddress);
+
+      /* memory the recorder never saw being pooled starts out here. the
+         lock can be entered again by the same thread. */
+      if (blockIter == this->blocks.end())
+         this->allocated(newAddress, size);
+      else
+      {
+         block = blockIter->second;
+         block.size = size;
+         this->blocks.erase(blockIter);
+         this->blocks[newAddress] = block;
+
+         this->record(AllocatorStatistics::Reallocate, block.number, 0, size);
+      }
+   }
+   catch (...)
+   {
+      this->broken = true;
+   }
+
+   LeaveCriticalSection(&this->lock);
+}
+
+void
+TraceRecorder::deallocated
+(Label address) noexcept
+{
+   BlockMap::iterator blockIter;
+
+   EnterCriticalSection(&this->lock);
+
+   try
+   {
+      blockIter = this->blocks.find(address);
+
+      if (blockIter != this->blocks.end())
+      {
+         this->record(AllocatorStatistics::Deallocate, blockIter->second.number, 0, blockIter->second.size);
+         this->blocks.erase(blockIter);
+      }
+   }
+   catch (...)
+   {
+      this->broken = true;
+   }
+
+   LeaveCriticalSection(&this->lock);
+}
+
+void
+TraceRecorder::accessed
+(AllocatorStatistics::Operation operation, Label address, SIZE_T size) noexcept
+{
+   BlockMap::iterator blockIter;
+
+   EnterCriticalSection(&this->lock);
+
+   try
+   {
+      /* the block starting closest below the address, if it reaches that far */
+      blockIter = this->blocks.upper_bound(address);
+
+      if (blockIter != this->blocks.begin() && address - (--blockIter)->first < blockIter->second.size)
+         this->record(operation, blockIter->second.number, address - blockIter->first, size);
+      else
+         this->record(operation, TraceRecorder::NoBlock, address, size);
+   }
+   catch (...)
+   {
+      this->broken = true;
+   }
+
+   LeaveCriticalSection(&this->lock);
+}
+
+Data
+TraceRecorder::contents
+(void) const
+{
+   Data result;
+
+   EnterCriticalSection(&this->lock);
+   result = this->buffer;
+   LeaveCriticalSection(&this->lock);
+
+   return result;
+}
+
+void
+TraceRecorder::flush
+(void) noexcept
+{
+   EnterCriticalSection(&this->lock);
+
+   try
+   {
+      this->writeBuffer();
+   }
+   catch (...)
+   {
+      this->broken = true;
+   }
+
+   LeaveCriticalSection(&this->lock);
+}
+
+SIZE_T
+TraceRecorder::eventCount
+(void) const noexcept
+{
+   SIZE_T result;
+
+   EnterCriticalSection(&this->lock);
+   result = this->events;
+   LeaveCriticalSection(&this->lock);
+
+   return result;
+}
+
+bool
+TraceRecorder::failed
+(void) const noexcept
+{
+   bool result;
+
+   EnterCriticalSection(&this->lock);
+   result = this->broken;
+   LeaveCriticalSection(&this->lock);
+
+   return result;
+}
+
+void
+TraceRecorder::record
+(AllocatorStatistics::Operation operation, DWORD block, SIZE_T offset, SIZE_T size)
+{
+   std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+   this->buffer.push_back(static_cast<BYTE>(operation));
+   TraceRecorder::Encode(&this->buffer, GetCurrentThreadId());
+   TraceRecorder::Encode(&this->buffer, std::chrono::duration_cast<std::chrono::nanoseconds>(now - this->lastEvent).count());
+   TraceRecorder::Encode(&this->buffer, (block == TraceRecorder::NoBlock) ? 0 : static_cast<ULONGLONG>(block)+1);
+   TraceRecorder::Encode(&this->buffer, offset);
+   TraceRecorder::Encode(&this->buffer, size);
+
+   this->lastEvent = now;
+   ++this->events;
+
+   if (this->buffer.size() >= TraceRecorder::FlushThreshold)
+      this->writeBuffer();
+}
+
+void
+TraceRecorder::writeBuffer
+(void)
+{
+   DWORD written;
+
+   if (this->file == INVALID_HANDLE_VALUE || this->buffer.size() == 0)
+      return;
+
+   if (WriteFile(this->file, this->buffer.data(), static_cast<DWORD>(this->buffer.size()), &written, NULL) == FALSE
+       || written != this->buffer.size())
+      throw Win32Exception(EXCSTR(L"WriteFile failed."));
+
+   this->buffer.clear();
+}
+
+void
+TraceRecorder::Encode
+(Data *buffer, ULONGLONG value)
+{
+   while (value >= 0x80)
+   {
+      buffer->push_back(static_cast<BYTE>(value | 0x80));
+      value >>= 7;
+   }
+
+   buffer->push_back(static_cast<BYTE>(value));
+}
+
+TraceReplay::CorruptTraceException::CorruptTraceException
+(SIZE_T offset)
+   : Exception(EXCSTR(L"The trace couldn't be decoded."))
+   , offset(offset)
+{
+}
+
+TraceReplay::TraceReplay
+(const Data &trace)
+   : blockCount(0)
+{
+   this->decode(trace);
+}
+
+TraceReplay::TraceReplay
+(LPCWSTR filename)
+   : blockCount(0)
+{
+   HANDLE file;
+   Data trace;
+   BYTE chunk[0x10000];
+   DWORD bytesRead;
+
+   file = CreateFileW(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+   if (file == INVALID_HANDLE_VALUE)
+      throw Win32Exception(EXCSTR(L"CreateFile failed."));
+
+   do
+   {
+      if (ReadFile(file, chunk, sizeof(chunk), &bytesRead, NULL) == FALSE)
+      {
+         CloseHandle(file);
+         throw Win32Exception(EXCSTR(L"ReadFile failed."));
+      }
+
+      trace.insert(trace.end(), chunk, chunk+bytesRead);
+   } while (bytesRead > 0);
+
+   CloseHandle(file);
+
+   this->decode(trace);
+}
+
+const TraceReplay::EventList &
+TraceReplay::events
+(void) const noexcept
+{
+   return this->eventList;
+}
+
+TraceReplay::Result
+TraceReplay::run
+(Allocator &allocator) const
+{
+   std::vector<Allocation> live(this->blockCount);
+   std::vector<Label> bases(this->blockCount, 0);
+   std::vector<SIZE_T> sizes(this->blockCount, 0);
+   std::chrono::steady_clock::time_point start, finish;
+   Data scratch;
+   SIZE_T liveBytes = 0;
+   Result result;
+
+   ZeroMemory(&result, sizeof(result));
+
+   start = std::chrono::steady_clock::now();
+
+   for (EventList::const_iterator eventIter=this->eventList.begin(); eventIter!=this->eventList.end(); ++eventIter)
+   {
+      DWORD block = eventIter->block;
+
+      ++result.events;
+
+      if (block == TraceRecorder::NoBlock
+          || (eventIter->operation != AllocatorStatistics::Allocate && !live[block].isBound())
+          || (eventIter->operation == AllocatorStatistics::Allocate && live[block].isBound()))
+      {
+         ++result.skipped;
+         continue;
+      }
+
+      try
+      {
+         switch (eventIter->operation)
+         {
+         case AllocatorStatistics::Allocate:
+            live[block] = allocator.allocate(eventIter->size);
+            break;
+
+         case AllocatorStatistics::Reallocate:
+            allocator.reallocate(live[block], eventIter->size);
+            break;
+
+         case AllocatorStatistics::Deallocate:
+            allocator.deallocate(live[block]);
+            liveBytes -= sizes[block];
+            sizes[block] = 0;
+            continue;
+
+         default:
+            if (eventIter->offset + eventIter->size > sizes[block] || eventIter->offset + eventIter->size < eventIter->offset)
+            {
+               ++result.skipped;
+               continue;
+            }
+
+            if (scratch.size() < eventIter->size)
+               scratch.resize(eventIter->size);
+
+            if (eventIter->operation == AllocatorStatistics::Find)
+               allocator.tryFind(RawAddress(bases[block] + eventIter->offset), eventIter->size);
+            else if (eventIter->operation == AllocatorStatistics::Read)
+               allocator.readInto(RawAddress(bases[block] + eventIter->offset), scratch.data(), eventIter->size);
+            else
+               allocator.writeFrom(RawAddress(bases[block] + eventIter->offset), scratch.data(), eventIter->size);
+
+            continue;
+         }
+
+         /* the block was allocated or moved, so pick up where it is now */
+         liveBytes += eventIter->size - sizes[block];
+         sizes[block] = eventIter->size;
+         bases[block] = static_cast<const Allocation &>(live[block]).address().label();
+
+         if (liveBytes > result.peakBytes)
+            result.peakBytes = liveBytes;
+      }
+      catch (Neurology::Exception &exception)
+      {
+         UNUSED(exception);
+         ++result.failed;
+      }
+   }
+
+   finish = std::chrono::steady_clock::now();
+
+   for (std::vector<Allocation>::iterator liveIter=live.begin(); liveIter!=live.end(); ++liveIter)
+      if (liveIter->isBound())
+         allocator.deallocate(*liveIter);
+
+   result.nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start).count();
+
+   if (result.nanoseconds > 0)
+      result.eventsPerSecond = static_cast<double>(result.events) * 1e9 / static_cast<double>(result.nanoseconds);
+
+   return result;
+}
+
+void
+TraceReplay::decode
+(const Data &trace)
+{
+   SIZE_T offset = sizeof(TraceRecorder::Magic)+1;
+   ULONGLONG timestamp = 0;
+
+   if (trace.size() < offset
+       || !std::equal(TraceRecorder::Magic, TraceRecorder::Magic+sizeof(TraceRecorder::Magic), trace.begin())
+       || trace[sizeof(TraceRecorder::Magic)] != TraceRecorder::Version)
+      throw CorruptTraceException(0);
+
+   while (offset < trace.size())
+   {
+      Event event;
+      ULONGLONG block;
+
+      if (trace[offset] >= AllocatorStatistics::OperationCount)
+         throw CorruptTraceException(offset);
+
+      event.operation = static_cast<AllocatorStatistics::Operation>(trace[offset++]);
+      event.thread = static_cast<DWORD>(TraceReplay::Decode(trace, &offset));
+      timestamp += TraceReplay::Decode(trace, &offset);
+      event.timestamp = timestamp;
+      block = TraceReplay::Decode(trace, &offset);
+      event.offset = static_cast<SIZE_T>(TraceReplay::Decode(trace, &offset));
+      event.size = static_cast<SIZE_T>(TraceReplay::Decode(trace, &offset));
+
+      if (block > TraceRecorder::NoBlock)
+         throw CorruptTraceException(offset);
+
+      event.block = (block == 0) ? TraceRecorder::NoBlock : static_cast<DWORD>(block-1);
+
+      if (event.block != TraceRecorder::NoBlock && event.block >= this->blockCount)
+         this->blockCount = event.block+1;
+
+      this->eventList.push_back(event);
+   }
+}
+
+ULONGLONG
+TraceReplay::Decode
+(const Data &trace, SIZE_T *offset)
+{
+   ULONGLONG value = 0;
+
+   for (SIZE_T shift=0; shift<64; shift+=7)
+   {
+      BYTE byte;
+
+      if (*offset >= trace.size())
+         throw CorruptTraceException(*offset);
+
+      byte = trace[(*offset)++];
+      value |= static_cast<ULONGLONG>(byte & 0x7F) << shift;
+
+      if ((byte & 0x80) == 0)
+         return value;
+   }
+
+   throw CorruptTraceException(*offset);
+}
@@ -1,7 +1,53 @@
 #include <neurology/allocators/virtual.hpp>
 
+#ifndef _WIN32
+#include <errno.h>
+#endif
+
 using namespace Neurology;
 
+namespace
+{
+   /* compared field by field, since the structure has padding */
+   bool SameRegion(const MEMORY_BASIC_INFORMATION &left, const MEMORY_BASIC_INFORMATION &right)
+   {
+      return left.BaseAddress == right.BaseAddress
+         && left.AllocationBase == right.AllocationBase
+         && left.AllocationProtect == right.AllocationProtect
+         && left.RegionSize == right.RegionSize
+         && left.State == right.State
+         && left.Protect == right.Protect
+         && left.Type == right.Type;
+   }
+
+   void BatchTransfers(const Allocator::Batch &batch, VirtualMemory::TransferVector *transfers)
+   {
+      Allocator::Batch::const_iterator entryIter;
+      VirtualMemory::Transfer transfer;
+
+      transfers->reserve(batch.size());
+
+      for (entryIter=batch.begin(); entryIter!=batch.end(); ++entryIter)
+      {
+         transfer.address = entryIter->address.pointer();
+         transfer.buffer = entryIter->buffer;
+         transfer.size = entryIter->size;
+         transfers->push_back(transfer);
+      }
+   }
+
+   bool TransferredAll(const VirtualMemory::TransferVector &transfers)
+   {
+      VirtualMemory::TransferVector::const_iterator transferIter;
+
+      for (transferIter=transfers.begin(); transferIter!=transfers.end(); ++transferIter)
+         if (transferIter->transferred != transferIter->size)
+            return false;
+
+      return true;
+   }
+}
+
 Page::Page
 (void)
    : Allocation()
@@ -54,18 +100,27 @@ void
 Page::query
 (void)
 {
-   Label baseLabel;
-   
    this->throwIfNotBound();
 
    this->allocator->query(*this);
+   this->settle();
+}
+
+void
+Page::settle
+(void)
+{
+   Label baseLabel;
+
    baseLabel = reinterpret_cast<Label>(this->memoryInfo->BaseAddress);
 
-   if (baseLabel != this->pool.minimum())
-      this->pool.rebase(baseLabel);
+   if (baseLabel != this->minimum)
+      this->rebase(baseLabel);
    
-   if (this->memoryInfo->RegionSize != this->pool.size())
-      this->pool.setMax(baseLabel+this->memoryInfo->RegionSize);
+   if (this->memoryInfo->RegionSize != this->size())
+      this->setMax(baseLabel+this->memoryInfo->RegionSize);
+
+   this->allocator->reindex(this);
 }
 
 Address
@@ -108,6 +163,14 @@ Page::type
    return this->memoryInfo->Type;
 }
 
+void
+Page::decommit
+(void)
+{
+   this->throwIfNotBound();
+   this->allocator->decommit(*this);
+}
+
 void
 Page::release
 (void)
@@ -130,34 +193,101 @@ VirtualAllocator::NoSuchPageException::NoSuchPageException
 {
 }
 
+VirtualAllocator::LocalMirrorException::LocalMirrorException
+(VirtualAllocator &allocator)
+   : VirtualAllocator::Exception(allocator, EXCSTR(L"Only another process's memory can be mirrored."))
+{
+}
+
+VirtualAllocator::MirrorFaultException::MirrorFaultException
+(VirtualAllocator &allocator)
+   : VirtualAllocator::Exception(allocator, EXCSTR(L"Part of the mirrored memory couldn't be fetched."))
+{
+}
+
+VirtualAllocator::MirrorBacking::MirrorBacking
+(VirtualAllocator *allocator)
+   : allocator(allocator)
+{
+}
+
+void
+VirtualAllocator::MirrorBacking::transfer
+(VirtualMemory::TransferVector *transfers, bool writing)
+{
+   this->allocator->transferRemote(transfers, writing);
+}
+
 VirtualAllocator::VirtualAllocator
 (void)
    : Allocator()
    , defaultAllocation(MEM_RESERVE | MEM_COMMIT)
    , defaultProtection(PAGE_READWRITE)
+   , mirrorBacking(this)
+   , mirror(NULL)
+#ifndef _WIN32
+   , processMemory(NULL)
+#endif
 {
    this->local = true;
 }
 
+#ifdef _WIN32
 VirtualAllocator::VirtualAllocator
 (Handle &processHandle)
    : Allocator()
    , defaultAllocation(MEM_RESERVE | MEM_COMMIT)
    , defaultProtection(PAGE_READWRITE)
+   , mirrorBacking(this)
+   , mirror(NULL)
 {
    this->setProcessHandle(processHandle);
 }
+#else
+VirtualAllocator::VirtualAllocator
+(DWORD processID)
+   : Allocator()
+   , defaultAllocation(MEM_RESERVE | MEM_COMMIT)
+   , defaultProtection(PAGE_READWRITE)
+   , mirrorBacking(this)
+   , mirror(NULL)
+   , processMemory(NULL)
+{
+   this->setProcessID(processID);
+}
+#endif
 
 VirtualAllocator::~VirtualAllocator
 (void)
 {
-   PageObjectMap::iterator pageIter;
+   /* changes which can't be written back anymore are lost either way, and a destructor can't throw */
+   try
+   {
+      this->disableMirror();
+   }
+   catch (...)
+   {
+   }
 
+   /* a remote process which already exited can't be queried anymore, but there's nothing left of
+      its memory to free either, so whatever can't be unpooled just gets dropped */
    while (this->pages.size() > 0)
    {
-      pageIter = this->pages.begin();
-      this->unpool(Address(pageIter->first.label()));
+      try
+      {
+         this->unpoolPages();
+      }
+      catch (...)
+      {
+         Address address = Address(this->pages.begin()->first.label());
+
+         this->discardPage(address);
+      }
    }
+
+#ifndef _WIN32
+   delete this->processMemory;
+#endif
 }
 
 bool
@@ -182,6 +312,7 @@ VirtualAllocator::throwIfNoPage
       throw NoSuchPageException(*const_cast<VirtualAllocator *>(this), page);
 }
 
+#ifdef _WIN32
 void
 VirtualAllocator::setProcessHandle
 (Handle &handle)
@@ -192,17 +323,39 @@ VirtualAllocator::setProcessHandle
    if (handle.isNull())
       return;
 
+   /* whatever was mirrored belongs to the old process, so it goes back there before anything else changes */
+   if (this->mirror != NULL)
+      this->mirror->invalidate();
+
    /* remove all pages in the allocator-- if we're declaring this another process's virtual allocator, then
       all underlying allocations become invalid. */
-   for (Allocator::MemoryPool::iterator iter=this->pooledMemory.begin();
-        iter!=this->pooledMemory.end();
-        ++iter)
-      this->unpool(Address(iter->first.label()));
+   this->unpoolPages();
 
    this->processHandle = handle;
+   this->local = false;
    this->enumerate();
+}
+#else
+void
+VirtualAllocator::setProcessID
+(DWORD processID)
+{
+   ProcessMemory *processMemory;
+
+   if (this->mirror != NULL)
+      this->mirror->invalidate();
+
+   /* open the process first, so a bad pid leaves the allocator as it was */
+   processMemory = new ProcessMemory(processID);
+
+   this->unpoolPages();
+
+   delete this->processMemory;
+   this->processMemory = processMemory;
    this->local = false;
+   this->enumerate();
 }
+#endif
 
 void
 VirtualAllocator::setDefaultAllocation
@@ -264,8 +417,7 @@ VirtualAllocator::lock
 {
    this->throwIfNoPage(page);
 
-   if (!VirtualLock(page.address().pointer(), page.size()))
-      throw Win32Exception(EXCSTR(L"VirtualLock failed"));
+   VirtualMemory::Lock(page.address().pointer(), page.size());
 }
 
 void
@@ -274,39 +426,26 @@ VirtualAllocator::unlock
 {
    this->throwIfNoPage(page);
 
-   if (!VirtualUnlock(page.baseAddress().pointer(), page.size()))
-      throw Win32Exception(EXCSTR(L"VirtualUnlock failed"));
+   VirtualMemory::Unlock(page.baseAddress().pointer(), page.size());
 }
 
 void
 VirtualAllocator::protect
 (Page &page, Page::Protection protection)
 {
-   DWORD oldProtect;
-   
    this->throwIfNoPage(page);
 
-   if (this->isLocal())
-   {
-      if (!VirtualProtect(page.address().pointer()
-                          ,page.size()
-                          ,protection.mask
-                          ,&oldProtect))
-      {
-         throw Win32Exception(EXCSTR(L"VirtualProtect failed."));
-      }
-   }
-   else
-   {
-      if (!VirtualProtectEx(*this->processHandle
-                            ,page.address().pointer()
-                            ,page.size()
-                            ,protection.mask
-                            ,&oldProtect))
-      {
-         throw Win32Exception(EXCSTR(L"VirtualProtectEx failed."));
-      }
-   }
+   VirtualMemory::Protect(this->targetProcess(), page.address().pointer(), page.size(), protection.mask);
+}
+
+void
+VirtualAllocator::decommit
+(Page &page)
+{
+   this->throwIfNoPage(page);
+
+   VirtualMemory::Free(this->targetProcess(), page.address().pointer(), page.size(), MEM_DECOMMIT);
+   page.query();
 }
 
 SIZE_T
@@ -333,67 +472,157 @@ SIZE_T
 VirtualAllocator::query
 (Address address, PMEMORY_BASIC_INFORMATION buffer, SIZE_T length)
 {
-   SIZE_T result;
-   
-   if (this->isLocal())
-   {
-      result = VirtualQuery(address.pointer()
-                            ,buffer
-                            ,length);
-   }
-   else
-   {
-      result = VirtualQueryEx(*this->processHandle
-                              ,address.pointer()
-                              ,buffer
-                              ,length);
-   }
+#ifndef _WIN32
+   if (!this->isLocal())
+      return this->processMemory->query(address.pointer(), buffer, length);
+#endif
 
-   return result;
+   return VirtualMemory::Query(this->targetProcess(), address.pointer(), buffer, length);
 }
 
-void
+SIZE_T
 VirtualAllocator::enumerate
 (void)
 {
-   Address address = Label(NULL);
-   Object<MEMORY_BASIC_INFORMATION> memoryInfo;
-   SIZE_T size;
-   bool foundEntries = false;
+   VirtualMemory::RegionVector regions;
+   VirtualMemory::RegionVector::iterator regionIter;
+   PageObjectMap::iterator pageIter;
+   Address pageAddress;
+   Label regionBase;
+   Page *page;
+   SIZE_T changes = 0;
+
+#ifndef _WIN32
+   if (!this->isLocal())
+      this->processMemory->enumerate(&regions);
+   else
+#endif
+      VirtualMemory::Enumerate(this->targetProcess(), &regions);
 
-   memoryInfo.construct();
+   /* pages and regions are both in address order, so they get matched up in one pass over each. pages which
+      no longer start a region go first, so nothing which replaces them overlaps them. pages we allocated
+      ourselves stay until they're released. */
+   regionIter = regions.begin();
+   pageIter = this->pages.begin();
 
-   /* this is intentional-- if size is zero we break the loop */
-   while (size = this->query(address, memoryInfo.pointer(), memoryInfo.size()))
+   while (pageIter != this->pages.end())
    {
-      Address pooledAddress;
-      
-      if (size != memoryInfo.size())
+      while (regionIter != regions.end() && reinterpret_cast<Label>(regionIter->BaseAddress) < pageIter->first.label())
+         ++regionIter;
+
+      if (pageIter->second->ownedAllocation
+          || (regionIter != regions.end() && reinterpret_cast<Label>(regionIter->BaseAddress) == pageIter->first.label()))
       {
-         memoryInfo.reallocate(size);
+         ++pageIter;
          continue;
       }
 
-      foundEntries = true;
+      pageAddress = pageIter->first;
+      ++pageIter;
+
+      /* the page is still bound, so it has to be unpooled like any other. it isn't ours, so nothing gets freed */
+      this->unpool(pageAddress);
+      ++changes;
+   }
+
+   pageIter = this->pages.begin();
 
-      address = memoryInfo->BaseAddress;
+   for (regionIter=regions.begin(); regionIter!=regions.end(); ++regionIter)
+   {
+      regionBase = reinterpret_cast<Label>(regionIter->BaseAddress);
+
+      while (pageIter != this->pages.end() && pageIter->first.label() < regionBase)
+         ++pageIter;
 
-      /* we already appear to have this page-- skip it */
-      if (this->pages.find(address) != this->pages.end())
+      if (pageIter != this->pages.end() && pageIter->first.label() == regionBase)
       {
-         this->pages[address]->query();
-         address += memoryInfo->RegionSize;
-         continue;
+         page = pageIter->second;
+
+         /* the page is current, leave it be */
+         if (SameRegion(*page->memoryInfo.pointer(), *regionIter))
+            continue;
       }
+      else
+      {
+         pageAddress = this->pooledAddresses.address(regionBase);
+         this->pooledMemory[pageAddress] = regionIter->RegionSize;
+         this->createPage(pageAddress, false);
+         page = this->pages[pageAddress];
+      }
+
+      *page->memoryInfo.pointer() = *regionIter;
+      page->settle();
+      ++changes;
+   }
+
+   return changes;
+}
+
+void
+VirtualAllocator::enableMirror
+(SIZE_T capacity, PageMirror::Clock::duration timeToLive)
+{
+   if (this->isLocal())
+      throw LocalMirrorException(*this);
+
+   this->disableMirror();
+   this->mirror = new PageMirror(&this->mirrorBacking, VirtualMemory::PageSize(), capacity, timeToLive);
+}
+
+void
+VirtualAllocator::disableMirror
+(void)
+{
+   PageMirror *mirror = this->mirror;
 
-      pooledAddress = this->pooledAddresses.address(address.label());
-      this->pooledMemory[pooledAddress] = memoryInfo->RegionSize;
-      this->createPage(address, false);
-      address += memoryInfo->RegionSize;
+   if (mirror == NULL)
+      return;
+
+   /* the mirror goes away even if its changes can't all be written back */
+   this->mirror = NULL;
+
+   try
+   {
+      mirror->sync();
    }
+   catch (...)
+   {
+      delete mirror;
+      throw;
+   }
+
+   delete mirror;
+}
 
-   if (!foundEntries)
-      throw Win32Exception(EXCSTR(L"VirtualQuery failed"));
+bool
+VirtualAllocator::isMirrored
+(void) const noexcept
+{
+   return this->mirror != NULL;
+}
+
+void
+VirtualAllocator::sync
+(void)
+{
+   if (this->mirror != NULL)
+      this->mirror->sync();
+}
+
+void
+VirtualAllocator::invalidate
+(void)
+{
+   if (this->mirror != NULL)
+      this->mirror->invalidate();
+}
+
+void
+VirtualAllocator::invalidate
+(const RawAddress &address, SIZE_T size)
+{
+   if (this->mirror != NULL)
+      this->mirror->invalidate(address.label(), size);
 }
 
 Address
@@ -409,13 +638,11 @@ VirtualAllocator::poolAddress
 {
    Address resultAddress;
 
-   if (this->isLocal())
-      resultAddress = VirtualAlloc(address.pointer(), size, allocationType.mask, protection.mask);
-   else
-      resultAddress = VirtualAllocEx(*this->processHandle, address.pointer(), size, allocationType.mask, protection.mask);
-
-   if (resultAddress == Address::Null())
-      throw Win32Exception(EXCSTR(L"VirtualAlloc failed."));
+   resultAddress = VirtualMemory::Allocate(this->targetProcess()
+                                           ,address.pointer()
+                                           ,size
+                                           ,allocationType.mask
+                                           ,protection.mask);
 
    resultAddress = this->pooledAddresses.address(resultAddress.label());
 
@@ -477,6 +704,33 @@ VirtualAllocator::unpoolAddress
    this->pages.erase(address);
 }
 
+HANDLE
+VirtualAllocator::targetProcess
+(void) const
+{
+   if (this->isLocal())
+      return NULL;
+
+#ifdef _WIN32
+   return *this->processHandle;
+#else
+   throw Win32Exception(ENOSYS, EXCSTR(L"Another process's memory can only be read, written and queried."));
+#endif
+}
+
+void
+VirtualAllocator::unpoolPages
+(void)
+{
+   PageObjectMap::iterator pageIter;
+
+   while (this->pages.size() > 0)
+   {
+      pageIter = this->pages.begin();
+      this->unpool(Address(pageIter->first.label()));
+   }
+}
+
 void
 VirtualAllocator::createPage
 (Address &address, bool owned)
@@ -489,10 +743,10 @@ void
 VirtualAllocator::freePage
 (Address &address)
 {
-   BOOL result;
    Page *pointer;
    Object<MEMORY_BASIC_INFORMATION> memoryInfo;
    SIZE_T memorySize;
+   bool remote;
 
    /* we query the page manually here instead of asking the page for its actual address because unbinding
       may have wiped out the pool. this is the same reason the function doesn't rely on querying the page itself
@@ -501,7 +755,13 @@ VirtualAllocator::freePage
    memoryInfo.construct();
    memorySize = this->query(address, memoryInfo.pointer(), memoryInfo.size());
 
-   if (memorySize == 0 && (this->isLocal() || !this->processHandle.isNull()))
+#ifdef _WIN32
+   remote = !this->processHandle.isNull();
+#else
+   remote = this->processMemory != NULL;
+#endif
+
+   if (memorySize == 0 && (this->isLocal() || remote))
       throw Win32Exception(EXCSTR(L"VirtualQuery/VirtualQueryEx failed."));
 
    if (memorySize != 0 && memorySize != memoryInfo.size())
@@ -519,15 +779,16 @@ VirtualAllocator::freePage
    pointer = this->pages[address];
 
    if (memorySize != 0 && pointer->ownedAllocation)
-   {
-      if (this->isLocal())
-         result = VirtualFree(memoryInfo->BaseAddress, 0, MEM_RELEASE);
-      else
-         result = VirtualFreeEx(*this->processHandle, memoryInfo->BaseAddress, 0, MEM_RELEASE);
-      
-      if (result == FALSE)
-         throw Win32Exception(EXCSTR(L"VirtualFree failed."));
-   }
+      VirtualMemory::Free(this->targetProcess(), memoryInfo->BaseAddress, 0, MEM_RELEASE);
+
+   this->discardPage(address);
+}
+
+void
+VirtualAllocator::discardPage
+(Address &address)
+{
+   Page *pointer = this->pages[address];
 
    pointer->memoryInfo.reset();
 
@@ -536,6 +797,42 @@ VirtualAllocator::freePage
    delete pointer;
 }
 
+void
+VirtualAllocator::transferRemote
+(VirtualMemory::TransferVector *transfers, bool writing)
+{
+#ifdef _WIN32
+   VirtualMemory::TransferVector::iterator transferIter;
+   SIZE_T transferred;
+
+   /* a call which fails partway through still reports how much it got across, which is all a transfer needs */
+   for (transferIter=transfers->begin(); transferIter!=transfers->end(); ++transferIter)
+   {
+      transferred = 0;
+
+      if (writing)
+         WriteProcessMemory(*this->processHandle
+                            ,transferIter->address
+                            ,transferIter->buffer
+                            ,transferIter->size
+                            ,&transferred);
+      else
+         ReadProcessMemory(*this->processHandle
+                           ,transferIter->address
+                           ,transferIter->buffer
+                           ,transferIter->size
+                           ,&transferred);
+
+      transferIter->transferred = transferred;
+   }
+#else
+   if (writing)
+      this->processMemory->write(transfers);
+   else
+      this->processMemory->read(transfers);
+#endif
+}
+
 void
 VirtualAllocator::allocate
 (Allocation *allocation, SIZE_T size)
@@ -547,68 +844,191 @@ VirtualAllocator::allocate
 
 Data
 VirtualAllocator::readAddress
-(const Address &address, SIZE_T size) const
+(const RawAddress &address, SIZE_T size) const
+{
+   Data result(size);
+   SIZE_T copied;
+   LONG status;
+
+   if (this->isLocal())
+   {
+      status = CopyData(result.data(), address.pointer(), size, &copied);
+
+      if (status != 0 && copied == 0)
+         throw KernelFaultException(status, address.promote(), Address(result.data()), size);
+   }
+   else if (this->mirror != NULL)
+   {
+      copied = this->mirror->read(address.label(), result.data(), size);
+
+      if (copied == 0 && size != 0)
+         throw MirrorFaultException(*const_cast<VirtualAllocator *>(this));
+   }
+   else
+   {
+#ifdef _WIN32
+      return Allocator::readAddress(address, size);
+#else
+      copied = this->processMemory->read(address.pointer(), result.data(), size);
+
+      if (copied == 0 && size != 0)
+         throw Win32Exception(EFAULT, EXCSTR(L"None of the remote memory could be read."));
+#endif
+   }
+
+   result.resize(copied);
+   return result;
+}
+
+void
+VirtualAllocator::readAddressInto
+(const RawAddress &address, LPVOID destination, SIZE_T size) const
 {
-   Data data(size);
    SIZE_T bytesRead;
    LONG result;
 
    if (this->isLocal())
    {
-      result = CopyData(data.data(), address.pointer(), size);
+      result = CopyData(destination, address.pointer(), size);
 
       if (result != 0)
-         throw KernelFaultException(result, const_cast<Address &>(address), Address(data.data()), size);
+         throw KernelFaultException(result, address.promote(), Address(destination), size);
+   }
+   else if (this->mirror != NULL)
+   {
+      bytesRead = this->mirror->read(address.label(), destination, size);
+
+      if (bytesRead != size)
+         throw MirrorFaultException(*const_cast<VirtualAllocator *>(this));
    }
    else
    {
+#ifdef _WIN32
       result = ReadProcessMemory(*this->processHandle
                                  ,address.pointer()
-                                 ,data.data()
+                                 ,destination
                                  ,size
                                  ,&bytesRead);
 
       if (result == 0)
          throw Win32Exception(EXCSTR(L"ReadProcessMemory failed."));
+#else
+      bytesRead = this->processMemory->read(address.pointer(), destination, size);
 
-      data.resize(bytesRead);
+      if (bytesRead != size)
+         throw Win32Exception(EFAULT, EXCSTR(L"Not all of the remote memory could be read."));
+#endif
    }
-
-   return data;
 }
 
 void
-VirtualAllocator::writeAddress
-(const Address &address, const Data data)
+VirtualAllocator::writeAddressFrom
+(const RawAddress &address, LPCVOID source, SIZE_T size)
 {
    SIZE_T bytesWritten;
    LONG result;
 
    if (this->isLocal())
    {
-      result = CopyData(address.pointer()
-                        ,reinterpret_cast<LPVOID>(
-                           const_cast<LPBYTE>(data.data()))
-                        ,data.size());
+      result = CopyData(address.pointer(), const_cast<LPVOID>(source), size);
 
       if (result != 0)
          throw KernelFaultException(result
-                                    ,const_cast<Address &>(address)
-                                    ,Address(reinterpret_cast<LPVOID>(
-                                                const_cast<LPBYTE>(data.data())))
-                                    ,data.size());
+                                    ,address.promote()
+                                    ,Address(const_cast<LPVOID>(source))
+                                    ,size);
+   }
+   else if (this->mirror != NULL)
+   {
+      bytesWritten = this->mirror->write(address.label(), source, size);
+
+      if (bytesWritten != size)
+         throw MirrorFaultException(*this);
    }
    else
    {
+#ifdef _WIN32
       result = WriteProcessMemory(*this->processHandle
                                   ,address.pointer()
-                                  ,data.data()
-                                  ,data.size()
+                                  ,source
+                                  ,size
                                   ,&bytesWritten);
 
       if (result == 0)
-         throw Win32Exception(EXCSTR(L"ReadProcessMemory failed."));
+         throw Win32Exception(EXCSTR(L"WriteProcessMemory failed."));
+#else
+      bytesWritten = this->processMemory->write(address.pointer(), source, size);
+
+      if (bytesWritten != size)
+         throw Win32Exception(EFAULT, EXCSTR(L"Not all of the remote memory could be written."));
+#endif
    }
 }
 
+void
+VirtualAllocator::readAddresses
+(const Batch &batch) const
+{
+   VirtualMemory::TransferVector transfers;
+
+   if (!this->isLocal() && this->mirror != NULL)
+   {
+      BatchTransfers(batch, &transfers);
+      this->mirror->read(&transfers);
+
+      if (!TransferredAll(transfers))
+         throw MirrorFaultException(*const_cast<VirtualAllocator *>(this));
+
+      return;
+   }
+
+#ifndef _WIN32
+   if (!this->isLocal())
+   {
+      BatchTransfers(batch, &transfers);
+      this->processMemory->read(&transfers);
+
+      if (!TransferredAll(transfers))
+         throw Win32Exception(EFAULT, EXCSTR(L"Part of the batch fell in unmapped remote memory."));
+
+      return;
+   }
+#endif
+
+   Allocator::readAddresses(batch);
+}
+
+void
+VirtualAllocator::writeAddresses
+(const Batch &batch)
+{
+   VirtualMemory::TransferVector transfers;
+
+   if (!this->isLocal() && this->mirror != NULL)
+   {
+      BatchTransfers(batch, &transfers);
+      this->mirror->write(&transfers);
+
+      if (!TransferredAll(transfers))
+         throw MirrorFaultException(*this);
+
+      return;
+   }
+
+#ifndef _WIN32
+   if (!this->isLocal())
+   {
+      BatchTransfers(batch, &transfers);
+      this->processMemory->write(&transfers);
+
+      if (!TransferredAll(transfers))
+         throw Win32Exception(EFAULT, EXCSTR(L"Part of the batch fell in unmapped remote memory."));
+
+      return;
+   }
+#endif
+
+   Allocator::writeAddresses(batch);
+}
+
    
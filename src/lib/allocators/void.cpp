@@ -1,7 +1,71 @@
+#include <neurology/allocators/trace.hpp>
 #include <neurology/allocators/void.hpp>
 
+#include <algorithm>
+
 using namespace Neurology;
 
+namespace
+{
+   /* the allocations a thread found last, most recent first. they only
+      stand for the allocator and index generation they were found under. */
+   struct Lookaside
+   {
+      struct Entry
+      {
+         Label start, end;
+         Allocation *allocation;
+      };
+
+      SIZE_T allocator;
+      SIZE_T generation;
+      SIZE_T count;
+      Entry entries[Allocator::LookasideSize];
+   };
+
+   /* the caches of the last few allocators a thread found something in. they
+      take turns making way for a new allocator. */
+   struct LookasideSet
+   {
+      Lookaside caches[Allocator::LookasideAllocators];
+      SIZE_T next;
+   };
+
+   thread_local LookasideSet LastFound = {};
+
+   /* allocator ids start at 1, so an unused cache never matches */
+   Lookaside &ThreadLookaside(SIZE_T allocator)
+   {
+      LookasideSet &set = LastFound;
+      Lookaside *lookaside;
+
+      for (SIZE_T i=0; i<Allocator::LookasideAllocators; ++i)
+         if (set.caches[i].allocator == allocator)
+            return set.caches[i];
+
+      lookaside = &set.caches[set.next];
+      set.next = (set.next + 1) % Allocator::LookasideAllocators;
+      lookaside->allocator = 0;
+
+      return *lookaside;
+   }
+
+#ifdef NEUROLOGY_INSTRUMENT
+   /* the bytes a batch covers, for the statistics */
+   SIZE_T BatchBytes(const Allocator::Batch &batch)
+   {
+      SIZE_T total = 0;
+
+      for (Allocator::Batch::const_iterator entryIter=batch.begin(); entryIter!=batch.end(); ++entryIter)
+         total += entryIter->size;
+
+      return total;
+   }
+#endif
+}
+
+std::atomic<SIZE_T> Allocator::NextID(1);
+
 Allocator::Exception::Exception
 (Allocator &allocator, const LPWSTR message)
    : Neurology::Exception(message)
@@ -97,37 +161,52 @@ Allocator::PoolCollisionException::PoolCollisionException
 }
 
 Allocator::AddressNotFoundException::AddressNotFoundException
-(Allocator &allocator, Address &address)
+(Allocator &allocator, const RawAddress &address)
    : Allocator::Exception(allocator, EXCSTR(L"The allocator has not allocated any such address."))
    , address(address)
 {
 }
 
+Allocator::EpochGuard::EpochGuard
+(Allocator &allocator)
+   : allocator(allocator)
+   , epoch(allocator.enterEpoch())
+{
+}
+
+Allocator::EpochGuard::~EpochGuard
+(void)
+{
+   this->allocator.leaveEpoch(this->epoch);
+}
+
 Allocator::Allocator
 (void)
    : local(false)
+   , zeroing(Allocator::DefaultZeroPolicy)
+   , deferring(false)
+   , epoch(1)
+   , id(Allocator::NextID++)
+   , lookasideHits(0)
+   , lookasideMisses(0)
+   , recorder(NULL)
 {
+   InitializeCriticalSection(&this->epochLock);
 }
 
 Allocator::~Allocator
 (void)
 {
+   /* retired addresses are still pooled, so they get unpooled below with
+      everything else. */
+   EnterCriticalSection(&this->epochLock);
+   this->retired.clear();
+   LeaveCriticalSection(&this->epochLock);
+
+   /* unbinding the last allocation of an address erases its binding and
+      unpools it, so keep going until there's nothing left. */
    while (this->bindings.size() > 0)
-   {
-      /* unbind all allocation bindings */
-      Allocator::BindingMap::iterator iter = this->bindings.begin();
-      
-      while (iter->second.size() > 0)
-         this->unbind(*iter->second.begin());
-
-      /* the binding set is now empty, check if it's still pooled.
-         if so, erase it. */
-      if (this->isPooled(iter->first))
-         /* ha ha fuck you Stoustrup here's a hack */
-         this->unpool(Address(iter->first.label()));
-         
-      this->bindings.erase(iter->first);
-   }
+      this->unbind(this->table.at(this->bindings.begin()->second.first).allocation);
    
    /* if there are any entries left in the memory pool, delete them */
    for (MemoryPool::iterator iter=this->pooledMemory.begin();
@@ -136,6 +215,8 @@ Allocator::~Allocator
    {
       this->unpool(Address(iter->first.label()));
    }
+
+   DeleteCriticalSection(&this->epochLock);
 }
 
 bool
@@ -145,6 +226,138 @@ Allocator::isLocal
    return this->local;
 }
 
+Allocator::ZeroPolicy
+Allocator::zeroPolicy
+(void) const noexcept
+{
+   return this->zeroing;
+}
+
+void
+Allocator::setZeroPolicy
+(ZeroPolicy policy) noexcept
+{
+   this->zeroing = policy;
+}
+
+bool
+Allocator::defersFrees
+(void) const noexcept
+{
+   return this->deferring;
+}
+
+void
+Allocator::setDeferredFrees
+(bool defer) noexcept
+{
+   this->deferring = defer;
+}
+
+SIZE_T
+Allocator::retiredCount
+(void) const noexcept
+{
+   SIZE_T count;
+
+   EnterCriticalSection(&this->epochLock);
+   count = this->retired.size();
+   LeaveCriticalSection(&this->epochLock);
+
+   return count;
+}
+
+SIZE_T
+Allocator::enterEpoch
+(void)
+{
+   SIZE_T current;
+
+   EnterCriticalSection(&this->epochLock);
+   current = this->epoch;
+   ++this->readers[current];
+   LeaveCriticalSection(&this->epochLock);
+
+   return current;
+}
+
+void
+Allocator::leaveEpoch
+(SIZE_T epoch)
+{
+   ReaderMap::iterator readerIter;
+
+   EnterCriticalSection(&this->epochLock);
+
+   readerIter = this->readers.find(epoch);
+
+   if (readerIter != this->readers.end() && --readerIter->second == 0)
+      this->readers.erase(readerIter);
+
+   LeaveCriticalSection(&this->epochLock);
+}
+
+SIZE_T
+Allocator::reclaim
+(void)
+{
+   RetirementList taken;
+
+   this->takeRetired(&taken);
+
+   return this->unpoolRetired(taken);
+}
+
+Allocator::ReleaseQueue
+Allocator::handOff
+(void)
+{
+   RetirementList taken;
+   ReleaseQueue queue;
+   RetiredBlock block;
+
+   this->takeRetired(&taken);
+   queue.reserve(taken.size());
+
+   for (SIZE_T i=0; i<taken.size(); ++i)
+   {
+      Address address = this->pooledAddresses.address(taken[i].address);
+
+      if (!this->isPooled(address))
+         continue;
+
+      try
+      {
+         block.size = this->forgetAddress(address);
+         NEUROLOGY_INSTRUMENTED(this->instruments.shrink(block.size, 1));
+
+         if (this->recorder != NULL)
+            this->recorder->deallocated(taken[i].address);
+      }
+      catch (...)
+      {
+         /* nothing from here on has been forgotten, so it can go back in line */
+         EnterCriticalSection(&this->epochLock);
+         this->retired.insert(this->retired.end(), taken.begin()+i, taken.end());
+         LeaveCriticalSection(&this->epochLock);
+         throw;
+      }
+
+      block.address = taken[i].address;
+      queue.push_back(block);
+   }
+
+   return queue;
+}
+
+void
+Allocator::release
+(const ReleaseQueue &queue)
+{
+   for (ReleaseQueue::const_iterator blockIter=queue.begin(); blockIter!=queue.end(); ++blockIter)
+      NEUROLOGY_MEASURE(this->instruments, AllocatorStatistics::Deallocate, blockIter->size, this->releaseAddress(RawAddress(blockIter->address), blockIter->size));
+}
+
 bool
 Allocator::isPooled
 (const Address &address) const noexcept
@@ -156,24 +369,31 @@ bool
 Allocator::isBound
 (const Allocation &allocation) const noexcept
 {
-   Address address;
-   Allocator::BindingMap::const_iterator bindIter;
-   Allocator::AllocationSet::const_iterator allocIter;
-
-   if (allocation.allocator != this)
-      return false;
-
-   if (this->associations.count(&allocation) == 0)
-      return false;
+   return allocation.allocator == this && this->table.holds(allocation.slot, &allocation);
+}
 
-   address = this->associations.at(&allocation);
+Allocator::AllocationHandle
+Allocator::handle
+(const Allocation &allocation) const noexcept
+{
+   if (!this->isBound(allocation))
+      return AllocationTable::NullHandle;
 
-   if (this->bindings.count(address) == 0)
-      return false;
+   return this->table.handle(allocation.slot);
+}
 
-   allocIter = this->bindings.at(address).find(const_cast<Allocation *>(&allocation));
+Allocation *
+Allocator::resolve
+(const AllocationHandle &handle) const noexcept
+{
+   return this->table.resolve(handle);
+}
 
-   return allocIter != this->bindings.at(address).end();
+bool
+Allocator::isLive
+(const AllocationHandle &handle) const noexcept
+{
+   return this->table.isLive(handle);
 }
 
 bool
@@ -183,22 +403,11 @@ Allocator::hasAddress
    if (this->pooledAddresses.hasLabel(address.label()))
       return true;
 
-   if (this->bindings.count(address) > 0)
+   if (this->bindings.count(address.label()) > 0)
       return true;
 
-   /* check the pool of every allocation we have */
-   for (Allocator::AllocationSet::const_iterator iter=this->allocations.begin();
-        iter!=this->allocations.end();
-        ++iter)
-   {
-      if (!this->isPooled((**iter).address()) || (**iter).size() != this->pooledMemory.at((**iter).address()))
-         continue;
-            
-      if ((**iter).pool.inRange(address.label()))
-         return true;
-   }
-
-   return false;
+   /* check the ranges of every allocation we have */
+   return this->index.find(address.label(), 0) != NULL;
 }
 
 bool
@@ -210,13 +419,13 @@ Allocator::sharesPool
 
    const Allocation &leftRoot = this->root(left);
    const Allocation &rightRoot = this->root(right);
-   Address leftAddress = this->associations.at(&leftRoot);
-   Address rightAddress = this->associations.at(&rightRoot);
-   
-   if (!this->isPooled(leftAddress) || !this->isPooled(rightAddress))
+   Label leftLabel = this->table.at(leftRoot.slot).address;
+   Label rightLabel = this->table.at(rightRoot.slot).address;
+
+   if (leftLabel != rightLabel)
       return false;
 
-   return leftAddress == rightAddress;
+   return this->isPooled(Address(leftLabel));
 }
 
 bool
@@ -264,7 +473,7 @@ Allocator::throwIfNoAddress
 (const Address &address) const
 {
    if (!this->hasAddress(address))
-      throw AddressNotFoundException(const_cast<Allocator &>(*this), const_cast<Address &>(address));
+      throw AddressNotFoundException(const_cast<Allocator &>(*this), address);
 }
 
 void
@@ -298,7 +507,7 @@ Allocator::addressOf
    if (!this->isBound(allocation))
       return Address(static_cast<Label>(0));
 
-   return this->associations.at(&allocation);
+   return Address(this->table.at(allocation.slot).address);
 }
 
 Address
@@ -320,8 +529,10 @@ SIZE_T
 Allocator::bindCount
 (const Address &address) const
 {
-   if (this->bindings.count(address) > 0)
-      return this->bindings.at(address).size();
+   BindingMap::const_iterator bindIter = this->bindings.find(address.label());
+
+   if (bindIter != this->bindings.end())
+      return bindIter->second.count;
 
    return 0;
 }
@@ -346,12 +557,16 @@ Allocator::pool
    if (size == 0)
       throw ZeroSizeException(*this);
    
-   address = this->poolAddress(size);
+   NEUROLOGY_MEASURE(this->instruments, AllocatorStatistics::Allocate, size, address = this->poolAddress(size));
 
    if (!address.usesPool(&this->pooledAddresses))
       address = this->pooledAddresses.address(address.label());
    
    this->pooledMemory[address] = size;
+   NEUROLOGY_INSTRUMENTED(this->instruments.grow(size, 1));
+
+   if (this->recorder != NULL)
+      this->recorder->allocated(address.label(), size);
 
    return address;
 }
@@ -361,6 +576,10 @@ Allocator::repool
 (Address &address, SIZE_T newSize)
 {
    Address newAddress, baseAddress;
+   BindingMap::iterator bindIter;
+   std::vector<Allocation *> roots;
+   std::vector<Allocation *>::iterator rootIter;
+   DWORD slot;
 
    this->throwIfNotPooled(address);
 
@@ -372,34 +591,51 @@ Allocator::repool
    else
       baseAddress = this->pooledAddresses.address(address.label());
 
-   newAddress = this->repoolAddress(address, newSize);
+   NEUROLOGY_INSTRUMENTED(this->instruments.shrink(this->pooledMemory.at(baseAddress), 1));
+   NEUROLOGY_MEASURE(this->instruments, AllocatorStatistics::Reallocate, newSize, newAddress = this->repoolAddress(address, newSize));
 
    if (!newAddress.usesPool(&this->pooledAddresses))
       newAddress = this->pooledAddresses.address(newAddress.label());
    
    this->pooledMemory[newAddress] = newSize;
+   NEUROLOGY_INSTRUMENTED(this->instruments.grow(newSize, 1));
+
+   if (this->recorder != NULL)
+      this->recorder->reallocated(baseAddress.label(), newAddress.label(), newSize);
+
+   /* if the address is the same, the memory was resized in place and only the
+      ranges of its allocations need to follow. */
+   /* only the allocations spanning the whole block follow it. children which
+      happen to start at its base get moved along by their parents. */
+   bindIter = this->bindings.find(baseAddress.label());
+
+   if (bindIter != this->bindings.end())
+      for (slot=bindIter->second.first; slot!=AllocationTable::NoSlot; slot=this->table.at(slot).nextBound)
+         if (this->table.at(slot).parent == AllocationTable::NoSlot)
+            roots.push_back(this->table.at(slot).allocation);
 
-   /* if the address is the same, nothing needs to be done. */
    if (baseAddress == newAddress)
+   {
+      for (rootIter=roots.begin(); rootIter!=roots.end(); ++rootIter)
+      {
+         (**rootIter).setMax((baseAddress+newSize).label());
+         this->reindex(*rootIter);
+      }
+
       return baseAddress;
+   }
 
    /* why did you give us a pool address that's already allocated but wasn't our
       original address? that's weird. */
-   if (this->bindings.count(newAddress) > 0)
+   if (this->bindings.count(newAddress.label()) > 0)
       throw PoolCollisionException(*this, newAddress);
    
    /* there are bindings to fix */
-   if (this->bindings.count(baseAddress) > 0)
+   for (rootIter=roots.begin(); rootIter!=roots.end(); ++rootIter)
    {
-      AllocationSet allocations(this->bindings[baseAddress]);
-
-      for (AllocationSet::iterator allocIter=this->allocations.begin();
-           allocIter!=this->allocations.end();
-           ++allocIter)
-      {
-         this->rebind(*allocIter, newAddress);
-         (**allocIter).pool.setMax((newAddress+newSize).label());
-      }
+      this->rebind(*rootIter, newAddress);
+      (**rootIter).setMax((newAddress+newSize).label());
+      this->reindex(*rootIter);
    }
 
    this->pooledMemory.erase(baseAddress);
@@ -409,20 +645,26 @@ Allocator::repool
 
 void
 Allocator::unpool
-(Address &address)
+(const Address &address)
 {
    Address localAddress = Address(address.label());
+   BindingMap::iterator bindIter;
    
    this->throwIfNotPooled(address);
 
-   while (this->bindings.count(localAddress) > 0)
-      this->unbind(*this->bindings[localAddress].begin());
+   while ((bindIter = this->bindings.find(localAddress.label())) != this->bindings.end())
+      this->unbind(this->table.at(bindIter->second.first).allocation);
 
    /* unbind killed us, bail. */
    if (this->pooledMemory.count(localAddress) == 0)
       return;
    
-   this->unpoolAddress(localAddress);
+   NEUROLOGY_INSTRUMENTED(this->instruments.shrink(this->pooledMemory.at(localAddress), 1));
+
+   if (this->recorder != NULL)
+      this->recorder->deallocated(localAddress.label());
+
+   NEUROLOGY_MEASURE(this->instruments, AllocatorStatistics::Deallocate, this->pooledMemory.at(localAddress), this->unpoolAddress(localAddress));
 }
 
 Allocation &
@@ -436,58 +678,167 @@ Allocation &
 Allocator::find
 (const Address &address, SIZE_T size) const
 {
-   Allocator::BindingMap::const_iterator bindIter, allocIter;
-   std::list<const Allocation *> searchQueue;
-   std::set<const Allocation *> queueVisited;
-   const Allocation *possibleResult = NULL;
+   Allocation *result = this->tryFind(address, size);
 
-   bindIter = this->bindings.upper_bound(address);
+   if (result == NULL)
+      throw AddressNotFoundException(const_cast<Allocator &>(*this), address);
 
-   /* if the root allocations don't have this address, this address can't possibly exist */
-   if (this->bindings.size() == 0 || bindIter == this->bindings.begin())
-      throw AddressNotFoundException(const_cast<Allocator &>(*this), const_cast<Address &>(address));
+   return *result;
+}
+
+Allocation *
+Allocator::tryFind
+(const Address &address, SIZE_T size) const noexcept
+{
+   if (address.isNull())
+      return NULL;
 
-   --bindIter;
+   return this->tryFind(RawAddress(address), size);
+}
 
-   allocIter = bindIter;
+Allocation *
+Allocator::tryFind
+(const RawAddress &address, SIZE_T size) const noexcept
+{
+   this->traceAccess(AllocatorStatistics::Find, address.label(), size);
 
-   for (AllocationSet::iterator iter=allocIter->second.begin();
-        iter!=allocIter->second.end();
-        ++iter)
-      searchQueue.push_back(*iter);
+   return this->lookup(address, size);
+}
 
-   while (searchQueue.size() > 0)
+Allocation *
+Allocator::lookup
+(const Address &address, SIZE_T size) const noexcept
+{
+   if (address.isNull())
+      return NULL;
+
+   return this->lookup(RawAddress(address), size);
+}
+
+Allocation *
+Allocator::lookup
+(const RawAddress &address, SIZE_T size) const noexcept
+{
+   Allocation *result;
+
+   NEUROLOGY_MEASURE(this->instruments, AllocatorStatistics::Find, size, result = this->findCached(address, size));
+
+   return result;
+}
+
+Allocation *
+Allocator::findCached
+(const RawAddress &address, SIZE_T size) const noexcept
+{
+   Lookaside &lookaside = ThreadLookaside(this->id);
+   Label start = address.label();
+   Label end = start + ((size == 0) ? 1 : size);
+   Allocation *result;
+   SIZE_T entryIndex;
+
+   if (end <= start)
+      return NULL;
+
+   if (lookaside.allocator != this->id || lookaside.generation != this->index.generation())
    {
-      const Allocation *popped = searchQueue.front();
-      
-      searchQueue.pop_front();
-      queueVisited.insert(popped);
+      lookaside.allocator = this->id;
+      lookaside.generation = this->index.generation();
+      lookaside.count = 0;
+   }
 
-      if (size == 0 && popped->inRange(address))
-         return const_cast<Allocation &>(*popped);
-      else if (popped->inRange(address, size))
-      {
-         if (size == popped->size())
-            return const_cast<Allocation &>(*popped);
-         else if (size < popped->size() && possibleResult == NULL)
-            possibleResult = popped;
-         else if (possibleResult != NULL && size < popped->size() && popped->size() < possibleResult->size())
-            possibleResult = popped;
-      }
+   for (entryIndex=0; entryIndex<lookaside.count; ++entryIndex)
+   {
+      Lookaside::Entry found = lookaside.entries[entryIndex];
 
-      if (popped->hasParent())
-      {
-         const Allocation &parent = popped->getParent();
+      if (found.start > start || found.end < end)
+         continue;
 
-         if (queueVisited.find(&parent) != queueVisited.end())
-            searchQueue.push_back(&popped->getParent());
-      }
+      /* move it to the front */
+      for (; entryIndex>0; --entryIndex)
+         lookaside.entries[entryIndex] = lookaside.entries[entryIndex-1];
+
+      lookaside.entries[0] = found;
+      NEUROLOGY_INSTRUMENTED(this->lookasideHits.fetch_add(1, std::memory_order_relaxed));
+
+      return found.allocation;
    }
 
-   if (possibleResult != NULL)
-      return const_cast<Allocation &>(*possibleResult);
+   NEUROLOGY_INSTRUMENTED(this->lookasideMisses.fetch_add(1, std::memory_order_relaxed));
+   result = this->index.find(start, size);
+
+   /* an allocation with something smaller inside it would give the wrong
+      answer for ranges in that something, so those aren't remembered. */
+   if (result == NULL || !this->index.isExclusive(result))
+      return result;
+
+   if (lookaside.count < Allocator::LookasideSize)
+      ++lookaside.count;
+
+   for (entryIndex=lookaside.count-1; entryIndex>0; --entryIndex)
+      lookaside.entries[entryIndex] = lookaside.entries[entryIndex-1];
+
+   lookaside.entries[0].start = result->minimum;
+   lookaside.entries[0].end = result->maximum;
+   lookaside.entries[0].allocation = result;
+
+   return result;
+}
+
+Allocator::LookasideStatistics
+Allocator::lookasideStatistics
+(void) const noexcept
+{
+   LookasideStatistics result;
+
+   result.hits = this->lookasideHits.load(std::memory_order_relaxed);
+   result.misses = this->lookasideMisses.load(std::memory_order_relaxed);
+
+   return result;
+}
+
+void
+Allocator::resetLookasideStatistics
+(void) noexcept
+{
+   this->lookasideHits.store(0, std::memory_order_relaxed);
+   this->lookasideMisses.store(0, std::memory_order_relaxed);
+}
+
+AllocatorStatistics::Snapshot
+Allocator::instrumentation
+(void) const noexcept
+{
+   /* without instrumentation nothing ever gets recorded, so this is all zeroes */
+   return this->instruments.snapshot();
+}
+
+void
+Allocator::resetInstrumentation
+(void) noexcept
+{
+   NEUROLOGY_INSTRUMENTED(this->instruments.reset());
+}
+
+void
+Allocator::setRecorder
+(TraceRecorder *recorder) noexcept
+{
+   this->recorder = recorder;
+}
 
-   throw AddressNotFoundException(const_cast<Allocator &>(*this), const_cast<Address &>(address));
+TraceRecorder *
+Allocator::getRecorder
+(void) const noexcept
+{
+   return this->recorder;
+}
+
+void
+Allocator::traceAccess
+(AllocatorStatistics::Operation operation, Label address, SIZE_T size) const noexcept
+{
+   if (this->recorder != NULL)
+      this->recorder->accessed(operation, address, size);
 }
 
 Allocation
@@ -532,16 +883,278 @@ Data
 Allocator::read
 (const Address &address, SIZE_T size) const
 {
-   this->throwIfNoAddress(address);
-   return this->read(&this->find(address, size), address, size);
+   Data data;
+
+   if (!this->tryRead(address, size, &data))
+      throw AddressNotFoundException(const_cast<Allocator &>(*this), address);
+
+   return data;
+}
+
+void
+Allocator::write
+(const Address &address, const Data data)
+{
+   if (!this->tryWrite(address, data))
+      throw AddressNotFoundException(*this, address);
+}
+
+Data
+Allocator::read
+(const RawAddress &address, SIZE_T size) const
+{
+   Data data;
+
+   if (!this->tryRead(address, size, &data))
+      throw AddressNotFoundException(const_cast<Allocator &>(*this), address);
+
+   return data;
 }
 
 void
 Allocator::write
+(const RawAddress &address, const Data data)
+{
+   if (!this->tryWrite(address, data))
+      throw AddressNotFoundException(*this, address);
+}
+
+bool
+Allocator::tryRead
+(const Address &address, SIZE_T size, Data *data) const
+{
+   if (address.isNull())
+      return false;
+
+   return this->tryRead(RawAddress(address), size, data);
+}
+
+bool
+Allocator::tryRead
+(const RawAddress &address, SIZE_T size, Data *data) const
+{
+   Allocation *allocation = this->lookup(address, size);
+
+   if (allocation == NULL || !allocation->inRange(address, size))
+      return false;
+
+   this->traceAccess(AllocatorStatistics::Read, address.label(), size);
+   NEUROLOGY_MEASURE(this->instruments, AllocatorStatistics::Read, size, *data = this->readAddress(address, size));
+   return true;
+}
+
+bool
+Allocator::tryWrite
 (const Address &address, const Data data)
 {
-   this->throwIfNoAddress(address);
-   return this->write(&this->find(address, data.size()), address, data);
+   if (address.isNull())
+      return false;
+
+   return this->tryWrite(RawAddress(address), data);
+}
+
+bool
+Allocator::tryWrite
+(const RawAddress &address, const Data data)
+{
+   Allocation *allocation = this->lookup(address, data.size());
+
+   if (allocation == NULL || !allocation->inRange(address, data.size()))
+      return false;
+
+   this->traceAccess(AllocatorStatistics::Write, address.label(), data.size());
+   NEUROLOGY_MEASURE(this->instruments, AllocatorStatistics::Write, data.size(), this->writeAddress(address, data));
+   return true;
+}
+
+void
+Allocator::readInto
+(const Address &address, LPVOID destination, SIZE_T size) const
+{
+   Allocation *allocation = this->lookup(address, size);
+
+   if (allocation == NULL || !allocation->inRange(RawAddress(address), size))
+      throw AddressNotFoundException(const_cast<Allocator &>(*this), address);
+
+   this->traceAccess(AllocatorStatistics::Read, address.label(), size);
+   NEUROLOGY_MEASURE(this->instruments, AllocatorStatistics::Read, size, this->readAddressInto(address, destination, size));
+}
+
+void
+Allocator::readInto
+(const RawAddress &address, LPVOID destination, SIZE_T size) const
+{
+   Allocation *allocation = this->lookup(address, size);
+
+   if (allocation == NULL || !allocation->inRange(address, size))
+      throw AddressNotFoundException(const_cast<Allocator &>(*this), address);
+
+   this->traceAccess(AllocatorStatistics::Read, address.label(), size);
+   NEUROLOGY_MEASURE(this->instruments, AllocatorStatistics::Read, size, this->readAddressInto(address, destination, size));
+}
+
+void
+Allocator::writeFrom
+(const Address &address, LPCVOID source, SIZE_T size)
+{
+   Allocation *allocation = this->lookup(address, size);
+
+   if (allocation == NULL || !allocation->inRange(RawAddress(address), size))
+      throw AddressNotFoundException(*this, address);
+
+   this->traceAccess(AllocatorStatistics::Write, address.label(), size);
+   NEUROLOGY_MEASURE(this->instruments, AllocatorStatistics::Write, size, this->writeAddressFrom(address, source, size));
+}
+
+void
+Allocator::writeFrom
+(const RawAddress &address, LPCVOID source, SIZE_T size)
+{
+   Allocation *allocation = this->lookup(address, size);
+
+   if (allocation == NULL || !allocation->inRange(address, size))
+      throw AddressNotFoundException(*this, address);
+
+   this->traceAccess(AllocatorStatistics::Write, address.label(), size);
+   NEUROLOGY_MEASURE(this->instruments, AllocatorStatistics::Write, size, this->writeAddressFrom(address, source, size));
+}
+
+void
+Allocator::readv
+(const Batch &batch) const
+{
+   std::vector<SIZE_T> order;
+   BatchRunList runs;
+   Batch backendBatch;
+   Data scratch;
+   SIZE_T scratchSize = 0;
+
+   this->planBatch(batch, &order, &runs);
+
+   /* runs of a single entry get read straight into the caller's buffer.
+      coalesced runs get read into scratch space and scattered afterwards. */
+   for (BatchRunList::iterator runIter=runs.begin(); runIter!=runs.end(); ++runIter)
+   {
+      if (runIter->last - runIter->first == 1)
+         continue;
+
+      scratchSize += runIter->end - runIter->start;
+   }
+
+   scratch.resize(scratchSize);
+   scratchSize = 0;
+
+   for (BatchRunList::iterator runIter=runs.begin(); runIter!=runs.end(); ++runIter)
+   {
+      BatchEntry entry;
+
+      if (runIter->last - runIter->first == 1)
+      {
+         backendBatch.push_back(batch[order[runIter->first]]);
+         continue;
+      }
+
+      entry.address = RawAddress(runIter->start);
+      entry.buffer = scratch.data() + scratchSize;
+      entry.size = runIter->end - runIter->start;
+      backendBatch.push_back(entry);
+
+      scratchSize += entry.size;
+   }
+
+   if (backendBatch.size() == 0)
+      return;
+
+   if (this->recorder != NULL)
+      for (Batch::const_iterator entryIter=batch.begin(); entryIter!=batch.end(); ++entryIter)
+         this->traceAccess(AllocatorStatistics::Read, entryIter->address.label(), entryIter->size);
+
+   NEUROLOGY_MEASURE(this->instruments, AllocatorStatistics::Read, BatchBytes(backendBatch), this->readAddresses(backendBatch));
+
+   scratchSize = 0;
+
+   for (BatchRunList::iterator runIter=runs.begin(); runIter!=runs.end(); ++runIter)
+   {
+      if (runIter->last - runIter->first == 1)
+         continue;
+
+      for (SIZE_T i=runIter->first; i<runIter->last; ++i)
+      {
+         const BatchEntry &entry = batch[order[i]];
+
+         CopyMemory(entry.buffer
+                    ,scratch.data() + scratchSize + (entry.address.label() - runIter->start)
+                    ,entry.size);
+      }
+
+      scratchSize += runIter->end - runIter->start;
+   }
+}
+
+void
+Allocator::writev
+(const Batch &batch)
+{
+   std::vector<SIZE_T> order;
+   BatchRunList runs;
+   Batch backendBatch;
+   Data scratch;
+   SIZE_T scratchSize = 0;
+
+   this->planBatch(batch, &order, &runs);
+
+   for (BatchRunList::iterator runIter=runs.begin(); runIter!=runs.end(); ++runIter)
+   {
+      if (runIter->last - runIter->first == 1)
+         continue;
+
+      scratchSize += runIter->end - runIter->start;
+   }
+
+   scratch.resize(scratchSize);
+   scratchSize = 0;
+
+   for (BatchRunList::iterator runIter=runs.begin(); runIter!=runs.end(); ++runIter)
+   {
+      std::vector<SIZE_T> runOrder;
+      BatchEntry entry;
+
+      if (runIter->last - runIter->first == 1)
+      {
+         backendBatch.push_back(batch[order[runIter->first]]);
+         continue;
+      }
+
+      /* gather the run in batch order, so later entries overwrite earlier
+         ones wherever they overlap */
+      runOrder.assign(order.begin() + runIter->first, order.begin() + runIter->last);
+      std::sort(runOrder.begin(), runOrder.end());
+
+      for (std::vector<SIZE_T>::iterator orderIter=runOrder.begin(); orderIter!=runOrder.end(); ++orderIter)
+      {
+         const BatchEntry &source = batch[*orderIter];
+
+         CopyMemory(scratch.data() + scratchSize + (source.address.label() - runIter->start)
+                    ,source.buffer
+                    ,source.size);
+      }
+
+      entry.address = RawAddress(runIter->start);
+      entry.buffer = scratch.data() + scratchSize;
+      entry.size = runIter->end - runIter->start;
+      backendBatch.push_back(entry);
+
+      scratchSize += entry.size;
+   }
+
+   if (backendBatch.size() == 0)
+      return;
+
+   if (this->recorder != NULL)
+      for (Batch::const_iterator entryIter=batch.begin(); entryIter!=batch.end(); ++entryIter)
+         this->traceAccess(AllocatorStatistics::Write, entryIter->address.label(), entryIter->size);
+
+   NEUROLOGY_MEASURE(this->instruments, AllocatorStatistics::Write, BatchBytes(backendBatch), this->writeAddresses(backendBatch));
 }
 
 Allocation &
@@ -588,10 +1201,54 @@ void
 Allocator::zeroAddress
 (const Address &address, SIZE_T size)
 {
-   Data data(size);
+   this->zeroAddressRange(address, size, false);
+}
+
+bool
+Allocator::zeroesOnPool
+(void) const noexcept
+{
+   return this->zeroing == ZeroOnAlloc || this->zeroing == ZeroSecurely;
+}
+
+bool
+Allocator::zeroesOnUnpool
+(void) const noexcept
+{
+   return this->zeroing == ZeroOnFree || this->zeroing == ZeroSecurely;
+}
+
+void
+Allocator::zeroOnPool
+(const RawAddress &address, SIZE_T size)
+{
+   if (this->zeroesOnPool())
+      this->zeroAddressRange(address, size, false);
+}
 
-   std::fill(data.begin(), data.end(), 0);
-   this->writeAddress(address, data);
+void
+Allocator::zeroOnUnpool
+(const RawAddress &address, SIZE_T size)
+{
+   if (this->zeroesOnUnpool())
+      this->zeroAddressRange(address, size, this->zeroing == ZeroSecurely);
+}
+
+void
+Allocator::zeroAddressRange
+(const RawAddress &address, SIZE_T size, bool secure)
+{
+   static const BYTE zeroes[0x1000] = {0};
+   SIZE_T offset;
+
+   /* writes to the backend can't be optimized away, so there's nothing
+      extra to do for secure zeroing here. */
+   UNUSED(secure);
+
+   for (offset=0; offset<size; offset+=sizeof(zeroes))
+      this->writeAddressFrom(RawAddress(address.label()+offset)
+                             ,zeroes
+                             ,min(size-offset, sizeof(zeroes)));
 }
 
 Address
@@ -615,6 +1272,152 @@ Allocator::unpoolAddress
    throw VoidAllocatorException(*this);
 }
 
+SIZE_T
+Allocator::forgetAddress
+(Address &address)
+{
+   throw VoidAllocatorException(*this);
+}
+
+void
+Allocator::releaseAddress
+(const RawAddress &address, SIZE_T size)
+{
+   throw VoidAllocatorException(*this);
+}
+
+void
+Allocator::retire
+(const Address &address)
+{
+   Retirement retirement;
+
+   retirement.address = address.label();
+
+   EnterCriticalSection(&this->epochLock);
+   retirement.epoch = this->epoch;
+   this->retired.push_back(retirement);
+   LeaveCriticalSection(&this->epochLock);
+}
+
+void
+Allocator::takeRetired
+(RetirementList *taken)
+{
+   RetirementList kept;
+   RetirementList::iterator retireIter;
+   SIZE_T oldest;
+
+   /* readers which enter from here on can't see anything retired so far, so
+      only the readers inside right now hold anything back. */
+   EnterCriticalSection(&this->epochLock);
+   oldest = (this->readers.empty()) ? this->epoch+1 : this->readers.begin()->first;
+   ++this->epoch;
+
+   for (retireIter=this->retired.begin(); retireIter!=this->retired.end(); ++retireIter)
+   {
+      if (retireIter->epoch < oldest)
+         taken->push_back(*retireIter);
+      else
+         kept.push_back(*retireIter);
+   }
+
+   this->retired.swap(kept);
+   LeaveCriticalSection(&this->epochLock);
+
+   /* freeing in address order walks the pool's bookkeeping front to back */
+   std::sort(taken->begin(), taken->end()
+             ,[] (const Retirement &left, const Retirement &right) { return left.address < right.address; });
+}
+
+void
+Allocator::reclaimAll
+(void)
+{
+   RetirementList taken;
+
+   EnterCriticalSection(&this->epochLock);
+   taken.swap(this->retired);
+   LeaveCriticalSection(&this->epochLock);
+
+   std::sort(taken.begin(), taken.end()
+             ,[] (const Retirement &left, const Retirement &right) { return left.address < right.address; });
+
+   this->unpoolRetired(taken);
+}
+
+SIZE_T
+Allocator::unpoolRetired
+(const RetirementList &taken)
+{
+   RetirementList::const_iterator retireIter;
+   MemoryPool::iterator poolIter;
+   SIZE_T reclaimed = 0;
+
+   /* a few retirements among a lot of live memory are quicker to look up one
+      at a time than to walk the whole pool for */
+   if (taken.size() < this->pooledMemory.size() / Allocator::RetiredWalkRatio)
+   {
+      for (retireIter=taken.begin(); retireIter!=taken.end(); ++retireIter)
+      {
+         Address address = this->pooledAddresses.address(retireIter->address);
+
+         /* it may have been unpooled by hand in the meantime */
+         if (!this->isPooled(address))
+            continue;
+
+         this->unpool(address);
+         ++reclaimed;
+      }
+
+      return reclaimed;
+   }
+
+   /* otherwise walk the pool alongside them. both are in address order, so
+      nothing needs looking up, and unpooling an address never touches the
+      ones after it. */
+   poolIter = this->pooledMemory.begin();
+
+   for (retireIter=taken.begin(); retireIter!=taken.end(); ++retireIter)
+   {
+      while (poolIter != this->pooledMemory.end() && poolIter->first.label() < retireIter->address)
+         ++poolIter;
+
+      if (poolIter == this->pooledMemory.end())
+         break;
+
+      /* same as above, and an address retired twice is only freed once */
+      if (poolIter->first.label() != retireIter->address)
+         continue;
+
+      {
+         Address address = poolIter->first;
+         SIZE_T size = poolIter->second;
+
+         ++poolIter;
+         ++reclaimed;
+
+         /* something bound to it again since it was retired, which unpool()
+            knows how to deal with */
+         if (this->bindings.count(retireIter->address) > 0)
+         {
+            this->unpool(address);
+            continue;
+         }
+
+         /* the rest of what unpool() does, minus finding the address again */
+         NEUROLOGY_INSTRUMENTED(this->instruments.shrink(size, 1));
+
+         if (this->recorder != NULL)
+            this->recorder->deallocated(retireIter->address);
+
+         NEUROLOGY_MEASURE(this->instruments, AllocatorStatistics::Deallocate, size, this->unpoolAddress(address));
+      }
+   }
+
+   return reclaimed;
+}
+
 void
 Allocator::allocate
 (Allocation *allocation, SIZE_T size)
@@ -636,7 +1439,9 @@ Allocator::reallocate
       but is only applicable to orphan allocations */
    if (!allocation->hasParent())
    {
-      this->repool(this->associations.at(allocation), size);
+      Address boundAddress = this->pooledAddresses.address(this->table.at(allocation->slot).address);
+
+      this->repool(boundAddress, size);
       return;
    }
 
@@ -644,7 +1449,7 @@ Allocator::reallocate
       throw ZeroSizeException(*this);
 
    paternalDelta = size - allocation->size();
-   paternalEnd = allocation->end().label() + paternalDelta;
+   paternalEnd = allocation->maximum + paternalDelta;
 
    /* since we won't be doing any technical allocation now, we need to figure out
       which children are still alive and which children are not.
@@ -654,27 +1459,32 @@ Allocator::reallocate
       * calculate child->end().label() + delta
       * if it's less than child->start(), it has been deleted
       * if it's greater than child->start(), it has been resized */
-   if (allocation->hasChildren() && allocation->end() > paternalEnd)
+   if (allocation->hasChildren() && allocation->maximum > paternalEnd)
    {
-      Allocator::AllocationSet::iterator childIter;
       std::vector<Allocation *> deadChildren;
       std::vector<Allocation *>::iterator deadIter;
+      DWORD child;
 
-      for (childIter=allocation->children.begin();
-           childIter!=allocation->children.end();
-           ++childIter)
+      for (child=this->table.at(allocation->slot).firstChild;
+           child!=AllocationTable::NoSlot;
+           child=this->table.at(child).nextSibling)
       {
-         if ((**childIter).start() >= paternalEnd)
-            deadChildren.push_back(*childIter);
-         else if ((**childIter).end() > paternalEnd)
-            (**childIter).pool.setMax(paternalEnd);
+         Allocation *childAllocation = this->table.at(child).allocation;
+
+         if (childAllocation->minimum >= paternalEnd)
+            deadChildren.push_back(childAllocation);
+         else if (childAllocation->maximum > paternalEnd)
+         {
+            childAllocation->setMax(paternalEnd);
+            this->reindex(childAllocation);
+         }
       }
 
       for (deadIter=deadChildren.begin(); deadIter!=deadChildren.end(); ++deadIter)
       {
          /* try hosting the address in the parent's parent */
          if (allocation->hasParent() && allocation->getParent().hasParent())
-            (**deadIter).setParent(allocation->getParent().getParent());
+            this->table.adopt(allocation->getParent().getParent().slot, (**deadIter).slot);
          else
             this->unbind(*deadIter);
       }
@@ -692,52 +1502,62 @@ void
 Allocator::bind
 (Allocation *allocation, const Address &address)
 {
-   Address localAddress;
-   bool rootAlloc;
+   this->bind(allocation, address, NULL);
+}
+
+void
+Allocator::bind
+(Allocation *allocation, const Address &address, Allocation *parent)
+{
+   BindingMap::iterator bindIter;
 
    this->throwIfBound(*allocation);
    
-   rootAlloc = !this->hasParent(*allocation);
-
-   if (rootAlloc)
+   if (parent == NULL)
    {
       this->throwIfNotPooled(address);
-      allocation->pool.setRange(address.label()
-                                ,address.label() + this->pooledMemory.at(address));
+      allocation->setRange(address.label()
+                           ,address.label() + this->pooledMemory.at(address));
    }
    else
    {
-      Allocation &parent = allocation->getParent();
-      parent.throwIfNotInRange(address);
-   }
+      this->throwIfNotBound(*parent);
+      parent->throwIfNotInRange(address);
+   }
+
+   allocation->allocator = this;
+   allocation->slot = this->table.claim(allocation, address.label());
+
+   if (parent != NULL)
+      this->table.adopt(parent->slot, allocation->slot);
+
+   bindIter = this->bindings.find(address.label());
+
+   if (bindIter == this->bindings.end())
+   {
+      AllocationTable::SlotList emptyList = { AllocationTable::NoSlot, 0 };
 
-   if (!rootAlloc)
-      localAddress = allocation->getParent().address(allocation->getParent().offset(address));
-   else if (address.usesPool(&this->pooledAddresses))
-      localAddress = address;
-   else
-      localAddress = this->pooledAddresses.address(address.label());
+      bindIter = this->bindings.insert(BindingMap::value_type(address.label(), emptyList)).first;
+   }
 
-   this->bindings[localAddress].insert(allocation);
-   this->associations[allocation] = localAddress;
-   this->allocations.insert(allocation);
-   
-   allocation->allocator = this;
+   this->table.link(&bindIter->second, allocation->slot);
+   this->reindex(allocation);
 }
 
 void
 Allocator::rebind
 (Allocation *allocation, const Address &newAddress)
 {
-   Address oldAddress, localNewAddress;
-   SIZE_T bindCount;
+   Label oldLabel, newLabel;
+   BindingMap::iterator bindIter;
    std::intptr_t delta;
-   bool rootAlloc = !allocation->hasParent();
+   bool emptied;
+   DWORD child;
    
    if (!this->isBound(*allocation))
       return this->bind(allocation, newAddress);
 
-   if (rootAlloc)
+   if (!allocation->hasParent())
       this->throwIfNotPooled(newAddress);
    else
    {
@@ -745,49 +1565,50 @@ Allocator::rebind
       parent.throwIfNotInRange(newAddress);
    }
 
-   if (!rootAlloc)
-   {
-      if (newAddress.usesPool(&allocation->getParent().pool))
-         localNewAddress = newAddress;
-      else
-         localNewAddress = allocation->getParent().address(allocation->getParent().offset(newAddress));
-   }
-   else if (newAddress.usesPool(&this->pooledAddresses))
-      localNewAddress = newAddress;
-   else
-      localNewAddress = this->pooledAddresses.address(newAddress.label());
-
-   oldAddress = this->associations[allocation];
-   delta = localNewAddress - oldAddress;
+   oldLabel = this->table.at(allocation->slot).address;
+   newLabel = newAddress.label();
+   delta = newLabel - oldLabel;
 
    /* if the addresses are the same, that's not an error, but there's no point in rebinding */
    if (delta == 0)
       return;
-   
-   this->bindings[localNewAddress].insert(allocation);
-   this->bindings[oldAddress].erase(allocation);
-   this->associations[allocation] = localNewAddress;
 
-   allocation->pool.rebase(localNewAddress.label());
-   bindCount = this->bindings[oldAddress].size();
-   
-   if (this->hasChildren(*allocation))
+   bindIter = this->bindings.find(oldLabel);
+   this->table.unlink(&bindIter->second, allocation->slot);
+   emptied = bindIter->second.count == 0;
+
+   /* children sharing the old address rebind on their own below, so the old
+      binding has to go before they get to it */
+   if (emptied)
+      this->bindings.erase(bindIter);
+
+   bindIter = this->bindings.find(newLabel);
+
+   if (bindIter == this->bindings.end())
    {
-      AllocationSet::iterator childIter;
+      AllocationTable::SlotList emptyList = { AllocationTable::NoSlot, 0 };
 
-      for (childIter = allocation->children.begin();
-           childIter != allocation->children.end();
-           ++childIter)
-      {
-         Address newAddress = Address(this->associations.at(*childIter).label() + delta);
-         this->rebind(*childIter, newAddress);
-      }
+      bindIter = this->bindings.insert(BindingMap::value_type(newLabel, emptyList)).first;
+   }
+
+   this->table.link(&bindIter->second, allocation->slot);
+   this->table.at(allocation->slot).address = newLabel;
+
+   allocation->rebase(newLabel);
+   this->reindex(allocation);
+
+   for (child=this->table.at(allocation->slot).firstChild;
+        child!=AllocationTable::NoSlot;
+        child=this->table.at(child).nextSibling)
+   {
+      Address newChildAddress = Address(this->table.at(child).address + delta);
+      this->rebind(this->table.at(child).allocation, newChildAddress);
    }
    
    /* originally this moved the identifier of the old address... don't do that. it causes problems. */
-   if (bindCount == 0)
+   if (emptied)
    {
-      this->bindings.erase(oldAddress);
+      Address oldAddress = this->pooledAddresses.address(oldLabel);
 
       /* rebind may have been called by repool, which may have already unpooled the prior address.
          that or this might be a suballocation. */
@@ -801,44 +1622,126 @@ Allocator::unbind
 (Allocation *allocation)
 {
    Address boundAddress;
+   Label boundLabel;
+   BindingMap::iterator bindIter;
+   bool rootAlloc;
+   DWORD child;
    
    this->throwIfNotBound(*allocation);
 
-   if (!allocation->hasParent())
-      this->throwIfNotPooled(this->associations.at(allocation));
-   else
-      allocation->leaveParent();
-   
-   if (allocation->hasChildren())
-   {
-      Allocator::AllocationSet::iterator childIter;
+   boundLabel = this->table.at(allocation->slot).address;
+   rootAlloc = !allocation->hasParent();
 
-      while (allocation->children.size() > 0)
-         this->unbind(*allocation->children.begin());
+   if (rootAlloc)
+   {
+      boundAddress = this->pooledAddresses.address(boundLabel);
+      this->throwIfNotPooled(boundAddress);
    }
+   else
+      this->table.orphan(allocation->slot);
+   
+   while ((child = this->table.at(allocation->slot).firstChild) != AllocationTable::NoSlot)
+      this->unbind(this->table.at(child).allocation);
 
-   boundAddress = this->associations[allocation];
+   bindIter = this->bindings.find(boundLabel);
+   this->table.unlink(&bindIter->second, allocation->slot);
+   this->table.release(allocation->slot);
 
-   this->bindings[boundAddress].erase(allocation);
-   this->associations.erase(allocation);
-   this->allocations.erase(allocation);
-   allocation->pool.setRange(0,0);
+   allocation->slot = AllocationTable::NoSlot;
+   this->index.erase(allocation);
+   allocation->setRange(0,0);
    
-   if (this->bindings.count(boundAddress) > 0 && this->bindings[boundAddress].size() != 0)
+   if (bindIter->second.count != 0)
       return;
    
-   this->bindings.erase(boundAddress);
-      
-   if (this->isPooled(boundAddress))
+   this->bindings.erase(bindIter);
+
+   /* a child's address can only be pooled if it starts its root, and roots
+      outlive their children, so there's nothing to unpool here. */
+   if (!rootAlloc || !this->isPooled(boundAddress))
+      return;
+
+   if (this->deferring)
+      this->retire(boundAddress);
+   else
       this->unpool(boundAddress);
 }
 
+void
+Allocator::unbindAll
+(void)
+{
+   /* the allocations themselves still hold their slots and their old ranges,
+      so cut those loose before the table goes. */
+   for (DWORD slot=0; slot<this->table.capacity(); ++slot)
+   {
+      Allocation *allocation = this->table.at(slot).allocation;
+
+      if (allocation == NULL)
+         continue;
+
+      allocation->slot = AllocationTable::NoSlot;
+      allocation->setRange(0,0);
+   }
+
+#ifdef NEUROLOGY_INSTRUMENT
+   for (MemoryPool::iterator iter=this->pooledMemory.begin(); iter!=this->pooledMemory.end(); ++iter)
+      this->instruments.shrink(iter->second, 1);
+#endif
+
+   if (this->recorder != NULL)
+      for (MemoryPool::iterator iter=this->pooledMemory.begin(); iter!=this->pooledMemory.end(); ++iter)
+         this->recorder->deallocated(iter->first.label());
+
+   this->table.clear();
+   this->bindings.clear();
+   this->pooledMemory.clear();
+   this->index.clear();
+
+   EnterCriticalSection(&this->epochLock);
+   this->retired.clear();
+   LeaveCriticalSection(&this->epochLock);
+}
+
+void
+Allocator::reindex
+(Allocation *allocation)
+{
+   /* unbound or emptied allocations have no range to speak of */
+   if (!this->table.holds(allocation->slot, allocation) || allocation->size() == 0)
+      return this->index.erase(allocation);
+
+   this->index.insert(allocation, allocation->minimum, allocation->maximum);
+}
+
+void
+Allocator::transfer
+(Allocation *from, Allocation *to)
+{
+   this->throwIfNotBound(*from);
+
+   /* the slot is the only thing pointing at the allocation, so moving it over
+      is all it takes for parents, children and handles to follow. */
+   to->allocator = this;
+   to->slot = from->slot;
+   this->table.at(to->slot).allocation = to;
+
+   from->slot = AllocationTable::NoSlot;
+   this->index.erase(from);
+   this->reindex(to);
+}
+
 Data
 Allocator::read
 (const Allocation *allocation, const Address &address, SIZE_T size) const
 {
+   Data result;
+
    allocation->throwIfNotInRange(address, size);
-   return this->readAddress(address, size);
+   this->traceAccess(AllocatorStatistics::Read, address.label(), size);
+   NEUROLOGY_MEASURE(this->instruments, AllocatorStatistics::Read, size, result = this->readAddress(address, size));
+
+   return result;
 }
 
 void
@@ -846,19 +1749,105 @@ Allocator::write
 (const Allocation *allocation, const Address &destination, const Data data)
 {
    allocation->throwIfNotInRange(destination, data.size());
-   return this->writeAddress(destination, data);
+   this->traceAccess(AllocatorStatistics::Write, destination.label(), data.size());
+   NEUROLOGY_MEASURE(this->instruments, AllocatorStatistics::Write, data.size(), this->writeAddress(destination, data));
 }
 
 Data
 Allocator::readAddress
-(const Address &address, SIZE_T size) const
+(const RawAddress &address, SIZE_T size) const
 {
-   throw VoidAllocatorException(const_cast<Allocator &>(*this));
+   Data result(size);
+
+   this->readAddressInto(address, result.data(), size);
+   return result;
 }
 
 void
 Allocator::writeAddress
-(const Address &destination, const Data data)
+(const RawAddress &destination, const Data data)
+{
+   this->writeAddressFrom(destination, data.data(), data.size());
+}
+
+void
+Allocator::readAddresses
+(const Batch &batch) const
+{
+   for (Batch::const_iterator entryIter=batch.begin(); entryIter!=batch.end(); ++entryIter)
+      this->readAddressInto(entryIter->address, entryIter->buffer, entryIter->size);
+}
+
+void
+Allocator::writeAddresses
+(const Batch &batch)
+{
+   for (Batch::const_iterator entryIter=batch.begin(); entryIter!=batch.end(); ++entryIter)
+      this->writeAddressFrom(entryIter->address, entryIter->buffer, entryIter->size);
+}
+
+void
+Allocator::planBatch
+(const Batch &batch, std::vector<SIZE_T> *order, BatchRunList *runs) const
+{
+   Allocation *allocation = NULL;
+
+   order->clear();
+   runs->clear();
+
+   for (SIZE_T i=0; i<batch.size(); ++i)
+   {
+      if (batch[i].size > 0)
+         order->push_back(i);
+   }
+
+   std::stable_sort(order->begin(), order->end()
+                    ,[&batch] (SIZE_T left, SIZE_T right) { return batch[left].address < batch[right].address; });
+
+   /* sorted entries tend to land in the same allocation as the one before,
+      so only go back to the index when they don't. */
+   for (SIZE_T i=0; i<order->size(); ++i)
+   {
+      const BatchEntry &entry = batch[(*order)[i]];
+      Label start = entry.address.label();
+      Label end = start + entry.size;
+
+      if (allocation == NULL || !allocation->inRange(entry.address, entry.size))
+      {
+         allocation = this->tryFind(entry.address, entry.size);
+
+         if (allocation == NULL || !allocation->inRange(entry.address, entry.size))
+            throw AddressNotFoundException(const_cast<Allocator &>(*this), entry.address);
+      }
+
+      if (runs->size() > 0 && start <= runs->back().end)
+      {
+         runs->back().end = max(runs->back().end, end);
+         runs->back().last = i+1;
+      }
+      else
+      {
+         BatchRun run;
+
+         run.start = start;
+         run.end = end;
+         run.first = i;
+         run.last = i+1;
+         runs->push_back(run);
+      }
+   }
+}
+
+void
+Allocator::readAddressInto
+(const RawAddress &address, LPVOID destination, SIZE_T size) const
+{
+   throw VoidAllocatorException(const_cast<Allocator &>(*this));
+}
+
+void
+Allocator::writeAddressFrom
+(const RawAddress &destination, LPCVOID source, SIZE_T size)
 {
    throw VoidAllocatorException(*this);
 }
@@ -868,16 +1857,13 @@ Allocator::spawn
 (Allocation *allocation, const Address &address, SIZE_T size)
 {
    Allocation newAllocation;
-   Address baseAddress;
    
    allocation->throwIfNotInRange(address, size);
 
    newAllocation = this->null();
-   baseAddress = allocation->address(allocation->offset(address));
 
-   newAllocation.setParent(*allocation);
-   newAllocation.pool.setRange(address.label(), address.label()+size);
-   this->bind(&newAllocation, baseAddress);
+   newAllocation.setRange(address.label(), address.label()+size);
+   this->bind(&newAllocation, address, allocation);
 
    return newAllocation;
 }
@@ -945,41 +1931,72 @@ Allocation::OrphanAllocationException::OrphanAllocationException
 Allocation::Allocation
 (void)
    : allocator(NULL)
-   , parent(NULL)
+   , pool(NULL)
+   , minimum(0)
+   , maximum(0)
+   , generation(0)
+   , slot(AllocationTable::NoSlot)
 {
-   this->pool.setRange(0,0);
 }
 
 Allocation::Allocation
 (Allocator *allocator)
    : allocator(allocator)
-   , parent(NULL)
+   , pool(NULL)
+   , minimum(0)
+   , maximum(0)
+   , generation(0)
+   , slot(AllocationTable::NoSlot)
 {
    if (this->allocator == NULL)
       throw NoAllocatorException(*this);
-
-   this->pool.setRange(0,0);
 }
 
 Allocation::Allocation
 (Allocation &allocation)
    : allocator(allocation.allocator)
-   , parent(NULL)
+   , pool(NULL)
+   , minimum(0)
+   , maximum(0)
+   , generation(0)
+   , slot(AllocationTable::NoSlot)
 {
    if (allocation.isBound())
       this->copy(allocation);
 }
 
+Allocation::Allocation
+(Allocation &&allocation)
+   : allocator(allocation.allocator)
+   , pool(allocation.pool)
+   , minimum(allocation.minimum)
+   , maximum(allocation.maximum)
+   , generation(0)
+   , slot(AllocationTable::NoSlot)
+{
+   /* tracked addresses point at the pool itself, so they come along with it */
+   allocation.pool = NULL;
+
+   if (allocation.isBound())
+      this->allocator->transfer(&allocation, this);
+   else
+      this->minimum = this->maximum = 0;
+
+   allocation.setRange(0,0);
+}
+
 Allocation::~Allocation
 (void)
 {
-   if (this->allocator == NULL)
-      return;
-
-   if (this->isBound())
+   if (this->allocator != NULL && this->isBound())
       this->allocator->unbind(this);
 
    this->allocator = NULL;
+
+   if (this->pool != NULL)
+      delete this->pool;
+
+   this->pool = NULL;
 }
 
 void
@@ -996,6 +2013,25 @@ Allocation::operator=
       this->throwIfNotBound();
 }
 
+void
+Allocation::operator=
+(Allocation &&allocation)
+{
+   /* a bound allocation keeps its own slot and rebinds like it always has */
+   if (this->isBound() || !allocation.isBound())
+      return this->operator=(static_cast<Allocation &>(allocation));
+
+   if (this->pool != NULL)
+      delete this->pool;
+
+   this->pool = allocation.pool;
+   allocation.pool = NULL;
+
+   this->setRange(allocation.minimum, allocation.maximum);
+   allocation.allocator->transfer(&allocation, this);
+   allocation.setRange(0,0);
+}
+
 void
 Allocation::operator=
 (const Allocation *allocation)
@@ -1042,12 +2078,10 @@ bool
 Allocation::inRange
 (SIZE_T offset) const noexcept
 {
-   Address check;
-   
-   if (this->isNull() || this->size() == 0)
+   if (this->isNull())
       return false;
 
-   return this->inRange(this->start() + offset);
+   return offset < this->size();
 }
 
 bool
@@ -1065,7 +2099,10 @@ bool
 Allocation::inRange
 (const Address &address) const noexcept
 {
-   return address >= this->start() && address < this->end();
+   if (this->isNull())
+      return false;
+
+   return address.label() >= this->minimum && address.label() < this->maximum;
 }
 
 bool
@@ -1077,32 +2114,56 @@ Allocation::inRange
    return size != 0 && this->inRange(address) && this->inRange(Address(address.label()+size-1));
 }
 
+bool
+Allocation::inRange
+(const RawAddress &address) const noexcept
+{
+   /* the pool of an allocation spans exactly the range of the allocation, so
+      the check can be made without creating any addresses. */
+   if (this->isNull())
+      return false;
+
+   return address >= this->minimum && address < this->maximum;
+}
+
+bool
+Allocation::inRange
+(const RawAddress &address, SIZE_T size) const noexcept
+{
+   return size != 0 && this->inRange(address) && size <= this->maximum - address.label();
+}
+
 bool
 Allocation::hasParent
 (void) const noexcept
 {
-   return this->parent != NULL;
+   return this->holdsSlot()
+      && this->allocator->table.at(this->slot).parent != AllocationTable::NoSlot;
 }
 
 bool
 Allocation::hasChildren
 (void) const noexcept
 {
-   return this->children.size() > 0;
+   return this->holdsSlot()
+      && this->allocator->table.at(this->slot).firstChild != AllocationTable::NoSlot;
 }
 
 bool
 Allocation::isChild
 (const Allocation &parent) const noexcept
 {
-   return this->isBound() && parent.children.find(const_cast<Allocation *>(this)) != parent.children.end();
+   return this->isBound()
+      && parent.allocatedFrom(this->allocator)
+      && parent.holdsSlot()
+      && this->allocator->table.at(this->slot).parent == parent.slot;
 }
 
 bool
 Allocation::isParent
 (const Allocation &child) const noexcept
 {
-   return this->isBound() && child.parent == this;
+   return child.isChild(*this);
 }
 
 void
@@ -1172,6 +2233,22 @@ Allocation::throwIfNotInRange
       throw AddressOutOfRangeException(*this, address, size);
 }
 
+void
+Allocation::throwIfNotInRange
+(const RawAddress &address) const
+{
+   if (!this->inRange(address))
+      throw AddressOutOfRangeException(*this, address.promote(), 0);
+}
+
+void
+Allocation::throwIfNotInRange
+(const RawAddress &address, SIZE_T size) const
+{
+   if (!this->inRange(address, size))
+      throw AddressOutOfRangeException(*this, address.promote(), size);
+}
+
 void
 Allocation::throwIfNoParent
 (void) const
@@ -1186,7 +2263,7 @@ Allocation::address
 {
    this->throwIfNotBound();
    
-   return this->pool.address(this->pool.minimum());
+   return this->trackingPool().address(this->minimum);
 }
 
 Address
@@ -1195,7 +2272,7 @@ Allocation::address
 {
    this->throwIfNotBound();
 
-   return Address(this->pool.minimum());
+   return Address(this->minimum);
 }
 
 Address
@@ -1214,9 +2291,10 @@ Allocation::address
    
    this->throwIfNotBound();
 
-   newLabel = this->pool.minimum() + offset;
+   newLabel = this->minimum + offset;
 
-   this->pool.throwIfNotInRange(newLabel);
+   if (newLabel > this->maximum)
+      throw OffsetOutOfRangeException(*this, offset, 0);
 
    return this->address() + offset;
 }
@@ -1227,7 +2305,7 @@ Allocation::newAddress
 {
    this->throwIfNotBound();
    
-   return this->pool.newAddress(this->pool.minimum());
+   return this->trackingPool().newAddress(this->minimum);
 }
 
 Address
@@ -1236,7 +2314,7 @@ Allocation::newAddress
 {
    this->throwIfNotBound();
 
-   return AddressPool::Instance.newAddress(this->pool.minimum());
+   return AddressPool::Instance.newAddress(this->minimum);
 }
 
 Address
@@ -1245,7 +2323,7 @@ Allocation::newAddress
 {
    this->throwIfNotBound();
    
-   return this->pool.newAddress(this->pool.minimum() + offset);
+   return this->trackingPool().newAddress(this->minimum + offset);
 }
 
 Address
@@ -1256,9 +2334,10 @@ Allocation::newAddress
    
    this->throwIfNotBound();
 
-   newLabel = this->pool.minimum() + offset;
+   newLabel = this->minimum + offset;
 
-   this->pool.throwIfNotInRange(newLabel);
+   if (newLabel > this->maximum)
+      throw OffsetOutOfRangeException(*this, offset, 0);
 
    return AddressPool::Instance.newAddress(newLabel);
 }
@@ -1314,7 +2393,7 @@ SIZE_T
 Allocation::size
 (void) const noexcept
 {
-   return this->pool.size();
+   return this->maximum - this->minimum;
 }
 
 void
@@ -1353,7 +2432,7 @@ Allocation::zeroFill
 (void)
 {
    this->throwIfNotBound();
-   this->allocator->zeroAddress(this->address(), this->size());
+   this->allocator->zeroAddressRange(RawAddress(this->minimum), this->size(), false);
 }
 
 Data
@@ -1374,15 +2453,15 @@ Data
 Allocation::read
 (SIZE_T offset, SIZE_T size) const
 {
-   try
-   {
-      return this->read(this->address(offset), size);
-   }
-   catch (AddressOutOfRangeException &exception)
+   Data data;
+
+   if (!this->tryRead(offset, size, &data))
    {
-      UNUSED(exception);
+      this->throwIfNotBound();
       throw OffsetOutOfRangeException(*this, offset, size);
    }
+
+   return data;
 }
 
 Data
@@ -1405,16 +2484,9 @@ void
 Allocation::write
 (SIZE_T offset, const Data data)
 {
-   try
-   {
-      /* explicitly create an address object so that it doesn't cast the resulting address as an integer...
-         fucking C++ */
-      Address offsetAddr = this->address(offset);
-      this->write(offsetAddr, data);
-   }
-   catch (AddressOutOfRangeException &exception)
+   if (!this->tryWrite(offset, data))
    {
-      UNUSED(exception);
+      this->throwIfNotBound();
       throw OffsetOutOfRangeException(*this, offset, data.size());
    }
 }
@@ -1428,25 +2500,94 @@ Allocation::write
    this->allocator->write(this, destAddress, data);
 }
 
+bool
+Allocation::tryRead
+(SIZE_T offset, SIZE_T size, Data *data) const
+{
+   RawAddress address;
+
+   if (!this->resolveOffset(offset, size, &address))
+      return false;
+
+   *data = this->allocator->readAddress(address, size);
+   return true;
+}
+
+bool
+Allocation::tryWrite
+(SIZE_T offset, const Data data)
+{
+   RawAddress address;
+
+   if (!this->resolveOffset(offset, data.size(), &address))
+      return false;
+
+   this->allocator->writeAddress(address, data);
+   return true;
+}
+
+void
+Allocation::readInto
+(SIZE_T offset, LPVOID destination, SIZE_T size) const
+{
+   RawAddress address;
+
+   if (!this->resolveOffset(offset, size, &address))
+   {
+      this->throwIfNotBound();
+      throw OffsetOutOfRangeException(*this, offset, size);
+   }
+
+   this->allocator->readAddressInto(address, destination, size);
+}
+
+void
+Allocation::writeFrom
+(SIZE_T offset, LPCVOID source, SIZE_T size)
+{
+   RawAddress address;
+
+   if (!this->resolveOffset(offset, size, &address))
+   {
+      this->throwIfNotBound();
+      throw OffsetOutOfRangeException(*this, offset, size);
+   }
+
+   this->allocator->writeAddressFrom(address, source, size);
+}
+
 void
 Allocation::copy
 (Allocation &allocation)
 {
+   Address base;
+   Allocation *parent = NULL;
+
    allocation.throwIfNotBound();
    
    this->allocator = allocation.allocator;
 
    if (allocation.hasParent())
-      this->setParent(allocation.getParent());
+      parent = &allocation.getParent();
 
    /* don't copy the children though-- those belong to the other allocation, not us */
 
+   /* going through the allocator's pool keeps the other allocation from
+      creating a pool of its own just to hand over its address */
+   base = this->allocator->pooledAddresses.address(allocation.minimum);
+
    if (this->isBound())
-      this->allocator->rebind(this, allocation.address());
+   {
+      if (parent != NULL)
+         this->allocator->table.adopt(parent->slot, this->slot);
+
+      this->allocator->rebind(this, base);
+   }
    else
-      this->allocator->bind(this, allocation.address());
+      this->allocator->bind(this, base, parent);
 
-   this->pool.setRange(allocation.pool.range());
+   this->setRange(allocation.minimum, allocation.maximum);
+   this->allocator->reindex(this);
 }
 
 void
@@ -1478,7 +2619,7 @@ Allocation::root
 (void) noexcept
 {
    if (this->hasParent())
-      return this->parent->root();
+      return this->getParent().root();
 
    return *this;
 }
@@ -1488,7 +2629,7 @@ Allocation::root
 (void) const noexcept
 {
    if (this->hasParent())
-      return this->parent->root();
+      return this->getParent().root();
 
    return *this;
 }
@@ -1499,7 +2640,7 @@ Allocation::getParent
 {
    this->throwIfNoParent();
 
-   return *this->parent;
+   return *this->allocator->table.at(this->allocator->table.at(this->slot).parent).allocation;
 }
 
 const Allocation &
@@ -1508,46 +2649,110 @@ Allocation::getParent
 {
    this->throwIfNoParent();
 
-   return *this->parent;
+   return *this->allocator->table.at(this->allocator->table.at(this->slot).parent).allocation;
 }
 
 Allocator::AllocationSet
 Allocation::getChildren
 (void) const
 {
-   if (this->children.size() == 0)
-      return Allocator::AllocationSet();
+   Allocator::AllocationSet result;
+   DWORD child;
+
+   if (!this->holdsSlot())
+      return result;
+
+   for (child=this->allocator->table.at(this->slot).firstChild;
+        child!=AllocationTable::NoSlot;
+        child=this->allocator->table.at(child).nextSibling)
+      result.insert(this->allocator->table.at(child).allocation);
    
-   return Allocator::AllocationSet(this->children);
+   return result;
+}
+
+bool
+Allocation::resolveOffset
+(SIZE_T offset, SIZE_T size, RawAddress *address) const noexcept
+{
+   /* offsets go straight to the backend, no tracked addresses get made. */
+   if (this->isNull() || !this->holdsSlot() || offset >= this->size())
+      return false;
+
+   *address = RawAddress(this->minimum + offset);
+
+   return this->inRange(*address, size);
+}
+
+bool
+Allocation::holdsSlot
+(void) const noexcept
+{
+   return this->allocator != NULL && this->allocator->table.holds(this->slot, this);
+}
+
+SIZE_T
+Allocation::currentGeneration
+(void) const noexcept
+{
+   return this->generation;
+}
+
+Allocator::AllocationHandle
+Allocation::handle
+(void) const noexcept
+{
+   if (this->allocator == NULL)
+      return AllocationTable::NullHandle;
+
+   return this->allocator->handle(*this);
+}
+
+AddressPool &
+Allocation::trackingPool
+(void) const
+{
+   /* allocations get rebased whenever their memory moves, so keep their
+      labels relative to the base of the pool. */
+   if (this->pool == NULL)
+   {
+      this->pool = new AddressPool(this->minimum, this->maximum);
+      this->pool->setRelative(true);
+   }
+
+   return *this->pool;
 }
 
 void
-Allocation::setParent
-(Allocation &allocation)
+Allocation::setRange
+(Label minimum, Label maximum)
 {
-   if (this->parent != NULL)
-      this->leaveParent();
+   if (this->pool != NULL)
+      this->pool->setRange(minimum, maximum);
 
-   this->parent = &allocation;
-   this->parent->children.insert(this);
+   this->minimum = minimum;
+   this->maximum = maximum;
+   ++this->generation;
 }
 
 void
-Allocation::disownChild
-(Allocation &allocation)
+Allocation::setMax
+(Label maximum)
 {
-   if (this->children.find(&allocation) == this->children.end())
-      return;
+   if (this->pool != NULL)
+      this->pool->setMax(maximum);
 
-   allocation.parent = NULL;
-   this->children.erase(&allocation);
+   this->maximum = maximum;
+   ++this->generation;
 }
 
 void
-Allocation::leaveParent
-(void)
+Allocation::rebase
+(Label base)
 {
-   this->throwIfNoParent();
+   if (this->pool != NULL)
+      this->pool->rebase(base);
 
-   this->parent->disownChild(*this);
+   this->maximum = base + (this->maximum - this->minimum);
+   this->minimum = base;
+   ++this->generation;
 }
@@ -4,4 +4,8 @@
 
 #include "test.hpp"
 #include "tests/address.hpp"
+#include "tests/addresspool.hpp"
+#include "tests/allocindex.hpp"
+#include "tests/arenaalloc.hpp"
+#include "tests/heapalloc.hpp"
 // #include "tests/localalloc.hpp"
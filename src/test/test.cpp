@@ -4,6 +4,48 @@ using namespace NeurologyTest;
 
 TestRunner TestRunner::Instance;
 
+std::wstring
+NeurologyTest::Format
+(const wchar_t *format)
+{
+#ifdef _WIN32
+   return format;
+#else
+   std::wstring result;
+
+   for (; *format != 0; ++format)
+   {
+      if (*format != L'%')
+      {
+         result.push_back(*format);
+         continue;
+      }
+
+      if (format[1] == L's')
+         result.append(L"%ls");
+      else if (format[1] == L'S')
+         result.append(L"%s");
+      else if (format[1] == L'I' && format[2] == L'6' && format[3] == L'4')
+      {
+         result.append(L"%ll");
+         format += 2;
+      }
+      else
+      {
+         result.push_back(L'%');
+         result.push_back(format[1]);
+      }
+
+      if (format[1] == 0)
+         break;
+
+      ++format;
+   }
+
+   return result;
+#endif
+}
+
 Test::Test
 (void)
 {
@@ -124,19 +166,19 @@ TestRunner::run
       }
 
       wprintf(L"done.\r\n\r\n==========\r\n\r\n");
-      wprintf(L"[!] %I64d total failures.\r\n\r\n", failures.size());
+      wprintf(Format(L"[!] %I64d total failures.\r\n\r\n").c_str(), failures.size());
 
       for (std::map<const char *, FailVector>::iterator iter=organizedFails.begin();
            iter!=organizedFails.end();
            ++iter)
       {
-         wprintf(L"[!] %I64d failures in %S...\r\n", iter->second.size(), iter->first);
+         wprintf(Format(L"[!] %I64d failures in %S...\r\n").c_str(), iter->second.size(), iter->first);
 
          for (FailVector::iterator failIter=iter->second.begin();
               failIter!=iter->second.end();
               ++failIter)
          {
-            wprintf(L"... %S (line %I64d, file %S)\r\n", failIter->expression, failIter->line, failIter->fileName);
+            wprintf(Format(L"... %S (line %I64d, file %S)\r\n").c_str(), failIter->expression, failIter->line, failIter->fileName);
          }
 
          wprintf(L"\r\n");
@@ -145,7 +187,10 @@ TestRunner::run
       result = 1;
    }
 
+#ifdef _WIN32
    system("pause");
+#endif
+
    return result;
 }
 
@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <stdio.h>
+#include <string>
 #include <typeinfo>
 #include <vector>
 
@@ -27,6 +28,10 @@ namespace NeurologyTest
    class TestFailure;
    
    typedef std::vector<TestFailure> FailVector;
+
+   /* messages are written with the MSVC conversions (%s wide, %S narrow, %I64d), which
+      this translates for every other runtime. */
+   std::wstring Format(const wchar_t *format);
    
    class Test
    {
@@ -39,7 +44,7 @@ namespace NeurologyTest
       
       template <class ... Args> void assertMessage(LPWSTR format, Args ... args)
       {
-         wprintf(format, args...);
+         wprintf(Format(format).c_str(), args...);
          wprintf(L"\r\n");
       }
 
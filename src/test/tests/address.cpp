@@ -17,6 +17,7 @@ AddressTest::run
 {
    this->testAddressPool(failures);
    this->testAddress(failures);
+   this->testRawAddress(failures);
 }
 
 void
@@ -65,6 +66,127 @@ AddressTest::testAddressPool
    NASSERT(x86Pool.maximum() == 0x691000);
    NASSERT(x86Pool.size() == 0x1000);
 
+   NASSERT(!x86Pool.tryAddress(0x400000, &compAddrObj));
+   NASSERT(x86Pool.tryAddress(0x690800, &compAddrObj));
+   NASSERT(x86Pool.isBound(compAddrObj));
+   NASSERT(compAddrObj.label() == 0x690800);
+   NEXCEPT(x86Pool.address(0x400000), true);
+
+   /* enough addresses to spill over several identity slabs */
+   {
+      AddressPool slabPool, slabDrainPool;
+      std::vector<Address> slabAddresses;
+      SIZE_T count = AddressPool::IdentitySlabSize*3+1;
+
+      for (SIZE_T i=0; i<count; ++i)
+         slabAddresses.push_back(slabPool.address(0x10000+i));
+
+      slabAddresses.erase(slabAddresses.begin(), slabAddresses.begin()+count/2);
+
+      NASSERT(!slabPool.hasLabel(0x10000));
+      NASSERT(slabPool.hasLabel(0x10000+count-1));
+
+      slabPool.drain(slabDrainPool);
+
+      for (SIZE_T i=0; i<count/2; ++i)
+         slabAddresses.push_back(slabDrainPool.address(0x20000+i));
+
+      NASSERT(slabDrainPool.isBound(slabAddresses.front()));
+      NASSERT(slabAddresses.front().label() == 0x10000+count/2);
+      NASSERT(slabAddresses.back().label() == 0x20000+count/2-1);
+   }
+
+   /* copies of an address all get linked to the same identity */
+   {
+      AddressPool bindPool;
+      Address firstAddress = bindPool.address(0x1000);
+      Address secondAddress = firstAddress;
+      Address thirdAddress(secondAddress);
+
+      NASSERT(bindPool.pool().size() == 3);
+      NASSERT(bindPool.sharesIdentity(firstAddress, thirdAddress));
+
+      secondAddress = Address();
+
+      NASSERT(!bindPool.isBound(secondAddress));
+      NASSERT(bindPool.pool().size() == 2);
+      NASSERT(bindPool.sharesIdentity(firstAddress, thirdAddress));
+   }
+
+   /* relative pools move their base rather than every label */
+   {
+      AddressPool relativePool(0x400000, 0x401000);
+      Address baseAddress, endAddress;
+
+      relativePool.setRelative(true);
+      NASSERT(relativePool.isRelative());
+
+      baseAddress = relativePool.address(0x400000);
+      endAddress = relativePool.address(0x401000);
+
+      relativePool.rebase(0x690000);
+
+      NASSERT(baseAddress.label() == 0x690000);
+      NASSERT(endAddress.label() == 0x691000);
+      NASSERT(relativePool.hasLabel(0x690000));
+      NASSERT(!relativePool.hasLabel(0x400000));
+      NEXCEPT(relativePool.shift(1), true);
+
+      baseAddress.move(0x690800);
+      NASSERT(relativePool.hasLabel(0x690800));
+
+      relativePool.setRelative(false);
+
+      NASSERT(baseAddress.label() == 0x690800);
+      NASSERT(endAddress.label() == 0x691000);
+      NASSERT(relativePool.hasLabel(0x691000));
+   }
+
+   /* shrinking the range evicts only what falls outside of it */
+   {
+      AddressPool rangePool(0x1000, 0x2000);
+      std::vector<Address> rangeAddresses;
+
+      for (Label label=0x1000; label<=0x2000; label+=0x100)
+         rangeAddresses.push_back(rangePool.address(label));
+
+      Address sharedAddress = rangeAddresses.front();
+
+      rangePool.setRange(0x1000, 0x2000);
+      NASSERT(rangePool.pool().size() == rangeAddresses.size()+1);
+
+      rangePool.setRange(0x1100, 0x1F00);
+
+      NASSERT(!rangeAddresses.front().hasPool());
+      NASSERT(!sharedAddress.hasPool());
+      NASSERT(!rangeAddresses.back().hasPool());
+      NASSERT(!rangePool.hasLabel(0x1000));
+      NASSERT(!rangePool.hasLabel(0x2000));
+      NASSERT(rangePool.isBound(rangeAddresses[1]));
+      NASSERT(rangePool.pool().size() == rangeAddresses.size()-2);
+
+      rangePool.setMax(0x1800);
+
+      NASSERT(rangePool.isBound(rangeAddresses[8]));
+      NASSERT(!rangeAddresses[9].hasPool());
+      NASSERT(rangePool.pool().size() == 8);
+
+      /* in relative mode the stored labels can wrap around the base */
+      rangePool.setRelative(true);
+      rangePool.rebase(0);
+
+      NASSERT(rangeAddresses[1].label() == 0);
+
+      rangePool.setMax(static_cast<Label>(-1));
+      rangePool.setMin(0x200);
+
+      NASSERT(!rangeAddresses[1].hasPool());
+      NASSERT(!rangeAddresses[2].hasPool());
+      NASSERT(rangePool.isBound(rangeAddresses[3]));
+      NASSERT(rangeAddresses[8].label() == 0x700);
+      NASSERT(rangePool.pool().size() == 6);
+   }
+
    this->assertMessage(L"[*] AddressPool test completed.");
 }
 
@@ -138,3 +260,47 @@ AddressTest::testAddress
 
    this->assertMessage(L"[*] Address test completed.");
 }
+
+void
+AddressTest::testRawAddress
+(FailVector *failures)
+{
+   AddressPool rawPool;
+   RawAddress rawAddress(0xDEADBEEFDEFACED1), nullAddress;
+   Address promotedAddress;
+
+   this->assertMessage(L"[*] Testing RawAddress objects.");
+
+   NASSERT(nullAddress.isNull());
+   NASSERT(nullAddress == RawAddress::Null());
+   NASSERT(!rawAddress.isNull());
+
+   NASSERT(rawAddress+1 == rawAddress.label()+1);
+   NASSERT(rawAddress-1 == rawAddress.label()-1);
+   NASSERT(rawAddress+(-1) == rawAddress.label()-1);
+   NASSERT((rawAddress+8)-rawAddress == 8);
+   NASSERT(rawAddress < rawAddress+1);
+   NASSERT(rawAddress > rawAddress-1);
+   NASSERT(rawAddress.pointer() == reinterpret_cast<LPVOID>(0xDEADBEEFDEFACED1));
+
+   rawAddress += 1;
+   NASSERT(rawAddress == 0xDEADBEEFDEFACED2);
+
+   rawAddress -= 1;
+   NASSERT(rawAddress == 0xDEADBEEFDEFACED1);
+
+   NEXCEPT(RawAddress(static_cast<Label>(-1))+1, true);
+   NEXCEPT(nullAddress-1, true);
+
+   /* raw addresses never touch a pool until they're promoted */
+   NASSERT(!rawPool.hasLabel(rawAddress.label()));
+
+   promotedAddress = rawAddress.promote(&rawPool);
+
+   NASSERT(rawPool.hasLabel(rawAddress.label()));
+   NASSERT(rawPool.isBound(promotedAddress));
+   NASSERT(promotedAddress == rawAddress.label());
+   NASSERT(RawAddress(promotedAddress) == rawAddress);
+
+   this->assertMessage(L"[*] RawAddress test completed.");
+}
@@ -21,5 +21,6 @@ namespace NeurologyTest
       virtual void run(FailVector *failures);
       void testAddressPool(FailVector *failures);
       void testAddress(FailVector *failures);
+      void testRawAddress(FailVector *failures);
    };
 }
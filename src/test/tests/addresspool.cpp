@@ -0,0 +1,99 @@
+#include "addresspool.hpp"
+
+#include <atomic>
+#include <thread>
+
+using namespace Neurology;
+using namespace NeurologyTest;
+
+AddressPoolTest AddressPoolTest::Instance;
+
+AddressPoolTest::AddressPoolTest
+(void)
+   : Test()
+{
+}
+
+void
+AddressPoolTest::run
+(FailVector *failures)
+{
+   this->testConcurrency(failures);
+}
+
+void
+AddressPoolTest::testConcurrency
+(FailVector *failures)
+{
+   const SIZE_T threadCount = 8;
+   const SIZE_T rounds = 2000;
+   AddressPool sharedPool(0, 0xFFFFFFFF, AddressPool::InstanceShards);
+   std::vector<std::thread> threads;
+   std::vector<Address> anchors;
+   std::atomic<SIZE_T> mismatches(0);
+
+   this->assertMessage(L"[*] Testing concurrent AddressPool access.");
+
+   NASSERT(sharedPool.shardTotal() == AddressPool::InstanceShards);
+   NASSERT(AddressPool::Instance.shardTotal() == AddressPool::InstanceShards);
+
+   /* every thread hammers the same handful of shared labels as well as its own */
+   for (SIZE_T i=0; i<16; ++i)
+      anchors.push_back(sharedPool.address(0x1000 + i*8));
+
+   for (SIZE_T thread=0; thread<threadCount; ++thread)
+   {
+      threads.push_back(std::thread([&sharedPool, &anchors, &mismatches, thread, rounds] ()
+      {
+         Label base = 0x100000 + thread*0x100000;
+
+         for (SIZE_T round=0; round<rounds; ++round)
+         {
+            Address ownAddress = sharedPool.address(base + round*8);
+            Address sharedAddress = sharedPool.address(0x1000 + (round % 16)*8);
+
+            if (ownAddress.label() != base + round*8)
+               ++mismatches;
+
+            if (!sharedPool.sharesIdentity(sharedAddress, anchors[round % 16]))
+               ++mismatches;
+
+            ownAddress.move(base + round*8 + 4);
+
+            if (ownAddress.label() != base + round*8 + 4 || sharedPool.hasLabel(base + round*8))
+               ++mismatches;
+         }
+      }));
+   }
+
+   for (std::vector<std::thread>::iterator threadIter=threads.begin(); threadIter!=threads.end(); ++threadIter)
+      threadIter->join();
+
+   NASSERT(mismatches == 0);
+   NASSERT(sharedPool.pool().size() == anchors.size());
+
+   /* draining redistributes everything into the target's shards */
+   {
+      AddressPool singlePool;
+
+      sharedPool.drain(singlePool);
+
+      NASSERT(sharedPool.pool().size() == 0);
+      NASSERT(singlePool.pool().size() == anchors.size());
+      NASSERT(singlePool.isBound(anchors.front()));
+      NASSERT(anchors.back().label() == 0x1000 + 15*8);
+
+      singlePool.drain(sharedPool);
+
+      NASSERT(sharedPool.isBound(anchors.back()));
+      NASSERT(sharedPool.hasLabel(0x1000 + 15*8));
+
+      sharedPool.shift(0x10);
+      
+      NASSERT(anchors.front().label() == 0x1010);
+      NASSERT(sharedPool.hasLabel(0x1010));
+      NASSERT(!sharedPool.hasLabel(0x1000));
+   }
+
+   this->assertMessage(L"[*] Concurrent AddressPool test completed.");
+}
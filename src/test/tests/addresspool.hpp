@@ -0,0 +1,21 @@
+#pragma once
+
+#include <neurology/address.hpp>
+
+#include "../test.hpp"
+
+namespace NeurologyTest
+{
+   class AddressPoolTest : public Test
+   {
+   public:
+      static AddressPoolTest Instance;
+
+   protected:
+      AddressPoolTest(void);
+
+   public:
+      virtual void run(FailVector *failures);
+      void testConcurrency(FailVector *failures);
+   };
+}
@@ -0,0 +1,176 @@
+#include "allocindex.hpp"
+
+#include <chrono>
+
+using namespace Neurology;
+using namespace NeurologyTest;
+
+AllocationIndexTest AllocationIndexTest::Instance;
+
+/* the index never dereferences its allocations, so plain tokens will do */
+#define TOKEN(n) (reinterpret_cast<Allocation *>(static_cast<std::uintptr_t>(n)))
+
+AllocationIndexTest::AllocationIndexTest
+(void)
+   : Test()
+{
+}
+
+void
+AllocationIndexTest::run
+(FailVector *failures)
+{
+   this->testIndex(failures);
+   this->benchmarkFind(failures);
+}
+
+void
+AllocationIndexTest::testIndex
+(FailVector *failures)
+{
+   AllocationIndex index;
+   AllocationIndex denseIndex;
+   bool denseFound = true;
+   SIZE_T generation;
+
+   this->assertMessage(L"[*] Testing AllocationIndex objects.");
+
+   NASSERT(index.size() == 0);
+   NASSERT(index.find(0x1000, 0) == NULL);
+
+   /* a root, a child, a grandchild at the child's base and a second child */
+   index.insert(TOKEN(1), 0x1000, 0x2000);
+   index.insert(TOKEN(2), 0x1100, 0x1200);
+   index.insert(TOKEN(3), 0x1100, 0x1108);
+   index.insert(TOKEN(4), 0x1800, 0x1900);
+
+   NASSERT(index.size() == 4);
+   NASSERT(index.isIndexed(TOKEN(3)));
+   NASSERT(index.find(0x1104, 4) == TOKEN(3));
+   NASSERT(index.find(0x1104, 8) == TOKEN(2));
+   NASSERT(index.find(0x1100, 0) == TOKEN(3));
+   NASSERT(index.find(0x1300, 0) == TOKEN(1));
+   NASSERT(index.find(0x1850, 0x10) == TOKEN(4));
+   NASSERT(index.find(0x18F0, 0x20) == TOKEN(1));
+   NASSERT(index.find(0x1FFF, 1) == TOKEN(1));
+   NASSERT(index.find(0x2000, 0) == NULL);
+   NASSERT(index.find(0xFFF, 0) == NULL);
+   NASSERT(index.find(0x1100, 0x1000) == NULL);
+
+   /* only ranges with nothing smaller inside them are exclusive */
+   NASSERT(!index.isExclusive(TOKEN(1)));
+   NASSERT(!index.isExclusive(TOKEN(2)));
+   NASSERT(index.isExclusive(TOKEN(3)));
+   NASSERT(index.isExclusive(TOKEN(4)));
+   NASSERT(!index.isExclusive(TOKEN(5)));
+
+   generation = index.generation();
+   index.erase(TOKEN(3));
+
+   NASSERT(index.generation() != generation);
+   NASSERT(index.isExclusive(TOKEN(2)));
+   NASSERT(!index.isIndexed(TOKEN(3)));
+   NASSERT(index.find(0x1104, 4) == TOKEN(2));
+
+   /* reinserting replaces the old range */
+   index.insert(TOKEN(4), 0x5000, 0x5010);
+
+   NASSERT(index.size() == 3);
+   NASSERT(index.find(0x1850, 0x10) == TOKEN(1));
+   NASSERT(index.find(0x5008, 8) == TOKEN(4));
+
+   /* a range poking into another one spoils it for both */
+   index.insert(TOKEN(5), 0x5008, 0x5020);
+
+   NASSERT(!index.isExclusive(TOKEN(4)));
+   NASSERT(!index.isExclusive(TOKEN(5)));
+
+   index.clear();
+
+   NASSERT(index.size() == 0);
+   NASSERT(index.find(0x1104, 4) == NULL);
+
+   /* enough adjacent ranges to split into many blocks, with one parent
+      spanning all of them */
+   denseIndex.insert(TOKEN(1), 0x10000, 0x10000 + 0x10*5000);
+
+   for (std::uintptr_t i=0; i<5000; ++i)
+      denseIndex.insert(TOKEN(i+2), 0x10000 + 0x10*i, 0x10000 + 0x10*(i+1));
+
+   for (std::uintptr_t i=0; i<5000; i+=7)
+      denseFound = denseFound && denseIndex.find(0x10000 + 0x10*i + 4, 4) == TOKEN(i+2);
+
+   NASSERT(denseFound);
+   NASSERT(denseIndex.find(0x10008, 0x10) == TOKEN(1));
+
+   for (std::uintptr_t i=0; i<5000; i+=2)
+      denseIndex.erase(TOKEN(i+2));
+
+   NASSERT(denseIndex.size() == 2501);
+   NASSERT(denseIndex.find(0x10004, 4) == TOKEN(1));
+   NASSERT(denseIndex.find(0x10014, 4) == TOKEN(3));
+   NASSERT(denseIndex.isExclusive(TOKEN(3)));
+   NASSERT(denseIndex.isExclusive(TOKEN(203)));
+   NASSERT(!denseIndex.isExclusive(TOKEN(1)));
+
+   this->assertMessage(L"[*] AllocationIndex test completed.");
+}
+
+void
+AllocationIndexTest::benchmarkFind
+(FailVector *failures)
+{
+   const std::uintptr_t liveCounts[] = { 10000, 100000, 1000000 };
+   const std::uintptr_t lookups = 1000000;
+
+   this->assertMessage(L"[*] Benchmarking AllocationIndex lookups.");
+
+   for (SIZE_T i=0; i<sizeof(liveCounts)/sizeof(liveCounts[0]); ++i)
+   {
+      AllocationIndex index;
+      std::uintptr_t live = liveCounts[i];
+      std::uintptr_t roots = live/5;
+      std::uint64_t state = 0x9E3779B9;
+      std::uintptr_t hits = 0;
+      std::chrono::steady_clock::time_point start, finish;
+      long long elapsed;
+
+      /* every root is 0x100 bytes with four 0x40-byte children, mimicking
+         allocations sliced up by objects and pointers */
+      for (std::uintptr_t root=0; root<roots; ++root)
+      {
+         Label base = 0x10000 + root*0x100;
+
+         index.insert(TOKEN(root*5+1), base, base+0x100);
+
+         for (std::uintptr_t child=0; child<4; ++child)
+            index.insert(TOKEN(root*5+child+2), base+child*0x40, base+(child+1)*0x40);
+      }
+
+      start = std::chrono::steady_clock::now();
+
+      for (std::uintptr_t lookup=0; lookup<lookups; ++lookup)
+      {
+         state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+
+         /* keep lookups 8-byte aligned so each one lands in a single child */
+         if (index.find(0x10000 + ((state >> 16) % (roots*0x20))*8, 8) != NULL)
+            ++hits;
+      }
+
+      finish = std::chrono::steady_clock::now();
+      elapsed = std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count();
+
+      if (elapsed == 0)
+         elapsed = 1;
+
+      this->assertMessage(L"[*] %I64d live allocations: %I64d lookups (%I64d hits) in %I64d us, %I64d lookups/sec."
+                          ,static_cast<long long>(index.size())
+                          ,static_cast<long long>(lookups)
+                          ,static_cast<long long>(hits)
+                          ,elapsed
+                          ,static_cast<long long>(lookups) * 1000000 / elapsed);
+
+      NASSERT(hits == lookups);
+   }
+}
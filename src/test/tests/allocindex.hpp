@@ -0,0 +1,22 @@
+#pragma once
+
+#include <neurology/allocators/index.hpp>
+
+#include "../test.hpp"
+
+namespace NeurologyTest
+{
+   class AllocationIndexTest : public Test
+   {
+   public:
+      static AllocationIndexTest Instance;
+
+   protected:
+      AllocationIndexTest(void);
+
+   public:
+      virtual void run(FailVector *failures);
+      void testIndex(FailVector *failures);
+      void benchmarkFind(FailVector *failures);
+   };
+}
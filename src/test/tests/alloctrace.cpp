@@ -0,0 +1,177 @@
+#include "alloctrace.hpp"
+
+#include <neurology/allocators/arena.hpp>
+#include <neurology/allocators/heap.hpp>
+#include <neurology/allocators/local.hpp>
+
+using namespace Neurology;
+using namespace NeurologyTest;
+
+AllocatorTraceTest AllocatorTraceTest::Instance;
+
+AllocatorTraceTest::AllocatorTraceTest
+(void)
+   : Test()
+{
+}
+
+void
+AllocatorTraceTest::run
+(FailVector *failures)
+{
+   this->testTrace(failures);
+   this->benchmarkReplay(failures);
+}
+
+void
+AllocatorTraceTest::testTrace
+(FailVector *failures)
+{
+   LocalAllocator allocator, replayAllocator;
+   TraceRecorder recorder;
+   Allocation first, second;
+   DWORD value = 0x11223344, readback = 0;
+   Data trace, corrupt;
+   TraceReplay::Result result;
+
+   this->assertMessage(L"[*] Testing allocator traces.");
+
+   allocator.setRecorder(&recorder);
+
+   NASSERT(allocator.getRecorder() == &recorder);
+
+   first = allocator.allocate(0x100);
+   second = allocator.allocate(0x40);
+   allocator.writeFrom(RawAddress(first.address().label() + 0x10), &value, sizeof(value));
+   allocator.readInto(RawAddress(first.address().label() + 0x10), &readback, sizeof(readback));
+   allocator.tryFind(RawAddress(second.address().label() + 8), 4);
+   allocator.reallocate(first, 0x200);
+   allocator.tryFind(RawAddress(static_cast<Label>(0x10)), 4);
+   second.deallocate();
+
+   allocator.setRecorder(NULL);
+   first.deallocate();
+
+   NASSERT(readback == value);
+   NASSERT(!recorder.failed());
+   NASSERT(recorder.eventCount() == 8);
+
+   trace = recorder.contents();
+
+   TraceReplay replay(trace);
+   const TraceReplay::EventList &events = replay.events();
+
+   NASSERT(events.size() == 8);
+   NASSERT(events[0].operation == AllocatorStatistics::Allocate && events[0].block == 0 && events[0].size == 0x100);
+   NASSERT(events[1].operation == AllocatorStatistics::Allocate && events[1].block == 1 && events[1].size == 0x40);
+   NASSERT(events[2].operation == AllocatorStatistics::Write && events[2].block == 0 && events[2].offset == 0x10 && events[2].size == sizeof(DWORD));
+   NASSERT(events[3].operation == AllocatorStatistics::Read && events[3].block == 0 && events[3].offset == 0x10);
+   NASSERT(events[4].operation == AllocatorStatistics::Find && events[4].block == 1 && events[4].offset == 8);
+   NASSERT(events[5].operation == AllocatorStatistics::Reallocate && events[5].block == 0 && events[5].size == 0x200);
+   NASSERT(events[6].operation == AllocatorStatistics::Find && events[6].block == TraceRecorder::NoBlock && events[6].offset == 0x10);
+   NASSERT(events[7].operation == AllocatorStatistics::Deallocate && events[7].block == 1);
+   NASSERT(events[7].timestamp >= events[0].timestamp);
+   NASSERT(events[0].thread == GetCurrentThreadId());
+
+   result = replay.run(replayAllocator);
+
+   NASSERT(result.events == 8);
+   NASSERT(result.skipped == 1);
+   NASSERT(result.failed == 0);
+   NASSERT(result.peakBytes == 0x240);
+
+   /* nothing the replay allocated is left behind */
+   NASSERT(replayAllocator.tryFind(RawAddress(static_cast<Label>(0x10)), 4) == NULL);
+
+   /* a trace cut off in the middle of an event doesn't decode */
+   corrupt.assign(trace.begin(), trace.end()-1);
+
+   NEXCEPT(TraceReplay replayCorrupt(corrupt), true);
+
+   corrupt = trace;
+   corrupt[0] = 'X';
+
+   NEXCEPT(TraceReplay replayCorrupt(corrupt), true);
+
+   this->assertMessage(L"[*] Allocator trace test completed.");
+}
+
+void
+AllocatorTraceTest::benchmarkReplay
+(FailVector *failures)
+{
+   const SIZE_T operationCount = 200000;
+   const SIZE_T liveLimit = 2000;
+   LocalAllocator recorded;
+   TraceRecorder recorder;
+   std::vector<Allocation> live(liveLimit);
+   std::vector<SIZE_T> sizes(liveLimit, 0);
+   std::uint64_t state = 0x9E3779B9;
+   BYTE buffer[0x40];
+   Data trace;
+
+   this->assertMessage(L"[*] Benchmarking trace replay.");
+
+   ZeroMemory(buffer, sizeof(buffer));
+   recorded.setRecorder(&recorder);
+
+   /* a churning mix of allocations of all sizes with reads and writes in
+      between, the way a scanner caches pieces of another process */
+   for (SIZE_T operation=0; operation<operationCount; ++operation)
+   {
+      SIZE_T slot, choice;
+
+      state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+      slot = static_cast<SIZE_T>(state >> 33) % liveLimit;
+      choice = static_cast<SIZE_T>(state >> 20) % 16;
+
+      if (!live[slot].isBound())
+      {
+         sizes[slot] = 0x10 << (static_cast<SIZE_T>(state >> 40) % 9);
+         live[slot] = recorded.allocate(sizes[slot]);
+      }
+      else if (choice == 0)
+         recorded.deallocate(live[slot]);
+      else if (choice == 1)
+      {
+         sizes[slot] *= 2;
+         recorded.reallocate(live[slot], sizes[slot]);
+      }
+      else if (choice < 9)
+         recorded.readInto(RawAddress(static_cast<const Allocation &>(live[slot]).address().label() + (sizes[slot] - 0x10)), buffer, 0x10);
+      else
+         recorded.writeFrom(RawAddress(static_cast<const Allocation &>(live[slot]).address().label()), buffer, 0x10);
+   }
+
+   recorded.setRecorder(NULL);
+   trace = recorder.contents();
+
+   this->assertMessage(L"[*] %I64d events recorded in %I64d bytes."
+                       ,static_cast<long long>(recorder.eventCount())
+                       ,static_cast<long long>(trace.size()));
+
+   NASSERT(!recorder.failed());
+
+   TraceReplay replay(trace);
+   LocalAllocator localAllocator;
+   HeapAllocator heapAllocator;
+   ArenaAllocator arenaAllocator;
+   Allocator *allocators[] = { &localAllocator, &heapAllocator, &arenaAllocator };
+   const wchar_t *names[] = { L"local", L"heap", L"arena" };
+
+   for (SIZE_T i=0; i<sizeof(allocators)/sizeof(allocators[0]); ++i)
+   {
+      TraceReplay::Result result = replay.run(*allocators[i]);
+
+      this->assertMessage(L"[*] %s: %I64d events/sec, peak %I64d bytes, %I64d skipped, %I64d failed."
+                          ,names[i]
+                          ,static_cast<long long>(result.eventsPerSecond)
+                          ,static_cast<long long>(result.peakBytes)
+                          ,static_cast<long long>(result.skipped)
+                          ,static_cast<long long>(result.failed));
+
+      NASSERT(result.events == replay.events().size());
+      NASSERT(result.skipped == 0);
+      NASSERT(result.failed == 0);
+   }
+}
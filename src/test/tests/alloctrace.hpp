@@ -0,0 +1,22 @@
+#pragma once
+
+#include <neurology/allocators/trace.hpp>
+
+#include "../test.hpp"
+
+namespace NeurologyTest
+{
+   class AllocatorTraceTest : public Test
+   {
+   public:
+      static AllocatorTraceTest Instance;
+
+   protected:
+      AllocatorTraceTest(void);
+
+   public:
+      virtual void run(FailVector *failures);
+      void testTrace(FailVector *failures);
+      void benchmarkReplay(FailVector *failures);
+   };
+}
@@ -0,0 +1,207 @@
+#include "arenaalloc.hpp"
+
+#include <chrono>
+
+using namespace Neurology;
+using namespace NeurologyTest;
+
+ArenaAllocatorTest ArenaAllocatorTest::Instance;
+
+ArenaAllocatorTest::ArenaAllocatorTest
+(void)
+   : Test()
+{
+}
+
+void
+ArenaAllocatorTest::run
+(FailVector *failures)
+{
+   this->testArena(failures);
+   this->benchmarkArena(failures);
+}
+
+void
+ArenaAllocatorTest::testArena
+(FailVector *failures)
+{
+   ArenaAllocator arena(0x100);
+   Allocation allocation, otherAlloc, bigAlloc, childAlloc, copyAlloc;
+   std::uintptr_t uintptr = 0xDEADBEEFDEFACED1, readback = 0;
+   Allocator::AllocationHandle handle;
+   Label firstLabel, movedLabel;
+
+   this->assertMessage(L"[*] Testing ArenaAllocator objects.");
+
+   NASSERT(arena.isLocal());
+   NASSERT(arena.chunkCount() == 0);
+   NEXCEPT(ArenaAllocator(0), true);
+
+   allocation = arena.allocate(0x20);
+   otherAlloc = arena.allocate(0x18);
+   firstLabel = allocation.address().label();
+
+   /* both come out of the same chunk, one right after the other */
+   NASSERT(arena.chunkCount() == 1);
+   NASSERT(otherAlloc.address().label() == firstLabel + 0x20);
+   NASSERT(arena.isBound(allocation));
+   NASSERT(&arena.find(otherAlloc.address()+4) == &otherAlloc);
+
+   allocation.writeFrom(0, &uintptr, sizeof(uintptr));
+   allocation.readInto(0, &readback, sizeof(readback));
+   NASSERT(readback == uintptr);
+
+   copyAlloc = allocation;
+   NASSERT(arena.bindCount(allocation.address()) == 2);
+
+   /* the most recent allocation grows in place, anything else moves */
+   otherAlloc.reallocate(0x40);
+   NASSERT(otherAlloc.address().label() == firstLabel + 0x20);
+   NASSERT(otherAlloc.size() == 0x40);
+
+   allocation.reallocate(0x30);
+   movedLabel = allocation.address().label();
+
+   NASSERT(movedLabel != firstLabel);
+   NASSERT(copyAlloc.address().label() == movedLabel);
+   NASSERT(copyAlloc.size() == 0x30);
+   NASSERT(otherAlloc.address().label() == firstLabel + 0x20);
+
+   readback = 0;
+   allocation.readInto(0, &readback, sizeof(readback));
+   NASSERT(readback == uintptr);
+
+   /* anything bigger than a chunk gets one of its own */
+   bigAlloc = arena.allocate(0x400);
+   NASSERT(arena.chunkCount() == 2);
+   NASSERT(arena.capacity() == 0x500);
+
+   /* the most recent allocation can be handed back */
+   bigAlloc.deallocate();
+   bigAlloc = arena.allocate(0x80);
+   NASSERT(arena.chunkCount() == 2);
+
+   childAlloc = allocation.slice(allocation.address()+8, 8);
+   NASSERT(childAlloc.isChild(allocation));
+
+   handle = allocation.handle();
+   NASSERT(arena.resolve(handle) == &allocation);
+
+   arena.reset();
+
+   NASSERT(!allocation.isBound());
+   NASSERT(!copyAlloc.isBound());
+   NASSERT(!childAlloc.isBound());
+   NASSERT(!childAlloc.hasParent());
+   NASSERT(!allocation.hasChildren());
+   NASSERT(allocation.isNull());
+   NASSERT(arena.tryFind(RawAddress(firstLabel), 4) == NULL);
+   NEXCEPT(allocation.read(4), true);
+   NASSERT(arena.chunkCount() == 2);
+
+   /* the arena starts carving from the top again, and dead allocations can be
+      allocated anew */
+   allocation.allocate(0x20);
+   NASSERT(allocation.address().label() == firstLabel);
+   NASSERT(arena.isBound(allocation));
+
+   /* the slots a reset freed get reused, but handles from before it stay stale */
+   NASSERT(!arena.isLive(handle));
+   NASSERT(arena.resolve(handle) == NULL);
+   NASSERT(arena.resolve(allocation.handle()) == &allocation);
+
+   otherAlloc = arena.allocate(0x20);
+   NASSERT(!arena.isLive(handle));
+   NASSERT(arena.resolve(handle) == NULL);
+
+   childAlloc = allocation.slice(allocation.address(), 4);
+   NASSERT(childAlloc.isChild(allocation));
+
+   /* zeroing on free has to wipe everything a reset throws away */
+   allocation.writeFrom(0, &uintptr, sizeof(uintptr));
+   arena.setZeroPolicy(Allocator::ZeroOnFree);
+   arena.reset();
+
+   arena.setZeroPolicy(Allocator::ZeroNever);
+   allocation.allocate(0x20);
+   NASSERT(allocation.address().label() == firstLabel);
+   allocation.readInto(0, &readback, sizeof(readback));
+   NASSERT(readback == 0);
+
+   /* arena memory can only be given back on the arena's own terms, so it
+      can't be handed off to be freed elsewhere */
+   arena.setDeferredFrees(true);
+   otherAlloc = arena.allocate(0x20);
+   otherAlloc.deallocate();
+   NASSERT(arena.retiredCount() == 1);
+   NEXCEPT(arena.handOff(), true);
+   NASSERT(arena.retiredCount() == 1);
+   NASSERT(arena.reclaim() == 1);
+
+   this->assertMessage(L"[*] ArenaAllocator test completed.");
+}
+
+void
+ArenaAllocatorTest::benchmarkArena
+(FailVector *failures)
+{
+   const SIZE_T frames = 50;
+   const SIZE_T allocationCount = 1000;
+   const SIZE_T allocationSize = 0x40;
+   LocalAllocator local;
+   ArenaAllocator arena;
+   Allocation *allocations = new Allocation[allocationCount];
+   std::chrono::steady_clock::time_point start, finish;
+   long long localElapsed, arenaElapsed;
+   SIZE_T chunks = 0;
+
+   this->assertMessage(L"[*] Benchmarking per-frame allocations.");
+
+   /* each frame allocates a batch of short-lived allocations, then gets rid of
+      all of them before the next one */
+   start = std::chrono::steady_clock::now();
+
+   for (SIZE_T frame=0; frame<frames; ++frame)
+   {
+      for (SIZE_T i=0; i<allocationCount; ++i)
+         allocations[i] = local.allocate(allocationSize);
+
+      for (SIZE_T i=0; i<allocationCount; ++i)
+         allocations[i].deallocate();
+   }
+
+   finish = std::chrono::steady_clock::now();
+   localElapsed = std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count();
+
+   start = std::chrono::steady_clock::now();
+
+   for (SIZE_T frame=0; frame<frames; ++frame)
+   {
+      for (SIZE_T i=0; i<allocationCount; ++i)
+         allocations[i] = arena.allocate(allocationSize);
+
+      if (frame == 0)
+         chunks = arena.chunkCount();
+
+      arena.reset();
+   }
+
+   finish = std::chrono::steady_clock::now();
+   arenaElapsed = std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count();
+
+   if (localElapsed == 0)
+      localElapsed = 1;
+
+   if (arenaElapsed == 0)
+      arenaElapsed = 1;
+
+   this->assertMessage(L"[*] %I64d allocations: local allocator %I64d allocations/sec, arena %I64d allocations/sec."
+                       ,static_cast<long long>(frames * allocationCount)
+                       ,static_cast<long long>(frames * allocationCount) * 1000000 / localElapsed
+                       ,static_cast<long long>(frames * allocationCount) * 1000000 / arenaElapsed);
+
+   /* every frame after the first reuses the same chunks */
+   NASSERT(arena.chunkCount() == chunks);
+
+   delete[] allocations;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <neurology/allocators/arena.hpp>
+
+#include "../test.hpp"
+
+namespace NeurologyTest
+{
+   class ArenaAllocatorTest : public Test
+   {
+   public:
+      static ArenaAllocatorTest Instance;
+
+   protected:
+      ArenaAllocatorTest(void);
+
+   public:
+      virtual void run(FailVector *failures);
+      void testArena(FailVector *failures);
+      void benchmarkArena(FailVector *failures);
+   };
+}
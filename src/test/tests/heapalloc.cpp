@@ -0,0 +1,223 @@
+#include "heapalloc.hpp"
+
+#include <chrono>
+
+using namespace Neurology;
+using namespace NeurologyTest;
+
+HeapAllocatorTest HeapAllocatorTest::Instance;
+
+HeapAllocatorTest::HeapAllocatorTest
+(void)
+   : Test()
+{
+}
+
+void
+HeapAllocatorTest::run
+(FailVector *failures)
+{
+   this->testHeap(failures);
+   this->testPrivateHeap(failures);
+   this->benchmarkDestroy(failures);
+}
+
+void
+HeapAllocatorTest::testHeap
+(FailVector *failures)
+{
+   HeapAllocator allocator, otherAllocator;
+   HeapAllocator::Statistics stats;
+   Allocation small, large, childAlloc;
+   std::uintptr_t uintptr = 0xDEADBEEFDEFACED1, readback = 0;
+   Label smallLabel;
+   HANDLE oldHeap;
+
+   this->assertMessage(L"[*] Testing HeapAllocator objects.");
+
+   NASSERT(allocator.isLocal());
+   NASSERT(allocator.handle() != NULL);
+   NASSERT(allocator.handle() != otherAllocator.handle());
+
+   stats = allocator.statistics();
+   NASSERT(stats.live == 0 && stats.peak == 0 && stats.reserved == 0);
+   NASSERT(stats.fragmentation == 0.0);
+
+   small = allocator.allocate(20);
+   large = allocator.allocate(0x2000);
+   smallLabel = small.address().label();
+
+   stats = allocator.statistics();
+   NASSERT(stats.live == 0x2014);
+   NASSERT(stats.peak == 0x2014);
+   NASSERT(stats.reserved == SlabPool::SpanSize + 0x2000);
+   NASSERT(stats.fragmentation > 0.0 && stats.fragmentation < 1.0);
+
+   small.writeFrom(0, &uintptr, sizeof(uintptr));
+   large.writeFrom(0x1000, &uintptr, sizeof(uintptr));
+
+   /* slab blocks grow in place within their class and move beyond it */
+   small.reallocate(24);
+   NASSERT(small.address().label() == smallLabel);
+
+   small.reallocate(0x40);
+   NASSERT(small.address().label() != smallLabel);
+   small.readInto(0, &readback, sizeof(readback));
+   NASSERT(readback == uintptr);
+
+   /* shrinking a big block never needs to move it */
+   smallLabel = large.address().label();
+   large.reallocate(0x1800);
+   NASSERT(large.address().label() == smallLabel);
+   NASSERT(large.size() == 0x1800);
+
+   readback = 0;
+   large.readInto(0x1000, &readback, sizeof(readback));
+   NASSERT(readback == uintptr);
+
+   stats = allocator.statistics();
+   NASSERT(stats.live == 0x1840);
+   NASSERT(stats.peak == 0x2058); // both blocks were live while small moved
+
+   large.deallocate();
+   NASSERT(allocator.statistics().live == 0x40);
+
+   large = allocator.allocate(0x3000);
+   childAlloc = large.slice(large.address()+0x10, 0x10);
+   NASSERT(childAlloc.isChild(large));
+
+   /* destroying drops every allocation along with the heap they lived in */
+   oldHeap = allocator.handle();
+   allocator.destroy();
+
+   NASSERT(!small.isBound());
+   NASSERT(!large.isBound());
+   NASSERT(!childAlloc.isBound());
+   NASSERT(large.isNull());
+   NASSERT(allocator.handle() != NULL);
+   NASSERT(allocator.handle() != oldHeap);
+
+   stats = allocator.statistics();
+   NASSERT(stats.live == 0);
+   NASSERT(stats.reserved == 0);
+   NASSERT(stats.peak == 0x3040);
+
+   /* and the allocator carries on with a fresh heap */
+   small.allocate(8);
+   small.writeFrom(0, &uintptr, sizeof(uintptr));
+   readback = 0;
+   small.readInto(0, &readback, sizeof(readback));
+   NASSERT(readback == uintptr);
+   NASSERT(allocator.statistics().live == 8);
+
+   this->assertMessage(L"[*] HeapAllocator test completed.");
+}
+
+void
+HeapAllocatorTest::testPrivateHeap
+(FailVector *failures)
+{
+   PrivateHeap heap, otherHeap;
+   LPBYTE small, other, large;
+   SIZE_T zeroes = 0;
+   BYTE stackBlock[32];
+
+   this->assertMessage(L"[*] Testing PrivateHeap objects.");
+
+   memset(stackBlock, 0, sizeof(stackBlock));
+
+   small = static_cast<LPBYTE>(heap.allocate(20, false));
+   NASSERT(small != NULL);
+   NASSERT(reinterpret_cast<ULONG_PTR>(small) % 16 == 0);
+
+   /* a freed block is dirty when it comes back, unless it's asked for zeroed */
+   memset(small, 0xCC, 20);
+   heap.free(small);
+   other = static_cast<LPBYTE>(heap.allocate(20, true));
+   NASSERT(other != NULL);
+
+   for (SIZE_T i=0; i<20; ++i)
+      zeroes += (other[i] == 0) ? 1 : 0;
+
+   NASSERT(zeroes == 20);
+
+   large = static_cast<LPBYTE>(heap.allocate(0x2000, true));
+   NASSERT(large != NULL);
+   NASSERT(large[0] == 0 && large[0x1FFF] == 0);
+   NASSERT(heap.resize(large, 0x1800, false));
+
+#ifndef _WIN32
+   /* the slab under the heap hands the block just freed right back */
+   NASSERT(other == small);
+
+   /* small blocks resize in place within their class, zeroing what they grow by */
+   memset(other, 0xCC, 20);
+   NASSERT(heap.resize(other, 28, true));
+   NASSERT(other[20] == 0 && other[27] == 0);
+   NASSERT(!heap.resize(other, 0x40, false));
+   NASSERT(!heap.resize(other, 0x2000, false));
+   NASSERT(!heap.resize(large, 0x10000, false));
+
+   /* blocks of another heap, blocks freed twice and memory which was never
+      allocated are all refused. a Windows heap makes no such promise. */
+   NEXCEPT(otherHeap.free(other), true);
+   NEXCEPT(heap.free(stackBlock+16), true);
+
+   heap.free(other);
+   heap.free(large);
+
+   NEXCEPT(heap.free(other), true);
+   NEXCEPT(heap.free(large), true);
+#else
+   UNUSED(otherHeap);
+
+   heap.free(other);
+   heap.free(large);
+#endif
+
+   this->assertMessage(L"[*] PrivateHeap test completed.");
+}
+
+void
+HeapAllocatorTest::benchmarkDestroy
+(FailVector *failures)
+{
+   const SIZE_T allocationCount = 2000;
+   HeapAllocator freedAllocator, destroyedAllocator;
+   Allocation *allocations = new Allocation[allocationCount];
+   std::chrono::steady_clock::time_point start, finish;
+   long long freedElapsed, destroyedElapsed;
+
+   this->assertMessage(L"[*] Benchmarking session teardown.");
+
+   /* a mix of small and big allocations, thrown away one at a time or all
+      at once */
+   for (SIZE_T i=0; i<allocationCount; ++i)
+      allocations[i] = freedAllocator.allocate((i % 8 == 0) ? 0x2000 : 0x20 + (i % 64) * 8);
+
+   start = std::chrono::steady_clock::now();
+
+   for (SIZE_T i=0; i<allocationCount; ++i)
+      allocations[i].deallocate();
+
+   finish = std::chrono::steady_clock::now();
+   freedElapsed = std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count();
+
+   for (SIZE_T i=0; i<allocationCount; ++i)
+      allocations[i] = destroyedAllocator.allocate((i % 8 == 0) ? 0x2000 : 0x20 + (i % 64) * 8);
+
+   start = std::chrono::steady_clock::now();
+   destroyedAllocator.destroy();
+   finish = std::chrono::steady_clock::now();
+   destroyedElapsed = std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count();
+
+   this->assertMessage(L"[*] %I64d allocations: freed one at a time in %I64d us, destroyed in %I64d us."
+                       ,static_cast<long long>(allocationCount)
+                       ,freedElapsed
+                       ,destroyedElapsed);
+
+   NASSERT(freedAllocator.statistics().live == 0);
+   NASSERT(destroyedAllocator.statistics().live == 0);
+
+   delete[] allocations;
+}
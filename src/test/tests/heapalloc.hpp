@@ -0,0 +1,23 @@
+#pragma once
+
+#include <neurology/allocators/heap.hpp>
+
+#include "../test.hpp"
+
+namespace NeurologyTest
+{
+   class HeapAllocatorTest : public Test
+   {
+   public:
+      static HeapAllocatorTest Instance;
+
+   protected:
+      HeapAllocatorTest(void);
+
+   public:
+      virtual void run(FailVector *failures);
+      void testHeap(FailVector *failures);
+      void testPrivateHeap(FailVector *failures);
+      void benchmarkDestroy(FailVector *failures);
+   };
+}
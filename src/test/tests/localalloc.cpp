@@ -1,10 +1,39 @@
 #include "localalloc.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
 using namespace Neurology;
 using namespace NeurologyTest;
 
 LocalAllocatorTest LocalAllocatorTest::Instance;
 
+/* counts what reaches the backend, to see batches getting coalesced */
+class BatchCountingAllocator : public LocalAllocator
+{
+public:
+   mutable SIZE_T lastBatch;
+
+   BatchCountingAllocator(void) : LocalAllocator(), lastBatch(0) {}
+
+protected:
+   virtual void readAddresses(const Batch &batch) const
+   {
+      this->lastBatch = batch.size();
+      LocalAllocator::readAddresses(batch);
+   }
+
+   virtual void writeAddresses(const Batch &batch)
+   {
+      this->lastBatch = batch.size();
+      LocalAllocator::writeAddresses(batch);
+   }
+};
+
 LocalAllocatorTest::LocalAllocatorTest
 (void)
    : Test()
@@ -17,6 +46,22 @@ LocalAllocatorTest::run
 {
    this->testAllocator(failures);
    this->testAllocation(failures);
+   this->testBatches(failures);
+   this->testSlabs(failures);
+   this->testZeroing(failures);
+   this->testDeferredFrees(failures);
+   this->testHandles(failures);
+   this->testLookaside(failures);
+   this->testInstrumentation(failures);
+   this->testFaults(failures);
+   this->benchmarkMisses(failures);
+   this->benchmarkSlabs(failures);
+   this->benchmarkZeroing(failures);
+   this->benchmarkTeardown(failures);
+   this->benchmarkSlices(failures);
+   this->benchmarkBindings(failures);
+   this->benchmarkLookaside(failures);
+   this->benchmarkCopies(failures);
 }
 
 void
@@ -86,6 +131,57 @@ LocalAllocatorTest::testAllocator
    
    NASSERT(writeData == recvData);
 
+   /* untracked addresses go through the same allocation */
+   allocator.write(RawAddress(allocAddress), writeData);
+   recvData = allocator.read(RawAddress(allocAddress)+4, 4);
+
+   NASSERT(Data(writeData.begin()+4, writeData.end()) == recvData);
+   NASSERT(allocation.inRange(RawAddress(allocAddress)+(allocation.size()-4), 4));
+   NASSERT(!allocation.inRange(RawAddress(allocAddress)+(allocation.size()-4), 5));
+   NEXCEPT(allocator.read(RawAddress(allocAddress)+(allocation.size()-4), 5), true);
+
+   /* the exception keeps its own copy of the missing address */
+   {
+      Label missingLabel = 0;
+
+      try
+      {
+         allocator.read(RawAddress(static_cast<Label>(0x1234)), 4);
+      }
+      catch (Allocator::AddressNotFoundException &exception)
+      {
+         missingLabel = exception.address.label();
+      }
+
+      NASSERT(missingLabel == 0x1234);
+   }
+
+   /* the try versions report misses instead of throwing */
+   NASSERT(allocator.tryFind(RawAddress(allocAddress)+4, 4) == allocator.tryFind(allocAddress, 0));
+   NASSERT(allocator.tryFind(RawAddress(allocAddress)+(allocation.size()-4), 5) == NULL);
+   NASSERT(allocator.tryRead(RawAddress(allocAddress)+4, 4, &recvData));
+   NASSERT(Data(writeData.begin()+4, writeData.end()) == recvData);
+   NASSERT(!allocator.tryRead(RawAddress(allocAddress)+(allocation.size()-4), 5, &recvData));
+   NASSERT(!allocator.tryRead(Address(), 4, &recvData));
+   NASSERT(allocator.tryWrite(allocAddress, writeData));
+   NASSERT(!allocator.tryWrite(RawAddress(allocAddress)+(allocation.size()-4), writeData));
+
+   /* caller-supplied buffers skip the Data objects altogether */
+   {
+      std::uintptr_t readBack = 0;
+      std::uint32_t halfWord = 0xCAFEBABE;
+
+      allocator.readInto(allocAddress, &readBack, sizeof(readBack));
+      NASSERT(readBack == uintptr);
+
+      allocator.writeFrom(RawAddress(allocAddress)+4, &halfWord, sizeof(halfWord));
+      allocator.readInto(RawAddress(allocAddress)+4, &halfWord, sizeof(halfWord));
+      NASSERT(halfWord == 0xCAFEBABE);
+      NEXCEPT(allocator.readInto(RawAddress(allocAddress)+(allocation.size()-4), &readBack, sizeof(readBack)), true);
+
+      allocator.writeFrom(allocAddress, &uintptr, sizeof(uintptr));
+   }
+
    /* should still technically be around in some ephemeral way because we have
       otherAlloc pointing to the underlying allocation */
    allocator.deallocate(allocation);
@@ -121,6 +217,7 @@ LocalAllocatorTest::testAllocation
    std::uint32_t uint32 = 0xDEADBEEF;
    std::uint16_t uint16;
    Data sendData, recvData;
+   SIZE_T generation;
 
    this->assertMessage(L"[*] Running Allocation tests.");
    
@@ -187,6 +284,25 @@ LocalAllocatorTest::testAllocation
    sendData = VarData(uint32);
 
    testAllocation.write(4, sendData);
+
+   NASSERT(testAllocation.tryRead(4, 4, &recvData));
+   NASSERT(sendData == recvData);
+   NASSERT(!testAllocation.tryRead(4, 5, &recvData));
+   NASSERT(!testAllocation.tryRead(sizeof(std::uintptr_t), 1, &recvData));
+   NASSERT(!testAllocation.tryWrite(6, sendData));
+   NEXCEPT(testAllocation.read(4, 5), true);
+
+   {
+      std::uint32_t readBack = 0;
+
+      testAllocation.readInto(4, &readBack, sizeof(readBack));
+      NASSERT(readBack == uint32);
+
+      testAllocation.writeFrom(4, &readBack, sizeof(readBack));
+      NASSERT(sendData == testAllocation.read(4, 4));
+      NEXCEPT(testAllocation.readInto(6, &readBack, sizeof(readBack)), true);
+      NEXCEPT(testAllocation.writeFrom(6, &readBack, sizeof(readBack)), true);
+   }
    
    NASSERT(sendData != testAllocation.read(4));
    NASSERT(sendData == testAllocation.read(4,4));
@@ -279,5 +395,1294 @@ LocalAllocatorTest::testAllocation
 
    NASSERT(sendData == testAllocation.read());
 
+   /* slices carry their own range, so they stay small, and they still follow
+      their parent around when it moves */
+   NASSERT(sizeof(Allocation) < 64);
+
+   generation = superSliced.currentGeneration();
+   testAllocation.reallocate(0x1000);
+
+   NASSERT(superSliced.currentGeneration() != generation);
+   NASSERT(superSliced.isChild(slicedAllocation));
+   NASSERT(testAllocation.inRange(superSliced.address(), superSliced.size()));
+
+   uint16 = 0xDEAD;
+   sendData = VarData(uint16);
+
+   NASSERT(sendData == superSliced.read());
+
    this->assertMessage(L"[*] Finished Allocation tests.");
 }
+
+void
+LocalAllocatorTest::testBatches
+(FailVector *failures)
+{
+   BatchCountingAllocator allocator;
+   Allocation first, second;
+   RawAddress firstBase, secondBase;
+   BYTE pattern[0x20], fields[5][8];
+   Allocator::Batch batch;
+   Allocator::BatchEntry entry;
+
+   this->assertMessage(L"[*] Running batch tests.");
+
+   first = allocator.allocate(sizeof(pattern));
+   second = allocator.allocate(sizeof(pattern));
+   firstBase = RawAddress(first.address());
+   secondBase = RawAddress(second.address());
+
+   for (SIZE_T i=0; i<sizeof(pattern); ++i)
+      pattern[i] = static_cast<BYTE>(i);
+
+   allocator.writeFrom(firstBase, pattern, sizeof(pattern));
+   allocator.writeFrom(secondBase, pattern, sizeof(pattern));
+
+   /* out of order, with an overlapping pair and an adjacent pair in the
+      first allocation and a lone entry in the second */
+   entry.address = secondBase+8; entry.buffer = fields[0]; entry.size = 8; batch.push_back(entry);
+   entry.address = firstBase+4; entry.buffer = fields[1]; entry.size = 8; batch.push_back(entry);
+   entry.address = firstBase; entry.buffer = fields[2]; entry.size = 8; batch.push_back(entry);
+   entry.address = firstBase+12; entry.buffer = fields[3]; entry.size = 4; batch.push_back(entry);
+   entry.address = firstBase+0x18; entry.buffer = fields[4]; entry.size = 8; batch.push_back(entry);
+
+   allocator.readv(batch);
+
+   NASSERT(allocator.lastBatch == 3);
+   NASSERT(fields[0][0] == 8 && fields[0][7] == 15);
+   NASSERT(fields[1][0] == 4 && fields[1][7] == 11);
+   NASSERT(fields[2][0] == 0 && fields[2][7] == 7);
+   NASSERT(fields[3][0] == 12 && fields[3][3] == 15);
+   NASSERT(fields[4][0] == 0x18 && fields[4][7] == 0x1F);
+
+   /* the later of two overlapping writes wins */
+   memset(fields[1], 0xAA, 8);
+   memset(fields[2], 0xBB, 8);
+   batch.pop_back();
+   allocator.writev(batch);
+
+   NASSERT(allocator.lastBatch == 2);
+   NASSERT(first.read(0, 1)[0] == 0xBB);
+   NASSERT(first.read(7, 1)[0] == 0xBB);
+   NASSERT(first.read(8, 1)[0] == 0xAA);
+   NASSERT(first.read(12, 1)[0] == 12);
+   NASSERT(second.read(8, 1)[0] == 8);
+
+   /* a single miss rejects the whole batch before anything is written */
+   memset(fields[0], 0xCC, 8);
+   entry.address = firstBase+sizeof(pattern)-4; entry.buffer = fields[4]; entry.size = 8; batch.push_back(entry);
+   allocator.lastBatch = 0;
+
+   NEXCEPT(allocator.writev(batch), true);
+   NASSERT(allocator.lastBatch == 0);
+   NASSERT(second.read(8, 1)[0] == 8);
+
+   this->assertMessage(L"[*] Finished batch tests.");
+}
+
+void
+LocalAllocatorTest::testSlabs
+(FailVector *failures)
+{
+   LocalAllocator allocator(true);
+   SlabPool sharedPool;
+   Allocation small, other, large;
+   std::uintptr_t uintptr = 0xDEADBEEFDEFACED1, readback = 0;
+   Label smallLabel, largeLabel;
+   std::vector<std::thread> threads;
+   std::atomic<SIZE_T> mismatches(0);
+
+   this->assertMessage(L"[*] Running slab tests.");
+
+   NASSERT(allocator.usesSlabs());
+   NASSERT(!LocalAllocator::Instance.usesSlabs());
+
+   NASSERT(SlabPool::sizeClass(0) == SlabPool::NoClass);
+   NASSERT(SlabPool::sizeClass(1) == 0);
+   NASSERT(SlabPool::sizeClass(8) == 0);
+   NASSERT(SlabPool::sizeClass(9) == 1);
+   NASSERT(SlabPool::sizeClass(SlabPool::MaximumSize) == SlabPool::ClassCount-1);
+   NASSERT(SlabPool::sizeClass(SlabPool::MaximumSize+1) == SlabPool::NoClass);
+
+   small = allocator.allocate(20);
+   other = allocator.allocate(20);
+   smallLabel = small.address().label();
+
+   small.writeFrom(0, &uintptr, sizeof(uintptr));
+
+   /* 20 bytes sits in the 24 byte class, so growing to 24 stays put */
+   small.reallocate(24);
+   NASSERT(small.address().label() == smallLabel);
+   NASSERT(small.size() == 24);
+
+   /* but 25 doesn't */
+   small.reallocate(25);
+   NASSERT(small.address().label() != smallLabel);
+   small.readInto(0, &readback, sizeof(readback));
+   NASSERT(readback == uintptr);
+
+   /* the freed block goes back to this thread's cache, so it's next in line */
+   small.reallocate(0x2000);
+   large = allocator.allocate(24);
+   NASSERT(large.address().label() == smallLabel);
+   large.deallocate();
+
+   readback = 0;
+   small.readInto(0, &readback, sizeof(readback));
+   NASSERT(readback == uintptr);
+
+   /* heap blocks can shrink in place, but crossing back over to a slab moves it */
+   largeLabel = small.address().label();
+   small.reallocate(0x1800);
+   NASSERT(small.address().label() == largeLabel);
+   NASSERT(small.size() == 0x1800);
+
+   small.reallocate(16);
+   NASSERT(small.address().label() != largeLabel);
+   readback = 0;
+   small.readInto(0, &readback, sizeof(readback));
+   NASSERT(readback == uintptr);
+
+   /* shrinking on the general heap doesn't move anything either */
+   large = LocalAllocator::Instance.allocate(0x100);
+   largeLabel = large.address().label();
+   large.reallocate(0x80);
+   NASSERT(large.address().label() == largeLabel);
+   NASSERT(large.size() == 0x80);
+   large.deallocate();
+
+   NEXCEPT(sharedPool.allocate(SlabPool::MaximumSize+1), true);
+
+   /* blocks allocated on one thread and freed on another still end up in
+      the right class */
+   for (SIZE_T thread=0; thread<4; ++thread)
+   {
+      threads.push_back(std::thread([&sharedPool, &mismatches, thread] () {
+         LPBYTE blocks[256];
+
+         for (SIZE_T round=0; round<50; ++round)
+         {
+            for (SIZE_T i=0; i<256; ++i)
+            {
+               blocks[i] = static_cast<LPBYTE>(sharedPool.allocate(8 + (i % 64) * 8));
+               blocks[i][0] = static_cast<BYTE>(thread);
+               blocks[i][7] = static_cast<BYTE>(i);
+            }
+
+            for (SIZE_T i=0; i<256; ++i)
+            {
+               if (blocks[i][0] != static_cast<BYTE>(thread) || blocks[i][7] != static_cast<BYTE>(i))
+                  ++mismatches;
+
+               sharedPool.free(blocks[i], 8 + (i % 64) * 8);
+            }
+         }
+      }));
+   }
+
+   for (std::vector<std::thread>::iterator threadIter=threads.begin(); threadIter!=threads.end(); ++threadIter)
+      threadIter->join();
+
+   NASSERT(mismatches == 0);
+
+   /* a thread hands back whatever it still has cached when it exits, so the
+      whole span is there for this thread to use */
+   {
+      SlabPool exitPool;
+      std::vector<LPVOID> blocks;
+
+      std::thread([&exitPool] () {
+         exitPool.free(exitPool.allocate(8), 8);
+      }).join();
+
+      NASSERT(exitPool.capacity() == SlabPool::SpanSize);
+
+      for (SIZE_T i=0; i<SlabPool::SpanSize/8; ++i)
+         blocks.push_back(exitPool.allocate(8));
+
+      NASSERT(exitPool.capacity() == SlabPool::SpanSize);
+
+      for (std::vector<LPVOID>::iterator blockIter=blocks.begin(); blockIter!=blocks.end(); ++blockIter)
+         exitPool.free(*blockIter, 8);
+   }
+
+   /* going back and forth between pools keeps each one's cache */
+   {
+      SlabPool firstPool, secondPool;
+      LPVOID firstBlock, secondBlock;
+
+      firstBlock = firstPool.allocate(16);
+      secondBlock = secondPool.allocate(16);
+      firstPool.free(firstBlock, 16);
+      secondPool.free(secondBlock, 16);
+
+      NASSERT(firstPool.allocate(16) == firstBlock);
+      NASSERT(secondPool.allocate(16) == secondBlock);
+
+      firstPool.free(firstBlock, 16);
+      secondPool.free(secondBlock, 16);
+   }
+
+   this->assertMessage(L"[*] Finished slab tests.");
+}
+
+void
+LocalAllocatorTest::testZeroing
+(FailVector *failures)
+{
+   LocalAllocator allocator(true);
+   Allocation block, large;
+   BYTE buffer[64];
+   Label blockLabel, largeLabel;
+   bool dirty, clean;
+
+   this->assertMessage(L"[*] Running zeroing tests.");
+
+   NASSERT(allocator.zeroPolicy() == Allocator::DefaultZeroPolicy);
+
+   /* freed slab blocks are handed right back out, so whatever was left in
+      them shows up in the next allocation. the first bytes hold the free
+      list, so only look past them. */
+   allocator.setZeroPolicy(Allocator::ZeroNever);
+   NASSERT(allocator.zeroPolicy() == Allocator::ZeroNever);
+
+   block = allocator.allocate(sizeof(buffer));
+   blockLabel = block.address().label();
+   FillMemory(buffer, sizeof(buffer), 0xAA);
+   block.writeFrom(0, buffer, sizeof(buffer));
+   block.deallocate();
+
+   block = allocator.allocate(sizeof(buffer));
+   NASSERT(block.address().label() == blockLabel);
+   block.readInto(0, buffer, sizeof(buffer));
+   dirty = true;
+
+   for (SIZE_T i=sizeof(LPVOID); i<sizeof(buffer); ++i)
+      dirty = dirty && buffer[i] == 0xAA;
+
+   NASSERT(dirty);
+
+   /* zeroing on allocation clears it on the way out */
+   block.deallocate();
+   allocator.setZeroPolicy(Allocator::ZeroOnAlloc);
+   block = allocator.allocate(sizeof(buffer));
+   NASSERT(block.address().label() == blockLabel);
+   block.readInto(0, buffer, sizeof(buffer));
+   clean = true;
+
+   for (SIZE_T i=0; i<sizeof(buffer); ++i)
+      clean = clean && buffer[i] == 0;
+
+   NASSERT(clean);
+
+   /* zeroing on free clears it on the way in */
+   FillMemory(buffer, sizeof(buffer), 0xAA);
+   block.writeFrom(0, buffer, sizeof(buffer));
+   allocator.setZeroPolicy(Allocator::ZeroOnFree);
+   block.deallocate();
+
+   allocator.setZeroPolicy(Allocator::ZeroNever);
+   block = allocator.allocate(sizeof(buffer));
+   NASSERT(block.address().label() == blockLabel);
+   block.readInto(0, buffer, sizeof(buffer));
+   clean = true;
+
+   for (SIZE_T i=sizeof(LPVOID); i<sizeof(buffer); ++i)
+      clean = clean && buffer[i] == 0;
+
+   NASSERT(clean);
+
+   /* secure zeroing does both, and wipes whatever a shrink cuts off */
+   FillMemory(buffer, sizeof(buffer), 0xAA);
+   block.writeFrom(0, buffer, sizeof(buffer));
+   allocator.setZeroPolicy(Allocator::ZeroSecurely);
+   block.reallocate(sizeof(buffer)-8);
+   NASSERT(block.address().label() == blockLabel);
+   NASSERT(static_cast<LPBYTE>(block.address().pointer())[sizeof(buffer)-1] == 0);
+   NASSERT(static_cast<LPBYTE>(block.address().pointer())[0] == 0xAA);
+   block.deallocate();
+
+   /* zeroing an allocation directly doesn't care about the policy */
+   allocator.setZeroPolicy(Allocator::ZeroNever);
+   block = allocator.allocate(sizeof(buffer));
+   FillMemory(buffer, sizeof(buffer), 0xAA);
+   block.writeFrom(0, buffer, sizeof(buffer));
+   block.zeroFill();
+   block.readInto(0, buffer, sizeof(buffer));
+   clean = true;
+
+   for (SIZE_T i=0; i<sizeof(buffer); ++i)
+      clean = clean && buffer[i] == 0;
+
+   NASSERT(clean);
+   block.deallocate();
+
+   /* big blocks come from the OS already zeroed, even without a policy */
+   large = allocator.allocate(LocalAllocator::PagedBlockSize+0x1000);
+   largeLabel = large.address().label();
+   NASSERT(static_cast<LPBYTE>(large.address().pointer())[0] == 0);
+   NASSERT(static_cast<LPBYTE>(large.address().pointer())[LocalAllocator::PagedBlockSize] == 0);
+
+   /* they can shrink in place as long as they stay big... */
+   large.reallocate(LocalAllocator::PagedBlockSize);
+   NASSERT(large.address().label() == largeLabel);
+
+   /* ...and keep what they held when they move */
+   FillMemory(buffer, sizeof(buffer), 0xAA);
+   large.writeFrom(0, buffer, sizeof(buffer));
+   large.reallocate(LocalAllocator::PagedBlockSize*2);
+   NASSERT(large.address().label() != largeLabel);
+   NASSERT(static_cast<LPBYTE>(large.address().pointer())[0] == 0xAA);
+   NASSERT(static_cast<LPBYTE>(large.address().pointer())[LocalAllocator::PagedBlockSize*2-1] == 0);
+
+   /* dropping under the threshold moves it back to the heap */
+   largeLabel = large.address().label();
+   large.reallocate(0x8000);
+   NASSERT(large.address().label() != largeLabel);
+   NASSERT(static_cast<LPBYTE>(large.address().pointer())[0] == 0xAA);
+   large.deallocate();
+
+   this->assertMessage(L"[*] Finished zeroing tests.");
+}
+
+void
+LocalAllocatorTest::testDeferredFrees
+(FailVector *failures)
+{
+   LocalAllocator allocator(true);
+   Allocation first, second, blocks[8];
+   Allocator::ReleaseQueue queue;
+   Label firstLabel;
+   SIZE_T reader;
+   bool sorted;
+
+   this->assertMessage(L"[*] Running deferred free tests.");
+
+   NASSERT(!allocator.defersFrees());
+   allocator.setDeferredFrees(true);
+   NASSERT(allocator.defersFrees());
+
+   /* deallocating unbinds right away, but the memory stays pooled */
+   first = allocator.allocate(0x40);
+   firstLabel = first.address().label();
+   first.deallocate();
+
+   NASSERT(!first.isBound());
+   NASSERT(allocator.retiredCount() == 1);
+   NASSERT(allocator.isPooled(Address(firstLabel)));
+   NASSERT(allocator.tryFind(RawAddress(firstLabel), 4) == NULL);
+
+   /* so it can't be handed out again yet */
+   second = allocator.allocate(0x40);
+   NASSERT(second.address().label() != firstLabel);
+
+   NASSERT(allocator.reclaim() == 1);
+   NASSERT(allocator.retiredCount() == 0);
+   NASSERT(!allocator.isPooled(Address(firstLabel)));
+
+   /* nothing retired while a reader is inside an epoch gets reclaimed */
+   {
+      Allocator::EpochGuard guard(allocator);
+
+      second.deallocate();
+      NASSERT(allocator.reclaim() == 0);
+      NASSERT(allocator.retiredCount() == 1);
+   }
+
+   NASSERT(allocator.reclaim() == 1);
+
+   /* readers which only came in after a reclaim started a new epoch don't
+      hold back anything retired before it */
+   first = allocator.allocate(0x40);
+   first.deallocate();
+   reader = allocator.enterEpoch();
+   NASSERT(allocator.reclaim() == 0);
+   allocator.leaveEpoch(reader);
+
+   reader = allocator.enterEpoch();
+   NASSERT(allocator.reclaim() == 1);
+   allocator.leaveEpoch(reader);
+
+   /* handing off forgets everything here and frees it wherever release is called */
+   for (SIZE_T i=0; i<8; ++i)
+      blocks[i] = allocator.allocate((i % 2 == 0) ? 0x20 : 0x2000);
+
+   for (SIZE_T i=0; i<8; ++i)
+      blocks[i].deallocate();
+
+   NASSERT(allocator.retiredCount() == 8);
+
+   queue = allocator.handOff();
+   NASSERT(queue.size() == 8);
+   NASSERT(allocator.retiredCount() == 0);
+   NASSERT(!allocator.isPooled(Address(queue[0].address)));
+
+   sorted = true;
+
+   for (SIZE_T i=1; i<queue.size(); ++i)
+      sorted = sorted && queue[i-1].address < queue[i].address;
+
+   NASSERT(sorted);
+
+   std::thread([&allocator, &queue] () { allocator.release(queue); }).join();
+
+   /* turning deferral off frees right away again */
+   allocator.setDeferredFrees(false);
+   first = allocator.allocate(0x40);
+   first.deallocate();
+   NASSERT(allocator.retiredCount() == 0);
+
+   /* whatever is still retired goes when the allocator does */
+   {
+      LocalAllocator scoped(true);
+      Allocation doomed;
+
+      scoped.setDeferredFrees(true);
+      doomed = scoped.allocate(0x40);
+      doomed.deallocate();
+      NASSERT(scoped.retiredCount() == 1);
+   }
+
+   this->assertMessage(L"[*] Finished deferred free tests.");
+}
+
+void
+LocalAllocatorTest::benchmarkMisses
+(FailVector *failures)
+{
+   const SIZE_T allocationCount = 64;
+   const SIZE_T allocationSize = 0x100;
+   const SIZE_T probes = 100000;
+   LocalAllocator allocator;
+   Allocation allocations[allocationCount];
+   std::vector<RawAddress> targets;
+   std::uint64_t state = 0x9E3779B9;
+   std::chrono::steady_clock::time_point start, finish;
+   long long throwingElapsed, tryingElapsed;
+   SIZE_T throwingHits = 0, tryingHits = 0;
+   Data data;
+
+   this->assertMessage(L"[*] Benchmarking miss-heavy reads.");
+
+   for (SIZE_T i=0; i<allocationCount; ++i)
+   {
+      allocations[i] = allocator.allocate(allocationSize);
+      targets.push_back(RawAddress(allocations[i].address()));
+   }
+
+   /* probes land anywhere within 16 times the size of an allocation past its
+      start, so most of them miss */
+   start = std::chrono::steady_clock::now();
+   
+   for (SIZE_T probe=0; probe<probes; ++probe)
+   {
+      state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+
+      try
+      {
+         allocator.read(targets[(state >> 8) % allocationCount] + static_cast<std::intptr_t>((state >> 32) % (allocationSize*16)), 4);
+         ++throwingHits;
+      }
+      catch (Allocator::AddressNotFoundException &exception)
+      {
+         UNUSED(exception);
+      }
+   }
+   
+   finish = std::chrono::steady_clock::now();
+   throwingElapsed = std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count();
+
+   state = 0x9E3779B9;
+   start = std::chrono::steady_clock::now();
+   
+   for (SIZE_T probe=0; probe<probes; ++probe)
+   {
+      state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+
+      if (allocator.tryRead(targets[(state >> 8) % allocationCount] + static_cast<std::intptr_t>((state >> 32) % (allocationSize*16)), 4, &data))
+         ++tryingHits;
+   }
+   
+   finish = std::chrono::steady_clock::now();
+   tryingElapsed = std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count();
+
+   if (throwingElapsed == 0)
+      throwingElapsed = 1;
+
+   if (tryingElapsed == 0)
+      tryingElapsed = 1;
+
+   this->assertMessage(L"[*] %I64d probes (%I64d hits): throwing reads %I64d probes/sec, try reads %I64d probes/sec."
+                       ,static_cast<long long>(probes)
+                       ,static_cast<long long>(tryingHits)
+                       ,static_cast<long long>(probes) * 1000000 / throwingElapsed
+                       ,static_cast<long long>(probes) * 1000000 / tryingElapsed);
+
+   NASSERT(throwingHits == tryingHits);
+   NASSERT(tryingHits < probes);
+}
+
+void
+LocalAllocatorTest::benchmarkSlabs
+(FailVector *failures)
+{
+   const SIZE_T rounds = 200;
+   const SIZE_T allocationCount = 256;
+   LocalAllocator heapAllocator, slabAllocator(true);
+   SlabPool pool;
+   Allocation *allocations = new Allocation[allocationCount];
+   LPBYTE blocks[allocationCount];
+   std::chrono::steady_clock::time_point start, finish;
+   long long heapElapsed, slabElapsed;
+
+   this->assertMessage(L"[*] Benchmarking small allocations.");
+
+   /* small PODs, allocated, grown a little and freed */
+   start = std::chrono::steady_clock::now();
+
+   for (SIZE_T round=0; round<rounds; ++round)
+   {
+      for (SIZE_T i=0; i<allocationCount; ++i)
+         allocations[i] = heapAllocator.allocate(4 + (i % 16) * 4);
+
+      for (SIZE_T i=0; i<allocationCount; ++i)
+         allocations[i].reallocate(allocations[i].size() + 2);
+
+      for (SIZE_T i=0; i<allocationCount; ++i)
+         allocations[i].deallocate();
+   }
+
+   finish = std::chrono::steady_clock::now();
+   heapElapsed = std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count();
+
+   start = std::chrono::steady_clock::now();
+
+   for (SIZE_T round=0; round<rounds; ++round)
+   {
+      for (SIZE_T i=0; i<allocationCount; ++i)
+         allocations[i] = slabAllocator.allocate(4 + (i % 16) * 4);
+
+      for (SIZE_T i=0; i<allocationCount; ++i)
+         allocations[i].reallocate(allocations[i].size() + 2);
+
+      for (SIZE_T i=0; i<allocationCount; ++i)
+         allocations[i].deallocate();
+   }
+
+   finish = std::chrono::steady_clock::now();
+   slabElapsed = std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count();
+
+   if (heapElapsed == 0)
+      heapElapsed = 1;
+
+   if (slabElapsed == 0)
+      slabElapsed = 1;
+
+   this->assertMessage(L"[*] %I64d allocations: heap %I64d allocations/sec, slabs %I64d allocations/sec."
+                       ,static_cast<long long>(rounds * allocationCount)
+                       ,static_cast<long long>(rounds * allocationCount) * 1000000 / heapElapsed
+                       ,static_cast<long long>(rounds * allocationCount) * 1000000 / slabElapsed);
+
+   delete[] allocations;
+
+   /* the same pattern against the backends alone, without any of the
+      allocator's bookkeeping */
+   start = std::chrono::steady_clock::now();
+
+   for (SIZE_T round=0; round<rounds*10; ++round)
+   {
+      for (SIZE_T i=0; i<allocationCount; ++i)
+         blocks[i] = new BYTE[4 + (i % 16) * 4];
+
+      for (SIZE_T i=0; i<allocationCount; ++i)
+         delete[] blocks[i];
+   }
+
+   finish = std::chrono::steady_clock::now();
+   heapElapsed = std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count();
+
+   start = std::chrono::steady_clock::now();
+
+   for (SIZE_T round=0; round<rounds*10; ++round)
+   {
+      for (SIZE_T i=0; i<allocationCount; ++i)
+         blocks[i] = static_cast<LPBYTE>(pool.allocate(4 + (i % 16) * 4));
+
+      for (SIZE_T i=0; i<allocationCount; ++i)
+         pool.free(blocks[i], 4 + (i % 16) * 4);
+   }
+
+   finish = std::chrono::steady_clock::now();
+   slabElapsed = std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count();
+
+   if (heapElapsed == 0)
+      heapElapsed = 1;
+
+   if (slabElapsed == 0)
+      slabElapsed = 1;
+
+   this->assertMessage(L"[*] %I64d blocks: new/delete %I64d blocks/sec, slab pool %I64d blocks/sec."
+                       ,static_cast<long long>(rounds * 10 * allocationCount)
+                       ,static_cast<long long>(rounds * 10 * allocationCount) * 1000000 / heapElapsed
+                       ,static_cast<long long>(rounds * 10 * allocationCount) * 1000000 / slabElapsed);
+}
+
+void
+LocalAllocatorTest::benchmarkZeroing
+(FailVector *failures)
+{
+   const SIZE_T rounds = 50;
+   const SIZE_T bufferSize = 0x400000;
+   const Allocator::ZeroPolicy policies[] = { Allocator::ZeroNever
+                                              ,Allocator::ZeroOnAlloc
+                                              ,Allocator::ZeroSecurely };
+   const LPCWSTR names[] = { L"never", L"on alloc", L"securely" };
+   LocalAllocator allocator;
+   Allocation buffer;
+   std::chrono::steady_clock::time_point start, finish;
+   long long elapsed;
+
+   this->assertMessage(L"[*] Benchmarking zeroing of large buffers.");
+
+   for (SIZE_T policy=0; policy<sizeof(policies)/sizeof(policies[0]); ++policy)
+   {
+      allocator.setZeroPolicy(policies[policy]);
+      start = std::chrono::steady_clock::now();
+
+      /* touch every page, so the cost of the OS zeroing them shows up too */
+      for (SIZE_T round=0; round<rounds; ++round)
+      {
+         buffer = allocator.allocate(bufferSize);
+
+         for (SIZE_T offset=0; offset<bufferSize; offset+=0x1000)
+            static_cast<LPBYTE>(buffer.address().pointer())[offset] = 1;
+
+         buffer.deallocate();
+      }
+
+      finish = std::chrono::steady_clock::now();
+      elapsed = std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count();
+
+      if (elapsed == 0)
+         elapsed = 1;
+
+      this->assertMessage(L"[*] %I64d buffers of %I64d bytes, zeroing %s: %I64d MB/sec."
+                          ,static_cast<long long>(rounds)
+                          ,static_cast<long long>(bufferSize)
+                          ,names[policy]
+                          ,static_cast<long long>(rounds * (bufferSize >> 20)) * 1000000 / elapsed);
+   }
+
+   NASSERT(!buffer.isBound());
+}
+
+void
+LocalAllocatorTest::benchmarkTeardown
+(FailVector *failures)
+{
+   const SIZE_T allocationCount = 100000;
+   LocalAllocator immediate(true), deferred(true), handedOff(true);
+   Allocation *allocations;
+   Allocator::ReleaseQueue queue;
+   std::thread releaser;
+   std::chrono::steady_clock::time_point start, finish;
+   long long immediateElapsed, deferredElapsed, reclaimElapsed, handOffElapsed;
+   SIZE_T reclaimed;
+
+   this->assertMessage(L"[*] Benchmarking allocation teardown.");
+
+   deferred.setDeferredFrees(true);
+   handedOff.setDeferredFrees(true);
+
+   /* every allocation dies at once, the way a scan's worth of objects does */
+   allocations = new Allocation[allocationCount];
+
+   for (SIZE_T i=0; i<allocationCount; ++i)
+      allocations[i] = immediate.allocate(0x10 + (i % 32) * 8);
+
+   start = std::chrono::steady_clock::now();
+   delete[] allocations;
+   finish = std::chrono::steady_clock::now();
+   immediateElapsed = std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count();
+
+   allocations = new Allocation[allocationCount];
+
+   for (SIZE_T i=0; i<allocationCount; ++i)
+      allocations[i] = deferred.allocate(0x10 + (i % 32) * 8);
+
+   start = std::chrono::steady_clock::now();
+   delete[] allocations;
+   finish = std::chrono::steady_clock::now();
+   deferredElapsed = std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count();
+
+   start = std::chrono::steady_clock::now();
+   reclaimed = deferred.reclaim();
+   finish = std::chrono::steady_clock::now();
+   reclaimElapsed = std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count();
+
+   NASSERT(reclaimed == allocationCount);
+
+   /* the same, but with the freeing itself moved off to another thread */
+   allocations = new Allocation[allocationCount];
+
+   for (SIZE_T i=0; i<allocationCount; ++i)
+      allocations[i] = handedOff.allocate(0x10 + (i % 32) * 8);
+
+   start = std::chrono::steady_clock::now();
+   delete[] allocations;
+   queue = handedOff.handOff();
+   finish = std::chrono::steady_clock::now();
+   handOffElapsed = std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count();
+
+   releaser = std::thread([&handedOff, &queue] () { handedOff.release(queue); });
+   releaser.join();
+
+   NASSERT(queue.size() == allocationCount);
+
+   this->assertMessage(L"[*] %I64d allocations: freed immediately in %I64d us, retired in %I64d us and reclaimed in %I64d us, handed off in %I64d us."
+                       ,static_cast<long long>(allocationCount)
+                       ,immediateElapsed
+                       ,deferredElapsed
+                       ,reclaimElapsed
+                       ,handOffElapsed);
+}
+
+void
+LocalAllocatorTest::benchmarkSlices
+(FailVector *failures)
+{
+   const SIZE_T sliceCount = 100000;
+   const SIZE_T parentSize = 0x1000;
+   LocalAllocator allocator;
+   Allocation parent;
+   Address base;
+   std::chrono::steady_clock::time_point start, finish;
+   long long elapsed;
+   SIZE_T mismatches = 0;
+
+   this->assertMessage(L"[*] Benchmarking slices.");
+
+   parent = allocator.allocate(parentSize);
+   base = parent.address();
+
+   /* the way dereferencing a pointer object slices its target out of a bigger
+      allocation, reads it and throws the slice away */
+   start = std::chrono::steady_clock::now();
+
+   for (SIZE_T i=0; i<sliceCount; ++i)
+   {
+      Allocation slice = parent.slice(base + (i % (parentSize/8)) * 8, 8);
+
+      if (slice.size() != 8)
+         ++mismatches;
+   }
+
+   finish = std::chrono::steady_clock::now();
+   elapsed = std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count();
+
+   if (elapsed == 0)
+      elapsed = 1;
+
+   this->assertMessage(L"[*] %I64d slices of %I64d-byte allocations: %I64d slices/sec."
+                       ,static_cast<long long>(sliceCount)
+                       ,static_cast<long long>(sizeof(Allocation))
+                       ,static_cast<long long>(sliceCount) * 1000000 / elapsed);
+
+   NASSERT(mismatches == 0);
+   NASSERT(!parent.hasChildren());
+}
+
+void
+LocalAllocatorTest::testHandles
+(FailVector *failures)
+{
+   LocalAllocator allocator;
+   Allocation allocation, child, moved;
+   Allocator::AllocationHandle handle, childHandle;
+
+   this->assertMessage(L"[*] Testing allocation handles.");
+
+   handle = allocation.handle();
+
+   NASSERT(handle.slot == AllocationTable::NoSlot);
+   NASSERT(!allocator.isLive(handle));
+
+   allocation = allocator.allocate(0x100);
+   child = allocation.slice(allocation.address(0x10), 0x20);
+   handle = allocation.handle();
+   childHandle = child.handle();
+
+   NASSERT(allocator.isLive(handle));
+   NASSERT(allocator.resolve(handle) == &allocation);
+   NASSERT(allocator.resolve(childHandle) == &child);
+   NASSERT(child.isChild(allocation));
+
+   /* moving hands the slot over, so handles and children follow along */
+   {
+      Allocation movedTo(std::move(allocation));
+
+      NASSERT(!allocation.isBound());
+      NASSERT(movedTo.isBound());
+      NASSERT(movedTo.size() == 0x100);
+      NASSERT(allocator.resolve(handle) == &movedTo);
+      NASSERT(child.isChild(movedTo));
+      NASSERT(&child.getParent() == &movedTo);
+      NASSERT(allocator.tryFind(RawAddress(movedTo.address(0x80).label()), 1) == &movedTo);
+
+      moved = std::move(movedTo);
+
+      NASSERT(!movedTo.isBound());
+      NASSERT(allocator.resolve(handle) == &moved);
+   }
+
+   NASSERT(moved.isBound());
+   NASSERT(&child.getParent() == &moved);
+
+   /* unbinding makes the handle stale, and stays that way after the slot
+      gets reused */
+   child.deallocate();
+
+   NASSERT(!allocator.isLive(childHandle));
+   NASSERT(!moved.hasChildren());
+
+   child = moved.slice(moved.address(0x40), 0x10);
+
+   NASSERT(child.handle().slot == childHandle.slot);
+   NASSERT(child.handle().generation != childHandle.generation);
+   NASSERT(allocator.resolve(childHandle) == NULL);
+   NASSERT(allocator.resolve(child.handle()) == &child);
+
+   moved.deallocate();
+
+   NASSERT(!child.isBound());
+   NASSERT(!allocator.isLive(handle));
+}
+
+void
+LocalAllocatorTest::benchmarkBindings
+(FailVector *failures)
+{
+   const SIZE_T allocationCount = 100000;
+   const SIZE_T checkCount = 1000000;
+   LocalAllocator allocator(true);
+   std::vector<Allocation> allocations(allocationCount);
+   std::vector<Allocation> slices(allocationCount);
+   std::chrono::steady_clock::time_point start, bound, checked, finish;
+   long long bindTime, checkTime, unbindTime;
+   SIZE_T hits = 0;
+
+   this->assertMessage(L"[*] Benchmarking allocation bookkeeping.");
+
+   start = std::chrono::steady_clock::now();
+
+   for (SIZE_T i=0; i<allocationCount; ++i)
+   {
+      allocations[i] = allocator.allocate(0x40);
+      slices[i] = allocations[i].slice(allocations[i].address(0x10), 0x10);
+   }
+
+   bound = std::chrono::steady_clock::now();
+
+   for (SIZE_T i=0; i<checkCount; ++i)
+      if (allocator.isBound(slices[(i * 7919) % allocationCount]))
+         ++hits;
+
+   checked = std::chrono::steady_clock::now();
+
+   for (SIZE_T i=0; i<allocationCount; ++i)
+      allocations[i].deallocate();
+
+   finish = std::chrono::steady_clock::now();
+
+   bindTime = std::chrono::duration_cast<std::chrono::microseconds>(bound - start).count();
+   checkTime = std::chrono::duration_cast<std::chrono::microseconds>(checked - bound).count();
+   unbindTime = std::chrono::duration_cast<std::chrono::microseconds>(finish - checked).count();
+
+   this->assertMessage(L"[*] %I64d allocations and slices: bound in %I64d us, unbound in %I64d us."
+                       ,static_cast<long long>(allocationCount)
+                       ,bindTime
+                       ,unbindTime);
+   this->assertMessage(L"[*] %I64d binding checks in %I64d us."
+                       ,static_cast<long long>(checkCount)
+                       ,checkTime);
+
+   NASSERT(hits == checkCount);
+   NASSERT(!slices[0].isBound());
+}
+
+void
+LocalAllocatorTest::testLookaside
+(FailVector *failures)
+{
+   LocalAllocator allocator, otherAllocator;
+   Allocation outer, inner, other, elsewhere;
+   Allocator::LookasideStatistics statistics;
+   Label base;
+
+   this->assertMessage(L"[*] Testing the lookaside cache.");
+
+   outer = allocator.allocate(0x100);
+   other = allocator.allocate(0x100);
+   base = outer.address().label();
+   allocator.resetLookasideStatistics();
+
+   /* the first lookup misses, the ones after it hit */
+   NASSERT(allocator.tryFind(RawAddress(base + 0x10), 4) == &outer);
+   NASSERT(allocator.tryFind(RawAddress(base + 0x20), 4) == &outer);
+   NASSERT(allocator.tryFind(RawAddress(base + 0xFC), 4) == &outer);
+   NASSERT(allocator.tryFind(RawAddress(base + 0xFE), 4) != &outer);
+
+   statistics = allocator.lookasideStatistics();
+
+#ifdef NEUROLOGY_INSTRUMENT
+   NASSERT(statistics.hits == 2);
+   NASSERT(statistics.misses == 2);
+#else
+   /* the counters are shared between threads, so they're only kept when instrumented */
+   NASSERT(statistics.hits == 0 && statistics.misses == 0);
+#endif
+
+   /* going back and forth between allocators keeps what was found in each */
+   elsewhere = otherAllocator.allocate(0x100);
+   otherAllocator.resetLookasideStatistics();
+   allocator.resetLookasideStatistics();
+
+   for (SIZE_T i=0; i<4; ++i)
+   {
+      NASSERT(allocator.tryFind(RawAddress(base + 0x10), 4) == &outer);
+      NASSERT(otherAllocator.tryFind(RawAddress(elsewhere.address().label() + 0x10), 4) == &elsewhere);
+   }
+
+#ifdef NEUROLOGY_INSTRUMENT
+   NASSERT(allocator.lookasideStatistics().hits == 4);
+   NASSERT(otherAllocator.lookasideStatistics().hits == 3);
+   NASSERT(otherAllocator.lookasideStatistics().misses == 1);
+#endif
+
+   /* slicing changes the index, so the smaller slice is found instead */
+   inner = outer.slice(outer.address(0x40), 0x20);
+
+   NASSERT(allocator.tryFind(RawAddress(base + 0x48), 4) == &inner);
+   NASSERT(allocator.tryFind(RawAddress(base + 0x48), 4) == &inner);
+   NASSERT(allocator.tryFind(RawAddress(base + 0x10), 4) == &outer);
+   NASSERT(allocator.tryFind(RawAddress(base + 0x10), 4) == &outer);
+   NASSERT(allocator.tryFind(RawAddress(base + 0x50), 4) == &inner);
+   NASSERT(allocator.tryFind(RawAddress(base + 0x3E), 4) == &outer);
+   NASSERT(allocator.tryFind(RawAddress(other.address().label()), 0) == &other);
+   NASSERT(allocator.tryFind(RawAddress(other.address().label()), 0) == &other);
+
+   /* and once it's gone, the outer allocation is found again */
+   inner.deallocate();
+
+   NASSERT(allocator.tryFind(RawAddress(base + 0x48), 4) == &outer);
+   NASSERT(allocator.tryFind(RawAddress(base + 0x48), 4) == &outer);
+
+   /* moving the allocation elsewhere doesn't leave the old range behind */
+   allocator.reallocate(outer, 0x10000);
+   base = outer.address().label();
+
+   NASSERT(allocator.tryFind(RawAddress(base + 0x8000), 4) == &outer);
+
+   outer.deallocate();
+
+   NASSERT(allocator.tryFind(RawAddress(base + 0x8000), 4) == NULL);
+
+#ifdef NEUROLOGY_INSTRUMENT
+   statistics = allocator.lookasideStatistics();
+
+   NASSERT(statistics.hits > 0);
+   NASSERT(statistics.misses > 0);
+#endif
+
+   allocator.resetLookasideStatistics();
+   statistics = allocator.lookasideStatistics();
+
+   NASSERT(statistics.hits == 0 && statistics.misses == 0);
+}
+
+void
+LocalAllocatorTest::testInstrumentation
+(FailVector *failures)
+{
+   LocalAllocator allocator;
+   AllocatorStatistics statistics;
+   AllocatorStatistics::Snapshot snapshot;
+   Allocation allocation;
+   DWORD value = 0x11223344;
+   Data data;
+
+   this->assertMessage(L"[*] Testing allocator instrumentation.");
+
+   /* the statistics themselves work whether or not allocators keep them */
+   statistics.record(AllocatorStatistics::Read, 0x10, 100);
+   statistics.record(AllocatorStatistics::Read, 0x10, 3000);
+   statistics.grow(0x100, 1);
+   statistics.grow(0x200, 1);
+   statistics.shrink(0x200, 1);
+   statistics.shrink(0x1000, 5);
+   snapshot = statistics.snapshot();
+
+   NASSERT(snapshot.calls[AllocatorStatistics::Read] == 2);
+   NASSERT(snapshot.bytes[AllocatorStatistics::Read] == 0x20);
+   NASSERT(snapshot.nanoseconds[AllocatorStatistics::Read] == 3100);
+   NASSERT(snapshot.latencies[AllocatorStatistics::Read][6] == 1);
+   NASSERT(snapshot.latencies[AllocatorStatistics::Read][11] == 1);
+   NASSERT(snapshot.percentile(AllocatorStatistics::Read, 0.5) == 128);
+   NASSERT(snapshot.percentile(AllocatorStatistics::Read, 1.0) == 4096);
+   NASSERT(snapshot.percentile(AllocatorStatistics::Write, 0.5) == 0);
+   NASSERT(snapshot.liveBytes == 0);
+   NASSERT(snapshot.liveAllocations == 0);
+   NASSERT(snapshot.peakBytes == 0x300);
+   NASSERT(snapshot.json().find("\"read\":{\"calls\":2,\"bytes\":32,\"nanoseconds\":3100") != std::string::npos);
+   NASSERT(snapshot.text().find("peak bytes: 768") != std::string::npos);
+
+   statistics.reset();
+   snapshot = statistics.snapshot();
+
+   NASSERT(snapshot.calls[AllocatorStatistics::Read] == 0);
+   NASSERT(snapshot.peakBytes == 0);
+
+   allocator.resetInstrumentation();
+   allocation = allocator.allocate(0x100);
+   allocator.write(allocation.address(), VarData(value));
+   data = allocator.read(allocation.address(), sizeof(DWORD));
+   snapshot = allocator.instrumentation();
+
+   NASSERT(data == VarData(value));
+
+#ifdef NEUROLOGY_INSTRUMENT
+   NASSERT(snapshot.calls[AllocatorStatistics::Allocate] == 1);
+   NASSERT(snapshot.bytes[AllocatorStatistics::Allocate] == 0x100);
+   NASSERT(snapshot.calls[AllocatorStatistics::Find] == 2);
+   NASSERT(snapshot.calls[AllocatorStatistics::Read] == 1);
+   NASSERT(snapshot.bytes[AllocatorStatistics::Read] == sizeof(DWORD));
+   NASSERT(snapshot.calls[AllocatorStatistics::Write] == 1);
+   NASSERT(snapshot.liveBytes == 0x100);
+   NASSERT(snapshot.liveAllocations == 1);
+
+   allocation.deallocate();
+   snapshot = allocator.instrumentation();
+
+   NASSERT(snapshot.calls[AllocatorStatistics::Deallocate] == 1);
+   NASSERT(snapshot.liveBytes == 0);
+   NASSERT(snapshot.liveAllocations == 0);
+   NASSERT(snapshot.peakBytes == 0x100);
+#else
+   /* compiled out, nothing gets recorded */
+   NASSERT(snapshot.calls[AllocatorStatistics::Allocate] == 0);
+   NASSERT(snapshot.calls[AllocatorStatistics::Read] == 0);
+   NASSERT(snapshot.liveBytes == 0);
+#endif
+}
+
+void
+LocalAllocatorTest::testFaults
+(FailVector *failures)
+{
+   const SIZE_T pageSize = 0x1000;
+   LocalAllocator allocator;
+   Allocation pages;
+   LPBYTE base;
+   Data source(pageSize * 2), destination(pageSize * 2), overlap, large, largeCopy;
+   Data readBack;
+   SIZE_T copied;
+   LONG status;
+
+   this->assertMessage(L"[*] Testing fault-tolerant copies.");
+
+   for (SIZE_T i=0; i<source.size(); ++i)
+      source[i] = static_cast<BYTE>(i * 7 + 1);
+
+   /* odd sizes and alignments take the head and tail paths of the vector copy */
+   for (SIZE_T size=0; size<300; size+=13)
+   {
+      std::fill(destination.begin(), destination.end(), 0);
+      status = CopyData(destination.data()+3, source.data()+5, size, &copied);
+
+      NASSERT(status == 0);
+      NASSERT(copied == size);
+      NASSERT(std::equal(source.begin()+5, source.begin()+5+size, destination.begin()+3));
+      NASSERT(destination[2] == 0 && destination[3+size] == 0);
+   }
+
+   /* overlapping ranges move correctly in both directions */
+   overlap = source;
+   status = CopyData(overlap.data()+0x11, overlap.data(), pageSize, &copied);
+
+   NASSERT(status == 0 && copied == pageSize);
+   NASSERT(std::equal(source.begin(), source.begin()+pageSize, overlap.begin()+0x11));
+
+   overlap = source;
+   status = CopyData(overlap.data(), overlap.data()+0x11, pageSize, &copied);
+
+   NASSERT(status == 0 && copied == pageSize);
+   NASSERT(std::equal(source.begin()+0x11, source.begin()+0x11+pageSize, overlap.begin()));
+
+   /* a big copy to a misaligned destination */
+   large.resize(0x1000123);
+   largeCopy.resize(large.size() + 1);
+
+   for (SIZE_T i=0; i<large.size(); ++i)
+      large[i] = static_cast<BYTE>(i ^ (i >> 8));
+
+   status = CopyData(largeCopy.data()+1, large.data(), large.size(), &copied);
+
+   NASSERT(status == 0 && copied == large.size());
+   NASSERT(std::equal(large.begin(), large.end(), largeCopy.begin()+1));
+
+   /* paged blocks come straight from the OS, so their second page can be taken away */
+   pages = allocator.allocate(LocalAllocator::PagedBlockSize);
+   base = static_cast<LPBYTE>(pages.address().pointer());
+   allocator.write(pages.address(), source);
+
+   NEXCEPT(VirtualMemory::Protect(NULL, base+pageSize, pageSize, PAGE_NOACCESS), false);
+
+   /* copies stop exactly at the page boundary, whichever side faults */
+   std::fill(destination.begin(), destination.end(), 0);
+   status = CopyData(destination.data(), base+pageSize-0x35, 0x100, &copied);
+
+   NASSERT(status != 0);
+   NASSERT(copied == 0x35);
+   NASSERT(std::equal(source.begin()+pageSize-0x35, source.begin()+pageSize, destination.begin()));
+
+   status = CopyData(base+pageSize-0x21, source.data(), 0x80, &copied);
+
+   NASSERT(status != 0);
+   NASSERT(copied == 0x21);
+   NASSERT(std::equal(source.begin(), source.begin()+0x21, base+pageSize-0x21));
+
+   /* an overlapping copy may have clobbered its own source, so it claims nothing */
+   status = CopyData(base+pageSize-0x40, base+pageSize-0x80, 0x80, &copied);
+
+   NASSERT(status != 0);
+   NASSERT(copied == 0);
+
+   /* a read running into the page comes back short, one starting in it throws */
+   readBack = pages.read(pageSize-0x40, 0x100);
+
+   NASSERT(readBack.size() == 0x40);
+   NASSERT(std::equal(readBack.begin(), readBack.end(), base+pageSize-0x40));
+   NEXCEPT(pages.read(pageSize, 4), true);
+
+   /* buffers of a fixed size still have to be filled completely */
+   NEXCEPT(pages.readInto(pageSize-4, destination.data(), 8), true);
+
+   NEXCEPT(VirtualMemory::Protect(NULL, base+pageSize, pageSize, PAGE_READWRITE), false);
+
+   readBack = pages.read(pageSize-0x40, 0x100);
+
+   NASSERT(readBack.size() == 0x100);
+
+   pages.deallocate();
+}
+
+void
+LocalAllocatorTest::benchmarkLookaside
+(FailVector *failures)
+{
+   const SIZE_T allocationCount = 10000;
+   const SIZE_T readCount = 2000000;
+   LocalAllocator allocator;
+   std::vector<Allocation> allocations(allocationCount);
+   std::vector<Label> targets(allocationCount);
+   std::chrono::steady_clock::time_point start, finish;
+   Allocator::LookasideStatistics statistics;
+   long long elapsed;
+   Data value;
+   SIZE_T misses = 0;
+
+   this->assertMessage(L"[*] Benchmarking the lookaside cache.");
+
+   for (SIZE_T i=0; i<allocationCount; ++i)
+   {
+      allocations[i] = allocator.allocate(0x100);
+      targets[i] = allocations[i].address().label();
+   }
+
+   allocator.resetLookasideStatistics();
+
+   /* a handful of objects read field by field, the way a scanner polls
+      structures */
+   start = std::chrono::steady_clock::now();
+
+   for (SIZE_T i=0; i<readCount; ++i)
+   {
+      Label target = targets[((i / 64) * 7919) % allocationCount] + ((i * 4) % 0x100);
+
+      if (!allocator.tryRead(RawAddress(target), sizeof(DWORD), &value))
+         ++misses;
+   }
+
+   finish = std::chrono::steady_clock::now();
+   elapsed = std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count();
+   statistics = allocator.lookasideStatistics();
+
+   if (elapsed == 0)
+      elapsed = 1;
+
+   this->assertMessage(L"[*] %I64d local reads: %I64d reads/sec, %I64d lookaside hits, %I64d misses."
+                       ,static_cast<long long>(readCount)
+                       ,static_cast<long long>(readCount) * 1000000 / elapsed
+                       ,static_cast<long long>(statistics.hits)
+                       ,static_cast<long long>(statistics.misses));
+
+   NASSERT(misses == 0);
+
+#ifdef NEUROLOGY_INSTRUMENT
+   NASSERT(statistics.hits + statistics.misses == readCount);
+   NASSERT(statistics.hits > statistics.misses);
+#endif
+}
+
+void
+LocalAllocatorTest::benchmarkCopies
+(FailVector *failures)
+{
+   const SIZE_T sizes[] = { 0x40, 0x1000, 0x10000, 0x1000000 };
+   const SIZE_T totalBytes = 0x10000000;
+   Data source(0x1000040), destination(0x1000040);
+   std::chrono::steady_clock::time_point start, finish;
+   long long guarded, plain;
+   SIZE_T copied = 0, rounds;
+
+   this->assertMessage(L"[*] Benchmarking fault-tolerant copies.");
+
+   for (SIZE_T i=0; i<source.size(); ++i)
+      source[i] = static_cast<BYTE>(i);
+
+   for (SIZE_T size=0; size<sizeof(sizes)/sizeof(sizes[0]); ++size)
+   {
+      rounds = totalBytes / sizes[size];
+
+      /* a misaligned destination, the way reads into arbitrary buffers land */
+      start = std::chrono::steady_clock::now();
+
+      for (SIZE_T round=0; round<rounds; ++round)
+         CopyData(destination.data()+1, source.data(), sizes[size], &copied);
+
+      finish = std::chrono::steady_clock::now();
+      guarded = std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count();
+
+      start = std::chrono::steady_clock::now();
+
+      for (SIZE_T round=0; round<rounds; ++round)
+         MoveMemory(destination.data()+1, source.data(), sizes[size]);
+
+      finish = std::chrono::steady_clock::now();
+      plain = std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count();
+
+      if (guarded == 0)
+         guarded = 1;
+
+      if (plain == 0)
+         plain = 1;
+
+      this->assertMessage(L"[*] %I64d byte copies: %I64d MB/sec guarded, %I64d MB/sec unguarded."
+                          ,static_cast<long long>(sizes[size])
+                          ,static_cast<long long>(totalBytes >> 20) * 1000000 / guarded
+                          ,static_cast<long long>(totalBytes >> 20) * 1000000 / plain);
+   }
+
+   NASSERT(copied == sizes[sizeof(sizes)/sizeof(sizes[0])-1]);
+   NASSERT(std::equal(source.begin(), source.begin()+copied, destination.begin()+1));
+}
@@ -18,5 +18,21 @@ namespace NeurologyTest
       virtual void run(FailVector *failures);
       void testAllocator(FailVector *failures);
       void testAllocation(FailVector *failures);
+      void testBatches(FailVector *failures);
+      void testSlabs(FailVector *failures);
+      void testZeroing(FailVector *failures);
+      void testDeferredFrees(FailVector *failures);
+      void testHandles(FailVector *failures);
+      void testLookaside(FailVector *failures);
+      void testInstrumentation(FailVector *failures);
+      void testFaults(FailVector *failures);
+      void benchmarkMisses(FailVector *failures);
+      void benchmarkSlabs(FailVector *failures);
+      void benchmarkZeroing(FailVector *failures);
+      void benchmarkTeardown(FailVector *failures);
+      void benchmarkSlices(FailVector *failures);
+      void benchmarkBindings(FailVector *failures);
+      void benchmarkLookaside(FailVector *failures);
+      void benchmarkCopies(FailVector *failures);
    };
 }
@@ -1,5 +1,14 @@
 #include "virtualalloc.hpp"
 
+#include <algorithm>
+
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
 using namespace Neurology;
 using namespace NeurologyTest;
 
@@ -17,12 +26,16 @@ VirtualAllocatorTest::run
 {
    this->testAllocator(failures);
    this->testPage(failures);
+   this->testEnumerate(failures);
+   this->testRemote(failures);
+   this->testMirror(failures);
 }
 
 void
 VirtualAllocatorTest::testAllocator
 (FailVector *failures)
 {
+#ifdef _WIN32
    VirtualAllocator allocator;
    Process process;
    Page page;
@@ -51,11 +64,290 @@ VirtualAllocatorTest::testAllocator
    process.kill(0);
 
    this->assertMessage(L"[*] Finished VirtualAllocator tests.");
+#endif
 }
 
 void
 VirtualAllocatorTest::testPage
 (FailVector *failures)
 {
-   return;
+   VirtualAllocator allocator;
+   Address base;
+   SIZE_T pageSize = VirtualMemory::PageSize();
+
+   NEXCEPT(base = allocator.allocate(pageSize*4, MEM_RESERVE, PAGE_READWRITE).address(), false);
+   NASSERT(allocator.pageOf(base).state().reserve);
+   NASSERT(allocator.pageOf(base).allocationProtect().readWrite);
+   NASSERT(allocator.pageOf(base).allocationBase() == base);
+
+   /* reserved memory can't be protected until it's committed */
+   NEXCEPT(allocator.protect(allocator.pageOf(base), PAGE_READONLY), true);
+
+   NEXCEPT(allocator.allocate(base, pageSize*4, MEM_COMMIT, PAGE_READWRITE), false);
+   NASSERT(allocator.pageOf(base).state().commit);
+   NASSERT(allocator.pageOf(base).protection().readWrite);
+   NASSERT(allocator.pageOf(base).size() == pageSize*4);
+
+   *reinterpret_cast<LPDWORD>(base.pointer()) = 0xDEADBEEF;
+
+   NEXCEPT(allocator.protect(allocator.pageOf(base), PAGE_READONLY), false);
+   NASSERT(allocator.pageOf(base).protection().readOnly);
+   NASSERT(*reinterpret_cast<LPDWORD>(base.pointer()) == 0xDEADBEEF);
+
+   NEXCEPT(allocator.pageOf(base).decommit(), false);
+   NASSERT(allocator.pageOf(base).state().reserve);
+
+   /* committing it again brings it back zeroed */
+   NEXCEPT(allocator.allocate(base, pageSize*4, MEM_COMMIT, PAGE_READWRITE), false);
+   NASSERT(*reinterpret_cast<LPDWORD>(base.pointer()) == 0);
+
+   NEXCEPT(allocator.pageOf(base).release(), false);
+
+   this->assertMessage(L"[*] Finished Page tests.");
+}
+
+void
+VirtualAllocatorTest::testEnumerate
+(FailVector *failures)
+{
+   VirtualAllocator allocator;
+   LPVOID foreign;
+   SIZE_T changes = 0;
+   SIZE_T pageSize = VirtualMemory::PageSize();
+
+   NEXCEPT(changes = allocator.enumerate(), false);
+   NASSERT(changes > 0);
+
+   /* memory allocated behind the allocator's back shows up on the next pass */
+   foreign = VirtualMemory::Allocate(NULL, NULL, pageSize*4, MEM_RESERVE, PAGE_READWRITE);
+
+   NEXCEPT(changes = allocator.enumerate(), false);
+   NASSERT(changes > 0);
+   NASSERT(allocator.pageOf(foreign).address() == foreign);
+   NASSERT(allocator.pageOf(foreign).state().reserve);
+
+   /* and once it's gone, so is its page */
+   VirtualMemory::Free(NULL, foreign, 0, MEM_RELEASE);
+
+   NEXCEPT(changes = allocator.enumerate(), false);
+   NASSERT(changes > 0);
+   NASSERT(!allocator.pageOf(foreign).state().reserve);
+
+#ifndef _WIN32
+   /* memory mapped and unmapped around VirtualMemory shows up in the very next query */
+   {
+      MEMORY_BASIC_INFORMATION info;
+
+      NASSERT(VirtualMemory::Query(NULL, foreign, &info, sizeof(info)) == sizeof(info));
+
+      foreign = mmap(NULL, pageSize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      NASSERT(foreign != MAP_FAILED);
+
+      NASSERT(VirtualMemory::Query(NULL, foreign, &info, sizeof(info)) == sizeof(info));
+      NASSERT(info.State == MEM_COMMIT && info.Protect == PAGE_READONLY);
+
+      munmap(foreign, pageSize);
+
+      NASSERT(VirtualMemory::Query(NULL, foreign, &info, sizeof(info)) == sizeof(info));
+      NASSERT(info.State == MEM_FREE);
+   }
+#endif
+
+   this->assertMessage(L"[*] Finished enumeration tests.");
+}
+
+void
+VirtualAllocatorTest::testRemote
+(FailVector *failures)
+{
+#ifndef _WIN32
+   VirtualAllocator allocator;
+   SIZE_T pageSize = VirtualMemory::PageSize();
+   LPBYTE block;
+   pid_t child;
+   Data data;
+   Allocator::Batch batch;
+   Allocator::BatchEntry entry;
+   std::vector<DWORD> values;
+   DWORD value, readBack = 0;
+   SIZE_T offset;
+
+   /* the child gets its own copy of the block, with a hole where the middle page was decommitted */
+   block = static_cast<LPBYTE>(VirtualMemory::Allocate(NULL, NULL, pageSize*3, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+
+   for (SIZE_T i=0; i<pageSize*3; ++i)
+      block[i] = static_cast<BYTE>(i * 7 + 1);
+
+   VirtualMemory::Free(NULL, block+pageSize, pageSize, MEM_DECOMMIT);
+
+   child = fork();
+
+   if (child == 0)
+   {
+      for (;;)
+         pause();
+   }
+
+   NEXCEPT(allocator.setProcessID(child), false);
+   NASSERT(!allocator.isLocal());
+   NEXCEPT(allocator.allocate(pageSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE), true);
+
+   NEXCEPT(data = allocator.read(RawAddress(block+0x10), 0x100), false);
+   NASSERT(data.size() == 0x100);
+   NASSERT(std::equal(data.begin(), data.end(), block+0x10));
+
+   /* the hole is a region of its own, so the allocator won't read into it. underneath, a transfer
+      running into it comes back short, and one starting in it reads nothing */
+   NEXCEPT(allocator.read(RawAddress(block+pageSize-0x40), 0x100), true);
+   NEXCEPT(allocator.read(RawAddress(block+pageSize), 4), true);
+
+   {
+      ProcessMemory memory(static_cast<DWORD>(child));
+
+      data.resize(0x100);
+      NASSERT(memory.read(block+pageSize-0x40, data.data(), data.size()) == 0x40);
+      NASSERT(std::equal(data.begin(), data.begin()+0x40, block+pageSize-0x40));
+      NASSERT(memory.read(block+pageSize, data.data(), 4) == 0);
+   }
+
+   /* more entries than fit in one call, none of them touching so they don't get coalesced */
+   for (offset=0; offset+sizeof(DWORD)<=pageSize; offset+=6)
+   {
+      entry.address = RawAddress(block+offset);
+      entry.size = sizeof(DWORD);
+      batch.push_back(entry);
+
+      entry.address = RawAddress(block+pageSize*2+offset);
+      batch.push_back(entry);
+   }
+
+   values.resize(batch.size());
+
+   for (SIZE_T i=0; i<batch.size(); ++i)
+      batch[i].buffer = &values[i];
+
+   NEXCEPT(allocator.readv(batch), false);
+
+   for (SIZE_T i=0; i<batch.size(); ++i)
+      NASSERT(values[i] == *reinterpret_cast<LPDWORD>(batch[i].address.pointer()));
+
+   /* an entry in the hole fails the batch, but everything else still gets read */
+   std::fill(values.begin(), values.end(), 0);
+   batch.back().address = RawAddress(block+pageSize+0x10);
+
+   NEXCEPT(allocator.readv(batch), true);
+   NASSERT(values.front() == *reinterpret_cast<LPDWORD>(block));
+   NASSERT(values[values.size()-2] == *reinterpret_cast<LPDWORD>(batch[values.size()-2].address.pointer()));
+
+   /* writes land in the child's copy and nowhere else */
+   value = 0xDEADBEEF;
+
+   NEXCEPT(allocator.writeFrom(RawAddress(block+pageSize*2), &value, sizeof(value)), false);
+   NEXCEPT(allocator.readInto(RawAddress(block+pageSize*2), &readBack, sizeof(readBack)), false);
+   NASSERT(readBack == 0xDEADBEEF);
+   NASSERT(*reinterpret_cast<LPDWORD>(block+pageSize*2) != 0xDEADBEEF);
+
+   kill(child, SIGKILL);
+   waitpid(child, NULL, 0);
+
+   VirtualMemory::Free(NULL, block, 0, MEM_RELEASE);
+
+   this->assertMessage(L"[*] Finished remote VirtualAllocator tests.");
+#endif
+}
+
+void
+VirtualAllocatorTest::testMirror
+(FailVector *failures)
+{
+#ifndef _WIN32
+   VirtualAllocator local, mirrored, direct;
+   SIZE_T pageSize = VirtualMemory::PageSize();
+   LPBYTE block;
+   pid_t child;
+   Data data;
+   DWORD value, readBack = 0;
+
+   NEXCEPT(local.enableMirror(4, PageMirror::Clock::duration::zero()), true);
+   NASSERT(!local.isMirrored());
+
+   block = static_cast<LPBYTE>(VirtualMemory::Allocate(NULL, NULL, pageSize*3, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+
+   for (SIZE_T i=0; i<pageSize*3; ++i)
+      block[i] = static_cast<BYTE>(i * 7 + 1);
+
+   VirtualMemory::Free(NULL, block+pageSize, pageSize, MEM_DECOMMIT);
+
+   child = fork();
+
+   if (child == 0)
+   {
+      for (;;)
+         pause();
+   }
+
+   /* the direct allocator sees the child as it is, the mirrored one sees its copies */
+   NEXCEPT(mirrored.setProcessID(child), false);
+   NEXCEPT(direct.setProcessID(child), false);
+   NEXCEPT(mirrored.enableMirror(4, PageMirror::Clock::duration::zero()), false);
+   NASSERT(mirrored.isMirrored());
+
+   NEXCEPT(data = mirrored.read(RawAddress(block+0x10), 0x100), false);
+   NASSERT(data.size() == 0x100);
+   NASSERT(std::equal(data.begin(), data.end(), block+0x10));
+
+   /* the hole can't be mirrored any more than it can be read, and it's still a region of its own */
+   NEXCEPT(mirrored.read(RawAddress(block+pageSize-0x40), 0x100), true);
+   NEXCEPT(mirrored.read(RawAddress(block+pageSize), 4), true);
+
+   /* changes in the child only show up once the mirrored page is invalidated */
+   value = 0xFACEBABE;
+
+   NEXCEPT(direct.writeFrom(RawAddress(block+0x20), &value, sizeof(value)), false);
+   NEXCEPT(mirrored.readInto(RawAddress(block+0x20), &readBack, sizeof(readBack)), false);
+   NASSERT(readBack == *reinterpret_cast<LPDWORD>(block+0x20));
+
+   NEXCEPT(mirrored.invalidate(RawAddress(block+0x20), sizeof(value)), false);
+   NEXCEPT(mirrored.readInto(RawAddress(block+0x20), &readBack, sizeof(readBack)), false);
+   NASSERT(readBack == 0xFACEBABE);
+
+   /* and writes only reach the child once they're synced */
+   value = 0xDEADBEEF;
+
+   NEXCEPT(mirrored.writeFrom(RawAddress(block+pageSize*2+0x30), &value, sizeof(value)), false);
+   NEXCEPT(mirrored.readInto(RawAddress(block+pageSize*2+0x30), &readBack, sizeof(readBack)), false);
+   NASSERT(readBack == 0xDEADBEEF);
+   NEXCEPT(direct.readInto(RawAddress(block+pageSize*2+0x30), &readBack, sizeof(readBack)), false);
+   NASSERT(readBack == *reinterpret_cast<LPDWORD>(block+pageSize*2+0x30));
+
+   NEXCEPT(mirrored.sync(), false);
+   NEXCEPT(direct.readInto(RawAddress(block+pageSize*2+0x30), &readBack, sizeof(readBack)), false);
+   NASSERT(readBack == 0xDEADBEEF);
+
+   /* a write which matches the mirrored copy still has to reach the child, which may have moved on */
+   value = 0x12345678;
+   NEXCEPT(direct.writeFrom(RawAddress(block+pageSize*2+0x30), &value, sizeof(value)), false);
+
+   value = 0xDEADBEEF;
+   NEXCEPT(mirrored.writeFrom(RawAddress(block+pageSize*2+0x30), &value, sizeof(value)), false);
+   NEXCEPT(mirrored.sync(), false);
+   NEXCEPT(direct.readInto(RawAddress(block+pageSize*2+0x30), &readBack, sizeof(readBack)), false);
+   NASSERT(readBack == 0xDEADBEEF);
+
+   /* turning the mirror off writes back whatever it still holds */
+   value = 0x0DDBA11;
+
+   NEXCEPT(mirrored.writeFrom(RawAddress(block+0x40), &value, sizeof(value)), false);
+   NEXCEPT(mirrored.disableMirror(), false);
+   NASSERT(!mirrored.isMirrored());
+   NEXCEPT(direct.readInto(RawAddress(block+0x40), &readBack, sizeof(readBack)), false);
+   NASSERT(readBack == 0x0DDBA11);
+
+   kill(child, SIGKILL);
+   waitpid(child, NULL, 0);
+
+   VirtualMemory::Free(NULL, block, 0, MEM_RELEASE);
+
+   this->assertMessage(L"[*] Finished mirrored VirtualAllocator tests.");
+#endif
 }
@@ -1,8 +1,11 @@
 #pragma once
 
-#include <neurology/win32/process.hpp>
 #include <neurology/allocators/virtual.hpp>
 
+#ifdef _WIN32
+#include <neurology/win32/process.hpp>
+#endif
+
 #include "../test.hpp"
 
 namespace NeurologyTest
@@ -19,5 +22,8 @@ namespace NeurologyTest
       virtual void run(FailVector *failures);
       void testAllocator(FailVector *failures);
       void testPage(FailVector *failures);
+      void testEnumerate(FailVector *failures);
+      void testRemote(FailVector *failures);
+      void testMirror(FailVector *failures);
    };
 }